@@ -238,7 +238,16 @@ HEADERS += src/qt/bitcoingui.h \
     src/sync.h \
     src/util.h \
     src/uint256.h \
+    src/arith_uint256.h \
+    src/scheduler.h \
     src/kernel.h \
+    src/indexedbatch.h \
+    src/blockwriter.h \
+    src/publisher.h \
+    src/memusage.h \
+    src/blockstats.h \
+    src/bootstrap.h \
+    src/blockfilter.h \
     src/scrypt.h \
     src/pbkdf2.h \
     src/serialize.h \
@@ -313,6 +322,7 @@ HEADERS += src/qt/bitcoingui.h \
     src/netbase.h \
     src/clientversion.h \
 	src/hash.h \
+	src/hashmap.h \
     src/hashblock.h \
 	src/sph_echo.h \
 	src/sph_keccak.h \
@@ -353,6 +363,8 @@ SOURCES += src/qt/bitcoin.cpp src/qt/bitcoingui.cpp \
     src/qt/proofofimage.cpp \
     src/qt/termsofuse.cpp \
     src/alert.cpp \
+    src/arith_uint256.cpp \
+    src/scheduler.cpp \
 	src/base58.cpp \
     src/version.cpp \
     src/sync.cpp \
@@ -419,6 +431,12 @@ SOURCES += src/qt/bitcoin.cpp src/qt/bitcoingui.cpp \
     src/qt/adrenalinenodeconfigdialog.cpp \
     src/noui.cpp \
     src/kernel.cpp \
+    src/blockwriter.cpp \
+    src/publisher.cpp \
+    src/memusage.cpp \
+    src/blockstats.cpp \
+    src/bootstrap.cpp \
+    src/blockfilter.cpp \
     src/scrypt-arm.S \
     src/scrypt-x86.S \
     src/scrypt-x86_64.S \
@@ -0,0 +1,565 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The AveroPay developers
+# Distributed under the MIT/X11 software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""
+Runs a small AveroPay network on the local machine and reports how events
+propagate through it.
+
+Each node is a separate AveroPayd process with its own data directory on a
+private -regtest network. Nodes never connect to each other directly: every
+link goes through a relay in this script that delays traffic and limits its
+bandwidth, so the topology, latency and bandwidth of each link are set here.
+Links can be cut and restored to partition the network.
+
+Propagation is timed from the -pubnotify event stream of every node, message
+traffic per type is read from getpeerinfo and CPU time from /proc.
+
+    netsim.py --daemon ../../src/AveroPayd --nodes 8 --scenario txflood
+"""
+
+import argparse
+import base64
+import collections
+import json
+import os
+import random
+import shutil
+import socket
+import struct
+import subprocess
+import tempfile
+import threading
+import time
+import urllib.request
+
+BASE_P2P_PORT = 30000
+BASE_RPC_PORT = 31000
+BASE_PUB_PORT = 32000
+BASE_LINK_PORT = 33000
+
+RPC_METHOD_NOT_FOUND = -32601
+
+
+class RPCError(Exception):
+    def __init__(self, error):
+        Exception.__init__(self, error.get("message"))
+        self.code = error.get("code")
+
+
+class RPCClient(object):
+    def __init__(self, port, user, password):
+        self.url = "http://127.0.0.1:%d/" % port
+        self.auth = base64.b64encode(("%s:%s" % (user, password)).encode()).decode()
+
+    def call(self, method, *params):
+        body = json.dumps({"method": method, "params": list(params), "id": 1}).encode()
+        req = urllib.request.Request(self.url, body, {"Authorization": "Basic " + self.auth,
+                                                      "Content-Type": "application/json"})
+        try:
+            resp = urllib.request.urlopen(req, timeout=60).read()
+        except urllib.error.HTTPError as e:
+            # errors come back as HTTP 500 with a JSON body
+            resp = e.read()
+        reply = json.loads(resp.decode())
+        if reply.get("error"):
+            raise RPCError(reply["error"])
+        return reply["result"]
+
+    def __getattr__(self, method):
+        return lambda *params: self.call(method, *params)
+
+
+class Link(object):
+    """A one-way-delayed, bandwidth limited TCP relay between two nodes.
+
+    The dialling node connects to the relay, which connects on to the
+    listening node. Both directions get the same latency and bandwidth.
+    """
+
+    def __init__(self, port, target_port, latency_ms, bandwidth_kbps):
+        self.port = port
+        self.target_port = target_port
+        self.latency = latency_ms / 1000.0
+        self.rate = bandwidth_kbps * 1024 / 8.0 if bandwidth_kbps else 0
+        self.up = True
+        self.sockets = []
+        self.lock = threading.Lock()
+        self.listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.listener.bind(("127.0.0.1", port))
+        self.listener.listen(8)
+        threading.Thread(target=self.accept_loop, daemon=True).start()
+
+    def accept_loop(self):
+        while True:
+            try:
+                client, _ = self.listener.accept()
+            except OSError:
+                return
+            if not self.up:
+                client.close()
+                continue
+            try:
+                server = socket.create_connection(("127.0.0.1", self.target_port))
+            except OSError:
+                client.close()
+                continue
+            with self.lock:
+                self.sockets += [client, server]
+            for src, dst in ((client, server), (server, client)):
+                queue = collections.deque()
+                cond = threading.Condition()
+                threading.Thread(target=self.read_loop, args=(src, queue, cond), daemon=True).start()
+                threading.Thread(target=self.write_loop, args=(dst, queue, cond), daemon=True).start()
+
+    def read_loop(self, src, queue, cond):
+        while True:
+            try:
+                data = src.recv(65536)
+            except OSError:
+                data = b""
+            with cond:
+                queue.append((time.time() + self.latency, data))
+                cond.notify()
+            if not data:
+                return
+
+    def write_loop(self, dst, queue, cond):
+        # token bucket holding at most a quarter second of traffic
+        tokens = 0.0
+        last = time.time()
+        while True:
+            with cond:
+                while not queue:
+                    cond.wait()
+                due, data = queue.popleft()
+            delay = due - time.time()
+            if delay > 0:
+                time.sleep(delay)
+            if not data:
+                self.close_socket(dst)
+                return
+            if self.rate:
+                now = time.time()
+                tokens = min(tokens + (now - last) * self.rate, self.rate / 4.0)
+                last = now
+                if tokens < len(data):
+                    time.sleep((len(data) - tokens) / self.rate)
+                    last = time.time()
+                    tokens = 0.0
+                else:
+                    tokens -= len(data)
+            try:
+                dst.sendall(data)
+            except OSError:
+                return
+
+    def close_socket(self, s):
+        try:
+            s.shutdown(socket.SHUT_RDWR)
+        except OSError:
+            pass
+        s.close()
+
+    def cut(self):
+        self.up = False
+        with self.lock:
+            for s in self.sockets:
+                self.close_socket(s)
+            self.sockets = []
+
+    def restore(self):
+        self.up = True
+
+
+class Node(object):
+    def __init__(self, sim, index):
+        self.sim = sim
+        self.index = index
+        self.datadir = os.path.join(sim.workdir, "node%d" % index)
+        self.p2p_port = BASE_P2P_PORT + index
+        self.rpc_port = BASE_RPC_PORT + index
+        self.pub_port = BASE_PUB_PORT + index
+        self.rpc = RPCClient(self.rpc_port, "netsim", "netsim")
+        self.connect_ports = []
+        self.process = None
+        self.events = collections.defaultdict(dict)
+        self.sequence_gaps = 0
+
+    def start(self):
+        os.makedirs(self.datadir, exist_ok=True)
+        args = [self.sim.args.daemon,
+                "-datadir=" + self.datadir,
+                "-regtest",
+                "-server",
+                "-listen",
+                "-discover=0",
+                "-dnsseed=0",
+                "-port=%d" % self.p2p_port,
+                "-rpcport=%d" % self.rpc_port,
+                "-rpcuser=netsim",
+                "-rpcpassword=netsim",
+                "-pubnotify=%d" % self.pub_port,
+                "-printtoconsole=0"]
+        # connect only through the relays, so addr gossip can't bypass them
+        args += ["-connect=127.0.0.1:%d" % p for p in self.connect_ports]
+        args += self.sim.args.extra_arg or []
+        self.process = subprocess.Popen(args, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        self.wait_for_rpc()
+        threading.Thread(target=self.subscribe, daemon=True).start()
+
+    def wait_for_rpc(self):
+        deadline = time.time() + 120
+        while time.time() < deadline:
+            try:
+                self.rpc.getblockcount()
+                return
+            except (OSError, RPCError, ValueError):
+                time.sleep(0.25)
+        raise RuntimeError("node%d did not come up" % self.index)
+
+    def stop(self):
+        if self.process is None:
+            return
+        try:
+            self.rpc.stop()
+        except (OSError, RPCError, ValueError):
+            pass
+        try:
+            self.process.wait(60)
+        except subprocess.TimeoutExpired:
+            self.process.kill()
+        self.process = None
+
+    def subscribe(self):
+        """Record the arrival time of every event published by the node"""
+        process = self.process
+        while process is self.process and process.poll() is None:
+            try:
+                s = socket.create_connection(("127.0.0.1", self.pub_port))
+            except OSError:
+                time.sleep(0.25)
+                continue
+            last_sequence = {}
+            f = s.makefile("rb")
+            try:
+                while True:
+                    topic = f.read(ord(f.read(1))).decode()
+                    body = f.read(struct.unpack("<I", f.read(4))[0])
+                    sequence = struct.unpack("<I", f.read(4))[0]
+                    now = time.time()
+                    if topic in last_sequence and sequence != last_sequence[topic] + 1:
+                        self.sequence_gaps += 1
+                    last_sequence[topic] = sequence
+                    if topic in ("hashblock", "hashtx", "smsginbox"):
+                        key = body.hex() if topic != "smsginbox" else "%d" % sequence
+                        self.events[topic].setdefault(key, now)
+            except (OSError, TypeError, struct.error):
+                pass
+            finally:
+                s.close()
+
+    def cpu_seconds(self):
+        if self.process is None:
+            return 0.0
+        try:
+            with open("/proc/%d/stat" % self.process.pid) as f:
+                fields = f.read().rsplit(")", 1)[1].split()
+        except OSError:
+            return 0.0
+        # utime and stime, fields 14 and 15 of stat
+        return (int(fields[11]) + int(fields[12])) / float(os.sysconf("SC_CLK_TCK"))
+
+
+class Simulation(object):
+    def __init__(self, args):
+        self.args = args
+        self.workdir = args.workdir or tempfile.mkdtemp(prefix="netsim")
+        self.nodes = [Node(self, i) for i in range(args.nodes)]
+        self.links = {}
+        self.mocktime = 0
+        self.build_topology()
+
+    def build_topology(self):
+        rng = random.Random(self.args.seed)
+        port = BASE_LINK_PORT
+        n = len(self.nodes)
+        for i in range(n):
+            peers = set([(i + 1) % n]) if n > 1 else set()
+            while len(peers) < min(self.args.degree, n - 1):
+                j = rng.randrange(n)
+                if j != i:
+                    peers.add(j)
+            for j in peers:
+                if (i, j) in self.links or (j, i) in self.links:
+                    continue
+                latency = rng.uniform(self.args.min_latency, self.args.max_latency)
+                self.links[(i, j)] = Link(port, self.nodes[j].p2p_port, latency, self.args.bandwidth)
+                self.nodes[i].connect_ports.append(port)
+                port += 1
+
+    def start(self):
+        for node in self.nodes:
+            node.start()
+        if self.args.mocktime:
+            self.set_mocktime(int(time.time()))
+        self.cpu_start = [node.cpu_seconds() for node in self.nodes]
+        self.wait_for_peers()
+
+    def stop(self):
+        for node in self.nodes:
+            node.stop()
+        for link in self.links.values():
+            link.cut()
+        if not self.args.workdir and not self.args.keep:
+            shutil.rmtree(self.workdir, ignore_errors=True)
+
+    def set_mocktime(self, t):
+        self.mocktime = t
+        for node in self.nodes:
+            if node.process is not None:
+                node.rpc.setmocktime(t)
+
+    def advance(self, seconds):
+        """Move every node's clock forward together, or wait in real time"""
+        if self.mocktime:
+            self.set_mocktime(self.mocktime + seconds)
+        else:
+            time.sleep(seconds)
+
+    def wait_for_peers(self, timeout=60):
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            if all(node.rpc.getconnectioncount() > 0 for node in self.nodes):
+                return
+            time.sleep(0.5)
+        print("warning: some nodes have no peers")
+
+    def partition(self, side):
+        for (i, j), link in self.links.items():
+            if (i in side) != (j in side):
+                link.cut()
+
+    def heal(self):
+        for link in self.links.values():
+            link.restore()
+
+    def propagation(self, topic, key, origin_time):
+        """Delays until each other node saw the event, None where it never did"""
+        delays = []
+        for node in self.nodes:
+            t = node.events[topic].get(key)
+            delays.append(None if t is None else t - origin_time)
+        return delays
+
+    def wait_for_event(self, topic, keys, timeout):
+        deadline = time.time() + timeout
+        while time.time() < deadline:
+            if all(key in node.events[topic] for node in self.nodes for key in keys):
+                return
+            time.sleep(0.1)
+
+    def report(self, name, samples):
+        print("\n== %s" % name)
+        reached = [d for d in samples if d is not None]
+        missed = len(samples) - len(reached)
+        if reached:
+            reached.sort()
+            pct = lambda p: reached[min(len(reached) - 1, int(p / 100.0 * len(reached)))]
+            print("propagation ms  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f  (%d arrivals, %d missed)"
+                  % (pct(50) * 1000, pct(90) * 1000, pct(99) * 1000, reached[-1] * 1000, len(reached), missed))
+        else:
+            print("propagation: no events arrived (%d missed)" % missed)
+
+        sent = collections.Counter()
+        recv = collections.Counter()
+        for node in self.nodes:
+            if node.process is None:
+                continue
+            for peer in node.rpc.getpeerinfo():
+                sent.update(peer.get("bytessent_per_msg", {}))
+                recv.update(peer.get("bytesrecv_per_msg", {}))
+        print("bytes per message type:")
+        for cmd in sorted(set(sent) | set(recv), key=lambda c: -sent[c]):
+            print("  %-12s sent %12d  recv %12d" % (cmd, sent[cmd], recv[cmd]))
+
+        print("cpu seconds per node:")
+        for node, start in zip(self.nodes, self.cpu_start):
+            print("  node%-3d %8.2f  (%d sequence gaps)" % (node.index, node.cpu_seconds() - start, node.sequence_gaps))
+
+
+def generate(node, n):
+    try:
+        return node.rpc.generate(n)
+    except RPCError as e:
+        if e.code == RPC_METHOD_NOT_FOUND:
+            return None
+        raise
+
+
+def scenario_txflood(sim):
+    """Send transactions from node0 as fast as it takes them"""
+    origin = sim.nodes[0]
+    if origin.rpc.getbalance() < sim.args.count * 0.02:
+        # coinbases mature after 11 blocks on regtest
+        generate(origin, 20)
+    to = [n.rpc.getnewaddress() for n in sim.nodes[1:]] or [origin.rpc.getnewaddress()]
+    samples = []
+    sent = []
+    for i in range(sim.args.count):
+        try:
+            txid = origin.rpc.sendtoaddress(to[i % len(to)], 0.01)
+        except RPCError as e:
+            print("sendtoaddress failed after %d transactions: %s" % (i, e))
+            break
+        sent.append((txid, time.time()))
+    keys = [txid for txid, _ in sent]
+    sim.wait_for_event("hashtx", keys, sim.args.timeout)
+    for txid, t in sent:
+        samples += sim.propagation("hashtx", txid, t)[1:]
+    sim.report("txflood (%d transactions)" % len(sent), samples)
+
+
+def scenario_blockrace(sim):
+    """Two far apart nodes produce a block at the same moment"""
+    a, b = sim.nodes[0], sim.nodes[len(sim.nodes) // 2]
+    samples = []
+    for round in range(sim.args.count):
+        results = [None, None]
+        threads = [threading.Thread(target=lambda k, n: results.__setitem__(k, generate(n, 1)), args=(k, n))
+                   for k, n in enumerate((a, b))]
+        start = time.time()
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        if results[0] is None or results[1] is None:
+            print("blockrace skipped: the daemon has no generate RPC")
+            return
+        for hashes in results:
+            samples += sim.propagation("hashblock", hashes[0], start)
+        sim.advance(sim.args.interval)
+    tips = collections.Counter(node.rpc.getbestblockhash() for node in sim.nodes)
+    print("tips after race: %s" % dict(tips))
+    sim.report("blockrace (%d rounds)" % sim.args.count, samples)
+
+
+def scenario_reorg(sim):
+    """Split the network, grow both sides, rejoin and time the reorg"""
+    n = len(sim.nodes)
+    side = set(range(n // 2))
+    sim.partition(side)
+    time.sleep(1)
+    if generate(sim.nodes[0], 1) is None:
+        sim.heal()
+        print("reorg skipped: the daemon has no generate RPC")
+        return
+    generate(sim.nodes[0], sim.args.count - 1)
+    longer = generate(sim.nodes[n - 1], sim.args.count + 1)
+    sim.advance(sim.args.interval)
+    start = time.time()
+    sim.heal()
+    tip = longer[-1]
+    sim.wait_for_event("hashblock", [tip], sim.args.timeout)
+    sim.report("reorg (%d vs %d blocks)" % (sim.args.count, sim.args.count + 1),
+               sim.propagation("hashblock", tip, start))
+
+
+def scenario_mnchurn(sim):
+    """Restart a share of the nodes over and over while transactions flow.
+
+    Masternodes need funded collateral the simulator can't set up by itself;
+    pass -masternode and -masternodeprivkey through --extra-arg to churn real
+    masternodes, otherwise this measures plain node churn.
+    """
+    rng = random.Random(sim.args.seed)
+    samples = []
+    for round in range(sim.args.count):
+        victims = rng.sample(sim.nodes[1:], max(1, len(sim.nodes) // 4)) if len(sim.nodes) > 1 else []
+        for node in victims:
+            node.stop()
+        for node in victims:
+            node.start()
+            if sim.mocktime:
+                node.rpc.setmocktime(sim.mocktime)
+        try:
+            txid = sim.nodes[0].rpc.sendtoaddress(sim.nodes[0].rpc.getnewaddress(), 0.01)
+        except RPCError as e:
+            print("mnchurn: sendtoaddress failed: %s" % e)
+            txid = None
+        start = time.time()
+        if txid:
+            sim.wait_for_event("hashtx", [txid], sim.args.timeout)
+            samples += sim.propagation("hashtx", txid, start)[1:]
+        sim.advance(sim.args.interval)
+        counts = [node.rpc.masternode("count") for node in sim.nodes]
+        print("round %d: restarted %s, masternode counts %s"
+              % (round, [node.index for node in victims], counts))
+    sim.report("mnchurn (%d rounds)" % sim.args.count, samples)
+
+
+def scenario_smsgflood(sim):
+    """Send secure messages from one node to another as fast as it takes them"""
+    a, b = sim.nodes[0], sim.nodes[-1]
+    to = b.rpc.getnewaddress()
+    frm = a.rpc.getnewaddress()
+    # let the recipient's key reach the sender
+    b.rpc.smsgaddkey(to, b.rpc.validateaddress(to).get("pubkey", ""))
+    before = len(b.events["smsginbox"])
+    start = time.time()
+    sent = 0
+    for i in range(sim.args.count):
+        try:
+            a.rpc.smsgsend(frm, to, "netsim %d %s" % (i, "x" * 64))
+            sent += 1
+        except RPCError as e:
+            print("smsgsend failed after %d messages: %s" % (i, e))
+            break
+    deadline = time.time() + sim.args.timeout
+    while time.time() < deadline and len(b.events["smsginbox"]) - before < sent:
+        time.sleep(0.1)
+    arrivals = sorted(b.events["smsginbox"].values())[before:]
+    samples = [t - start for t in arrivals] + [None] * (sent - len(arrivals))
+    sim.report("smsgflood (%d messages)" % sent, samples)
+
+
+SCENARIOS = {
+    "txflood": scenario_txflood,
+    "blockrace": scenario_blockrace,
+    "reorg": scenario_reorg,
+    "mnchurn": scenario_mnchurn,
+    "smsgflood": scenario_smsgflood,
+}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Simulate an AveroPay network on one machine")
+    parser.add_argument("--daemon", default="AveroPayd", help="path to AveroPayd")
+    parser.add_argument("--nodes", type=int, default=8)
+    parser.add_argument("--degree", type=int, default=3, help="outbound links per node")
+    parser.add_argument("--min-latency", type=float, default=20, help="per link, milliseconds")
+    parser.add_argument("--max-latency", type=float, default=150, help="per link, milliseconds")
+    parser.add_argument("--bandwidth", type=float, default=0, help="per link, kbit/s, 0 for unlimited")
+    parser.add_argument("--scenario", choices=sorted(SCENARIOS), action="append")
+    parser.add_argument("--count", type=int, default=100, help="transactions, messages, blocks or rounds")
+    parser.add_argument("--interval", type=int, default=10, help="seconds between rounds")
+    parser.add_argument("--timeout", type=int, default=120, help="seconds to wait for propagation")
+    parser.add_argument("--mocktime", action="store_true", help="drive the node clocks with setmocktime")
+    parser.add_argument("--seed", type=int, default=1)
+    parser.add_argument("--workdir", help="data directories go here, kept afterwards")
+    parser.add_argument("--keep", action="store_true", help="don't delete the temporary data directories")
+    parser.add_argument("--extra-arg", action="append", help="passed to every node")
+    args = parser.parse_args()
+
+    sim = Simulation(args)
+    try:
+        sim.start()
+        for name in args.scenario or ["txflood"]:
+            SCENARIOS[name](sim)
+    finally:
+        sim.stop()
+
+
+if __name__ == "__main__":
+    main()
@@ -7,107 +7,205 @@
 #include "masternodeconfig.h"
 #include <boost/lexical_cast.hpp>
 #include "clientversion.h"
+#include "ui_interface.h"
 
 //
 // Bootup the masternode, look for a 2000 AOP input and register on the network
 //
+// This is called every second by CheckDarkSendPool but only does work when one of the
+// event hooks below marked the status dirty or when the next (jittered) ping is due.
+//
 void CActiveMasternode::ManageStatus()
 {
     std::string errorMessage;
 
     if(!fMasterNode) return;
 
+    {
+        LOCK(cs);
+        if(!fDirty && GetTime() < nNextPingTime) return;
+        fDirty = false;
+    }
+
     if (fDebug) printf("CActiveMasternode::ManageStatus() - Begin\n");
 
     //need correct adjusted time to send ping
     bool fIsInitialDownload = IsInitialBlockDownload();
     if(fIsInitialDownload) {
-        status = MASTERNODE_SYNC_IN_PROCESS;
+        SetStatus(MASTERNODE_SYNC_IN_PROCESS);
         printf("CActiveMasternode::ManageStatus() - Sync in progress. Must wait until sync is complete to start masternode.\n");
         return;
     }
 
-    if(status == MASTERNODE_INPUT_TOO_NEW || status == MASTERNODE_NOT_CAPABLE || status == MASTERNODE_SYNC_IN_PROCESS){
-        status = MASTERNODE_NOT_PROCESSED;
-    }
+    int nStatus = GetStatus();
+    bool fRetry = (nStatus == MASTERNODE_INPUT_TOO_NEW || nStatus == MASTERNODE_NOT_CAPABLE || nStatus == MASTERNODE_SYNC_IN_PROCESS);
 
-    if(status == MASTERNODE_NOT_PROCESSED) {
+    if(nStatus == MASTERNODE_NOT_PROCESSED || fRetry) {
         if(strMasterNodeAddr.empty()) {
             if(!GetLocal(service)) {
-                notCapableReason = "Can't detect external address. Please use the masternodeaddr configuration option.";
-                status = MASTERNODE_NOT_CAPABLE;
-                printf("CActiveMasternode::ManageStatus() - not capable: %s\n", notCapableReason.c_str());
+                SetStatus(MASTERNODE_NOT_CAPABLE, "Can't detect external address. Please use the masternodeaddr configuration option.");
+                SchedulePing();
                 return;
             }
         } else {
             service = CService(strMasterNodeAddr);
         }
 
-        printf("CActiveMasternode::ManageStatus() - Checking inbound connection to '%s'\n", service.ToString().c_str());
+        if(!fServiceChecked || serviceChecked != service) {
+            printf("CActiveMasternode::ManageStatus() - Checking inbound connection to '%s'\n", service.ToString().c_str());
 
             if(!ConnectNode((CAddress)service, service.ToString().c_str())){
-                notCapableReason = "Could not connect to " + service.ToString();
-                status = MASTERNODE_NOT_CAPABLE;
-                printf("CActiveMasternode::ManageStatus() - not capable: %s\n", notCapableReason.c_str());
+                SetStatus(MASTERNODE_NOT_CAPABLE, "Could not connect to " + service.ToString());
+                SchedulePing();
                 return;
             }
 
+            fServiceChecked = true;
+            serviceChecked = service;
+        }
+
         if(pwalletMain->IsLocked()){
-            notCapableReason = "Wallet is locked.";
-            status = MASTERNODE_NOT_CAPABLE;
-            printf("CActiveMasternode::ManageStatus() - not capable: %s\n", notCapableReason.c_str());
+            SetStatus(MASTERNODE_NOT_CAPABLE, "Wallet is locked.");
+            SchedulePing();
             return;
         }
 
-        // Set defaults
-        status = MASTERNODE_NOT_CAPABLE;
-        notCapableReason = "Unknown. Check debug.log for more information.\n";
+        // Choose coins to use, the wallet is only scanned again after the cached collateral was spent
+        {
+            LOCK(cs);
+            if(!fCollateralCached)
+                fCollateralCached = GetMasterNodeVin(vinCollateral, pubKeyCollateralAddress, keyCollateralAddress);
+            if(fCollateralCached)
+                vin = vinCollateral;
+        }
 
-        // Choose coins to use
-        CPubKey pubKeyCollateralAddress;
-        CKey keyCollateralAddress;
+        if(!fCollateralCached) {
+            printf("CActiveMasternode::ManageStatus() - Could not find suitable coins!\n");
+            SetStatus(MASTERNODE_NOT_CAPABLE, "Could not find suitable coins.");
+            SchedulePing();
+            return;
+        }
 
-        if(GetMasterNodeVin(vin, pubKeyCollateralAddress, keyCollateralAddress)) {
+        int nInputAge = GetInputAge(vin);
+        if(nInputAge < MASTERNODE_MIN_CONFIRMATIONS){
+            // re-evaluated when the chain tip advances
+            printf("CActiveMasternode::ManageStatus() - Input must have least %d confirmations - %d confirmations\n", MASTERNODE_MIN_CONFIRMATIONS, nInputAge);
+            SetStatus(MASTERNODE_INPUT_TOO_NEW);
+            return;
+        }
 
-            if(GetInputAge(vin) < MASTERNODE_MIN_CONFIRMATIONS){
-                printf("CActiveMasternode::ManageStatus() - Input must have least %d confirmations - %d confirmations\n", MASTERNODE_MIN_CONFIRMATIONS, GetInputAge(vin));
-                status = MASTERNODE_INPUT_TOO_NEW;
-                return;
-            }
+        if(!GetMasternodeKeys(errorMessage)) {
+            printf("CActiveMasternode::ManageStatus() - Error upon calling SetKey: %s\n", errorMessage.c_str());
+            SetStatus(MASTERNODE_NOT_CAPABLE, errorMessage);
+            SchedulePing();
+            return;
+        }
 
-            printf("CActiveMasternode::ManageStatus() - Is capable master node!\n");
+        printf("CActiveMasternode::ManageStatus() - Is capable master node!\n");
 
-            status = MASTERNODE_IS_CAPABLE;
-            notCapableReason = "";
+        SetStatus(MASTERNODE_IS_CAPABLE);
 
-            pwalletMain->LockCoin(vin.prevout);
+        pwalletMain->LockCoin(vin.prevout);
 
-            // send to all nodes
-            CPubKey pubKeyMasternode;
-            CKey keyMasternode;
+        // send to all nodes
+        if(!Register(vin, service, keyCollateralAddress, pubKeyCollateralAddress, keyMasternode, pubKeyMasternodeCached, errorMessage)) {
+            printf("CActiveMasternode::ManageStatus() - Error on Register: %s\n", errorMessage.c_str());
+        }
 
-            if(!darkSendSigner.SetKey(strMasterNodePrivKey, errorMessage, keyMasternode, pubKeyMasternode))
-            {
-                printf("Register::ManageStatus() - Error upon calling SetKey: %s\n", errorMessage.c_str());
-                return;
-            }
+        SchedulePing();
+        return;
+    }
 
-            if(!Register(vin, service, keyCollateralAddress, pubKeyCollateralAddress, keyMasternode, pubKeyMasternode, errorMessage)) {
-                printf("CActiveMasternode::ManageStatus() - Error on Register: %s\n", errorMessage.c_str());
-            }
+    //send to all peers
+    if(!Dseep(errorMessage)) {
+        printf("CActiveMasternode::ManageStatus() - Error on Ping: %s", errorMessage.c_str());
+    }
 
+    SchedulePing();
+}
+
+void CActiveMasternode::ResetStatus()
+{
+    LOCK(cs);
+    status = MASTERNODE_NOT_PROCESSED;
+    fServiceChecked = false;
+    fDirty = true;
+}
+
+void CActiveMasternode::UpdatedBlockTip(int nHeight, int nNumBlocksOfPeers)
+{
+    if(!fMasterNode) return;
+
+    // a running masternode only needs its regular pings, everything else may have become
+    // possible with the new block (sync finished, collateral matured)
+    LOCK(cs);
+    if(status != MASTERNODE_IS_CAPABLE && status != MASTERNODE_REMOTELY_ENABLED && status != MASTERNODE_STOPPED)
+        fDirty = true;
+}
+
+void CActiveMasternode::SyncTransaction(const CTransaction& tx)
+{
+    if(!fMasterNode) return;
+
+    LOCK(cs);
+    const COutPoint& prevoutWatched = fCollateralCached ? vinCollateral.prevout : vin.prevout;
+    if(prevoutWatched.IsNull()) return;
+
+    BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+        if(txin.prevout == prevoutWatched) {
+            printf("CActiveMasternode::SyncTransaction() - Collateral %s spent by %s\n", prevoutWatched.ToString().c_str(), tx.GetHash().ToString().c_str());
+            fCollateralCached = false;
+            SetStatus(MASTERNODE_NOT_CAPABLE, "Collateral was spent.");
+            fDirty = true;
             return;
-        } else {
-            printf("CActiveMasternode::ManageStatus() - Could not find suitable coins!\n");
         }
     }
+}
 
-    //send to all peers
-    if(!Dseep(errorMessage)) {
-        printf("CActiveMasternode::ManageStatus() - Error on Ping: %s", errorMessage.c_str());
+void CActiveMasternode::NotifyConnectionsChanged(int nConnections)
+{
+    if(!fMasterNode) return;
+
+    LOCK(cs);
+    if(nConnections == 0) {
+        // lost the network, check reachability again once we are back
+        fServiceChecked = false;
+    } else if(status == MASTERNODE_NOT_CAPABLE || status == MASTERNODE_NOT_PROCESSED) {
+        fDirty = true;
     }
 }
 
+bool CActiveMasternode::GetMasternodeKeys(std::string& errorMessage)
+{
+    if(fKeysCached) return true;
+
+    if(!darkSendSigner.SetKey(strMasterNodePrivKey, errorMessage, keyMasternode, pubKeyMasternodeCached))
+        return false;
+
+    fKeysCached = true;
+    return true;
+}
+
+void CActiveMasternode::SetStatus(int newStatus, const std::string& reason)
+{
+    LOCK(cs);
+    if(newStatus == status && reason == notCapableReason) return;
+
+    status = newStatus;
+    notCapableReason = reason;
+    if(status == MASTERNODE_NOT_CAPABLE)
+        printf("CActiveMasternode::ManageStatus() - not capable: %s\n", notCapableReason.c_str());
+
+    uiInterface.NotifyMasternodeStatusChanged(status, notCapableReason);
+}
+
+void CActiveMasternode::SchedulePing(int64_t nDelay)
+{
+    // spread pings out so that masternodes started together don't ping in lockstep
+    LOCK(cs);
+    nNextPingTime = GetTime() + nDelay + GetRandInt(MASTERNODE_PING_JITTER_SECONDS);
+}
+
 // Send stop dseep to network for remote masternode
 bool CActiveMasternode::StopMasterNode(std::string strService, std::string strKeyMasternode, std::string& errorMessage) {
     CTxIn vin;
@@ -124,24 +222,22 @@ bool CActiveMasternode::StopMasterNode(std::string strService, std::string strKe
 
 // Send stop dseep to network for main masternode
 bool CActiveMasternode::StopMasterNode(std::string& errorMessage) {
-    if(status != MASTERNODE_IS_CAPABLE && status != MASTERNODE_REMOTELY_ENABLED) {
+    int nStatus = GetStatus();
+    if(nStatus != MASTERNODE_IS_CAPABLE && nStatus != MASTERNODE_REMOTELY_ENABLED) {
         errorMessage = "masternode is not in a running status";
         printf("CActiveMasternode::StopMasterNode() - Error: %s\n", errorMessage.c_str());
         return false;
     }
 
-    status = MASTERNODE_STOPPED;
-
-    CPubKey pubKeyMasternode;
-    CKey keyMasternode;
+    SetStatus(MASTERNODE_STOPPED);
 
-    if(!darkSendSigner.SetKey(strMasterNodePrivKey, errorMessage, keyMasternode, pubKeyMasternode))
+    if(!GetMasternodeKeys(errorMessage))
     {
         printf("Register::ManageStatus() - Error upon calling SetKey: %s\n", errorMessage.c_str());
         return false;
     }
 
-    return StopMasterNode(vin, service, keyMasternode, pubKeyMasternode, errorMessage);
+    return StopMasterNode(vin, service, keyMasternode, pubKeyMasternodeCached, errorMessage);
 }
 
 // Send stop dseep to network for any masternode
@@ -151,22 +247,20 @@ bool CActiveMasternode::StopMasterNode(CTxIn vin, CService service, CKey keyMast
 }
 
 bool CActiveMasternode::Dseep(std::string& errorMessage) {
-    if(status != MASTERNODE_IS_CAPABLE && status != MASTERNODE_REMOTELY_ENABLED) {
+    int nStatus = GetStatus();
+    if(nStatus != MASTERNODE_IS_CAPABLE && nStatus != MASTERNODE_REMOTELY_ENABLED) {
         errorMessage = "masternode is not in a running status";
         printf("CActiveMasternode::Dseep() - Error: %s\n", errorMessage.c_str());
         return false;
     }
 
-    CPubKey pubKeyMasternode;
-    CKey keyMasternode;
-
-    if(!darkSendSigner.SetKey(strMasterNodePrivKey, errorMessage, keyMasternode, pubKeyMasternode))
+    if(!GetMasternodeKeys(errorMessage))
     {
         printf("Register::ManageStatus() - Error upon calling SetKey: %s\n", errorMessage.c_str());
         return false;
     }
 
-    return Dseep(vin, service, keyMasternode, pubKeyMasternode, errorMessage, false);
+    return Dseep(vin, service, keyMasternode, pubKeyMasternodeCached, errorMessage, false);
 }
 
 bool CActiveMasternode::Dseep(CTxIn vin, CService service, CKey keyMasternode, CPubKey pubKeyMasternode, std::string &retErrorMessage, bool stop) {
@@ -203,8 +297,7 @@ bool CActiveMasternode::Dseep(CTxIn vin, CService service, CKey keyMasternode, C
         // Seems like we are trying to send a ping while the masternode is not registered in the network
         retErrorMessage = "Darksend Masternode List doesn't include our masternode, Shutting down masternode pinging service! " + vin.ToString();
         printf("CActiveMasternode::Dseep() - Error: %s\n", retErrorMessage.c_str());
-        status = MASTERNODE_NOT_CAPABLE;
-        notCapableReason = retErrorMessage;
+        SetStatus(MASTERNODE_NOT_CAPABLE, retErrorMessage);
         return false;
     }
 
@@ -289,6 +382,7 @@ bool CActiveMasternode::Register(CTxIn vin, CService service, CKey keyCollateral
         CMasterNode mn(service, vin, pubKeyCollateralAddress, vchMasterNodeSignature, masterNodeSignatureTime, pubKeyMasternode, PROTOCOL_VERSION);
         mn.UpdateLastSeen(masterNodeSignatureTime);
         vecMasternodes.push_back(mn);
+        uiInterface.NotifyMasternodeListChanged();
     }
 
     //send to all peers
@@ -526,12 +620,14 @@ bool CActiveMasternode::EnableHotColdMasterNode(CTxIn& newVin, CService& newServ
 {
     if(!fMasterNode) return false;
 
-    status = MASTERNODE_REMOTELY_ENABLED;
+    SetStatus(MASTERNODE_REMOTELY_ENABLED);
 
     //The values below are needed for signing dseep messages going forward
     this->vin = newVin;
     this->service = newService;
 
+    SchedulePing();
+
     printf("CActiveMasternode::EnableHotColdMasterNode() - Enabled! You may shut down the cold daemon.\n");
 
     return true;
@@ -26,15 +26,26 @@ public:
 	CTxIn vin;
     CService service;
 
-    int status;
-    std::string notCapableReason;
-
     CActiveMasternode()
     {        
         status = MASTERNODE_NOT_PROCESSED;
+        fDirty = true;
+        fKeysCached = false;
+        fCollateralCached = false;
+        fServiceChecked = false;
+        nNextPingTime = 0;
     }
 
+    int GetStatus() const { LOCK(cs); return status; }
+    std::string GetNotCapableReason() const { LOCK(cs); return notCapableReason; }
+
     void ManageStatus(); // manage status of main masternode
+    void ResetStatus(); // forget the current status and re-evaluate on the next ManageStatus
+
+    // event hooks, these only mark the status for re-evaluation on the next ManageStatus
+    void UpdatedBlockTip(int nHeight, int nNumBlocksOfPeers); // chain tip changed
+    void SyncTransaction(const CTransaction& tx); // watch for our collateral being spent
+    void NotifyConnectionsChanged(int nConnections); // peer connectivity changed
 
     bool Dseep(std::string& errorMessage); // ping for main masternode
     bool Dseep(CTxIn vin, CService service, CKey key, CPubKey pubKey, std::string &retErrorMessage, bool stop); // ping for any masternode
@@ -61,6 +72,36 @@ public:
 
     // enable hot wallet mode (run a masternode with no funds)
     bool EnableHotColdMasterNode(CTxIn& vin, CService& addr);
+
+private:
+    mutable CCriticalSection cs;
+
+    // written by SetStatus under cs, from the scheduler and the wallet notifications
+    int status;
+    std::string notCapableReason;
+
+    // set by the event hooks, ManageStatus does nothing until this is set or a ping is due
+    bool fDirty;
+    int64_t nNextPingTime;
+
+    // masternode key parsed once from strMasterNodePrivKey
+    bool fKeysCached;
+    CKey keyMasternode;
+    CPubKey pubKeyMasternodeCached;
+
+    // collateral selected by the last wallet scan, dropped when it is spent
+    bool fCollateralCached;
+    CTxIn vinCollateral;
+    CKey keyCollateralAddress;
+    CPubKey pubKeyCollateralAddress;
+
+    // the inbound connection check is only done once per external address
+    bool fServiceChecked;
+    CService serviceChecked;
+
+    bool GetMasternodeKeys(std::string& errorMessage);
+    void SetStatus(int newStatus, const std::string& reason = "");
+    void SchedulePing(int64_t nDelay = MASTERNODE_PING_SECONDS);
 };
 
 #endif
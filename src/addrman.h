@@ -8,6 +8,7 @@
 #include "protocol.h"
 #include "util.h"
 #include "sync.h"
+#include "memusage.h"
 
 
 #include <map>
@@ -395,6 +396,19 @@ public:
         return vRandom.size();
     }
 
+    // Estimated memory of the address tables
+    size_t DynamicMemoryUsage() const
+    {
+        LOCK(cs);
+        size_t nUsage = memusage::DynamicUsage(nKey) + memusage::DynamicUsage(mapInfo) + memusage::DynamicUsage(mapAddr) +
+                        memusage::DynamicUsage(vRandom) + memusage::DynamicUsage(vvTried) + memusage::DynamicUsage(vvNew);
+        for (std::vector<std::vector<int> >::const_iterator it = vvTried.begin(); it != vvTried.end(); it++)
+            nUsage += memusage::DynamicUsage(*it);
+        for (std::vector<std::set<int> >::const_iterator it = vvNew.begin(); it != vvNew.end(); it++)
+            nUsage += memusage::DynamicUsage(*it);
+        return nUsage;
+    }
+
     // Consistency check
     void Check()
     {
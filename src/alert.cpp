@@ -16,7 +16,7 @@
 
 using namespace std;
 
-map<uint256, CAlert> mapAlerts;
+boost::unordered_map<uint256, CAlert, CSaltedHasher> mapAlerts;
 CCriticalSection cs_mapAlerts;
 
 static const char* pszMainKey = "04f60adf569ab597e53177723fcaec749ffb953f01c34d7747e7199a911c6764cccc50ddd1af16fa754d1899a7a14623a55ca1629ec42b382b155beab851df0a51";
@@ -162,7 +162,7 @@ CAlert CAlert::getAlertByHash(const uint256 &hash)
     CAlert retval;
     {
         LOCK(cs_mapAlerts);
-        map<uint256, CAlert>::iterator mi = mapAlerts.find(hash);
+        boost::unordered_map<uint256, CAlert, CSaltedHasher>::iterator mi = mapAlerts.find(hash);
         if(mi != mapAlerts.end())
             retval = mi->second;
     }
@@ -201,7 +201,7 @@ bool CAlert::ProcessAlert(bool fThread)
     {
         LOCK(cs_mapAlerts);
         // Cancel previous alerts
-        for (map<uint256, CAlert>::iterator mi = mapAlerts.begin(); mi != mapAlerts.end();)
+        for (boost::unordered_map<uint256, CAlert, CSaltedHasher>::iterator mi = mapAlerts.begin(); mi != mapAlerts.end();)
         {
             const CAlert& alert = (*mi).second;
             if (Cancels(alert))
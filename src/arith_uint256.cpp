@@ -0,0 +1,197 @@
+// Copyright (c) 2018 The AveroPay developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "arith_uint256.h"
+#include "uint256.h"
+
+#include <string.h>
+
+arith_uint256& arith_uint256::operator*=(uint32_t b32)
+{
+    uint64_t carry = 0;
+    for (int i = 0; i < WIDTH; i++)
+    {
+        uint64_t n = carry + (uint64_t)b32 * pn[i];
+        pn[i] = n & 0xffffffff;
+        carry = n >> 32;
+    }
+    return *this;
+}
+
+arith_uint256& arith_uint256::operator*=(const arith_uint256& b)
+{
+    arith_uint256 a;
+    for (int j = 0; j < WIDTH; j++)
+    {
+        uint64_t carry = 0;
+        for (int i = 0; i + j < WIDTH; i++)
+        {
+            uint64_t n = carry + a.pn[i + j] + (uint64_t)pn[j] * b.pn[i];
+            a.pn[i + j] = n & 0xffffffff;
+            carry = n >> 32;
+        }
+    }
+    *this = a;
+    return *this;
+}
+
+// Shift-and-subtract long division, one quotient bit per step
+arith_uint256& arith_uint256::operator/=(const arith_uint256& b)
+{
+    arith_uint256 div = b;
+    arith_uint256 num = *this;
+    *this = 0;
+    int nNumBits = num.bits();
+    int nDivBits = div.bits();
+    if (nDivBits == 0)
+        throw arith_uint256_error("arith_uint256 : division by zero");
+    if (nDivBits > nNumBits)
+        return *this;
+    int nShift = nNumBits - nDivBits;
+    div <<= nShift;
+    while (nShift >= 0)
+    {
+        if (num >= div)
+        {
+            num -= div;
+            pn[nShift / 32] |= (1U << (nShift & 31));
+        }
+        div >>= 1;
+        nShift--;
+    }
+    return *this;
+}
+
+arith_uint256& arith_uint256::operator<<=(unsigned int shift)
+{
+    arith_uint256 a(*this);
+    for (int i = 0; i < WIDTH; i++)
+        pn[i] = 0;
+    int k = shift / 32;
+    shift = shift % 32;
+    for (int i = 0; i < WIDTH; i++)
+    {
+        if (i + k + 1 < WIDTH && shift != 0)
+            pn[i + k + 1] |= (a.pn[i] >> (32 - shift));
+        if (i + k < WIDTH)
+            pn[i + k] |= (a.pn[i] << shift);
+    }
+    return *this;
+}
+
+arith_uint256& arith_uint256::operator>>=(unsigned int shift)
+{
+    arith_uint256 a(*this);
+    for (int i = 0; i < WIDTH; i++)
+        pn[i] = 0;
+    int k = shift / 32;
+    shift = shift % 32;
+    for (int i = 0; i < WIDTH; i++)
+    {
+        if (i - k - 1 >= 0 && shift != 0)
+            pn[i - k - 1] |= (a.pn[i] << (32 - shift));
+        if (i - k >= 0)
+            pn[i - k] |= (a.pn[i] >> shift);
+    }
+    return *this;
+}
+
+int arith_uint256::CompareTo(const arith_uint256& b) const
+{
+    for (int i = WIDTH - 1; i >= 0; i--)
+    {
+        if (pn[i] < b.pn[i])
+            return -1;
+        if (pn[i] > b.pn[i])
+            return 1;
+    }
+    return 0;
+}
+
+bool arith_uint256::EqualTo(uint64_t b) const
+{
+    for (int i = WIDTH - 1; i >= 2; i--)
+        if (pn[i])
+            return false;
+    return GetLow64() == b;
+}
+
+unsigned int arith_uint256::bits() const
+{
+    for (int pos = WIDTH - 1; pos >= 0; pos--)
+    {
+        if (pn[pos])
+        {
+            for (int nBits = 31; nBits > 0; nBits--)
+                if (pn[pos] & 1U << nBits)
+                    return 32 * pos + nBits + 1;
+            return 32 * pos + 1;
+        }
+    }
+    return 0;
+}
+
+// The compact format is a 3 byte mantissa and a 1 byte exponent, the size
+// in bytes of the number: N = mantissa * 256^(exponent-3). Bit 0x00800000 of
+// the mantissa is the sign, as in the MPI encoding CBigNum goes through.
+arith_uint256& arith_uint256::SetCompact(uint32_t nCompact, bool* pfNegative, bool* pfOverflow)
+{
+    int nSize = nCompact >> 24;
+    uint32_t nWord = nCompact & 0x007fffff;
+    if (nSize <= 3)
+    {
+        nWord >>= 8 * (3 - nSize);
+        *this = nWord;
+    }
+    else
+    {
+        *this = nWord;
+        *this <<= 8 * (nSize - 3);
+    }
+    if (pfNegative)
+        *pfNegative = nWord != 0 && (nCompact & 0x00800000) != 0;
+    if (pfOverflow)
+        *pfOverflow = nWord != 0 && ((nSize > 34) ||
+                                     (nWord > 0xff && nSize > 33) ||
+                                     (nWord > 0xffff && nSize > 32));
+    return *this;
+}
+
+uint32_t arith_uint256::GetCompact(bool fNegative) const
+{
+    int nSize = (bits() + 7) / 8;
+    uint32_t nCompact = 0;
+    if (nSize <= 3)
+        nCompact = GetLow64() << 8 * (3 - nSize);
+    else
+        nCompact = (*this >> 8 * (nSize - 3)).GetLow64();
+    // the mantissa's top bit is the sign, so a mantissa reaching it moves up a byte
+    if (nCompact & 0x00800000)
+    {
+        nCompact >>= 8;
+        nSize++;
+    }
+    nCompact |= nSize << 24;
+    nCompact |= (fNegative && (nCompact & 0x007fffff) ? 0x00800000 : 0);
+    return nCompact;
+}
+
+std::string arith_uint256::GetHex() const
+{
+    return ArithToUint256(*this).GetHex();
+}
+
+uint256 ArithToUint256(const arith_uint256& a)
+{
+    uint256 b;
+    memcpy(b.begin(), a.pn, sizeof(a.pn));
+    return b;
+}
+
+arith_uint256 UintToArith256(const uint256& b)
+{
+    arith_uint256 a;
+    memcpy(a.pn, b.begin(), sizeof(a.pn));
+    return a;
+}
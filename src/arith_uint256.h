@@ -0,0 +1,139 @@
+// Copyright (c) 2018 The AveroPay developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_ARITH_UINT256_H
+#define BITCOIN_ARITH_UINT256_H
+
+#include <stdexcept>
+#include <string>
+
+#include <stdint.h>
+
+class uint256;
+
+class arith_uint256_error : public std::runtime_error
+{
+public:
+    explicit arith_uint256_error(const std::string& str) : std::runtime_error(str) {}
+};
+
+/** Unsigned 256-bit integer for proof-of-work targets and chain trust.
+ *
+ * uint256 is the type of hashes; this one adds the multiplication, division
+ * and compact (nBits) conversions the difficulty code used CBigNum for, on
+ * eight 32-bit words that live on the stack. Arithmetic wraps modulo 2^256
+ * like the built-in unsigned types, so callers whose products can overflow
+ * check before multiplying.
+ */
+class arith_uint256
+{
+private:
+    enum { WIDTH = 256 / 32 };
+    uint32_t pn[WIDTH];
+
+public:
+    arith_uint256()
+    {
+        for (int i = 0; i < WIDTH; i++)
+            pn[i] = 0;
+    }
+
+    arith_uint256(uint64_t b)
+    {
+        pn[0] = (uint32_t)b;
+        pn[1] = (uint32_t)(b >> 32);
+        for (int i = 2; i < WIDTH; i++)
+            pn[i] = 0;
+    }
+
+    const arith_uint256 operator~() const
+    {
+        arith_uint256 ret;
+        for (int i = 0; i < WIDTH; i++)
+            ret.pn[i] = ~pn[i];
+        return ret;
+    }
+
+    const arith_uint256 operator-() const
+    {
+        arith_uint256 ret = ~*this;
+        ++ret;
+        return ret;
+    }
+
+    arith_uint256& operator++()
+    {
+        int i = 0;
+        while (i < WIDTH && ++pn[i] == 0)
+            i++;
+        return *this;
+    }
+
+    arith_uint256& operator+=(const arith_uint256& b)
+    {
+        uint64_t carry = 0;
+        for (int i = 0; i < WIDTH; i++)
+        {
+            uint64_t n = carry + pn[i] + b.pn[i];
+            pn[i] = n & 0xffffffff;
+            carry = n >> 32;
+        }
+        return *this;
+    }
+
+    arith_uint256& operator-=(const arith_uint256& b)
+    {
+        *this += -b;
+        return *this;
+    }
+
+    arith_uint256& operator*=(uint32_t b32);
+    arith_uint256& operator*=(const arith_uint256& b);
+    /** Throws arith_uint256_error on division by zero */
+    arith_uint256& operator/=(const arith_uint256& b);
+    arith_uint256& operator<<=(unsigned int shift);
+    arith_uint256& operator>>=(unsigned int shift);
+
+    int CompareTo(const arith_uint256& b) const;
+    bool EqualTo(uint64_t b) const;
+
+    /** Position of the highest set bit plus one, 0 for zero */
+    unsigned int bits() const;
+
+    uint64_t GetLow64() const
+    {
+        return pn[0] | (uint64_t)pn[1] << 32;
+    }
+
+    /** Decode a compact (nBits) number like CBigNum::SetCompact. The sign bit
+     * and values of 2^256 and more cannot be represented; pfNegative and
+     * pfOverflow report them, and the value is then only the low bits. */
+    arith_uint256& SetCompact(uint32_t nCompact, bool* pfNegative = NULL, bool* pfOverflow = NULL);
+    uint32_t GetCompact(bool fNegative = false) const;
+
+    std::string GetHex() const;
+
+    friend uint256 ArithToUint256(const arith_uint256& a);
+    friend arith_uint256 UintToArith256(const uint256& b);
+
+    friend inline const arith_uint256 operator+(const arith_uint256& a, const arith_uint256& b) { return arith_uint256(a) += b; }
+    friend inline const arith_uint256 operator-(const arith_uint256& a, const arith_uint256& b) { return arith_uint256(a) -= b; }
+    friend inline const arith_uint256 operator*(const arith_uint256& a, const arith_uint256& b) { return arith_uint256(a) *= b; }
+    friend inline const arith_uint256 operator*(const arith_uint256& a, uint32_t b)             { return arith_uint256(a) *= b; }
+    friend inline const arith_uint256 operator/(const arith_uint256& a, const arith_uint256& b) { return arith_uint256(a) /= b; }
+    friend inline const arith_uint256 operator<<(const arith_uint256& a, unsigned int shift)    { return arith_uint256(a) <<= shift; }
+    friend inline const arith_uint256 operator>>(const arith_uint256& a, unsigned int shift)    { return arith_uint256(a) >>= shift; }
+    friend inline bool operator==(const arith_uint256& a, const arith_uint256& b) { return a.CompareTo(b) == 0; }
+    friend inline bool operator!=(const arith_uint256& a, const arith_uint256& b) { return a.CompareTo(b) != 0; }
+    friend inline bool operator<(const arith_uint256& a, const arith_uint256& b)  { return a.CompareTo(b) < 0; }
+    friend inline bool operator<=(const arith_uint256& a, const arith_uint256& b) { return a.CompareTo(b) <= 0; }
+    friend inline bool operator>(const arith_uint256& a, const arith_uint256& b)  { return a.CompareTo(b) > 0; }
+    friend inline bool operator>=(const arith_uint256& a, const arith_uint256& b) { return a.CompareTo(b) >= 0; }
+    friend inline bool operator==(const arith_uint256& a, uint64_t b) { return a.EqualTo(b); }
+    friend inline bool operator!=(const arith_uint256& a, uint64_t b) { return !a.EqualTo(b); }
+};
+
+uint256 ArithToUint256(const arith_uint256& a);
+arith_uint256 UintToArith256(const uint256& b);
+
+#endif
@@ -25,6 +25,9 @@
 #include <boost/filesystem/fstream.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/version.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <deque>
 #include <list>
 
 #define printf OutputDebugStringF
@@ -41,9 +44,12 @@ static std::string strRPCUserColonPass;
 const Object emptyobj;
 
 void ThreadRPCServer3(void* parg);
+static void StartRPCWorkers();
 
 static inline unsigned short GetDefaultRPCPort()
 {
+    if (GetBoolArg("-regtest", false))
+        return 32444;
     return GetBoolArg("-testnet", false) ? 32338 : 32339;
 }
 
@@ -236,114 +242,126 @@ Value stop(const Array& params, bool fHelp)
 
 
 static const CRPCCommand vRPCCommands[] =
-{ //  name                      function                 safemd  unlocked
-  //  ------------------------  -----------------------  ------  --------
-    { "help",                   &help,                   true,   true },
-    { "stop",                   &stop,                   true,   true },
-    { "getbestblockhash",       &getbestblockhash,       true,   false },
-    { "getblockcount",          &getblockcount,          true,   false },
-    { "getconnectioncount",     &getconnectioncount,     true,   false },
-    { "getpeerinfo",            &getpeerinfo,            true,   false },
-    { "gethashespersec",        &gethashespersec,        true,   false },
-    { "addnode",                &addnode,                true,   true },
-    { "dumpbootstrap",          &dumpbootstrap,          false,  false },
-    { "getdifficulty",          &getdifficulty,          true,   false },
-    { "getinfo",                &getinfo,                true,   false },
-    { "getsubsidy",             &getsubsidy,             true,   false },
-    { "getmininginfo",          &getmininginfo,          true,   false },
-    { "getstakinginfo",         &getstakinginfo,         true,   false },
-    { "getnewaddress",          &getnewaddress,          true,   false },
-    { "getnewpubkey",           &getnewpubkey,           true,   false },
-    { "getaccountaddress",      &getaccountaddress,      true,   false },
-    { "setaccount",             &setaccount,             true,   false },
-    { "getaccount",             &getaccount,             false,  false },
-    { "getaddressesbyaccount",  &getaddressesbyaccount,  true,   false },
-    { "sendtoaddress",          &sendtoaddress,          false,  false },
-    { "getreceivedbyaddress",   &getreceivedbyaddress,   false,  false },
-    { "getreceivedbyaccount",   &getreceivedbyaccount,   false,  false },
-    { "listreceivedbyaddress",  &listreceivedbyaddress,  false,  false },
-    { "listreceivedbyaccount",  &listreceivedbyaccount,  false,  false },
-    { "backupwallet",           &backupwallet,           true,   false },
-    { "keypoolrefill",          &keypoolrefill,          true,   false },
-    { "walletpassphrase",       &walletpassphrase,       true,   false },
-    { "walletpassphrasechange", &walletpassphrasechange, false,  false },
-    { "walletlock",             &walletlock,             true,   false },
-    { "encryptwallet",          &encryptwallet,          false,  false },
-    { "validateaddress",        &validateaddress,        true,   false },
-    { "validatepubkey",         &validatepubkey,         true,   false },
-    { "fetchbalance",           &fetchbalance,           true,   false },
-    { "getbalance",             &getbalance,             false,  false },
-    { "move",                   &movecmd,                false,  false },
-    { "sendfrom",               &sendfrom,               false,  false },
-    { "sendmany",               &sendmany,               false,  false },
-    { "addmultisigaddress",     &addmultisigaddress,     false,  false },
-    { "addredeemscript",        &addredeemscript,        false,  false },
-    { "getrawmempool",          &getrawmempool,          true,   false },
-    { "getblock",               &getblock,               false,  false },
-    { "getblock_old",           &getblock_old,           false,  false },
-    { "getblockbynumber",       &getblockbynumber,       false,  false },
-    { "getblockhash",           &getblockhash,           false,  false },
-    { "gettransaction",         &gettransaction,         false,  false },
-    { "listtransactions",       &listtransactions,       false,  false },
-    { "listaddressgroupings",   &listaddressgroupings,   false,  false },
-    { "signmessage",            &signmessage,            false,  false },
-    { "verifymessage",          &verifymessage,          false,  false },
-    { "getwork",                &getwork,                true,   false },
-    { "getworkex",              &getworkex,              true,   false },
-    { "listaccounts",           &listaccounts,           false,  false },
-    { "settxfee",               &settxfee,               false,  false },
-    { "getblocktemplate",       &getblocktemplate,       true,   false },
-    { "submitblock",            &submitblock,            false,  false },
-    { "listsinceblock",         &listsinceblock,         false,  false },
-    { "dumpprivkey",            &dumpprivkey,            false,  false },
-    { "dumpwallet",             &dumpwallet,             true,   false },
-    { "importwallet",           &importwallet,           false,  false },
-    { "importprivkey",          &importprivkey,          false,  false },
-    { "listunspent",            &listunspent,            false,  false },
-    { "getrawtransaction",      &getrawtransaction,      false,  false },
-    { "createrawtransaction",   &createrawtransaction,   false,  false },
-    { "decoderawtransaction",   &decoderawtransaction,   false,  false },
-    { "createmultisig",         &createmultisig,         false,  false },
-    { "decodescript",           &decodescript,           false,  false },
-    { "signrawtransaction",     &signrawtransaction,     false,  false },
-    { "sendrawtransaction",     &sendrawtransaction,     false,  false },
-    { "searchrawtransactions",  &searchrawtransactions,  false,  false },
-    { "getcheckpoint",          &getcheckpoint,          true,   false },
-    { "reservebalance",         &reservebalance,         false,  true},
-    { "checkwallet",            &checkwallet,            false,  true},
-    { "repairwallet",           &repairwallet,           false,  true},
-    { "resendtx",               &resendtx,               false,  true},
-    { "makekeypair",            &makekeypair,            false,  true},
-    { "sendalert",              &sendalert,              false,  false},
-    { "gettxout",               &gettxout,               true,   false },
-    { "importaddress",          &importaddress,          false,  false },
-
-    { "getnewstealthaddress",   &getnewstealthaddress,   false,  false},
-    { "liststealthaddresses",   &liststealthaddresses,   false,  false},
-    { "importstealthaddress",   &importstealthaddress,   false,  false},
-    { "sendtostealthaddress",   &sendtostealthaddress,   false,  false},
-    { "clearwallettransactions",&clearwallettransactions,false,  false},
-    { "scanforalltxns",         &scanforalltxns,         false,  false},
-    { "scanforstealthtxns",     &scanforstealthtxns,     false,  false},
+{ //  name                      function                 safemd  unlocked  threadsafe
+  //  ------------------------  -----------------------  ------  --------  ----------
+    { "help",                   &help,                   true,   true,     false },
+    { "stop",                   &stop,                   true,   true,     false },
+    { "getbestblockhash",       &getbestblockhash,       true,   false,    true },
+    { "getblockcount",          &getblockcount,          true,   false,    true },
+    { "getconnectioncount",     &getconnectioncount,     true,   false,    false },
+    { "getpeerinfo",            &getpeerinfo,            true,   false,    false },
+    { "gethashespersec",        &gethashespersec,        true,   false,    false },
+    { "addnode",                &addnode,                true,   true,     false },
+    { "dumpbootstrap",          &dumpbootstrap,          false,  false,    false },
+    { "getbootstrapinfo",       &getbootstrapinfo,       true,   false,    true },
+    { "getdifficulty",          &getdifficulty,          true,   false,    false },
+    { "getinfo",                &getinfo,                true,   false,    false },
+    { "getmemoryinfo",          &getmemoryinfo,          true,   true,     false },
+    { "setmocktime",            &setmocktime,            true,   false,    false },
+    { "getsubsidy",             &getsubsidy,             true,   false,    false },
+    { "getmininginfo",          &getmininginfo,          true,   false,    false },
+    { "getstakinginfo",         &getstakinginfo,         true,   false,    false },
+    { "generate",               &generate,               false,  true,     false },
+    { "getnewaddress",          &getnewaddress,          true,   false,    false },
+    { "getnewpubkey",           &getnewpubkey,           true,   false,    false },
+    { "getaccountaddress",      &getaccountaddress,      true,   false,    false },
+    { "setaccount",             &setaccount,             true,   false,    false },
+    { "getaccount",             &getaccount,             false,  false,    false },
+    { "getaddressesbyaccount",  &getaddressesbyaccount,  true,   false,    false },
+    { "sendtoaddress",          &sendtoaddress,          false,  false,    false },
+    { "getreceivedbyaddress",   &getreceivedbyaddress,   false,  false,    false },
+    { "getreceivedbyaccount",   &getreceivedbyaccount,   false,  false,    false },
+    { "listreceivedbyaddress",  &listreceivedbyaddress,  false,  false,    false },
+    { "listreceivedbyaccount",  &listreceivedbyaccount,  false,  false,    false },
+    { "backupwallet",           &backupwallet,           true,   false,    false },
+    { "keypoolrefill",          &keypoolrefill,          true,   false,    false },
+    { "walletpassphrase",       &walletpassphrase,       true,   false,    false },
+    { "walletpassphrasechange", &walletpassphrasechange, false,  false,    false },
+    { "walletlock",             &walletlock,             true,   false,    false },
+    { "encryptwallet",          &encryptwallet,          false,  false,    false },
+    { "validateaddress",        &validateaddress,        true,   false,    false },
+    { "validatepubkey",         &validatepubkey,         true,   false,    false },
+    { "fetchbalance",           &fetchbalance,           true,   false,    false },
+    { "getbalance",             &getbalance,             false,  false,    false },
+    { "move",                   &movecmd,                false,  false,    false },
+    { "sendfrom",               &sendfrom,               false,  false,    false },
+    { "sendmany",               &sendmany,               false,  false,    false },
+    { "addmultisigaddress",     &addmultisigaddress,     false,  false,    false },
+    { "addredeemscript",        &addredeemscript,        false,  false,    false },
+    { "getrawmempool",          &getrawmempool,          true,   false,    false },
+    { "getblock",               &getblock,               false,  false,    true },
+    { "getblock_old",           &getblock_old,           false,  false,    false },
+    { "getblockbynumber",       &getblockbynumber,       false,  false,    false },
+    { "getblockstats",          &getblockstats,          false,  false,    false },
+    { "getchainstats",          &getchainstats,          false,  false,    false },
+    { "getblockfilter",         &getblockfilter,         false,  false,    false },
+    { "getblockhash",           &getblockhash,           false,  false,    true },
+    { "gettransaction",         &gettransaction,         false,  false,    false },
+    { "listtransactions",       &listtransactions,       false,  false,    false },
+    { "listaddressgroupings",   &listaddressgroupings,   false,  false,    false },
+    { "signmessage",            &signmessage,            false,  false,    false },
+    { "verifymessage",          &verifymessage,          false,  false,    false },
+    { "getwork",                &getwork,                true,   false,    false },
+    { "getworkex",              &getworkex,              true,   false,    false },
+    { "listaccounts",           &listaccounts,           false,  false,    false },
+    { "settxfee",               &settxfee,               false,  false,    false },
+    { "getblocktemplate",       &getblocktemplate,       true,   false,    false },
+    { "submitblock",            &submitblock,            false,  false,    false },
+    { "listsinceblock",         &listsinceblock,         false,  false,    false },
+    { "dumpprivkey",            &dumpprivkey,            false,  false,    false },
+    { "dumpwallet",             &dumpwallet,             true,   false,    false },
+    { "importwallet",           &importwallet,           false,  false,    false },
+    { "importprivkey",          &importprivkey,          false,  false,    false },
+    { "listunspent",            &listunspent,            false,  false,    false },
+    { "getrawtransaction",      &getrawtransaction,      false,  false,    true },
+    { "createrawtransaction",   &createrawtransaction,   false,  false,    false },
+    { "decoderawtransaction",   &decoderawtransaction,   false,  false,    true },
+    { "createmultisig",         &createmultisig,         false,  false,    false },
+    { "decodescript",           &decodescript,           false,  false,    true },
+    { "signrawtransaction",     &signrawtransaction,     false,  false,    false },
+    { "sendrawtransaction",     &sendrawtransaction,     false,  false,    false },
+    { "searchrawtransactions",  &searchrawtransactions,  false,  false,    false },
+    { "getcheckpoint",          &getcheckpoint,          true,   false,    false },
+    { "reservebalance",         &reservebalance,         false,  true,     false },
+    { "checkwallet",            &checkwallet,            false,  true,     false },
+    { "repairwallet",           &repairwallet,           false,  true,     false },
+    { "resendtx",               &resendtx,               false,  true,     false },
+    { "makekeypair",            &makekeypair,            false,  true,     false },
+    { "sendalert",              &sendalert,              false,  false,    false },
+    { "gettxout",               &gettxout,               true,   false,    true },
+    { "importaddress",          &importaddress,          false,  false,    false },
+    { "importmulti",            &importmulti,            false,  false,    false },
+    { "rescanblockchain",       &rescanblockchain,       false,  false,    false },
+    { "getrescaninfo",          &getrescaninfo,          true,   false,    true },
+
+    { "getnewstealthaddress",   &getnewstealthaddress,   false,  false,    false },
+    { "liststealthaddresses",   &liststealthaddresses,   false,  false,    false },
+    { "importstealthaddress",   &importstealthaddress,   false,  false,    false },
+    { "sendtostealthaddress",   &sendtostealthaddress,   false,  false,    false },
+    { "clearwallettransactions",&clearwallettransactions,false,  false,    false },
+    { "scanforalltxns",         &scanforalltxns,         false,  false,    false },
+    { "scanforstealthtxns",     &scanforstealthtxns,     false,  false,    false },
 
     /* Masternode features */
-    { "getpoolinfo",            &getpoolinfo,            true,   false},
-    { "spork",                  &spork,                  true,   false},
-    { "masternode",             &masternode,             true,   false},
+    { "getpoolinfo",            &getpoolinfo,            true,   false,    false },
+    { "spork",                  &spork,                  true,   false,    false },
+    { "masternode",             &masternode,             true,   false,    false },
 
-    { "smsgenable",             &smsgenable,             false,  false},
-    { "smsgdisable",            &smsgdisable,            false,  false},
-    { "smsglocalkeys",          &smsglocalkeys,          false,  false},
-    { "smsgoptions",            &smsgoptions,            false,  false},
-    { "smsgscanchain",          &smsgscanchain,          false,  false},
-    { "smsgscanbuckets",        &smsgscanbuckets,        false,  false},
-    { "smsgaddkey",             &smsgaddkey,             false,  false},
-    { "smsggetpubkey",          &smsggetpubkey,          false,  false},
-    { "smsgsend",               &smsgsend,               false,  false},
-    { "smsgsendanon",           &smsgsendanon,           false,  false},
-    { "smsginbox",              &smsginbox,              false,  false},
-    { "smsgoutbox",             &smsgoutbox,             false,  false},
-    { "smsgbuckets",            &smsgbuckets,            false,  false},
+    { "smsgenable",             &smsgenable,             false,  false,    false },
+    { "smsgdisable",            &smsgdisable,            false,  false,    false },
+    { "smsglocalkeys",          &smsglocalkeys,          false,  false,    false },
+    { "smsgoptions",            &smsgoptions,            false,  false,    false },
+    { "smsgscanchain",          &smsgscanchain,          false,  false,    false },
+    { "smsgscanstatus",         &smsgscanstatus,         false,  false,    false },
+    { "smsgscanbuckets",        &smsgscanbuckets,        false,  false,    false },
+    { "smsgaddkey",             &smsgaddkey,             false,  false,    false },
+    { "smsggetpubkey",          &smsggetpubkey,          false,  false,    false },
+    { "smsgsend",               &smsgsend,               false,  false,    false },
+    { "smsgsendanon",           &smsgsendanon,           false,  false,    false },
+    { "smsgsendbatch",          &smsgsendbatch,          false,  true,     false },
+    { "smsginbox",              &smsginbox,              false,  false,    false },
+    { "smsgoutbox",             &smsgoutbox,             false,  false,    false },
+    { "smsgbuckets",            &smsgbuckets,            false,  false,    false },
 
 
 
@@ -966,6 +984,8 @@ void ThreadRPCServer2(void* parg)
         return;
     }
 
+    StartRPCWorkers();
+
     vnThreadsRunning[THREAD_RPCLISTENER]--;
     while (!fShutdown)
         io_service.run_one();
@@ -1014,13 +1034,15 @@ void JSONRequest::parse(const Value& valRequest)
         throw JSONRPCError(RPC_INVALID_REQUEST, "Params must be an array");
 }
 
-static Object JSONRPCExecOne(const Value& req)
+static Object JSONRPCExecOne(const Value& req, int64_t nDeadline)
 {
     Object rpc_result;
 
     JSONRequest jreq;
     try {
         jreq.parse(req);
+        if (GetTime() > nDeadline)
+            throw JSONRPCError(RPC_MISC_ERROR, "Batch time limit exceeded");
 
         Value result = tableRPC.execute(jreq.strMethod, jreq.params);
         rpc_result = JSONRPCReplyObj(result, Value::null, jreq.id);
@@ -1038,12 +1060,164 @@ static Object JSONRPCExecOne(const Value& req)
     return rpc_result;
 }
 
+//
+// Batches
+//
+// Consecutive requests for thread-safe commands are handed out to the
+// connection's thread and the RPC worker threads together; any other request
+// runs on its own in the connection's thread, after everything before it in
+// the batch and before everything after it.
+//
+
+class CRPCBatch
+{
+public:
+    const Array& vReq;
+    vector<Object> vResult;
+    int64_t nDeadline;
+
+    boost::mutex mutex;
+    boost::condition_variable condDone;
+    // the run of requests currently being executed in parallel
+    unsigned int nNext;
+    unsigned int nEnd;
+    unsigned int nDone;
+
+    CRPCBatch(const Array& vReqIn, int64_t nDeadlineIn) : vReq(vReqIn), vResult(vReqIn.size()), nDeadline(nDeadlineIn)
+    {
+        nNext = nEnd = nDone = 0;
+    }
+};
+
+static boost::mutex mutexRPCWorkers;
+static boost::condition_variable condRPCWorkers;
+static deque<boost::shared_ptr<CRPCBatch> > queueRPCWorkers;
+static int nRPCWorkers = 0;
+
+// Execute requests of the batch's current run until none are left to claim
+static void ExecBatchRun(CRPCBatch& batch)
+{
+    while (true)
+    {
+        unsigned int nIdx;
+        {
+            boost::unique_lock<boost::mutex> lock(batch.mutex);
+            if (batch.nNext >= batch.nEnd)
+                return;
+            nIdx = batch.nNext++;
+        }
+
+        Object result = JSONRPCExecOne(batch.vReq[nIdx], batch.nDeadline);
+
+        boost::unique_lock<boost::mutex> lock(batch.mutex);
+        batch.vResult[nIdx] = result;
+        if (++batch.nDone == batch.nEnd)
+            batch.condDone.notify_all();
+    }
+}
+
+static void ThreadRPCWorker(void* parg)
+{
+    // Make this thread recognisable as an RPC batch worker
+    RenameThread("AveroPay-rpcwork");
+
+    while (true)
+    {
+        boost::shared_ptr<CRPCBatch> pbatch;
+        {
+            boost::unique_lock<boost::mutex> lock(mutexRPCWorkers);
+            while (queueRPCWorkers.empty() && !fShutdown)
+                condRPCWorkers.timed_wait(lock, boost::posix_time::milliseconds(500));
+            if (fShutdown)
+                break;
+            pbatch = queueRPCWorkers.front();
+            queueRPCWorkers.pop_front();
+        }
+        try
+        {
+            ExecBatchRun(*pbatch);
+        }
+        catch (std::exception& e) {
+            PrintException(&e, "ThreadRPCWorker()");
+        }
+    }
+
+    boost::unique_lock<boost::mutex> lock(mutexRPCWorkers);
+    nRPCWorkers--;
+}
+
+static void StartRPCWorkers()
+{
+    int nThreads = GetArg("-rpcbatchthreads", 4);
+    for (int i = 0; i < nThreads; i++)
+    {
+        if (!NewThread(ThreadRPCWorker, NULL))
+        {
+            printf("Error: NewThread(ThreadRPCWorker) failed\n");
+            break;
+        }
+        boost::unique_lock<boost::mutex> lock(mutexRPCWorkers);
+        nRPCWorkers++;
+    }
+}
+
+static bool IsThreadSafeRequest(const Value& req)
+{
+    if (req.type() != obj_type)
+        return false;
+    const Value& valMethod = find_value(req.get_obj(), "method");
+    if (valMethod.type() != str_type)
+        return false;
+    const CRPCCommand* pcmd = tableRPC[valMethod.get_str()];
+    return pcmd && pcmd->threadSafe;
+}
+
 static string JSONRPCExecBatch(const Array& vReq)
 {
-    Array ret;
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    unsigned int nLimit = GetArg("-rpcbatchlimit", 1000);
+    if (vReq.size() > nLimit)
+        throw JSONRPCError(RPC_INVALID_REQUEST, strprintf("Batch of %" PRIszu" requests exceeds the limit of %u", vReq.size(), nLimit));
+
+    boost::shared_ptr<CRPCBatch> pbatch(new CRPCBatch(vReq, GetTime() + GetArg("-rpcbatchtimeout", 60)));
+    CRPCBatch& batch = *pbatch;
+
+    unsigned int reqIdx = 0;
+    while (reqIdx < vReq.size())
+    {
+        unsigned int nEnd = reqIdx;
+        while (nEnd < vReq.size() && IsThreadSafeRequest(vReq[nEnd]))
+            nEnd++;
+
+        if (nEnd - reqIdx < 2)
+        {
+            batch.vResult[reqIdx] = JSONRPCExecOne(vReq[reqIdx], batch.nDeadline);
+            reqIdx++;
+            continue;
+        }
+
+        {
+            boost::unique_lock<boost::mutex> lock(batch.mutex);
+            batch.nNext = batch.nDone = reqIdx;
+            batch.nEnd = nEnd;
+        }
+        {
+            // Workers that come too late find nothing left to claim
+            boost::unique_lock<boost::mutex> lock(mutexRPCWorkers);
+            for (int i = 0; i < nRPCWorkers && i < (int)(nEnd - reqIdx) - 1; i++)
+                queueRPCWorkers.push_back(pbatch);
+        }
+        condRPCWorkers.notify_all();
+
+        ExecBatchRun(batch);
+        {
+            boost::unique_lock<boost::mutex> lock(batch.mutex);
+            while (batch.nDone < batch.nEnd)
+                batch.condDone.wait(lock);
+        }
+        reqIdx = nEnd;
+    }
 
+    Array ret(batch.vResult.begin(), batch.vResult.end());
     return write_string(Value(ret), false) + "\n";
 }
 
@@ -1163,7 +1337,7 @@ json_spirit::Value CRPCTable::execute(const std::string &strMethod, const json_s
         // Execute
         Value result;
         {
-            if (pcmd->unlocked)
+            if (pcmd->unlocked || pcmd->threadSafe)
                 result = pcmd->actor(params, false);
             else {
                 LOCK2(cs_main, pwalletMain->cs_wallet);
@@ -1287,8 +1461,13 @@ Array RPCConvertValues(const std::string &strMethod, const std::vector<std::stri
     if (strMethod == "getblock_old"           && n > 1) ConvertTo<bool>(params[1]);
     if (strMethod == "getblockbynumber"       && n > 0) ConvertTo<int64_t>(params[0]);
     if (strMethod == "getblockbynumber"       && n > 1) ConvertTo<bool>(params[1]);
+    if (strMethod == "getblockstats"          && n > 1) ConvertTo<int64_t>(params[1]);
+    if (strMethod == "getchainstats"          && n > 0) ConvertTo<int64_t>(params[0]);
+    if (strMethod == "getchainstats"          && n > 1) ConvertTo<int64_t>(params[1]);
+    if (strMethod == "getchainstats"          && n > 2) ConvertTo<int64_t>(params[2]);
     if (strMethod == "getblockhash"           && n > 0) ConvertTo<int64_t>(params[0]);
     if (strMethod == "dumpbootstrap"          && n > 1) ConvertTo<int64_t>(params[1]);
+    if (strMethod == "dumpbootstrap"          && n > 2) ConvertTo<bool>(params[2]);
     if (strMethod == "move"                   && n > 2) ConvertTo<double>(params[2]);
     if (strMethod == "move"                   && n > 3) ConvertTo<int64_t>(params[3]);
     if (strMethod == "sendfrom"               && n > 2) ConvertTo<double>(params[2]);
@@ -1328,10 +1507,18 @@ Array RPCConvertValues(const std::string &strMethod, const std::vector<std::stri
     if (strMethod == "gettxout"               && n == 2) ConvertTo<int64_t>(params[1]);
     if (strMethod == "gettxout"               && n == 3) { ConvertTo<int64_t>(params[1]); ConvertTo<bool>(params[2]); }
     if (strMethod == "importaddress"          && n > 2) ConvertTo<bool>(params[2]);
+    if (strMethod == "importmulti"            && n > 0) ConvertTo<Array>(params[0]);
+    if (strMethod == "importmulti"            && n > 1) ConvertTo<bool>(params[1]);
+    if (strMethod == "rescanblockchain"       && n > 0) ConvertTo<int>(params[0]);
 
     if (strMethod == "sendtostealthaddress"   && n > 1) ConvertTo<double>(params[1]);
 
     if (strMethod == "getpoolinfo"            && n > 0) ConvertTo<int64_t>(params[0]);
+    if (strMethod == "setmocktime"            && n > 0) ConvertTo<int64_t>(params[0]);
+    if (strMethod == "generate"               && n > 0) ConvertTo<int64_t>(params[0]);
+    if (strMethod == "generate"               && n > 1) ConvertTo<bool>(params[1]);
+    if (strMethod == "smsgsendbatch"          && n > 1) ConvertTo<Array>(params[1]);
+    if (strMethod == "smsgscanchain"          && n > 0) ConvertTo<bool>(params[0]);
 
     if (strMethod == "addmultisigaddress"     && n > 0) ConvertTo<int64_t>(params[0]);
     if (strMethod == "addmultisigaddress"     && n > 1) ConvertTo<Array>(params[1]);
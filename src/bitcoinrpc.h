@@ -97,6 +97,9 @@ public:
     rpcfn_type actor;
     bool okSafeMode;
     bool unlocked;
+    // Read-only and takes whatever locks it needs itself: runs without
+    // cs_main/cs_wallet and may run concurrently within a batch
+    bool threadSafe;
 };
 
 /**
@@ -153,11 +156,14 @@ extern json_spirit::Value dumpprivkey(const json_spirit::Array& params, bool fHe
 extern json_spirit::Value importprivkey(const json_spirit::Array& params, bool fHelp);
 
 extern json_spirit::Value sendalert(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getmemoryinfo(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value setmocktime(const json_spirit::Array& params, bool fHelp);
 
 extern json_spirit::Value getsubsidy(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getmininginfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value gethashespersec(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getstakinginfo(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value generate(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getwork(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getworkex(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblocktemplate(const json_spirit::Array& params, bool fHelp);
@@ -217,15 +223,22 @@ extern json_spirit::Value getbestblockhash(const json_spirit::Array& params, boo
 extern json_spirit::Value getblockcount(const json_spirit::Array& params, bool fHelp); // in rpcblockchain.cpp
 extern json_spirit::Value getdifficulty(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value dumpbootstrap(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getbootstrapinfo(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value settxfee(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getrawmempool(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblockhash(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblock(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblock_old(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getblockbynumber(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getblockstats(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getchainstats(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getblockfilter(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value getcheckpoint(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value gettxout(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value importaddress(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value importmulti(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value rescanblockchain(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value getrescaninfo(const json_spirit::Array& params, bool fHelp);
 
 extern json_spirit::Value getnewstealthaddress(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value liststealthaddresses(const json_spirit::Array& params, bool fHelp);
@@ -245,11 +258,13 @@ extern json_spirit::Value smsgdisable(const json_spirit::Array& params, bool fHe
 extern json_spirit::Value smsglocalkeys(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value smsgoptions(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value smsgscanchain(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value smsgscanstatus(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value smsgscanbuckets(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value smsgaddkey(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value smsggetpubkey(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value smsgsend(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value smsgsendanon(const json_spirit::Array& params, bool fHelp);
+extern json_spirit::Value smsgsendbatch(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value smsginbox(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value smsgoutbox(const json_spirit::Array& params, bool fHelp);
 extern json_spirit::Value smsgbuckets(const json_spirit::Array& params, bool fHelp);
@@ -0,0 +1,522 @@
+// Copyright (c) 2018 The AveroPay developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilter.h"
+#include "hash.h"
+#include "main.h"
+#include "txdb.h"
+#include "ui_interface.h"
+#include "util.h"
+
+#include <algorithm>
+
+#include <boost/filesystem.hpp>
+#include <boost/foreach.hpp>
+
+#include <leveldb/db.h>
+#include <leveldb/write_batch.h>
+
+using namespace std;
+
+CBlockFilterIndex blockFilterIndex;
+
+// Bits are written and read most significant first, as BIP 158 specifies
+class CBitWriter
+{
+private:
+    vector<unsigned char>& vch;
+    int nBit;
+
+public:
+    CBitWriter(vector<unsigned char>& vchIn) : vch(vchIn), nBit(0) {}
+
+    void WriteBit(bool fBit)
+    {
+        if (nBit == 0)
+            vch.push_back(0);
+        if (fBit)
+            vch.back() |= 0x80 >> nBit;
+        nBit = (nBit + 1) & 7;
+    }
+
+    void WriteBits(uint64_t n, int nCount)
+    {
+        for (int i = nCount - 1; i >= 0; i--)
+            WriteBit((n >> i) & 1);
+    }
+
+    void WriteGolombRice(uint64_t n, int nP)
+    {
+        for (uint64_t q = n >> nP; q > 0; q--)
+            WriteBit(true);
+        WriteBit(false);
+        WriteBits(n, nP);
+    }
+};
+
+class CBitReader
+{
+private:
+    const vector<unsigned char>& vch;
+    size_t nPos;
+
+public:
+    CBitReader(const vector<unsigned char>& vchIn, size_t nStart) : vch(vchIn), nPos(nStart * 8) {}
+
+    bool ReadBit(bool& fBit)
+    {
+        if (nPos / 8 >= vch.size())
+            return false;
+        fBit = (vch[nPos / 8] & (0x80 >> (nPos % 8))) != 0;
+        nPos++;
+        return true;
+    }
+
+    bool ReadGolombRice(uint64_t& n, int nP)
+    {
+        uint64_t q = 0;
+        bool fBit;
+        while (true)
+        {
+            if (!ReadBit(fBit))
+                return false;
+            if (!fBit)
+                break;
+            q++;
+        }
+        n = q;
+        for (int i = 0; i < nP; i++)
+        {
+            if (!ReadBit(fBit))
+                return false;
+            n = (n << 1) | (fBit ? 1 : 0);
+        }
+        return true;
+    }
+};
+
+// (x * n) >> 64 without 128-bit integers
+static uint64_t MapIntoRange(uint64_t x, uint64_t n)
+{
+    uint64_t x_hi = x >> 32, x_lo = x & 0xFFFFFFFF;
+    uint64_t n_hi = n >> 32, n_lo = n & 0xFFFFFFFF;
+
+    uint64_t lo_lo = x_lo * n_lo;
+    uint64_t hi_lo = x_hi * n_lo;
+    uint64_t lo_hi = x_lo * n_hi;
+    uint64_t hi_hi = x_hi * n_hi;
+
+    uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+    return (hi_lo >> 32) + (cross >> 32) + hi_hi;
+}
+
+// Offset of the bit stream, after the element count
+static size_t GetBitStreamStart(const vector<unsigned char>& vch, uint64_t& nElementsRet)
+{
+    CDataStream ss(vch, SER_NETWORK, PROTOCOL_VERSION);
+    nElementsRet = ReadCompactSize(ss);
+    return vch.size() - ss.size();
+}
+
+CBlockFilter::CBlockFilter() : nElements(0)
+{
+}
+
+CBlockFilter::CBlockFilter(const uint256& hashBlockIn, const ElementSet& setElements) : hashBlock(hashBlockIn), nElements(setElements.size())
+{
+    vector<uint64_t> vHashes;
+    vHashes.reserve(setElements.size());
+    BOOST_FOREACH(const Element& element, setElements)
+        vHashes.push_back(HashToRange(element));
+    sort(vHashes.begin(), vHashes.end());
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(ss, nElements);
+    vchEncoded.assign(ss.begin(), ss.end());
+
+    CBitWriter writer(vchEncoded);
+    uint64_t nLast = 0;
+    BOOST_FOREACH(uint64_t nHash, vHashes)
+    {
+        writer.WriteGolombRice(nHash - nLast, P);
+        nLast = nHash;
+    }
+}
+
+CBlockFilter::CBlockFilter(const uint256& hashBlockIn, const vector<unsigned char>& vchEncodedIn) : hashBlock(hashBlockIn), vchEncoded(vchEncodedIn)
+{
+    GetBitStreamStart(vchEncoded, nElements);
+}
+
+void CBlockFilter::GetBasicElements(const CBlock& block, const vector<CScript>& vSpentScripts, ElementSet& setElements)
+{
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+    {
+        BOOST_FOREACH(const CTxOut& txout, tx.vout)
+        {
+            const CScript& script = txout.scriptPubKey;
+            if (script.empty() || script[0] == OP_RETURN)
+                continue;
+            setElements.insert(Element(script.begin(), script.end()));
+        }
+    }
+
+    BOOST_FOREACH(const CScript& script, vSpentScripts)
+    {
+        if (script.empty())
+            continue;
+        setElements.insert(Element(script.begin(), script.end()));
+    }
+}
+
+uint64_t CBlockFilter::HashToRange(const Element& element) const
+{
+    static const unsigned char chEmpty = 0;
+    uint64_t nHash = SipHash(hashBlock.Get64(0), hashBlock.Get64(1), element.empty() ? &chEmpty : &element[0], element.size());
+    return MapIntoRange(nHash, nElements * M);
+}
+
+bool CBlockFilter::MatchSorted(const vector<uint64_t>& vQuery) const
+{
+    uint64_t nCount;
+    CBitReader reader(vchEncoded, GetBitStreamStart(vchEncoded, nCount));
+
+    uint64_t nValue = 0;
+    vector<uint64_t>::const_iterator it = vQuery.begin();
+    for (uint64_t i = 0; i < nCount && it != vQuery.end(); i++)
+    {
+        uint64_t nDelta;
+        if (!reader.ReadGolombRice(nDelta, P))
+            return false;
+        nValue += nDelta;
+
+        while (it != vQuery.end() && *it < nValue)
+            ++it;
+        if (it != vQuery.end() && *it == nValue)
+            return true;
+    }
+    return false;
+}
+
+bool CBlockFilter::Match(const Element& element) const
+{
+    if (nElements == 0)
+        return false;
+    return MatchSorted(vector<uint64_t>(1, HashToRange(element)));
+}
+
+bool CBlockFilter::MatchAny(const ElementSet& setElements) const
+{
+    if (nElements == 0 || setElements.empty())
+        return false;
+    vector<uint64_t> vQuery;
+    vQuery.reserve(setElements.size());
+    BOOST_FOREACH(const Element& element, setElements)
+        vQuery.push_back(HashToRange(element));
+    sort(vQuery.begin(), vQuery.end());
+    return MatchSorted(vQuery);
+}
+
+uint256 CBlockFilter::GetHash() const
+{
+    return Hash(vchEncoded.begin(), vchEncoded.end());
+}
+
+uint256 CBlockFilter::ComputeHeader(const uint256& hashPrevHeader) const
+{
+    uint256 hashFilter = GetHash();
+    return Hash(BEGIN(hashFilter), END(hashFilter), BEGIN(hashPrevHeader), END(hashPrevHeader));
+}
+
+
+
+
+//
+// CBlockFilterIndex
+//
+
+template<typename K>
+static string SerializeKey(const K& key)
+{
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey << key;
+    return ssKey.str();
+}
+
+CBlockFilterIndex::CBlockFilterIndex()
+{
+    pdb = NULL;
+    pindexBest = NULL;
+    fSynced = false;
+    fRunning = false;
+    fStopping = false;
+}
+
+bool CBlockFilterIndex::Open(bool fWipe, string& strError)
+{
+    AssertLockHeld(cs_main);
+
+    boost::filesystem::path directory = GetDataDir() / "blockfilter";
+    if (fWipe)
+    {
+        printf("Wiping block filter index in %s\n", directory.string().c_str());
+        boost::filesystem::remove_all(directory);
+    }
+    boost::filesystem::create_directory(directory);
+
+    leveldb::Options options;
+    options.create_if_missing = true;
+    options.max_open_files = 64;
+    leveldb::Status status = leveldb::DB::Open(options, directory.string(), &pdb);
+    if (!status.ok())
+    {
+        pdb = NULL;
+        strError = strprintf(_("Error opening block filter index: %s"), status.ToString().c_str());
+        return false;
+    }
+
+    // Carry on from the last block written; if it's not in the block index
+    // any more the thread starts over from the genesis block
+    pindexBest = NULL;
+    fSynced = false;
+    string strValue;
+    if (pdb->Get(leveldb::ReadOptions(), SerializeKey(string("best")), &strValue).ok())
+    {
+        uint256 hashBest;
+        CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+        ssValue >> hashBest;
+        BlockMap::iterator mi = mapBlockIndex.find(hashBest);
+        if (mi != mapBlockIndex.end())
+            pindexBest = (*mi).second;
+    }
+    printf("Block filter index opened in %s, best height %d\n", directory.string().c_str(), pindexBest ? pindexBest->nHeight : -1);
+    return true;
+}
+
+void CBlockFilterIndex::Close()
+{
+    Stop();
+    delete pdb;
+    pdb = NULL;
+    pindexBest = NULL;
+    fSynced = false;
+}
+
+bool CBlockFilterIndex::WriteBest(const CBlockIndex* pindex)
+{
+    pindexBest = pindex;
+    if (!pindex)
+        return pdb->Delete(leveldb::WriteOptions(), SerializeKey(string("best"))).ok();
+
+    CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+    ssValue << pindex->GetBlockHash();
+    leveldb::Status status = pdb->Put(leveldb::WriteOptions(), SerializeKey(string("best")), ssValue.str());
+    if (!status.ok())
+        return error("CBlockFilterIndex::WriteBest() : %s", status.ToString().c_str());
+    return true;
+}
+
+bool CBlockFilterIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex, const vector<CScript>& vSpentScripts)
+{
+    uint256 hashPrevHeader = 0;
+    if (pindex->pprev)
+    {
+        CBlockFilterEntry entryPrev;
+        if (!LookupEntry(pindex->pprev, entryPrev))
+            return error("CBlockFilterIndex::WriteBlock() : no entry for the previous block of %s", pindex->GetBlockHash().ToString().c_str());
+        hashPrevHeader = entryPrev.hashHeader;
+    }
+
+    CBlockFilter::ElementSet setElements;
+    CBlockFilter::GetBasicElements(block, vSpentScripts, setElements);
+    CBlockFilter filter(pindex->GetBlockHash(), setElements);
+
+    CBlockFilterEntry entry;
+    entry.vchFilter = filter.GetEncoded();
+    entry.hashFilter = filter.GetHash();
+    entry.hashHeader = filter.ComputeHeader(hashPrevHeader);
+
+    // The entry and the new best block go in together
+    CDataStream ssEntry(SER_DISK, CLIENT_VERSION);
+    ssEntry << entry;
+    CDataStream ssBest(SER_DISK, CLIENT_VERSION);
+    ssBest << pindex->GetBlockHash();
+    leveldb::WriteBatch batch;
+    batch.Put(SerializeKey(make_pair(string("filter"), pindex->GetBlockHash())), ssEntry.str());
+    batch.Put(SerializeKey(string("best")), ssBest.str());
+    leveldb::Status status = pdb->Write(leveldb::WriteOptions(), &batch);
+    if (!status.ok())
+        return error("CBlockFilterIndex::WriteBlock() : %s", status.ToString().c_str());
+
+    pindexBest = pindex;
+    return true;
+}
+
+void CBlockFilterIndex::BlockConnected(const CBlock& block, const CBlockIndex* pindex, const vector<CScript>& vSpentScripts)
+{
+    AssertLockHeld(cs_main);
+    if (!pdb || pindexBest != pindex->pprev || !pindex->pprev)
+        return;
+
+    if (!WriteBlock(block, pindex, vSpentScripts))
+    {
+        // leave it to the thread
+        fSynced = false;
+        boost::unique_lock<boost::mutex> lock(mutex);
+        condWake.notify_all();
+    }
+}
+
+void CBlockFilterIndex::BlockDisconnected(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (!pdb || pindexBest != pindex)
+        return;
+    WriteBest(pindex->pprev);
+}
+
+bool CBlockFilterIndex::LookupEntry(const CBlockIndex* pindex, CBlockFilterEntry& entry) const
+{
+    if (!pdb)
+        return false;
+
+    string strValue;
+    if (!pdb->Get(leveldb::ReadOptions(), SerializeKey(make_pair(string("filter"), pindex->GetBlockHash())), &strValue).ok())
+        return false;
+    try {
+        CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+        ssValue >> entry;
+    }
+    catch (std::exception &e) {
+        return error("CBlockFilterIndex::LookupEntry() : deserialize failed for %s", pindex->GetBlockHash().ToString().c_str());
+    }
+    return true;
+}
+
+bool CBlockFilterIndex::LookupFilter(const CBlockIndex* pindex, CBlockFilter& filter) const
+{
+    CBlockFilterEntry entry;
+    if (!LookupEntry(pindex, entry))
+        return false;
+    filter = CBlockFilter(pindex->GetBlockHash(), entry.vchFilter);
+    return true;
+}
+
+bool CBlockFilterIndex::SyncNext(bool& fCaughtUp)
+{
+    LOCK(cs_main);
+    fCaughtUp = false;
+
+    // Step back to the main chain if the best block was reorganised away
+    if (pindexBest && !chainActive.Contains(pindexBest))
+    {
+        const CBlockIndex* pindexFork = pindexBest;
+        while (pindexFork && !chainActive.Contains(pindexFork))
+            pindexFork = pindexFork->pprev;
+        printf("CBlockFilterIndex : rewinding from height %d to %d\n", pindexBest->nHeight, pindexFork ? pindexFork->nHeight : -1);
+        if (!WriteBest(pindexFork))
+            return false;
+    }
+
+    const CBlockIndex* pindex = chainActive[pindexBest ? pindexBest->nHeight + 1 : 0];
+    if (!pindex)
+    {
+        if (!fSynced)
+            printf("CBlockFilterIndex : synced to height %d\n", pindexBest ? pindexBest->nHeight : -1);
+        fSynced = true;
+        fCaughtUp = true;
+        return true;
+    }
+
+    CBlock block;
+    if (!block.ReadFromDisk(pindex, true))
+        return error("CBlockFilterIndex::SyncNext() : ReadFromDisk failed for block %s", pindex->GetBlockHash().ToString().c_str());
+
+    // The scripts the block spends, the way GetBlockStats() fetches them
+    CTxDB txdb("r");
+    map<uint256, CTxIndex> mapUnused;
+    vector<CScript> vSpentScripts;
+    BOOST_FOREACH(CTransaction& tx, block.vtx)
+    {
+        if (tx.IsCoinBase())
+            continue;
+        MapPrevTx mapInputs;
+        bool fInvalid;
+        if (!tx.FetchInputs(txdb, mapUnused, true, false, mapInputs, fInvalid))
+            return error("CBlockFilterIndex::SyncNext() : FetchInputs failed for tx %s", tx.GetHash().ToString().c_str());
+        BOOST_FOREACH(const CTxIn& txin, tx.vin)
+            vSpentScripts.push_back(mapInputs[txin.prevout.hash].second.vout[txin.prevout.n].scriptPubKey);
+    }
+
+    if (!WriteBlock(block, pindex, vSpentScripts))
+        return false;
+    if (pindex->nHeight % 10000 == 0)
+        printf("CBlockFilterIndex : indexed height %d\n", pindex->nHeight);
+    return true;
+}
+
+void CBlockFilterIndex::ThreadMain()
+{
+    while (true)
+    {
+        bool fCaughtUp = false;
+        bool fOk = SyncNext(fCaughtUp);
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (fStopping)
+            break;
+        // Once caught up ConnectBlock keeps the index current; look again now
+        // and then in case it missed a block. After an error, back off.
+        if (!fOk || fCaughtUp)
+            condWake.timed_wait(lock, boost::posix_time::seconds(fOk ? 10 : 60));
+        if (fStopping)
+            break;
+    }
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fRunning = false;
+    condWake.notify_all();
+}
+
+static void ThreadBlockFilterIndex(void* parg)
+{
+    RenameThread("AveroPay-blkfilter");
+
+    try
+    {
+        blockFilterIndex.ThreadMain();
+    }
+    catch (std::exception& e) {
+        PrintException(&e, "ThreadBlockFilterIndex()");
+    }
+    printf("ThreadBlockFilterIndex exited\n");
+}
+
+void CBlockFilterIndex::Start()
+{
+    if (!pdb)
+        return;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (fRunning)
+            return;
+        fRunning = true;
+        fStopping = false;
+    }
+    if (!NewThread(ThreadBlockFilterIndex, NULL))
+    {
+        printf("Error: NewThread(ThreadBlockFilterIndex) failed\n");
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fRunning = false;
+    }
+}
+
+void CBlockFilterIndex::Stop()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fStopping = true;
+    condWake.notify_all();
+    while (fRunning)
+        condWake.wait(lock);
+}
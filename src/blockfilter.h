@@ -0,0 +1,159 @@
+// Copyright (c) 2018 The AveroPay developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_BLOCKFILTER_H
+#define BITCOIN_BLOCKFILTER_H
+
+#include "serialize.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <stdint.h>
+
+class CBlock;
+class CBlockIndex;
+class CScript;
+
+namespace leveldb {
+class DB;
+}
+
+/** The only filter type, see BIP 158 */
+static const unsigned char BLOCK_FILTER_BASIC = 0;
+
+/** Most blocks a getcfilters request may cover */
+static const int MAX_GETCFILTERS_SIZE = 1000;
+/** Most blocks a getcfheaders request may cover */
+static const int MAX_GETCFHEADERS_SIZE = 2000;
+/** Distance between the headers of a cfcheckpt message */
+static const int CFCHECKPT_INTERVAL = 1000;
+
+/** Golomb-coded set of the scripts a block creates and spends (BIP 158 basic filter).
+ *
+ * Each element is hashed with SipHash keyed by the block hash into the range
+ * [0, N * M), the hashes are sorted and their differences stored with
+ * Golomb-Rice coding using parameter P. A light client can test its own
+ * scripts against the filter and only fetch the blocks that match, with a
+ * false positive rate of about 1/M per script.
+ */
+class CBlockFilter
+{
+public:
+    static const int P = 19;
+    static const uint64_t M = 784931;
+
+    typedef std::vector<unsigned char> Element;
+    typedef std::set<Element> ElementSet;
+
+private:
+    uint256 hashBlock;
+    uint64_t nElements;
+    std::vector<unsigned char> vchEncoded;
+
+    uint64_t HashToRange(const Element& element) const;
+    bool MatchSorted(const std::vector<uint64_t>& vQuery) const;
+
+public:
+    CBlockFilter();
+    /** Build the filter of a set of elements */
+    CBlockFilter(const uint256& hashBlockIn, const ElementSet& setElements);
+    /** Take an encoded filter as received from the network or the index */
+    CBlockFilter(const uint256& hashBlockIn, const std::vector<unsigned char>& vchEncodedIn);
+
+    /** The basic filter's elements: every output script of the block except
+     * empty and OP_RETURN ones, and the non-empty output scripts it spends. */
+    static void GetBasicElements(const CBlock& block, const std::vector<CScript>& vSpentScripts, ElementSet& setElements);
+
+    const uint256& GetBlockHash() const { return hashBlock; }
+    uint64_t GetElementCount() const { return nElements; }
+    const std::vector<unsigned char>& GetEncoded() const { return vchEncoded; }
+
+    bool Match(const Element& element) const;
+    bool MatchAny(const ElementSet& setElements) const;
+
+    /** Double SHA256 of the encoded filter */
+    uint256 GetHash() const;
+    /** The filter header commits to this filter and every earlier one */
+    uint256 ComputeHeader(const uint256& hashPrevHeader) const;
+};
+
+/** What the filter index keeps per block */
+class CBlockFilterEntry
+{
+public:
+    std::vector<unsigned char> vchFilter;
+    uint256 hashFilter;
+    uint256 hashHeader;
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(vchFilter);
+        READWRITE(hashFilter);
+        READWRITE(hashHeader);
+    )
+};
+
+/** Optional index of basic block filters (-blockfilterindex).
+ *
+ * It lives in its own LevelDB in <datadir>/blockfilter so it can be dropped
+ * and rebuilt without touching the txdb. Entries are keyed by block hash; a
+ * filter and its header only depend on the block and its ancestors, so a
+ * disconnected block's entry stays valid and DisconnectBlock only has to move
+ * the index's best block back.
+ *
+ * ConnectBlock adds the entry of each block that extends the index's best
+ * block, using the spent scripts it has fetched anyway. Everything else (the
+ * genesis block, a new index, blocks missed after a failed reorganisation) is
+ * filled in from the blk*.dat files by a background thread. All of the state
+ * below is guarded by cs_main.
+ */
+class CBlockFilterIndex
+{
+private:
+    leveldb::DB* pdb;
+    const CBlockIndex* pindexBest;
+    bool fSynced;
+
+    boost::mutex mutex;
+    boost::condition_variable condWake;
+    bool fRunning;
+    bool fStopping;
+
+    bool WriteBest(const CBlockIndex* pindex);
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex, const std::vector<CScript>& vSpentScripts);
+    bool SyncNext(bool& fCaughtUp);
+
+public:
+    CBlockFilterIndex();
+
+    /** Open or create the index, wiping it first if fWipe. Call after the
+     * block index is loaded. */
+    bool Open(bool fWipe, std::string& strError);
+    void Close();
+    bool IsEnabled() const { return pdb != NULL; }
+    /** True once the index has caught up with the chain */
+    bool IsSynced() const { return fSynced; }
+    const CBlockIndex* GetBest() const { return pindexBest; }
+
+    void BlockConnected(const CBlock& block, const CBlockIndex* pindex, const std::vector<CScript>& vSpentScripts);
+    void BlockDisconnected(const CBlockIndex* pindex);
+
+    bool LookupEntry(const CBlockIndex* pindex, CBlockFilterEntry& entry) const;
+    bool LookupFilter(const CBlockIndex* pindex, CBlockFilter& filter) const;
+
+    /** Start the thread that catches the index up with the chain */
+    void Start();
+    void Stop();
+    void ThreadMain();
+};
+
+extern CBlockFilterIndex blockFilterIndex;
+
+#endif
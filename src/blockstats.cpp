@@ -0,0 +1,200 @@
+// Copyright (c) 2018 The AveroPay developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockstats.h"
+#include "main.h"
+#include "txdb.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <boost/foreach.hpp>
+
+using namespace std;
+
+const int BLOCKSTATS_PERCENTILES[CBlockStats::NUM_PERCENTILES] = { 10, 25, 50, 75, 90 };
+
+void CBlockStats::SetNull()
+{
+    nVersion = CBlockStats::CURRENT_VERSION;
+    nHeight = 0;
+    nTime = 0;
+    nTimeDelta = 0;
+    nBits = 0;
+    fProofOfStake = false;
+    nTxCount = 0;
+    nSize = 0;
+    nFeeTxSize = 0;
+    nTotalFees = 0;
+    for (int i = 0; i < NUM_PERCENTILES; i++)
+        nFeeRatePercentiles[i] = 0;
+    nStakeAmount = 0;
+    nMasternodePayout = 0;
+    nMint = 0;
+}
+
+// The masternode's share is the last output of the coinbase (proof-of-work)
+// or coinstake (proof-of-stake), see CreateNewBlock and CreateCoinStake.
+static int64_t GetMasternodePayout(const CBlock& block, int nHeight)
+{
+    if (nHeight <= GetMasternodePaymentsStartBlock())
+        return 0;
+
+    if (block.IsProofOfStake())
+    {
+        const CTransaction& txCoinStake = block.vtx[1];
+        return txCoinStake.vout.size() > 2 ? txCoinStake.vout.back().nValue : 0;
+    }
+
+    const CTransaction& txCoinBase = block.vtx[0];
+    return txCoinBase.vout.size() > 1 ? txCoinBase.vout.back().nValue : 0;
+}
+
+void CBlockStats::Set(const CBlock& block, const CBlockIndex* pindex, int64_t nFees, int64_t nStakeAmountIn,
+                      vector<pair<int64_t, unsigned int> >& vFeeRates)
+{
+    SetNull();
+    nHeight = pindex->nHeight;
+    nTime = block.GetBlockTime();
+    nTimeDelta = pindex->pprev ? nTime - pindex->pprev->GetBlockTime() : 0;
+    nBits = block.nBits;
+    fProofOfStake = block.IsProofOfStake();
+    nTxCount = block.vtx.size();
+    nSize = block.GetBlockSize();
+    nTotalFees = nFees;
+    nStakeAmount = nStakeAmountIn;
+    nMasternodePayout = GetMasternodePayout(block, pindex->nHeight);
+    nMint = pindex->nMint;
+
+    uint64_t nTotalSize = 0;
+    for (unsigned int i = 0; i < vFeeRates.size(); i++)
+        nTotalSize += vFeeRates[i].second;
+    nFeeTxSize = nTotalSize;
+    if (nTotalSize == 0)
+        return;
+
+    // Each percentile is the fee rate of the transaction holding that byte
+    // of the sorted fee paying transactions
+    sort(vFeeRates.begin(), vFeeRates.end());
+    uint64_t nCumulativeSize = 0;
+    int nPercentile = 0;
+    for (unsigned int i = 0; i < vFeeRates.size() && nPercentile < NUM_PERCENTILES; i++)
+    {
+        nCumulativeSize += vFeeRates[i].second;
+        while (nPercentile < NUM_PERCENTILES && nCumulativeSize * 100 >= nTotalSize * BLOCKSTATS_PERCENTILES[nPercentile])
+            nFeeRatePercentiles[nPercentile++] = vFeeRates[i].first;
+    }
+}
+
+bool GetBlockStats(CTxDB& txdb, const CBlockIndex* pindex, CBlockStats& stats)
+{
+    uint256 hash = pindex->GetBlockHash();
+    if (txdb.ReadBlockStats(hash, stats))
+        return true;
+
+    // Connected before the stats were kept: work them out from the block on
+    // disk, the same way ConnectBlock does
+    CBlock block;
+    if (!block.ReadFromDisk(pindex, true))
+        return error("GetBlockStats() : ReadFromDisk failed for block %s", hash.ToString().c_str());
+
+    int64_t nFees = 0;
+    int64_t nStakeAmount = 0;
+    vector<pair<int64_t, unsigned int> > vFeeRates;
+    map<uint256, CTxIndex> mapUnused;
+    BOOST_FOREACH(CTransaction& tx, block.vtx)
+    {
+        if (tx.IsCoinBase())
+            continue;
+
+        MapPrevTx mapInputs;
+        bool fInvalid;
+        if (!tx.FetchInputs(txdb, mapUnused, true, false, mapInputs, fInvalid))
+            return error("GetBlockStats() : FetchInputs failed for tx %s", tx.GetHash().ToString().c_str());
+
+        int64_t nTxValueIn = tx.GetValueIn(mapInputs);
+        if (tx.IsCoinStake())
+        {
+            nStakeAmount = nTxValueIn;
+            continue;
+        }
+
+        int64_t nTxFee = nTxValueIn - tx.GetValueOut();
+        unsigned int nTxSize = tx.GetTxSize();
+        nFees += nTxFee;
+        vFeeRates.push_back(make_pair(nTxFee * 1000 / nTxSize, nTxSize));
+    }
+
+    stats.Set(block, pindex, nFees, nStakeAmount, vFeeRates);
+    if (!txdb.WriteBlockStats(hash, stats))
+        printf("GetBlockStats() : WriteBlockStats failed for block %s\n", hash.ToString().c_str());
+    return true;
+}
+
+double GetDifficultyFromBits(unsigned int nBits)
+{
+    int nShift = (nBits >> 24) & 0xff;
+
+    double dDiff =
+        (double)0x0000ffff / (double)(nBits & 0x00ffffff);
+
+    // Scale by 256^(29 - nShift) in one step; exact, as it is a power of two
+    return ldexp(dDiff, 8 * (29 - nShift));
+}
+
+CBlockStatsWindow::CBlockStatsWindow() : nStartHeight(-1), nEndHeight(-1), nBlocks(0), nProofOfStake(0), nProofOfWork(0),
+    nTxCount(0), nSize(0), nFeeTxSize(0), nTotalFees(0), nStakeAmount(0), nMasternodePayout(0), nMint(0), nTimeSpan(0),
+    dDifficulty(0), nLastStakeBits(0), dStakeKernelsTried(0), nStakesTime(0), nLastStakeTime(0),
+    nLastWorkBits(0), dHashesTried(0), nWorkTime(0), nLastWorkTime(0)
+{
+}
+
+void CBlockStatsWindow::Add(const CBlockStats& stats)
+{
+    if (nBlocks++ == 0)
+        nStartHeight = stats.nHeight;
+    nEndHeight = stats.nHeight;
+    nTxCount += stats.nTxCount;
+    nSize += stats.nSize;
+    nFeeTxSize += stats.nFeeTxSize;
+    nTotalFees += stats.nTotalFees;
+    nStakeAmount += stats.nStakeAmount;
+    nMasternodePayout += stats.nMasternodePayout;
+    nMint += stats.nMint;
+    nTimeSpan += stats.nTimeDelta;
+    double dBlockDifficulty = GetDifficultyFromBits(stats.nBits);
+    dDifficulty += dBlockDifficulty;
+    if (stats.nFeeTxSize > 0)
+        vMedianFeeRates.push_back(stats.nFeeRatePercentiles[2]);
+
+    // work or kernels tried per second since the previous block of the same kind
+    if (stats.fProofOfStake)
+    {
+        if (nProofOfStake++ > 0)
+        {
+            dStakeKernelsTried += dBlockDifficulty * 4294967296.0;
+            nStakesTime += stats.nTime - nLastStakeTime;
+        }
+        nLastStakeTime = stats.nTime;
+        nLastStakeBits = stats.nBits;
+    }
+    else
+    {
+        if (nProofOfWork++ > 0)
+        {
+            dHashesTried += dBlockDifficulty * 4294967296.0;
+            nWorkTime += stats.nTime - nLastWorkTime;
+        }
+        nLastWorkTime = stats.nTime;
+        nLastWorkBits = stats.nBits;
+    }
+}
+
+int64_t CBlockStatsWindow::GetMedianFeeRate()
+{
+    if (vMedianFeeRates.empty())
+        return 0;
+    sort(vMedianFeeRates.begin(), vMedianFeeRates.end());
+    return vMedianFeeRates[vMedianFeeRates.size() / 2];
+}
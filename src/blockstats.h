@@ -0,0 +1,147 @@
+// Copyright (c) 2018 The AveroPay developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_BLOCKSTATS_H
+#define BITCOIN_BLOCKSTATS_H
+
+#include "serialize.h"
+
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+class CBlock;
+class CBlockIndex;
+class CTxDB;
+
+/** Summary of one block, kept in the txdb under its hash.
+ *
+ * ConnectBlock writes it from the values it works out anyway while checking
+ * the block, so the statistics page and getblockstats/getchainstats never have
+ * to read blocks back from disk. Blocks connected before the index existed get
+ * their entry the first time GetBlockStats() is asked for them.
+ *
+ * Fee rates are in satoshis per 1000 bytes. The percentiles are weighted by
+ * transaction size and only cover transactions that are neither coinbase nor
+ * coinstake.
+ */
+class CBlockStats
+{
+public:
+    static const int CURRENT_VERSION = 1;
+    enum { NUM_PERCENTILES = 5 };
+
+    int nVersion;
+    int nHeight;
+    int64_t nTime;
+    int64_t nTimeDelta;
+    unsigned int nBits;
+    bool fProofOfStake;
+    unsigned int nTxCount;
+    unsigned int nSize;
+    unsigned int nFeeTxSize;
+    int64_t nTotalFees;
+    int64_t nFeeRatePercentiles[NUM_PERCENTILES];
+    int64_t nStakeAmount;
+    int64_t nMasternodePayout;
+    int64_t nMint;
+
+    CBlockStats()
+    {
+        SetNull();
+    }
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(this->nVersion);
+        nVersion = this->nVersion;
+        READWRITE(nHeight);
+        READWRITE(nTime);
+        READWRITE(nTimeDelta);
+        READWRITE(nBits);
+        READWRITE(fProofOfStake);
+        READWRITE(nTxCount);
+        READWRITE(nSize);
+        READWRITE(nFeeTxSize);
+        READWRITE(nTotalFees);
+        for (int i = 0; i < NUM_PERCENTILES; i++)
+            READWRITE(nFeeRatePercentiles[i]);
+        READWRITE(nStakeAmount);
+        READWRITE(nMasternodePayout);
+        READWRITE(nMint);
+    )
+
+    void SetNull();
+
+    /** Fill in the stats of a connected block. vFeeRates holds the fee rate
+     * and size of each fee paying transaction and is sorted in place,
+     * nStakeAmount is the value of the coinstake's inputs. */
+    void Set(const CBlock& block, const CBlockIndex* pindex, int64_t nFees, int64_t nStakeAmount,
+             std::vector<std::pair<int64_t, unsigned int> >& vFeeRates);
+};
+
+/** The percentiles in CBlockStats::nFeeRatePercentiles */
+extern const int BLOCKSTATS_PERCENTILES[CBlockStats::NUM_PERCENTILES];
+
+/** Stats of a block in the main chain; computed and stored if the txdb has none */
+bool GetBlockStats(CTxDB& txdb, const CBlockIndex* pindex, CBlockStats& stats);
+
+/** Difficulty of a compact target, as a multiple of the minimum difficulty */
+double GetDifficultyFromBits(unsigned int nBits);
+
+/** Totals over a run of consecutive blocks, added in height order.
+ *
+ * Shared by getchainstats and the statistics page, so the network figures
+ * they show come from the stored block stats rather than from walking the
+ * block index.
+ */
+class CBlockStatsWindow
+{
+public:
+    int nStartHeight;
+    int nEndHeight;
+    int nBlocks;
+    int nProofOfStake;
+    int nProofOfWork;
+    uint64_t nTxCount;
+    uint64_t nSize;
+    uint64_t nFeeTxSize;
+    int64_t nTotalFees;
+    int64_t nStakeAmount;
+    int64_t nMasternodePayout;
+    int64_t nMint;
+    int64_t nTimeSpan;
+    double dDifficulty;
+    std::vector<int64_t> vMedianFeeRates;
+    unsigned int nLastStakeBits;
+    double dStakeKernelsTried;
+    int64_t nStakesTime;
+    int64_t nLastStakeTime;
+    unsigned int nLastWorkBits;
+    double dHashesTried;
+    int64_t nWorkTime;
+    int64_t nLastWorkTime;
+
+    CBlockStatsWindow();
+
+    void Add(const CBlockStats& stats);
+
+    /** Median of the blocks' median fee rates, 0 if none paid fees */
+    int64_t GetMedianFeeRate();
+
+    /** Network stake weight as in GetPoSKernelPS, over this window only */
+    double GetNetStakeWeight() const
+    {
+        return nStakesTime ? dStakeKernelsTried / nStakesTime : 0;
+    }
+
+    /** Proof-of-work hashes per second, from the difficulty and spacing of
+     * the window's proof-of-work blocks */
+    double GetNetHashPS() const
+    {
+        return nWorkTime ? dHashesTried / nWorkTime : 0;
+    }
+};
+
+#endif
@@ -0,0 +1,290 @@
+// Copyright (c) 2018 The AveroPay developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockwriter.h"
+#include "main.h"
+#include "util.h"
+
+#include <set>
+
+using namespace std;
+
+// Accepting blocks waits for the writer beyond this much queued data
+static const uint64_t MAX_QUEUED_BYTES = 32 * 1024 * 1024;
+
+// Free disk space is checked after this many bytes or seconds, whichever comes first
+static const uint64_t SPACE_CHECK_BYTES = 16 * 1024 * 1024;
+static const int64_t SPACE_CHECK_INTERVAL = 60;
+
+CBlockWriter blockWriter;
+
+// Whether a queued block lies at or before the given position
+static bool IsAtOrBefore(unsigned int nFile, unsigned int nBlockPos, unsigned int nFileLimit, unsigned int nBlockPosLimit)
+{
+    return nFile < nFileLimit || (nFile == nFileLimit && nBlockPos <= nBlockPosLimit);
+}
+
+CBlockWriter::CBlockWriter()
+{
+    nWritten = 0;
+    nQueuedBytes = 0;
+    nNextFile = 0;
+    nNextPos = 0;
+    fRunning = false;
+    fStopping = false;
+    fWriteError = false;
+    nLastSpaceCheck = 0;
+    nBytesSinceSpaceCheck = 0;
+}
+
+bool CBlockWriter::Write(const CQueuedBlock& item)
+{
+    CAutoFile fileout = CAutoFile(OpenBlockFile(item.nFile, 0, "ab"), SER_DISK, CLIENT_VERSION);
+    if (!fileout)
+        return error("CBlockWriter::Write() : OpenBlockFile failed");
+    if (fseek(fileout, 0, SEEK_END) != 0)
+        return error("CBlockWriter::Write() : fseek failed");
+
+    // The position was handed out when the block was queued, the file has to agree
+    unsigned int nSize = item.vchData.size();
+    long nEnd = ftell(fileout);
+    if (nEnd < 0 || (unsigned long)nEnd + sizeof(pchMessageStart) + sizeof(nSize) != item.nBlockPos)
+        return error("CBlockWriter::Write() : blk%04u.dat ends at %ld, block was assigned position %u", item.nFile, nEnd, item.nBlockPos);
+
+    fileout << FLATDATA(pchMessageStart) << nSize;
+    fileout.write(&item.vchData[0], nSize);
+    fflush(fileout);
+    return true;
+}
+
+void CBlockWriter::Sync(unsigned int nFile)
+{
+    FILE* file = OpenBlockFile(nFile, 0, "ab");
+    if (file)
+    {
+        FileCommit(file);
+        fclose(file);
+    }
+}
+
+void CBlockWriter::CheckSpace(uint64_t nBytesWritten, uint64_t nBytesQueued)
+{
+    nBytesSinceSpaceCheck += nBytesWritten;
+    if (nBytesSinceSpaceCheck < SPACE_CHECK_BYTES && GetTime() - nLastSpaceCheck < SPACE_CHECK_INTERVAL)
+        return;
+    nBytesSinceSpaceCheck = 0;
+    nLastSpaceCheck = GetTime();
+    CheckDiskSpace(nBytesQueued + SPACE_CHECK_BYTES);
+}
+
+bool CBlockWriter::Enqueue(const CBlock& block, bool fSync, unsigned int& nFileRet, unsigned int& nBlockPosRet)
+{
+    CQueuedBlock item;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << block;
+    ss.GetAndClear(item.vchData);
+    item.fSync = fSync;
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+
+    // Wait for room before taking a position, positions have to be queued in order
+    while (fRunning && !fWriteError && nQueuedBytes > MAX_QUEUED_BYTES)
+        condWritten.wait(lock);
+    if (fWriteError)
+        return error("CBlockWriter::Enqueue() : an earlier block could not be written");
+
+    if (nNextFile == 0)
+    {
+        // Carry on where the last block file ends
+        FILE* file = AppendBlockFile(nNextFile);
+        if (!file)
+            return error("CBlockWriter::Enqueue() : AppendBlockFile failed");
+        long nEnd = ftell(file);
+        fclose(file);
+        if (nEnd < 0)
+        {
+            nNextFile = 0;
+            return error("CBlockWriter::Enqueue() : ftell failed");
+        }
+        nNextPos = nEnd;
+    }
+
+    // FAT32 file size max 4GB, fseek and ftell max 2GB, so we must stay under 2GB
+    if (nNextPos >= (unsigned int)(0x7F000000 - MAX_SIZE))
+    {
+        nNextFile++;
+        nNextPos = 0;
+    }
+
+    item.nFile = nNextFile;
+    item.nBlockPos = nNextPos + sizeof(pchMessageStart) + sizeof(unsigned int);
+    nNextPos = item.nBlockPos + item.vchData.size();
+    nFileRet = item.nFile;
+    nBlockPosRet = item.nBlockPos;
+
+    if (!fRunning)
+    {
+        if (!Write(item))
+        {
+            // Nothing was written, work the position out from the file again
+            nNextFile = 0;
+            return false;
+        }
+        if (fSync)
+            Sync(item.nFile);
+        CheckSpace(item.vchData.size(), 0);
+        return true;
+    }
+
+    nQueuedBytes += item.vchData.size();
+    queue.push_back(CQueuedBlock());
+    CQueuedBlock& queued = queue.back();
+    queued.nFile = item.nFile;
+    queued.nBlockPos = item.nBlockPos;
+    queued.fSync = item.fSync;
+    queued.vchData.swap(item.vchData);
+    condQueued.notify_one();
+    return true;
+}
+
+bool CBlockWriter::WaitForWrite(unsigned int nFile, unsigned int nBlockPos, bool fDurable)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (true)
+    {
+        // the first entry still pending, not yet synced or not yet written
+        size_t nPending = fDurable ? 0 : nWritten;
+        if (nPending >= queue.size())
+            break;
+        const CQueuedBlock& item = queue[nPending];
+        if (!IsAtOrBefore(item.nFile, item.nBlockPos, nFile, nBlockPos))
+            break;
+        condWritten.wait(lock);
+    }
+    return !fWriteError;
+}
+
+void CBlockWriter::ThreadMain()
+{
+    while (true)
+    {
+        // Entries stay queued until they are written so that readers can wait
+        // for them; references into a deque survive pushes at the back.
+        vector<const CQueuedBlock*> vBatch;
+        bool fSyncAll;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queue.empty() && !fStopping)
+                condQueued.wait(lock);
+            if (queue.empty())
+            {
+                // Stopping with nothing left: make the last file durable and hand
+                // writing back to Enqueue() in the same step
+                if (nNextFile)
+                    Sync(nNextFile);
+                fRunning = false;
+                condWritten.notify_all();
+                break;
+            }
+            BOOST_FOREACH(const CQueuedBlock& item, queue)
+                vBatch.push_back(&item);
+            fSyncAll = fStopping;
+        }
+
+        set<unsigned int> setFiles;
+        bool fSync = fSyncAll;
+        bool fFailed = fWriteError; // only this thread sets it
+        uint64_t nBytes = 0;
+        BOOST_FOREACH(const CQueuedBlock* pitem, vBatch)
+        {
+            // After a failure the file no longer ends where the later blocks expect
+            if (!fFailed && !Write(*pitem))
+            {
+                fFailed = true;
+                AbortNode(strprintf("Failed to write block to blk%04u.dat at position %u", pitem->nFile, pitem->nBlockPos));
+            }
+            setFiles.insert(pitem->nFile);
+            fSync |= pitem->fSync;
+            nBytes += pitem->vchData.size();
+        }
+
+        // Readers can go ahead now, committing the tip waits for the fsync
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nWritten = vBatch.size();
+            if (fFailed)
+                fWriteError = true;
+        }
+        condWritten.notify_all();
+
+        // One fsync per file covers the whole batch
+        if (fSync && !fFailed)
+        {
+            BOOST_FOREACH(unsigned int nFile, setFiles)
+                Sync(nFile);
+        }
+
+        uint64_t nBytesQueued;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            for (unsigned int i = 0; i < vBatch.size(); i++)
+                queue.pop_front();
+            nWritten = 0;
+            nQueuedBytes -= nBytes;
+            nBytesQueued = nQueuedBytes;
+        }
+        condWritten.notify_all();
+
+        CheckSpace(nBytes, nBytesQueued);
+    }
+}
+
+static void ThreadBlockWriter(void* parg)
+{
+    // Make this thread recognisable as the block writing thread
+    RenameThread("AveroPay-blkwriter");
+
+    try
+    {
+        blockWriter.ThreadMain();
+    }
+    catch (std::exception& e) {
+        PrintException(&e, "ThreadBlockWriter()");
+    }
+    printf("ThreadBlockWriter exited\n");
+}
+
+void CBlockWriter::Start()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (fRunning)
+            return;
+        fRunning = true;
+        fStopping = false;
+    }
+    if (!NewThread(ThreadBlockWriter, NULL))
+    {
+        printf("Error: NewThread(ThreadBlockWriter) failed, writing blocks synchronously\n");
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fRunning = false;
+    }
+}
+
+void CBlockWriter::Stop()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!fRunning)
+        return;
+    fStopping = true;
+    condQueued.notify_all();
+    while (fRunning)
+        condWritten.wait(lock);
+}
+
+uint64_t CBlockWriter::GetQueuedBytes()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return nQueuedBytes;
+}
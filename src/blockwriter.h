@@ -0,0 +1,91 @@
+// Copyright (c) 2018 The AveroPay developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_BLOCKWRITER_H
+#define BITCOIN_BLOCKWRITER_H
+
+#include "serialize.h"
+
+#include <deque>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <stdint.h>
+
+class CBlock;
+
+/** Appends accepted blocks to the blk*.dat files from a background thread.
+ *
+ * AcceptBlock reserves the block's position and queues its serialized bytes,
+ * then goes on to connect the in-memory block while the writer thread puts it
+ * on disk. The thread writes whatever has been queued in one go and issues a
+ * single fsync for the batch. Free disk space is checked periodically there
+ * rather than for every block.
+ *
+ * Anyone opening a block file for reading waits until the data queued for it
+ * has been written, and SetBestChain waits until the new tip's block has been
+ * written and, if it asked for it, fsynced before it commits the tip to the
+ * txdb. A failed write is sticky: the node is aborted and every later wait
+ * reports the failure, so no tip is committed past a block that is missing.
+ * Until Start() is called (and after Stop()) blocks are written synchronously.
+ */
+class CBlockWriter
+{
+private:
+    struct CQueuedBlock
+    {
+        unsigned int nFile;
+        unsigned int nBlockPos;
+        bool fSync;
+        CSerializeData vchData;
+    };
+
+    boost::mutex mutex;
+    boost::condition_variable condQueued;
+    boost::condition_variable condWritten;
+    // Entries leave the queue once their batch has been written and synced;
+    // the first nWritten of them have been written already.
+    std::deque<CQueuedBlock> queue;
+    size_t nWritten;
+    uint64_t nQueuedBytes;
+
+    // where the next queued block goes, once the queue has been written out
+    unsigned int nNextFile;
+    unsigned int nNextPos;
+
+    bool fRunning;
+    bool fStopping;
+    bool fWriteError;
+    int64_t nLastSpaceCheck;
+    uint64_t nBytesSinceSpaceCheck;
+
+    bool Write(const CQueuedBlock& item);
+    void Sync(unsigned int nFile);
+    void CheckSpace(uint64_t nBytesWritten, uint64_t nBytesQueued);
+
+public:
+    CBlockWriter();
+
+    /** Reserve a file position for the block and queue it for writing. Waits
+     * while the queue is over its size limit; callers hold cs_main, so block
+     * acceptance stalls for as long as the writer needs to get the queue back
+     * under 32MB. Returns false once a write has failed. */
+    bool Enqueue(const CBlock& block, bool fSync, unsigned int& nFileRet, unsigned int& nBlockPosRet);
+
+    /** Wait until every queued block in an earlier file, or in nFile at or
+     * before nBlockPos, has been flushed to the OS, or with fDurable until
+     * its batch has also been fsynced. Returns false if a write failed. */
+    bool WaitForWrite(unsigned int nFile, unsigned int nBlockPos, bool fDurable = false);
+
+    void Start();
+    /** Write out and fsync anything still queued, then stop the thread */
+    void Stop();
+    void ThreadMain();
+
+    uint64_t GetQueuedBytes();
+};
+
+extern CBlockWriter blockWriter;
+
+#endif
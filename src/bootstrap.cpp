@@ -0,0 +1,485 @@
+// Copyright (c) 2018 The AveroPay developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bootstrap.h"
+#include "main.h"
+#include "util.h"
+#include "lz4/lz4.h"
+
+#include <boost/filesystem.hpp>
+#include <boost/filesystem/fstream.hpp>
+
+using namespace std;
+
+// Blocks per manifest line, the granularity an interrupted export resumes at
+static const int BOOTSTRAP_CHUNK_BLOCKS = 10000;
+
+// stdio buffer of the output and of the reads when checking a resumed file
+static const size_t BOOTSTRAP_BUFFER_SIZE = 4 * 1024 * 1024;
+
+CBootstrapExport bootstrapExport;
+
+static string GetDigest(SHA256_CTX ctx)
+{
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    SHA256_Final(digest, &ctx);
+    return HexStr(digest, digest + sizeof(digest));
+}
+
+static bool WriteManifest(const boost::filesystem::path& path, const vector<string>& vLines)
+{
+    boost::filesystem::path pathTmp = path.string() + ".new";
+    FILE* file = fopen(pathTmp.string().c_str(), "w");
+    if (!file)
+        return false;
+    BOOST_FOREACH(const string& strLine, vLines)
+        fprintf(file, "%s\n", strLine.c_str());
+    fflush(file);
+    FileCommit(file);
+    fclose(file);
+    return RenameOver(pathTmp, path);
+}
+
+// Where the exported blocks go: straight to the file, or gathered into LZ4
+// frames. The hashes and the offset follow what reaches the file, so the
+// manifest describes the file as written either way.
+class CBootstrapOutput
+{
+private:
+    FILE* file;
+    bool fLZ4;
+    SHA256_CTX& ctxChunk;
+    SHA256_CTX& ctxFile;
+    uint64_t& nOffset;
+    vector<char> vchFrame;
+    vector<char> vchCompressed;
+
+    bool WriteFile(const char* pch, size_t nSize)
+    {
+        if (fwrite(pch, 1, nSize, file) != nSize)
+            return false;
+        SHA256_Update(&ctxChunk, pch, nSize);
+        SHA256_Update(&ctxFile, pch, nSize);
+        nOffset += nSize;
+        return true;
+    }
+
+public:
+    CBootstrapOutput(FILE* fileIn, bool fLZ4In, SHA256_CTX& ctxChunkIn, SHA256_CTX& ctxFileIn, uint64_t& nOffsetIn) :
+        file(fileIn), fLZ4(fLZ4In), ctxChunk(ctxChunkIn), ctxFile(ctxFileIn), nOffset(nOffsetIn) {}
+
+    // The start of a new file
+    bool WriteMagic()
+    {
+        return !fLZ4 || WriteFile((const char*)BOOTSTRAP_LZ4_MAGIC, sizeof(BOOTSTRAP_LZ4_MAGIC));
+    }
+
+    // A block with its message start and size in front
+    bool WriteBlock(const vector<unsigned char>& vchBlock)
+    {
+        if (!fLZ4)
+            return WriteFile((const char*)&vchBlock[0], vchBlock.size());
+        if (!vchFrame.empty() && vchFrame.size() + vchBlock.size() > BOOTSTRAP_LZ4_FRAME_SIZE && !Flush())
+            return false;
+        vchFrame.insert(vchFrame.end(), vchBlock.begin(), vchBlock.end());
+        return true;
+    }
+
+    // Write out the pending frame, after which the file ends on a block
+    bool Flush()
+    {
+        if (!fLZ4 || vchFrame.empty())
+            return true;
+        unsigned int nRawSize = vchFrame.size();
+        vchCompressed.resize(8 + LZ4_compressBound(nRawSize));
+        int nCompressed = LZ4_compress(&vchFrame[0], &vchCompressed[8], nRawSize);
+        if (nCompressed <= 0)
+            return false;
+        unsigned int nCompressedSize = nCompressed;
+        memcpy(&vchCompressed[0], &nRawSize, sizeof(nRawSize));
+        memcpy(&vchCompressed[4], &nCompressedSize, sizeof(nCompressedSize));
+        vchFrame.clear();
+        return WriteFile(&vchCompressed[0], 8 + nCompressedSize);
+    }
+};
+
+bool IsBootstrapLZ4(FILE* file)
+{
+    unsigned char magic[sizeof(BOOTSTRAP_LZ4_MAGIC)];
+    if (fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, BOOTSTRAP_LZ4_MAGIC, sizeof(magic)) == 0)
+        return true;
+    fseek(file, 0, SEEK_SET);
+    return false;
+}
+
+bool ReadBootstrapLZ4Frame(FILE* file, vector<unsigned char>& vchRaw)
+{
+    unsigned int nSizes[2];
+    size_t nRead = fread(nSizes, 1, sizeof(nSizes), file);
+    if (nRead == 0)
+        return false;
+    if (nRead != sizeof(nSizes))
+        return error("ReadBootstrapLZ4Frame() : truncated frame header");
+
+    // a frame is filled to BOOTSTRAP_LZ4_FRAME_SIZE, or holds a single block
+    unsigned int nRawSize = nSizes[0], nCompressedSize = nSizes[1];
+    if (nRawSize == 0 || nRawSize > max(BOOTSTRAP_LZ4_FRAME_SIZE, MAX_BLOCK_SIZE + 8) ||
+        nCompressedSize == 0 || nCompressedSize > (unsigned int)LZ4_compressBound(nRawSize))
+        return error("ReadBootstrapLZ4Frame() : bad frame sizes %u %u", nRawSize, nCompressedSize);
+
+    vector<char> vchCompressed(nCompressedSize);
+    if (fread(&vchCompressed[0], 1, nCompressedSize, file) != nCompressedSize)
+        return error("ReadBootstrapLZ4Frame() : truncated frame");
+    vchRaw.resize(nRawSize);
+    if (LZ4_decompress_safe(&vchCompressed[0], (char*)&vchRaw[0], nCompressedSize, nRawSize) != (int)nRawSize)
+        return error("ReadBootstrapLZ4Frame() : frame does not decompress");
+    return true;
+}
+
+CBootstrapExport::CBootstrapExport()
+{
+    fStopping = false;
+    status.fRunning = false;
+    status.fComplete = false;
+    status.nStartHeight = 0;
+    status.nHeight = 0;
+    status.nEndHeight = 0;
+    status.nBytes = 0;
+    status.nStartTime = 0;
+    status.fLZ4 = false;
+}
+
+static void ThreadBootstrapExport(void* parg)
+{
+    RenameThread("AveroPay-bootstrap");
+
+    bootstrapExport.ThreadMain();
+    printf("ThreadBootstrapExport exited\n");
+}
+
+bool CBootstrapExport::Start(const string& strDest, int nEndHeight, bool fLZ4, string& strError)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (status.fRunning)
+    {
+        strError = "An export to " + status.strDest + " is already running";
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        if (nEndHeight < 0 || nEndHeight > nBestHeight)
+        {
+            strError = "Block number out of range";
+            return false;
+        }
+
+        vBlockPos.clear();
+        vBlockPos.reserve(nEndHeight + 1);
+        vChunkHash.clear();
+        for (int nHeight = 0; nHeight <= nEndHeight; nHeight++)
+        {
+            const CBlockIndex* pindex = chainActive[nHeight];
+            vBlockPos.push_back(make_pair(pindex->nFile, pindex->nBlockPos));
+            if (nHeight % BOOTSTRAP_CHUNK_BLOCKS == BOOTSTRAP_CHUNK_BLOCKS - 1 || nHeight == nEndHeight)
+                vChunkHash.push_back(pindex->GetBlockHash());
+        }
+    }
+
+    status.fRunning = true;
+    status.fComplete = false;
+    status.strDest = strDest;
+    status.nStartHeight = 0;
+    status.nHeight = 0;
+    status.nEndHeight = nEndHeight;
+    status.nBytes = 0;
+    status.nStartTime = GetTime();
+    status.fLZ4 = fLZ4;
+    status.strError.clear();
+    fStopping = false;
+
+    if (!NewThread(ThreadBootstrapExport, NULL))
+    {
+        status.fRunning = false;
+        strError = "Could not start the export thread";
+        return false;
+    }
+    return true;
+}
+
+void CBootstrapExport::Stop()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!status.fRunning)
+        return;
+    fStopping = true;
+    while (status.fRunning)
+        condStopped.wait(lock);
+}
+
+CBootstrapExport::CStatus CBootstrapExport::GetStatus()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return status;
+}
+
+void CBootstrapExport::SetProgress(int nHeight, uint64_t nBytes)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    status.nHeight = nHeight;
+    status.nBytes = nBytes;
+}
+
+void CBootstrapExport::ThreadMain()
+{
+    bool fComplete = false;
+    string strError;
+    try
+    {
+        Export(fComplete, strError);
+    }
+    catch (std::exception& e) {
+        PrintException(&e, "ThreadBootstrapExport()");
+        strError = e.what();
+    }
+    if (!strError.empty())
+        printf("Bootstrap export failed: %s\n", strError.c_str());
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    status.fRunning = false;
+    status.fComplete = fComplete;
+    status.strError = strError;
+    vBlockPos.clear();
+    vChunkHash.clear();
+    condStopped.notify_all();
+}
+
+// Keep the chunks of an earlier export that still match the chain and the
+// file, returns the height to carry on from
+int CBootstrapExport::Resume(const string& strDest, const vector<string>& vOldManifest, int nEndHeight,
+                             SHA256_CTX& ctxFile, vector<string>& vManifest, uint64_t& nOffsetRet)
+{
+    int nHeight = 0;
+    nOffsetRet = 0;
+    if (vOldManifest.size() < 2 || vOldManifest[1] != vManifest[1])
+        return 0;
+
+    FILE* file = fopen(strDest.c_str(), "rb");
+    if (!file)
+        return 0;
+    setvbuf(file, NULL, _IOFBF, BOOTSTRAP_BUFFER_SIZE);
+
+    vector<unsigned char> vchBuffer(1024 * 1024);
+    for (unsigned int i = 2; i < vOldManifest.size(); i++)
+    {
+        int nStart, nEnd;
+        uint64_t nOffset, nLength;
+        char pszDigest[65], pszHash[65];
+        if (sscanf(vOldManifest[i].c_str(), "chunk %d %d %" PRIu64" %" PRIu64" %64s %64s",
+                   &nStart, &nEnd, &nOffset, &nLength, pszDigest, pszHash) != 6)
+            break;
+        int nChunk = nStart / BOOTSTRAP_CHUNK_BLOCKS;
+        if (nStart != nHeight || nOffset != nOffsetRet || nChunk >= (int)vChunkHash.size() ||
+            nEnd != min(nStart + BOOTSTRAP_CHUNK_BLOCKS - 1, nEndHeight) ||
+            vChunkHash[nChunk] != uint256(pszHash))
+            break;
+
+        SHA256_CTX ctxChunk, ctxTry = ctxFile;
+        SHA256_Init(&ctxChunk);
+        uint64_t nRemaining = nLength;
+        while (nRemaining > 0)
+        {
+            size_t nRead = fread(&vchBuffer[0], 1, min((uint64_t)vchBuffer.size(), nRemaining), file);
+            if (nRead == 0)
+                break;
+            SHA256_Update(&ctxChunk, &vchBuffer[0], nRead);
+            SHA256_Update(&ctxTry, &vchBuffer[0], nRead);
+            nRemaining -= nRead;
+        }
+        if (nRemaining > 0 || GetDigest(ctxChunk) != pszDigest)
+            break;
+
+        ctxFile = ctxTry;
+        vManifest.push_back(vOldManifest[i]);
+        nHeight = nEnd + 1;
+        nOffsetRet += nLength;
+    }
+    fclose(file);
+    return nHeight;
+}
+
+bool CBootstrapExport::Export(bool& fCompleteRet, string& strError)
+{
+    fCompleteRet = false;
+    string strDest;
+    int nEndHeight;
+    bool fLZ4;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        strDest = status.strDest;
+        nEndHeight = status.nEndHeight;
+        fLZ4 = status.fLZ4;
+    }
+    boost::filesystem::path pathManifest(strDest + ".manifest");
+
+    vector<string> vOldManifest;
+    {
+        boost::filesystem::ifstream stream(pathManifest);
+        string strLine;
+        while (getline(stream, strLine))
+            vOldManifest.push_back(strLine);
+    }
+
+    SHA256_CTX ctxFile;
+    SHA256_Init(&ctxFile);
+    vector<string> vManifest;
+    vManifest.push_back("# AveroPay bootstrap manifest: chunk <first> <last> <offset> <length> <sha256> <last block hash>");
+    // a file in the other format is not resumed
+    vManifest.push_back("messagestart " + HexStr(pchMessageStart, pchMessageStart + sizeof(pchMessageStart)) +
+                        (fLZ4 ? " lz4" : ""));
+    uint64_t nOffset = 0;
+    int nHeight = Resume(strDest, vOldManifest, nEndHeight, ctxFile, vManifest, nOffset);
+    if (nHeight > 0)
+        printf("Bootstrap export: resuming %s at height %d\n", strDest.c_str(), nHeight);
+
+    // Drop whatever was written after the last complete chunk
+    try {
+        if (boost::filesystem::exists(strDest))
+            boost::filesystem::resize_file(strDest, nOffset);
+    } catch (const boost::filesystem::filesystem_error& e) {
+        strError = strprintf("Could not truncate %s: %s", strDest.c_str(), e.what());
+        return false;
+    }
+    if (!WriteManifest(pathManifest, vManifest))
+    {
+        strError = "Could not write " + pathManifest.string();
+        return false;
+    }
+
+    FILE* fileOut = fopen(strDest.c_str(), "ab");
+    if (!fileOut)
+    {
+        strError = "Could not open " + strDest + " for writing";
+        return false;
+    }
+    setvbuf(fileOut, NULL, _IOFBF, BOOTSTRAP_BUFFER_SIZE);
+
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        status.nStartHeight = nHeight;
+    }
+    SetProgress(nHeight, nOffset);
+
+    FILE* fileIn = NULL;
+    unsigned int nFileIn = 0;
+    vector<unsigned char> vchBlock;
+    SHA256_CTX ctxChunk;
+    SHA256_Init(&ctxChunk);
+    uint64_t nChunkOffset = nOffset;
+    int nChunkStart = nHeight;
+    CBootstrapOutput output(fileOut, fLZ4, ctxChunk, ctxFile, nOffset);
+    if (nOffset == 0 && !output.WriteMagic())
+    {
+        fclose(fileOut);
+        strError = "Write to " + strDest + " failed";
+        return false;
+    }
+    for (; nHeight <= nEndHeight; nHeight++)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fStopping)
+                break;
+        }
+
+        // Copy the block together with the message start and size that
+        // precede it in the block file, which is the bootstrap.dat format
+        unsigned int nFile = vBlockPos[nHeight].first;
+        unsigned int nBlockPos = vBlockPos[nHeight].second;
+        if (!fileIn || nFile != nFileIn)
+        {
+            if (fileIn)
+                fclose(fileIn);
+            fileIn = OpenBlockFile(nFile, 0, "rb");
+            nFileIn = nFile;
+            if (!fileIn)
+            {
+                strError = strprintf("Could not open block file %u", nFile);
+                break;
+            }
+        }
+
+        const unsigned int nHeaderSize = sizeof(pchMessageStart) + sizeof(unsigned int);
+        unsigned int nSize = 0;
+        vchBlock.resize(nHeaderSize);
+        if (nBlockPos < nHeaderSize || fseek(fileIn, nBlockPos - nHeaderSize, SEEK_SET) != 0 ||
+            fread(&vchBlock[0], 1, nHeaderSize, fileIn) != nHeaderSize ||
+            memcmp(&vchBlock[0], pchMessageStart, sizeof(pchMessageStart)) != 0)
+        {
+            strError = strprintf("No block header at file %u position %u (height %d)", nFile, nBlockPos, nHeight);
+            break;
+        }
+        memcpy(&nSize, &vchBlock[sizeof(pchMessageStart)], sizeof(nSize));
+        if (nSize == 0 || nSize > MAX_BLOCK_SIZE)
+        {
+            strError = strprintf("Bad block size %u at height %d", nSize, nHeight);
+            break;
+        }
+        vchBlock.resize(nHeaderSize + nSize);
+        if (fread(&vchBlock[nHeaderSize], 1, nSize, fileIn) != nSize)
+        {
+            strError = strprintf("Short read of the block at height %d", nHeight);
+            break;
+        }
+
+        if (!output.WriteBlock(vchBlock))
+        {
+            strError = "Write to " + strDest + " failed";
+            break;
+        }
+
+        if (nHeight % BOOTSTRAP_CHUNK_BLOCKS == BOOTSTRAP_CHUNK_BLOCKS - 1 || nHeight == nEndHeight)
+        {
+            // The data goes to disk before the manifest line claiming it
+            if (!output.Flush())
+            {
+                strError = "Write to " + strDest + " failed";
+                break;
+            }
+            fflush(fileOut);
+            FileCommit(fileOut);
+            vManifest.push_back(strprintf("chunk %d %d %" PRIu64" %" PRIu64" %s %s", nChunkStart, nHeight,
+                                          nChunkOffset, nOffset - nChunkOffset, GetDigest(ctxChunk).c_str(),
+                                          vChunkHash[nHeight / BOOTSTRAP_CHUNK_BLOCKS].GetHex().c_str()));
+            if (!WriteManifest(pathManifest, vManifest))
+            {
+                strError = "Could not write " + pathManifest.string();
+                break;
+            }
+            SHA256_Init(&ctxChunk);
+            nChunkOffset = nOffset;
+            nChunkStart = nHeight + 1;
+        }
+        SetProgress(nHeight + 1, nOffset);
+    }
+
+    if (fileIn)
+        fclose(fileIn);
+    fclose(fileOut);
+    if (!strError.empty())
+        return false;
+
+    if (nHeight > nEndHeight)
+    {
+        vManifest.push_back(strprintf("complete %d %" PRIu64" %s", nEndHeight + 1, nOffset, GetDigest(ctxFile).c_str()));
+        if (!WriteManifest(pathManifest, vManifest))
+        {
+            strError = "Could not write " + pathManifest.string();
+            return false;
+        }
+        fCompleteRet = true;
+        printf("Bootstrap export: wrote blocks 0 to %d to %s\n", nEndHeight, strDest.c_str());
+    }
+    return true;
+}
@@ -0,0 +1,102 @@
+// Copyright (c) 2018 The AveroPay developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_BOOTSTRAP_H
+#define BITCOIN_BOOTSTRAP_H
+
+#include "uint256.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <openssl/sha.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/** Writes bootstrap.dat from a background thread (dumpbootstrap).
+ *
+ * The positions of the main chain blocks are taken under cs_main when the
+ * export starts. After that the thread copies each block's bytes straight
+ * out of the blk*.dat files, in height order and without deserializing
+ * them. Block files are only ever appended to, so a reorg during the export
+ * does not matter.
+ *
+ * Next to the output goes a text manifest with one line per chunk of
+ * BOOTSTRAP_CHUNK_BLOCKS blocks, giving the chunk's byte range, its SHA256 and
+ * the hash of its last block. When the export finishes, a final line gives
+ * the SHA256 of the whole file. An interrupted export resumes from the last
+ * chunk whose block hash still matches the chain. The chunks before it are
+ * checked against the manifest, the rest of the file is cut off, and the
+ * export carries on from there.
+ *
+ * With LZ4 framing, the file starts with BOOTSTRAP_LZ4_MAGIC and the blocks,
+ * in the same format, are gathered into frames of up to
+ * BOOTSTRAP_LZ4_FRAME_SIZE bytes. Each frame is stored as its raw and
+ * compressed size, then its LZ4 compressed bytes, and holds whole blocks
+ * only. A chunk always ends a frame. The manifest describes the file as
+ * written, so resuming works the same way.
+ */
+class CBootstrapExport
+{
+public:
+    struct CStatus
+    {
+        bool fRunning;
+        bool fComplete;
+        std::string strDest;
+        int nStartHeight;
+        int nHeight;
+        int nEndHeight;
+        uint64_t nBytes;
+        int64_t nStartTime;
+        bool fLZ4;
+        std::string strError;
+    };
+
+private:
+    boost::mutex mutex;
+    boost::condition_variable condStopped;
+    bool fStopping;
+    CStatus status;
+
+    // taken from the chain when the export starts: the file and position of
+    // every block, by height, and the hash of the last block of each chunk
+    std::vector<std::pair<unsigned int, unsigned int> > vBlockPos;
+    std::vector<uint256> vChunkHash;
+
+    int Resume(const std::string& strDest, const std::vector<std::string>& vOldManifest, int nEndHeight,
+               SHA256_CTX& ctxFile, std::vector<std::string>& vManifest, uint64_t& nOffsetRet);
+    bool Export(bool& fCompleteRet, std::string& strError);
+    void SetProgress(int nHeight, uint64_t nBytes);
+
+public:
+    CBootstrapExport();
+
+    /** Start exporting blocks 0 to nEndHeight of the main chain to strDest */
+    bool Start(const std::string& strDest, int nEndHeight, bool fLZ4, std::string& strError);
+    /** Interrupt the export, it can be resumed later */
+    void Stop();
+    void ThreadMain();
+
+    CStatus GetStatus();
+};
+
+extern CBootstrapExport bootstrapExport;
+
+/** First bytes of a bootstrap file with LZ4 framing */
+static const unsigned char BOOTSTRAP_LZ4_MAGIC[8] = { 'A', 'O', 'P', 'L', 'Z', '4', 0x00, 0x01 };
+/** Raw bytes an LZ4 frame is filled to, unless a single block is larger */
+static const unsigned int BOOTSTRAP_LZ4_FRAME_SIZE = 4 * 1024 * 1024;
+
+/** Returns true and skips the magic if file, at its start, has LZ4 framing.
+ * Otherwise the file is rewound. */
+bool IsBootstrapLZ4(FILE* file);
+/** Read and decompress the next LZ4 frame; false at the end of the file or
+ * on a damaged frame */
+bool ReadBootstrapLZ4Frame(FILE* file, std::vector<unsigned char>& vchRaw);
+
+#endif
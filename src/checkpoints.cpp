@@ -53,20 +53,67 @@ namespace Checkpoints
         return checkpoints.rbegin()->first;
     }
 
-    CBlockIndex* GetLastCheckpoint(const std::map<uint256, CBlockIndex*>& mapBlockIndex)
+    CBlockIndex* GetLastCheckpoint(const BlockMap& mapBlockIndex)
     {
         MapCheckpoints& checkpoints = (fTestNet ? mapCheckpointsTestnet : mapCheckpoints);
 
         BOOST_REVERSE_FOREACH(const MapCheckpoints::value_type& i, checkpoints)
         {
             const uint256& hash = i.second;
-            std::map<uint256, CBlockIndex*>::const_iterator t = mapBlockIndex.find(hash);
+            BlockMap::const_iterator t = mapBlockIndex.find(hash);
             if (t != mapBlockIndex.end())
                 return t->second;
         }
         return NULL;
     }
 
+    uint256 hashAssumeValid = 0;
+
+    uint256 GetDefaultAssumeValid()
+    {
+        MapCheckpoints& checkpoints = (fTestNet ? mapCheckpointsTestnet : mapCheckpoints);
+
+        return checkpoints.rbegin()->second;
+    }
+
+    bool IsAssumedValid(const CBlockIndex* pindex)
+    {
+        AssertLockHeld(cs_main);
+
+        if (hashAssumeValid == 0)
+            return false;
+
+        // The chain below the assume-valid block, by height. Built once the
+        // block is in the index; blocks are never removed from it.
+        static uint256 hashAssumedChain = 0;
+        static std::vector<const CBlockIndex*> vAssumedChain;
+
+        BlockMap::const_iterator mi = mapBlockIndex.find(hashAssumeValid);
+        if (mi != mapBlockIndex.end())
+        {
+            if (hashAssumedChain != hashAssumeValid)
+            {
+                vAssumedChain.assign(mi->second->nHeight + 1, NULL);
+                for (const CBlockIndex* p = mi->second; p; p = p->pprev)
+                    vAssumedChain[p->nHeight] = p;
+                hashAssumedChain = hashAssumeValid;
+            }
+            return pindex->nHeight < (int)vAssumedChain.size() && vAssumedChain[pindex->nHeight] == pindex;
+        }
+
+        // Without headers-first sync the assume-valid block is usually not
+        // known yet while its ancestors are connected. A hardened checkpoint's
+        // height is known though, and CheckHardened keeps every accepted
+        // chain on the checkpoints below it, so blocks up to that height are
+        // taken as assumed valid. A hash given with -assumevalid that is not a
+        // checkpoint only takes effect once the block itself has been seen.
+        MapCheckpoints& checkpoints = (fTestNet ? mapCheckpointsTestnet : mapCheckpoints);
+        BOOST_FOREACH(const MapCheckpoints::value_type& i, checkpoints)
+            if (i.second == hashAssumeValid)
+                return pindex->nHeight <= i.first;
+        return false;
+    }
+
     // ppcoin: synchronized checkpoint (centrally broadcasted)
     uint256 hashSyncCheckpoint = 0;
     uint256 hashPendingCheckpoint = 0;
@@ -302,7 +349,7 @@ namespace Checkpoints
 
         // Test signing a sync-checkpoint with genesis block
         CSyncCheckpoint checkpoint;
-        checkpoint.hashCheckpoint = !fTestNet ? hashGenesisBlock : hashGenesisBlockTestNet;
+        checkpoint.hashCheckpoint = GetGenesisBlockHash();
         CDataStream sMsg(SER_NETWORK, PROTOCOL_VERSION);
         sMsg << (CUnsignedSyncCheckpoint)checkpoint;
         checkpoint.vchMsg = std::vector<unsigned char>(sMsg.begin(), sMsg.end());
@@ -7,6 +7,7 @@
 #include <map>
 #include "net.h"
 #include "util.h"
+#include "hashmap.h"
 
 #ifdef WIN32
 #undef STRICT
@@ -41,7 +42,18 @@ namespace Checkpoints
     int GetTotalBlocksEstimate();
 
     // Returns last CBlockIndex* in mapBlockIndex that is a checkpoint
-    CBlockIndex* GetLastCheckpoint(const std::map<uint256, CBlockIndex*>& mapBlockIndex);
+    CBlockIndex* GetLastCheckpoint(const BlockMap& mapBlockIndex);
+
+    // Block whose ancestors are connected without verifying their input
+    // scripts (-assumevalid), 0 to verify everything
+    extern uint256 hashAssumeValid;
+
+    // Default for -assumevalid: the last hardened checkpoint
+    uint256 GetDefaultAssumeValid();
+
+    // Returns true if the scripts of pindex need not be verified because it is
+    // the assume-valid block or one of its ancestors
+    bool IsAssumedValid(const CBlockIndex* pindex);
 
     extern uint256 hashSyncCheckpoint;
     extern CSyncCheckpoint checkpointMessage;
@@ -925,95 +925,94 @@ bool CDarksendQueue::CheckSignature()
 
 
 //TODO: Rename/move to core
-void ThreadCheckDarkSendPool(void* parg)
+// Masternode list upkeep, run every second by the scheduler
+void CheckDarkSendPool()
 {
-    // Make this thread recognisable as the wallet flushing thread
-    RenameThread("AveroPay-mn");
-
-    unsigned int c = 0;
+    static unsigned int c = 0;
     std::string errorMessage;
 
-    while (true && !fShutdown)
-    {
-        c++;
-
-        MilliSleep(1000);
-        //printf("ThreadCheckDarkSendPool::check timeout\n");
-        //darkSendPool.CheckTimeout();
+    c++;
+    //printf("ThreadCheckDarkSendPool::check timeout\n");
+    //darkSendPool.CheckTimeout();
 
-        int mnTimeout = 150; //2.5 minutes
+    int mnTimeout = 150; //2.5 minutes
 
-        if(c % mnTimeout == 0){
-            LOCK(cs_main);
-            /*
-                cs_main is required for doing masternode.Check because something
-                is modifying the coins view without a mempool lock. It causes
-                segfaults from this code without the cs_main lock.
-            */
+    if(c % mnTimeout == 0){
+        LOCK(cs_main);
+        /*
+            cs_main is required for doing masternode.Check because something
+            is modifying the coins view without a mempool lock. It causes
+            segfaults from this code without the cs_main lock.
+        */
         {
-
-        LOCK(cs_masternodes);
+            LOCK(cs_masternodes);
             vector<CMasterNode>::iterator it = vecMasternodes.begin();
-            //check them separately
+            //check them separately, an expiry changes the status column
+            bool fChanged = false;
             while(it != vecMasternodes.end()){
+                int nPrevEnabled = (*it).enabled;
                 (*it).Check();
+                if((*it).enabled != nPrevEnabled) fChanged = true;
                 ++it;
             }
 
             //remove inactive
+            bool fRemoved = false;
             it = vecMasternodes.begin();
             while(it != vecMasternodes.end()){
                 if((*it).enabled == 4 || (*it).enabled == 3){
                     printf("Removing inactive masternode %s\n", (*it).addr.ToString().c_str());
                     it = vecMasternodes.erase(it);
+                    fRemoved = true;
                 } else {
                     ++it;
                 }
             }
-
-        }
-            masternodePayments.CleanPaymentList();
+            if(fRemoved)
+                masternodePayees.Invalidate();
+            if(fRemoved || fChanged)
+                uiInterface.NotifyMasternodeListChanged();
         }
+        masternodePayments.CleanPaymentList();
+    }
 
-        int mnRefresh = 30;
-
-        //try to sync the masternode list and payment list every 30 seconds from at least 3 nodes until we have them all
-        if(vNodes.size() > 2 && c % mnRefresh == 0 && (mnCount == 0 || vecMasternodes.size() < mnCount)) {
-            bool fIsInitialDownload = IsInitialBlockDownload();
-            if(!fIsInitialDownload) {
-                LOCK(cs_vNodes);
-                BOOST_FOREACH(CNode* pnode, vNodes)
-                {
-                    if (pnode->nVersion >= darkSendPool.PROTOCOL_VERSION) {
-
-                        //keep track of who we've asked for the list
-                        if(pnode->HasFulfilledRequest("mnsync"))
-                        {
-                            continue;
-                        } else {
-                            pnode->FulfilledRequest("mnsync");
-                            printf("Asking for Masternode list from %s\n",pnode->addr.ToStringIPPort().c_str());
-
-                            pnode->PushMessage("dseg", CTxIn()); //request full mn list
-                            pnode->PushMessage("mnget"); //sync payees
-                            pnode->PushMessage("getsporks"); //get current network sporks
-                            RequestedMasterNodeList++;
-                            break;
-                        }
+    int mnRefresh = 30;
+
+    //try to sync the masternode list and payment list every 30 seconds from at least 3 nodes until we have them all
+    if(vNodes.size() > 2 && c % mnRefresh == 0 && (mnCount == 0 || vecMasternodes.size() < mnCount)) {
+        bool fIsInitialDownload = IsInitialBlockDownload();
+        if(!fIsInitialDownload) {
+            LOCK(cs_vNodes);
+            BOOST_FOREACH(CNode* pnode, vNodes)
+            {
+                if (pnode->nVersion >= darkSendPool.PROTOCOL_VERSION) {
+
+                    //keep track of who we've asked for the list
+                    if(pnode->HasFulfilledRequest("mnsync"))
+                    {
+                        continue;
+                    } else {
+                        pnode->FulfilledRequest("mnsync");
+                        printf("Asking for Masternode list from %s\n",pnode->addr.ToStringIPPort().c_str());
+
+                        pnode->PushMessage("dseg", CTxIn()); //request full mn list
+                        pnode->PushMessage("mnget"); //sync payees
+                        pnode->PushMessage("getsporks"); //get current network sporks
+                        RequestedMasterNodeList++;
+                        break;
                     }
                 }
             }
         }
+    }
 
-        if(c % MASTERNODE_PING_SECONDS == 0){
-            activeMasternode.ManageStatus();
-        }
+    // returns immediately unless a ping is due or the status needs re-evaluation
+    activeMasternode.ManageStatus();
 
-        //if(c % (60*5) == 0){
-        if(c % 60 == 0){
-            //if we've used 1/5 of the masternode list, then clear the list.
-            if((int)vecMasternodesUsed.size() > (int)vecMasternodes.size() / 5)
-                vecMasternodesUsed.clear();
-        }
+    //if(c % (60*5) == 0){
+    if(c % 60 == 0){
+        //if we've used 1/5 of the masternode list, then clear the list.
+        if((int)vecMasternodesUsed.size() > (int)vecMasternodes.size() / 5)
+            vecMasternodesUsed.clear();
     }
 }
@@ -26,7 +26,8 @@ class CWalletTx;
 
 extern unsigned int nWalletDBUpdated;
 
-void ThreadFlushWalletDB(void* parg);
+/** Have the scheduler flush the wallet file whenever it has been idle for a while */
+void StartFlushWalletDB(const std::string& strFile);
 bool BackupWallet(const CWallet& wallet, const std::string& strDest);
 
 
@@ -124,6 +124,14 @@
 
 unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash);
 
+/** SipHash-2-4 of a 256-bit value, keyed with (k0, k1). Used to hash block and
+ *  transaction ids for in-memory hash tables. */
+uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256& val);
+/** SipHash-2-4 of a 256-bit value followed by a 32-bit integer (e.g. an outpoint). */
+uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256& val, uint32_t extra);
+/** SipHash-2-4 of an arbitrary byte string, as used by the block filters. */
+uint64_t SipHash(uint64_t k0, uint64_t k1, const unsigned char* pch, size_t nLen);
+
 typedef struct
 {
     SHA512_CTX ctxInner;
@@ -0,0 +1,53 @@
+// Copyright (c) 2018 The AveroPay developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_HASHMAP_H
+#define BITCOIN_HASHMAP_H
+
+#include "uint256.h"
+#include "hash.h"
+#include "util.h"
+#include "core.h"
+#include "protocol.h"
+
+#include <limits>
+
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+
+class CBlockIndex;
+
+/** Hash function for unordered containers keyed by block or transaction hashes.
+ *
+ * Keys are hashed with SipHash under a random per-container salt, so peers can't
+ * grind ids that all land in the same bucket. Node based containers are used on
+ * purpose: CBlockIndex::phashBlock, CInPoint::ptx and the wallet hand out pointers
+ * into their maps, and those have to stay valid across a rehash.
+ */
+class CSaltedHasher
+{
+private:
+    uint64_t k0, k1;
+
+public:
+    CSaltedHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+    size_t operator()(const uint256& hash) const
+    {
+        return SipHashUint256(k0, k1, hash);
+    }
+
+    size_t operator()(const COutPoint& outpoint) const
+    {
+        return SipHashUint256Extra(k0, k1, outpoint.hash, outpoint.n);
+    }
+
+    size_t operator()(const CInv& inv) const
+    {
+        return SipHashUint256Extra(k0, k1, inv.hash, inv.type);
+    }
+};
+
+typedef boost::unordered_map<uint256, CBlockIndex*, CSaltedHasher> BlockMap;
+
+#endif
@@ -0,0 +1,102 @@
+// Copyright (c) 2018 The AveroPay developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_INDEXEDBATCH_H
+#define BITCOIN_INDEXEDBATCH_H
+
+#include <string>
+
+#include <boost/unordered_map.hpp>
+
+#include <leveldb/slice.h>
+#include <leveldb/write_batch.h>
+
+/** The pending writes of a database transaction, indexed by key.
+ *
+ * Code that opens a database transaction expects its own reads to see the
+ * writes it made so far. Looking a key up here is a hash lookup, where
+ * iterating a leveldb::WriteBatch would cost time proportional to everything
+ * written in the transaction.
+ *
+ * Only the latest write of each key matters to the commit, so the values are
+ * kept once, in an append-only buffer the index points into, and the
+ * leveldb::WriteBatch is built from them when the transaction is committed.
+ */
+class CIndexedWriteBatch
+{
+private:
+    struct CPending
+    {
+        bool fDeleted;
+        size_t nOffset; // into strValues
+        size_t nSize;
+    };
+
+    typedef boost::unordered_map<std::string, CPending> PendingMap;
+    PendingMap mapPending;
+    std::string strValues;
+    leveldb::WriteBatch batch;
+
+public:
+    void Put(const std::string& key, const std::string& value)
+    {
+        std::pair<PendingMap::iterator, bool> ret = mapPending.insert(std::make_pair(key, CPending()));
+        CPending& entry = ret.first->second;
+        if (ret.second || entry.fDeleted || value.size() > entry.nSize)
+        {
+            entry.nOffset = strValues.size();
+            strValues.append(value);
+        }
+        else
+        {
+            // a rewrite that fits goes over the value it replaces
+            strValues.replace(entry.nOffset, value.size(), value);
+        }
+        entry.fDeleted = false;
+        entry.nSize = value.size();
+    }
+
+    void Delete(const std::string& key)
+    {
+        CPending& entry = mapPending[key];
+        entry.fDeleted = true;
+        entry.nOffset = 0;
+        entry.nSize = 0;
+    }
+
+    /** Returns true if the batch writes or deletes key. On a write, value is
+     * set and deleted is false; on a delete, deleted is true. */
+    bool Lookup(const std::string& key, std::string* value, bool* deleted) const
+    {
+        *deleted = false;
+        PendingMap::const_iterator mi = mapPending.find(key);
+        if (mi == mapPending.end())
+            return false;
+        if (mi->second.fDeleted)
+            *deleted = true;
+        else
+            value->assign(strValues, mi->second.nOffset, mi->second.nSize);
+        return true;
+    }
+
+    /** The batch to commit, with the latest write or delete of every key */
+    leveldb::WriteBatch* GetBatch()
+    {
+        batch.Clear();
+        for (PendingMap::const_iterator mi = mapPending.begin(); mi != mapPending.end(); ++mi)
+        {
+            if (mi->second.fDeleted)
+                batch.Delete(mi->first);
+            else
+                batch.Put(mi->first, leveldb::Slice(strValues.data() + mi->second.nOffset, mi->second.nSize));
+        }
+        return &batch;
+    }
+
+    size_t size() const
+    {
+        return mapPending.size();
+    }
+};
+
+#endif
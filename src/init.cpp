@@ -5,6 +5,10 @@
 
 #include "init.h"
 #include "main.h"
+#include "blockfilter.h"
+#include "blockwriter.h"
+#include "bootstrap.h"
+#include "publisher.h"
 #include "txdb.h"
 #include "walletdb.h"
 #include "bitcoinrpc.h"
@@ -17,6 +21,7 @@
 #include "masternodeconfig.h"
 #include "spork.h"
 #include "smessage.h"
+#include "scheduler.h"
 
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -94,11 +99,21 @@ void Shutdown(void* parg)
         fShutdown = true;
 
         SecureMsgShutdown();
+        scheduler.Stop();
 
         mempool.AddTransactionsUpdated(1);
 //        CTxDB().Close();
         bitdb.Flush(false);
         StopNode();
+        bootstrapExport.Stop();
+        blockFilterIndex.Stop();
+        {
+            // the thread is stopped first, it takes cs_main itself
+            LOCK(cs_main);
+            blockFilterIndex.Close();
+        }
+        notificationPublisher.Stop();
+        blockWriter.Stop();
         bitdb.Flush(true);
         boost::filesystem::remove(GetPidFile());
         UnregisterWallet(pwalletMain);
@@ -279,7 +294,7 @@ std::string HelpMessage()
         "  -socks=<n>             " + _("Select the version of socks proxy to use (4-5, default: 5)") + "\n" +
         "  -tor=<ip:port>         " + _("Use proxy to reach tor hidden services (default: same as -proxy)") + "\n"
         "  -dns                   " + _("Allow DNS lookups for -addnode, -seednode and -connect") + "\n" +
-        "  -port=<port>           " + _("Listen for connections on <port> (default: 45360 or testnet: 33338)") + "\n" +
+        "  -port=<port>           " + _("Listen for connections on <port> (default: 45360, testnet: 33338 or regtest: 33444)") + "\n" +
         "  -maxconnections=<n>    " + _("Maintain at most <n> connections to peers (default: 125)") + "\n" +
         "  -addnode=<ip>          " + _("Add a node to connect to and attempt to keep the connection open") + "\n" +
         "  -connect=<ip>          " + _("Connect only to the specified node(s)") + "\n" +
@@ -314,21 +329,28 @@ std::string HelpMessage()
         "  -daemon                " + _("Run in the background as a daemon and accept commands") + "\n" +
 #endif
         "  -testnet               " + _("Use the test network") + "\n" +
+        "  -regtest               " + _("Run a private regression test network where blocks can be created instantly with generate") + "\n" +
         "  -debug                 " + _("Output extra debugging information. Implies all other -debug* options") + "\n" +
         "  -debugnet              " + _("Output extra network debugging information") + "\n" +
         "  -logtimestamps         " + _("Prepend debug output with timestamp") + "\n" +
         "  -shrinkdebugfile       " + _("Shrink debug.log file on client startup (default: 1 when no -debug)") + "\n" +
         "  -printtoconsole        " + _("Send trace/debug info to console instead of debug.log file") + "\n" +
+        "  -printmemory           " + _("Log the estimated memory use of the main data structures every 10 minutes") + "\n" +
 #ifdef WIN32
         "  -printtodebugger       " + _("Send trace/debug info to debugger") + "\n" +
 #endif
         "  -rpcuser=<user>        " + _("Username for JSON-RPC connections") + "\n" +
         "  -rpcpassword=<pw>      " + _("Password for JSON-RPC connections") + "\n" +
-        "  -rpcport=<port>        " + _("Listen for JSON-RPC connections on <port> (default: 32339 or testnet: 32338)") + "\n" +
+        "  -rpcport=<port>        " + _("Listen for JSON-RPC connections on <port> (default: 32339, testnet: 32338 or regtest: 32444)") + "\n" +
         "  -rpcallowip=<ip>       " + _("Allow JSON-RPC connections from specified IP address") + "\n" +
         "  -rpcconnect=<ip>       " + _("Send commands to node running on <ip> (default: 127.0.0.1)") + "\n" +
+        "  -rpcbatchthreads=<n>   " + _("Number of threads executing read-only requests of JSON-RPC batches in parallel (default: 4)") + "\n" +
+        "  -rpcbatchlimit=<n>     " + _("Maximum number of requests in a JSON-RPC batch (default: 1000)") + "\n" +
+        "  -rpcbatchtimeout=<n>   " + _("Seconds after which the remaining requests of a JSON-RPC batch fail (default: 60)") + "\n" +
         "  -blocknotify=<cmd>     " + _("Execute command when the best block changes (%s in cmd is replaced by block hash)") + "\n" +
         "  -walletnotify=<cmd>    " + _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID)") + "\n" +
+        "  -pubnotify=<[ip:]port> " + _("Publish block, transaction, wallet, secure message and masternode winner notifications to subscribers connecting to <port> (default ip: 127.0.0.1)") + "\n" +
+        "  -pubnotifytopic=<topic> " + _("Only publish <topic> (hashblock, hashtx, rawblock, rawtx, hashwallettx, smsginbox, masternodewinner), can be specified multiple times") + "\n" +
         "  -confchange            " + _("Require a confirmations for change (default: 0)") + "\n" +
         "  -enforcecanonical      " + _("Enforce transaction scripts to use canonical PUSH operators (default: 1)") + "\n" +
         "  -alertnotify=<cmd>     " + _("Execute command when a relevant alert is received (%s in cmd is replaced by message)") + "\n" +
@@ -338,7 +360,10 @@ std::string HelpMessage()
         "  -salvagewallet         " + _("Attempt to recover private keys from a corrupt wallet.dat") + "\n" +
         "  -checkblocks=<n>       " + _("How many blocks to check at startup (default: 2500, 0 = all)") + "\n" +
         "  -checklevel=<n>        " + _("How thorough the block verification is (0-6, default: 1)") + "\n" +
+        "  -assumevalid=<hex>     " + _("Skip input script checks of this block and its ancestors (default: last checkpoint, 0 = check all)") + "\n" +
         "  -loadblock=<file>      " + _("Imports blocks from external blk000?.dat file") + "\n" +
+        "  -blockfilterindex      " + _("Keep a compact filter of every block and serve them to light clients (BIP 157/158)") + "\n" +
+        "  -reindexblockfilters   " + _("Rebuild the block filter index from the blk*.dat files") + "\n" +
 
         "\n" + _("Block creation options:") + "\n" +
         "  -blockminsize=<n>      "   + _("Set minimum block size in bytes (default: 0)") + "\n" +
@@ -362,7 +387,8 @@ std::string HelpMessage()
         "\n" + _("Secure messaging options:") + "\n" +
         "  -nosmsg                                  " + _("Disable secure messaging.") + "\n" +
         "  -debugsmsg                               " + _("Log extra debug messages.") + "\n" +
-        "  -smsgscanchain                           " + _("Scan the block chain for public key addresses on startup.") + "\n";
+        "  -smsgscanchain                           " + _("Scan the block chain for public key addresses in the background on startup, resuming an interrupted scan.") + "\n" +
+        "  -smsgpowthreads=<n>                      " + _("Number of threads doing proof of work for outgoing messages (default: 1)") + "\n";
 
     return strUsage;
 }
@@ -451,7 +477,11 @@ bool AppInit2()
 
     nDerivationMethodIndex = 0;
 
-    fTestNet = GetBoolArg("-testnet");
+    // regtest is a private test network, it shares testnet's addresses and relaxed rules
+    fRegTest = GetBoolArg("-regtest");
+    fTestNet = GetBoolArg("-testnet") || fRegTest;
+
+    Checkpoints::hashAssumeValid = uint256(GetArg("-assumevalid", Checkpoints::GetDefaultAssumeValid().GetHex()));
 
     //if (fTestNet)
 
@@ -608,6 +638,9 @@ bool AppInit2()
 
     int64_t nStart;
 
+    // runs the periodic jobs (wallet and peers.dat flushes, masternode checks) added below
+    scheduler.Start(2);
+
     // ********************************************************* Step 5: verify database integrity
 
     uiInterface.InitMessage(_("Verifying database integrity..."));
@@ -788,6 +821,16 @@ bool AppInit2()
     }
     printf(" block index %15" PRId64"ms\n", GetTimeMillis() - nStart);
 
+    if (GetBoolArg("-blockfilterindex") || GetBoolArg("-reindexblockfilters"))
+    {
+        uiInterface.InitMessage(_("Opening block filter index..."));
+        string strError;
+        LOCK(cs_main);
+        if (!blockFilterIndex.Open(GetBoolArg("-reindexblockfilters"), strError))
+            return InitError(strError);
+        nLocalServices |= NODE_COMPACT_FILTERS;
+    }
+
     if (GetBoolArg("-printblockindex") || GetBoolArg("-printblocktree"))
     {
         PrintBlockTree();
@@ -798,7 +841,7 @@ bool AppInit2()
     {
         string strMatch = mapArgs["-printblock"];
         int nFound = 0;
-        for (map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
+        for (BlockMap::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
         {
             uint256 hash = (*mi).first;
             if (strncmp(hash.ToString().c_str(), strMatch.c_str(), strMatch.size()) == 0)
@@ -1029,8 +1072,13 @@ bool AppInit2()
         uiInterface.NotifyAdrenalineNodeChanged(c);
     }
 
-    //Threading still needs reworking
-    NewThread(ThreadCheckDarkSendPool, NULL);
+    if(fMasterNode) {
+        // drive the masternode status from chain and network events instead of polling
+        uiInterface.NotifyBlocksChanged.connect(boost::bind(&CActiveMasternode::UpdatedBlockTip, &activeMasternode, _1, _2));
+        uiInterface.NotifyNumConnectionsChanged.connect(boost::bind(&CActiveMasternode::NotifyConnectionsChanged, &activeMasternode, _1));
+    }
+
+    scheduler.ScheduleEvery(CheckDarkSendPool, 1000);
 
     RandAddSeedPerfmon();
 
@@ -1062,6 +1110,18 @@ bool AppInit2()
     printf("mapWallet.size() = %" PRIszu"\n",       pwalletMain->mapWallet.size());
     printf("mapAddressBook.size() = %" PRIszu"\n",  pwalletMain->mapAddressBook.size());
 
+    // Blocks imported above were written synchronously; from here on they are
+    // queued for the block writer thread
+    blockWriter.Start();
+    blockFilterIndex.Start();
+
+    if (mapArgs.count("-pubnotify"))
+    {
+        std::string strError;
+        if (!notificationPublisher.Start(pwalletMain, strError))
+            return InitError(strError);
+    }
+
     if (!NewThread(StartNode, NULL))
         InitError(_("Error: could not start node"));
 
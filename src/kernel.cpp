@@ -39,6 +39,16 @@ static bool GetLastStakeModifier(const CBlockIndex* pindex, uint64_t& nStakeModi
 {
     if (!pindex)
         return error("GetLastStakeModifier: null pindex");
+    {
+        LOCK(chainActive.cs);
+        if (chainActive.Contains(pindex))
+        {
+            int nHeight = pindex->nHeight;
+            while (nHeight > 0 && !(chainActive.Hot(nHeight).nFlags & CBlockIndex::BLOCK_STAKE_MODIFIER))
+                nHeight--;
+            pindex = chainActive[nHeight];
+        }
+    }
     while (pindex && pindex->pprev && !pindex->GeneratedStakeModifier())
         pindex = pindex->pprev;
     if (!pindex->GeneratedStakeModifier())
@@ -64,20 +74,22 @@ static int64_t GetStakeModifierSelectionInterval()
     return nSelectionInterval;
 }
 
+// Candidate blocks ordered by (timestamp, hash), carrying the index entry
+// along so selection rounds don't have to look each one up again
+typedef pair<pair<int64_t, uint256>, const CBlockIndex*> StakeModifierCandidate;
+
 // select a block from the candidate blocks in vSortedByTimestamp, excluding
 // already selected blocks in vSelectedBlocks, and with timestamp up to
 // nSelectionIntervalStop.
-static bool SelectBlockFromCandidates(vector<pair<int64_t, uint256> >& vSortedByTimestamp, map<uint256, const CBlockIndex*>& mapSelectedBlocks,
+static bool SelectBlockFromCandidates(vector<StakeModifierCandidate>& vSortedByTimestamp, map<uint256, const CBlockIndex*>& mapSelectedBlocks,
     int64_t nSelectionIntervalStop, uint64_t nStakeModifierPrev, const CBlockIndex** pindexSelected)
 {
     bool fSelected = false;
     uint256 hashBest = 0;
     *pindexSelected = (const CBlockIndex*) 0;
-    BOOST_FOREACH(const PAIRTYPE(int64_t, uint256)& item, vSortedByTimestamp)
+    BOOST_FOREACH(const StakeModifierCandidate& item, vSortedByTimestamp)
     {
-        if (!mapBlockIndex.count(item.second))
-            return error("SelectBlockFromCandidates: failed to find block index for candidate block %s", item.second.ToString().c_str());
-        const CBlockIndex* pindex = mapBlockIndex[item.second];
+        const CBlockIndex* pindex = item.second;
         if (fSelected && pindex->GetBlockTime() > nSelectionIntervalStop)
             break;
         if (mapSelectedBlocks.count(pindex->GetBlockHash()) > 0)
@@ -144,15 +156,33 @@ bool ComputeNextStakeModifier(const CBlockIndex* pindexPrev, uint64_t& nStakeMod
         return true;
 
     // Sort candidate blocks by timestamp
-    vector<pair<int64_t, uint256> > vSortedByTimestamp;
+    vector<StakeModifierCandidate> vSortedByTimestamp;
     vSortedByTimestamp.reserve(64 * nModifierInterval / nTargetSpacing);
     int64_t nSelectionInterval = GetStakeModifierSelectionInterval();
     int64_t nSelectionIntervalStart = (pindexPrev->GetBlockTime() / nModifierInterval) * nModifierInterval - nSelectionInterval;
     const CBlockIndex* pindex = pindexPrev;
-    while (pindex && pindex->GetBlockTime() >= nSelectionIntervalStart)
     {
-        vSortedByTimestamp.push_back(make_pair(pindex->GetBlockTime(), pindex->GetBlockHash()));
-        pindex = pindex->pprev;
+        LOCK(chainActive.cs);
+        if (chainActive.Contains(pindex))
+        {
+            // Scan the packed timestamps and only touch the entries that qualify
+            int nHeight = pindex->nHeight;
+            while (nHeight >= 0 && (int64_t)chainActive.Hot(nHeight).nTime >= nSelectionIntervalStart)
+            {
+                const CBlockIndex* pindexCandidate = chainActive[nHeight];
+                vSortedByTimestamp.push_back(make_pair(make_pair(pindexCandidate->GetBlockTime(), pindexCandidate->GetBlockHash()), pindexCandidate));
+                nHeight--;
+            }
+            pindex = chainActive[nHeight];
+        }
+        else
+        {
+            while (pindex && pindex->GetBlockTime() >= nSelectionIntervalStart)
+            {
+                vSortedByTimestamp.push_back(make_pair(make_pair(pindex->GetBlockTime(), pindex->GetBlockHash()), pindex));
+                pindex = pindex->pprev;
+            }
+        }
     }
     int nHeightFirstCandidate = pindex ? (pindex->nHeight + 1) : 0;
     reverse(vSortedByTimestamp.begin(), vSortedByTimestamp.end());
@@ -221,7 +251,37 @@ static bool GetKernelStakeModifier(uint256 hashBlockFrom, uint64_t& nStakeModifi
     nStakeModifierTime = pindexFrom->GetBlockTime();
     int64_t nStakeModifierSelectionInterval = GetStakeModifierSelectionInterval();
     const CBlockIndex* pindex = pindexFrom;
-    
+
+    {
+        LOCK(chainActive.cs);
+        if (chainActive.Contains(pindexFrom))
+        {
+            // Same walk as below, over the packed active chain headers
+            int nHeight = pindexFrom->nHeight;
+            while (nStakeModifierTime < pindexFrom->GetBlockTime() + nStakeModifierSelectionInterval)
+            {
+                if (nHeight >= chainActive.Height())
+                {   // reached best block; may happen if node is behind on block chain
+                    const CBlockIndex* pindexTip = chainActive.Tip();
+                    if (fPrintProofOfStake || (pindexTip->GetBlockTime() + nStakeMinAge - nStakeModifierSelectionInterval > GetAdjustedTime()))
+                        return error("GetKernelStakeModifier() : reached best block %s at height %d from block %s",
+                            pindexTip->GetBlockHash().ToString().c_str(), pindexTip->nHeight, hashBlockFrom.ToString().c_str());
+                    else
+                        return false;
+                }
+                nHeight++;
+                const CBlockIndexHot& hot = chainActive.Hot(nHeight);
+                if (hot.nFlags & CBlockIndex::BLOCK_STAKE_MODIFIER)
+                {
+                    nStakeModifierHeight = nHeight;
+                    nStakeModifierTime = hot.nTime;
+                }
+            }
+            nStakeModifier = chainActive[nHeight]->nStakeModifier;
+            return true;
+        }
+    }
+
     // loop to find the stake modifier later by a selection interval
     while (nStakeModifierTime < pindexFrom->GetBlockTime() + nStakeModifierSelectionInterval)
     {
@@ -367,7 +427,7 @@ bool CheckCoinStakeTimestamp(int64_t nTimeBlock, int64_t nTimeTx)
 // Get stake modifier checksum
 unsigned int GetStakeModifierChecksum(const CBlockIndex* pindex)
 {
-    assert (pindex->pprev || pindex->GetBlockHash() == (!fTestNet ? hashGenesisBlock : hashGenesisBlockTestNet));
+    assert (pindex->pprev || pindex->GetBlockHash() == GetGenesisBlockHash());
     
     // Hash previous checksum with flags, hashProofOfStake and nStakeModifier
     CDataStream ss(SER_GETHASH, 0);
@@ -6,6 +6,11 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "alert.h"
+#include "arith_uint256.h"
+#include "blockfilter.h"
+#include "blockstats.h"
+#include "blockwriter.h"
+#include "bootstrap.h"
 #include "checkpoints.h"
 #include "db.h"
 #include "txdb.h"
@@ -17,6 +22,7 @@
 #include "masternode.h"
 #include "spork.h"
 #include "smessage.h"
+#include "publisher.h"
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -37,12 +43,15 @@ CCriticalSection cs_main;
 CTxMemPool mempool;
 //unsigned int nTransactionsUpdated = 0;
 
-map<uint256, CBlockIndex*> mapBlockIndex;
+BlockMap mapBlockIndex;
 set<pair<COutPoint, unsigned int> > setStakeSeen;
 
-CBigNum bnProofOfWorkLimit(~uint256(0) >> 20);      // "standard" scrypt target limit for proof of work, results with 0,000244140625 proof-of-work difficulty
-CBigNum bnProofOfStakeLimit(~uint256(0) >> 20);
-CBigNum bnProofOfWorkLimitTestNet(~uint256(0) >> 16);
+arith_uint256 bnProofOfWorkLimit(~arith_uint256(0) >> 20);      // "standard" scrypt target limit for proof of work, results with 0,000244140625 proof-of-work difficulty
+arith_uint256 bnProofOfStakeLimit(~arith_uint256(0) >> 20);
+arith_uint256 bnProofOfWorkLimitTestNet(~arith_uint256(0) >> 16);
+arith_uint256 bnProofOfWorkLimitRegTest(~arith_uint256(0) >> 1);
+
+uint256 hashGenesisBlockRegTest = 0;
 
 // Block Variables
 
@@ -60,6 +69,8 @@ uint256 nBestInvalidTrust = 0;
 
 uint256 hashBestChain = 0;
 CBlockIndex* pindexBest = NULL;
+CChainIndex chainActive;
+CBlockIndexArena blockIndexArena;
 int64_t nTimeBestReceived = 0;
 
 bool fImporting = false;
@@ -184,6 +195,11 @@ void SyncWithWallets(const CTransaction& tx, const CBlock* pblock, bool fUpdate,
 
     BOOST_FOREACH(CWallet* pwallet, setpwalletRegistered)
         pwallet->AddToWalletIfInvolvingMe(tx, pblock, fUpdate);
+
+    notificationPublisher.NotifyTransaction(tx);
+
+    // let the active masternode notice its collateral being spent
+    activeMasternode.SyncTransaction(tx);
 }
 
 // notify wallets about a new best chain
@@ -256,7 +272,7 @@ bool AddOrphanTx(const CTransaction& tx)
     // 10,000 orphans, each of which is at most 5,000 bytes big is
     // at most 500 megabytes of orphans:
 
-    size_t nSize = tx.GetSerializeSize(SER_NETWORK, CTransaction::CURRENT_VERSION);
+    size_t nSize = tx.GetTxSize();
 
     if (nSize > 5000)
     {
@@ -429,7 +445,7 @@ bool IsStandardTx(const CTransaction& tx, string& reason)
     // almost as much to process as they cost the sender in fees, because
     // computing signature hashes is O(ninputs*txsize). Limiting transactions
     // to MAX_STANDARD_TX_SIZE mitigates CPU exhaustion attacks.
-    unsigned int sz = tx.GetSerializeSize(SER_NETWORK, CTransaction::CURRENT_VERSION);
+    unsigned int sz = tx.GetTxSize();
     if (sz >= MAX_STANDARD_TX_SIZE) {
         reason = "tx-size";
         return false;
@@ -631,7 +647,7 @@ int CMerkleTx::SetMerkleBranch(const CBlock* pblock)
     vMerkleBranch = pblock->GetMerkleBranch(nIndex);
 
     // Is the tx in a block that's in the main chain
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
     if (mi == mapBlockIndex.end())
         return 0;
     CBlockIndex* pindex = (*mi).second;
@@ -655,7 +671,7 @@ bool CTransaction::CheckTransaction() const
     if (vout.empty())
         return DoS(10, error("CTransaction::CheckTransaction() : vout empty"));
     // Size limits
-    if (::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION) > MAX_BLOCK_SIZE)
+    if (GetTxSize() > MAX_BLOCK_SIZE)
         return DoS(100, error("CTransaction::CheckTransaction() : size limits failed"));
 
     // Check for negative or overflow output values
@@ -811,7 +827,7 @@ bool CTxMemPool::accept(CTxDB& txdb, CTransaction &tx,
         // reasonable number of ECDSA signature verifications.
 
         int64_t nFees = tx.GetValueIn(mapInputs)-tx.GetValueOut();
-        unsigned int nSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        unsigned int nSize = tx.GetTxSize();
 
         // Don't accept it if it can't get into a block
         int64_t txMinFee = tx.GetMinFee(1000, GMF_RELAY, nSize);
@@ -960,7 +976,7 @@ bool AcceptableInputs(CTxMemPool& pool, const CTransaction &txo, bool fLimitFree
                                 hash.ToString().c_str(), nSigOps, MAX_TX_SIGOPS));
 
         int64_t nFees = tx.GetValueIn(mapInputs)-tx.GetValueOut();
-        unsigned int nSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        unsigned int nSize = tx.GetTxSize();
 
         // Don't accept it if it can't get into a block
         int64_t txMinFee = tx.GetMinFee(1000, GMF_RELAY, nSize);
@@ -1064,7 +1080,7 @@ bool CTxMemPool::remove(const CTransaction &tx, bool fRecursive)
         {
             if (fRecursive) {
                 for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                    std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(hash, i));
+                    NextTxMap::iterator it = mapNextTx.find(COutPoint(hash, i));
                     if (it != mapNextTx.end())
                         remove(*it->second.ptx, true);
                 }
@@ -1083,7 +1099,7 @@ bool CTxMemPool::removeConflicts(const CTransaction &tx)
     // Remove transactions which depend on inputs of tx, recursively
     LOCK(cs);
     BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-        std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(txin.prevout);
+        NextTxMap::iterator it = mapNextTx.find(txin.prevout);
         if (it != mapNextTx.end()) {
             const CTransaction &txConflict = *it->second.ptx;
             if (txConflict != tx)
@@ -1101,13 +1117,22 @@ void CTxMemPool::clear()
     ++nTransactionsUpdated;
 }
 
+size_t CTxMemPool::DynamicMemoryUsage() const
+{
+    LOCK(cs);
+    size_t nUsage = memusage::DynamicUsage(mapTx) + memusage::DynamicUsage(mapNextTx);
+    for (TxMap::const_iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
+        nUsage += RecursiveDynamicUsage(mi->second);
+    return nUsage;
+}
+
 void CTxMemPool::queryHashes(std::vector<uint256>& vtxid)
 {
     vtxid.clear();
 
     LOCK(cs);
     vtxid.reserve(mapTx.size());
-    for (map<uint256, CTransaction>::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
+    for (TxMap::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
         vtxid.push_back((*mi).first);
 }
 
@@ -1118,7 +1143,7 @@ int CMerkleTx::GetDepthInMainChainINTERNAL(CBlockIndex* &pindexRet) const
     AssertLockHeld(cs_main);
 
     // Find the block it claims to be in
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+    BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
     if (mi == mapBlockIndex.end())
         return 0;
     CBlockIndex* pindex = (*mi).second;
@@ -1128,7 +1153,7 @@ int CMerkleTx::GetDepthInMainChainINTERNAL(CBlockIndex* &pindexRet) const
     // Make sure the merkle branch connects to this block
     if (!fMerkleVerified)
     {
-        if (CBlock::CheckMerkleBranch(GetHash(), vMerkleBranch, nIndex) != pindex->hashMerkleRoot)
+        if (CBlock::CheckMerkleBranch(GetHash(), vMerkleBranch, nIndex) != pindex->GetCold().hashMerkleRoot)
             return 0;
         fMerkleVerified = true;
     }
@@ -1171,13 +1196,17 @@ bool CWalletTx::AcceptWalletTransaction(CTxDB& txdb)
 
     {
         // Add previous supporting transactions first
-        BOOST_FOREACH(CMerkleTx& tx, vtxPrev)
+        BOOST_FOREACH(const CMerkleTxRef& ptx, vtxPrev)
         {
-            if (!(tx.IsCoinBase() || tx.IsCoinStake()))
+            if (!(ptx->IsCoinBase() || ptx->IsCoinStake()))
             {
-                uint256 hash = tx.GetHash();
+                uint256 hash = ptx->GetHash();
                 if (!mempool.exists(hash) && !txdb.ContainsTx(hash))
+                {
+                    // the shared copy is not changed, the mempool gets its own
+                    CMerkleTx tx(*ptx);
                     tx.AcceptToMemoryPool(txdb);
+                }
             }
         }
         return AcceptToMemoryPool(txdb);
@@ -1198,7 +1227,7 @@ int CTxIndex::GetDepthInMainChain() const
     if (!block.ReadFromDisk(pos.nFile, pos.nBlockPos, false))
         return 0;
     // Find the block in the index
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(block.GetHash());
+    BlockMap::iterator mi = mapBlockIndex.find(block.GetHash());
     if (mi == mapBlockIndex.end())
         return 0;
     CBlockIndex* pindex = (*mi).second;
@@ -1246,22 +1275,147 @@ bool GetTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock, b
 // CBlock and CBlockIndex
 //
 
-static CBlockIndex* pblockindexFBBHLast;
+CBlockIndex* CBlockIndexArena::Allocate()
+{
+    LOCK(cs);
+    if (!vFree.empty())
+    {
+        CBlockIndex* pindex = vFree.back();
+        vFree.pop_back();
+        return pindex;
+    }
+    if (nUsedInChunk == nChunkSize)
+    {
+        vChunks.push_back(new CBlockIndex[nChunkSize]);
+        vColdChunks.push_back(new CBlockIndexCold[nChunkSize]);
+        nUsedInChunk = 0;
+    }
+    CBlockIndex* pindex = &vChunks.back()[nUsedInChunk];
+    pindex->pcold = &vColdChunks.back()[nUsedInChunk];
+    nUsedInChunk++;
+    return pindex;
+}
+
+void CBlockIndexArena::Release(CBlockIndex* pindex)
+{
+    LOCK(cs);
+    CBlockIndexCold* pcold = pindex->pcold;
+    *pcold = CBlockIndexCold();
+    *pindex = CBlockIndex();
+    pindex->pcold = pcold;
+    vFree.push_back(pindex);
+}
+
+size_t CBlockIndexArena::GetReservedBytes() const
+{
+    LOCK(cs);
+    return vChunks.size() * nChunkSize * (sizeof(CBlockIndex) + sizeof(CBlockIndexCold)) +
+           memusage::DynamicUsage(vFree);
+}
+
+void CChainIndex::SetTip(CBlockIndex* pindex)
+{
+    if (pindex == NULL)
+    {
+        vChain.clear();
+        vHot.clear();
+        return;
+    }
+    vChain.resize(pindex->nHeight + 1);
+    vHot.resize(pindex->nHeight + 1);
+    while (pindex && vChain[pindex->nHeight] != pindex)
+    {
+        CBlockIndexHot& hot = vHot[pindex->nHeight];
+        hot.nTime = pindex->nTime;
+        hot.nBits = pindex->nBits;
+        hot.nVersion = pindex->nVersion;
+        hot.nFlags = pindex->nFlags;
+        vChain[pindex->nHeight] = pindex;
+        pindex = pindex->pprev;
+    }
+}
+
 CBlockIndex* FindBlockByHeight(int nHeight)
 {
-    CBlockIndex *pblockindex;
-    if (nHeight < nBestHeight / 2)
-        pblockindex = pindexGenesisBlock;
-    else
-        pblockindex = pindexBest;
-    if (pblockindexFBBHLast && abs(nHeight - pblockindex->nHeight) > abs(nHeight - pblockindexFBBHLast->nHeight))
-        pblockindex = pblockindexFBBHLast;
-    while (pblockindex->nHeight > nHeight)
-        pblockindex = pblockindex->pprev;
-    while (pblockindex->nHeight < nHeight)
-        pblockindex = pblockindex->pnext;
-    pblockindexFBBHLast = pblockindex;
-    return pblockindex;
+    LOCK(chainActive.cs);
+    return chainActive[nHeight];
+}
+
+size_t RecursiveDynamicUsage(const CTransaction& tx)
+{
+    size_t nUsage = memusage::DynamicUsage(tx.vin) + memusage::DynamicUsage(tx.vout);
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        nUsage += memusage::DynamicUsage(txin.scriptSig);
+    BOOST_FOREACH(const CTxOut& txout, tx.vout)
+        nUsage += memusage::DynamicUsage(txout.scriptPubKey);
+    return nUsage;
+}
+
+size_t RecursiveDynamicUsage(const CBlock& block)
+{
+    size_t nUsage = memusage::DynamicUsage(block.vtx) + memusage::DynamicUsage(block.vchBlockSig) + memusage::DynamicUsage(block.vMerkleTree);
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+        nUsage += RecursiveDynamicUsage(tx);
+    return nUsage;
+}
+
+size_t GetBlockIndexMemoryUsage()
+{
+    size_t nUsage;
+    {
+        LOCK(cs_main);
+        nUsage = memusage::DynamicUsage(mapBlockIndex) + blockIndexArena.GetReservedBytes();
+    }
+    {
+        LOCK(chainActive.cs);
+        nUsage += chainActive.DynamicMemoryUsage();
+    }
+    return nUsage;
+}
+
+size_t GetOrphanBlocksMemoryUsage()
+{
+    LOCK(cs_main);
+    size_t nUsage = memusage::DynamicUsage(mapOrphanBlocks) + memusage::DynamicUsage(mapOrphanBlocksByPrev);
+    for (map<uint256, CBlock*>::iterator mi = mapOrphanBlocks.begin(); mi != mapOrphanBlocks.end(); ++mi)
+        nUsage += memusage::MallocUsage(sizeof(CBlock)) + RecursiveDynamicUsage(*mi->second);
+    return nUsage;
+}
+
+size_t GetOrphanTxMemoryUsage()
+{
+    LOCK(cs_main);
+    size_t nUsage = memusage::DynamicUsage(mapOrphanTransactions) + memusage::DynamicUsage(mapOrphanTransactionsByPrev);
+    for (map<uint256, CTransaction>::iterator mi = mapOrphanTransactions.begin(); mi != mapOrphanTransactions.end(); ++mi)
+        nUsage += RecursiveDynamicUsage(mi->second);
+    for (map<uint256, set<uint256> >::iterator mi = mapOrphanTransactionsByPrev.begin(); mi != mapOrphanTransactionsByPrev.end(); ++mi)
+        nUsage += memusage::DynamicUsage(mi->second);
+    return nUsage;
+}
+
+const CBlockIndexCold& CBlockIndex::GetCold() const
+{
+    static const CBlockIndexCold coldNull;
+    return pcold ? *pcold : coldNull;
+}
+
+int64_t CBlockIndex::GetMedianTimePast() const
+{
+    if (nMedianTimePast)
+        return nMedianTimePast;
+
+    // Only reached from SetChainCache() while this entry's cache is being filled,
+    // before it can be in chainActive, so the walk is all that is needed here
+    int64_t pmedian[nMedianTimeSpan];
+    int64_t* pbegin = &pmedian[nMedianTimeSpan];
+    int64_t* pend = &pmedian[nMedianTimeSpan];
+
+    const CBlockIndex* pindex = this;
+    for (int i = 0; i < nMedianTimeSpan && pindex; i++, pindex = pindex->pprev)
+        *(--pbegin) = pindex->GetBlockTime();
+
+    std::sort(pbegin, pend);
+    return pbegin[(pend - pbegin)/2];
 }
 
 bool CBlock::ReadFromDisk(const CBlockIndex* pindex, bool fReadTransactions)
@@ -1349,15 +1503,17 @@ static const int64_t nTargetTimespan = 120;
 //
 // maximum nBits value could possible be required nTime after
 //
-unsigned int ComputeMaxBits(CBigNum bnTargetLimit, unsigned int nBase, int64_t nTime)
+unsigned int ComputeMaxBits(const arith_uint256& bnTargetLimit, unsigned int nBase, int64_t nTime)
 {
-    CBigNum bnResult;
+    // nBase is the nBits of an accepted block; doubling a target at or above
+    // the limit only ends at the limit, so none of this can overflow
+    arith_uint256 bnResult;
     bnResult.SetCompact(nBase);
-    bnResult *= 2;
+    bnResult = bnResult < bnTargetLimit ? bnResult << 1 : bnTargetLimit;
     while (nTime > 0 && bnResult < bnTargetLimit)
     {
         // Maximum 200% adjustment per day...
-        bnResult *= 2;
+        bnResult <<= 1;
         nTime -= 24 * 60 * 60;
     }
     if (bnResult > bnTargetLimit)
@@ -1387,17 +1543,26 @@ unsigned int ComputeMinStake(unsigned int nBase, int64_t nTime, unsigned int nBl
 // ppcoin: find last block index up to pindex
 const CBlockIndex* GetLastBlockIndex(const CBlockIndex* pindex, bool fProofOfStake)
 {
+    if (pindex)
+    {
+        const CBlockIndex* pindexLast = fProofOfStake ? pindex->pindexLastPoS : pindex->pindexLastPoW;
+        if (pindexLast)
+            return pindexLast;
+    }
+
+    // Every indexed entry has its cache filled when it is added or loaded, this
+    // walk only covers entries that are not in mapBlockIndex
     while (pindex && pindex->pprev && (pindex->IsProofOfStake() != fProofOfStake))
         pindex = pindex->pprev;
     return pindex;
 }
 
-unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfStake)
+static unsigned int ComputeNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfStake)
 {
-    CBigNum bnTargetLimit = fProofOfStake ? bnProofOfStakeLimit : bnProofOfWorkLimit;
+    const arith_uint256& bnTargetLimit = fProofOfStake ? bnProofOfStakeLimit : bnProofOfWorkLimit;
 
-    if (pindexLast == NULL)
-        return bnTargetLimit.GetCompact(); // genesis block
+    if (pindexLast == NULL || fRegTest)
+        return bnTargetLimit.GetCompact(); // genesis block, or no retargeting on regtest
 
     const CBlockIndex* pindexPrev = GetLastBlockIndex(pindexLast, fProofOfStake);
     if (pindexPrev->pprev == NULL)
@@ -1412,28 +1577,60 @@ unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfS
 
     // ppcoin: target change every block
     // ppcoin: retarget with exponential moving toward target spacing
-    CBigNum bnNew;
-    bnNew.SetCompact(pindexPrev->nBits);
+    bool fNegative, fOverflow;
+    arith_uint256 bnNew;
+    bnNew.SetCompact(pindexPrev->nBits, &fNegative, &fOverflow);
     int64_t nInterval = nTargetTimespan / nTargetSpacing;
-    bnNew *= ((nInterval - 1) * nTargetSpacing + nActualSpacing + nActualSpacing);
-    bnNew /= ((nInterval + 1) * nTargetSpacing);
+    arith_uint256 bnMul = (nInterval - 1) * nTargetSpacing + nActualSpacing + nActualSpacing;
+    arith_uint256 bnDiv = (nInterval + 1) * nTargetSpacing;
 
-    if (bnNew <= 0 || bnNew > bnTargetLimit)
+    // a product past 256 bits is divided back to far above the limit
+    if (fNegative || fOverflow || bnNew == 0 || bnMul == 0 || bnNew > ~arith_uint256(0) / bnMul)
         bnNew = bnTargetLimit;
+    else
+    {
+        bnNew *= bnMul;
+        bnNew /= bnDiv;
+        if (bnNew == 0 || bnNew > bnTargetLimit)
+            bnNew = bnTargetLimit;
+    }
 
     return bnNew.GetCompact();
 }
+
+unsigned int GetNextTargetRequired(const CBlockIndex* pindexLast, bool fProofOfStake)
+{
+    if (pindexLast)
+    {
+        unsigned int nTarget = fProofOfStake ? pindexLast->nNextTargetPoS : pindexLast->nNextTargetPoW;
+        if (nTarget)
+            return nTarget;
+    }
+    return ComputeNextTargetRequired(pindexLast, fProofOfStake);
+}
+
+void CBlockIndex::SetChainCache()
+{
+    pindexLastPoW = (IsProofOfWork() || !pprev) ? this : GetLastBlockIndex(pprev, false);
+    pindexLastPoS = (IsProofOfStake() || !pprev) ? this : GetLastBlockIndex(pprev, true);
+    nMedianTimePast = 0;
+    nMedianTimePast = GetMedianTimePast();
+    nNextTargetPoW = ComputeNextTargetRequired(this, false);
+    nNextTargetPoS = ComputeNextTargetRequired(this, true);
+}
+
 bool CheckProofOfWork(uint256 hash, unsigned int nBits)
 {
-    CBigNum bnTarget;
-    bnTarget.SetCompact(nBits);
+    bool fNegative, fOverflow;
+    arith_uint256 bnTarget;
+    bnTarget.SetCompact(nBits, &fNegative, &fOverflow);
 
     // Check range
-    if (bnTarget <= 0 || bnTarget > bnProofOfWorkLimit)
+    if (fNegative || fOverflow || bnTarget == 0 || bnTarget > bnProofOfWorkLimit)
         return error("CheckProofOfWork() : nBits below minimum work");
 
     // Check proof of work matches claimed amount
-    if (hash > bnTarget.getuint256())
+    if (UintToArith256(hash) > bnTarget)
         return error("CheckProofOfWork() : hash doesn't match nBits");
 
     return true;
@@ -1727,33 +1924,28 @@ bool CTransaction::ConnectInputs(CTxDB& txdb, MapPrevTx inputs, map<uint256, CTx
 
     	if(fValidateSig)
 	    {
-            // Skip ECDSA signature verification when connecting blocks (fBlock=true)
-            // before the last blockchain checkpoint. This is safe because block merkle hashes are
-            // still computed and checked, and any change will be caught at the next checkpoint.
-            if (!(fBlock && (nBestHeight < Checkpoints::GetTotalBlocksEstimate())))
+            // Verify signature. ConnectBlock turns fValidateSig off for
+            // blocks covered by -assumevalid, see Checkpoints::IsAssumedValid
+            if (!VerifySignature(txPrev, *this, i, flags, 0))
             {
-                // Verify signature
-                if (!VerifySignature(txPrev, *this, i, flags, 0))
-                {
-                    if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS) {
-                    // Check whether the failure was caused by a
-                    // non-mandatory script verification check, such as
-                    // non-null dummy arguments;
-                    // if so, don't trigger DoS protection to
-                    // avoid splitting the network between upgraded and
-                    // non-upgraded nodes.
-                    if (VerifySignature(txPrev, *this, i, flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, 0))
-                        return error("ConnectInputs() : %s non-mandatory VerifySignature failed", GetHash().ToString().c_str());
-                    }
-                    // Failures of other flags indicate a transaction that is
-                    // invalid in new blocks, e.g. a invalid P2SH. We DoS ban
-                    // such nodes as they are not following the protocol. That
-                    // said during an upgrade careful thought should be taken
-                    // as to the correct behavior - we may want to continue
-                    // peering with non-upgraded nodes even after a soft-fork
-                    // super-majority vote has passed.
-                    return DoS(100,error("ConnectInputs() : %s VerifySignature failed", GetHash().ToString().substr(0,10).c_str()));
+                if (flags & STANDARD_NOT_MANDATORY_VERIFY_FLAGS) {
+                // Check whether the failure was caused by a
+                // non-mandatory script verification check, such as
+                // non-null dummy arguments;
+                // if so, don't trigger DoS protection to
+                // avoid splitting the network between upgraded and
+                // non-upgraded nodes.
+                if (VerifySignature(txPrev, *this, i, flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, 0))
+                    return error("ConnectInputs() : %s non-mandatory VerifySignature failed", GetHash().ToString().c_str());
                 }
+                // Failures of other flags indicate a transaction that is
+                // invalid in new blocks, e.g. a invalid P2SH. We DoS ban
+                // such nodes as they are not following the protocol. That
+                // said during an upgrade careful thought should be taken
+                // as to the correct behavior - we may want to continue
+                // peering with non-upgraded nodes even after a soft-fork
+                // super-majority vote has passed.
+                return DoS(100,error("ConnectInputs() : %s VerifySignature failed", GetHash().ToString().substr(0,10).c_str()));
             }
         }
             // Mark outpoints as spent
@@ -1806,6 +1998,8 @@ bool CBlock::DisconnectBlock(CTxDB& txdb, CBlockIndex* pindex)
             return error("DisconnectBlock() : WriteBlockIndex failed");
     }
 
+    blockFilterIndex.BlockDisconnected(pindex);
+
     // ppcoin: clean up wallet after disconnecting coinstake
     BOOST_FOREACH(CTransaction& tx, vtx)
         SyncWithWallets(tx, this, false, false);
@@ -1939,6 +2133,10 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
     }
     */
 
+    // Below the -assumevalid block only the input scripts are skipped; amounts,
+    // maturity, double spends and the stake kernel are still checked
+    bool fScriptChecks = fJustCheck || !Checkpoints::IsAssumedValid(pindex);
+
     //// issue here: it doesn't know the version
     unsigned int nTxPos;
     if (fJustCheck)
@@ -1953,6 +2151,10 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
     int64_t nValueIn = 0;
     int64_t nValueOut = 0;
     int64_t nStakeReward = 0;
+    int64_t nStakeAmount = 0;
+    vector<pair<int64_t, unsigned int> > vFeeRates;
+    bool fFilterIndex = !fJustCheck && blockFilterIndex.IsEnabled();
+    vector<CScript> vSpentScripts;
     unsigned int nSigOps = 0;
     BOOST_FOREACH(CTransaction& tx, vtx)
     {
@@ -1983,7 +2185,7 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
 
         CDiskTxPos posThisTx(pindex->nFile, pindex->nBlockPos, nTxPos);
         if (!fJustCheck)
-            nTxPos += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
+            nTxPos += tx.GetTxSize();
 
         MapPrevTx mapInputs;
         if (tx.IsCoinBase())
@@ -2006,12 +2208,25 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
             nValueIn += nTxValueIn;
             nValueOut += nTxValueOut;
             if (!tx.IsCoinStake())
+            {
+                unsigned int nTxSize = tx.GetTxSize();
                 nFees += nTxValueIn - nTxValueOut;
+                vFeeRates.push_back(make_pair((nTxValueIn - nTxValueOut) * 1000 / nTxSize, nTxSize));
+            }
             if (tx.IsCoinStake())
+            {
                 nStakeReward = nTxValueOut - nTxValueIn;
+                nStakeAmount = nTxValueIn;
+            }
 
-            if (!tx.ConnectInputs(txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false, flags))
+            if (!tx.ConnectInputs(txdb, mapInputs, mapQueuedChanges, posThisTx, pindex, true, false, flags, fScriptChecks))
                 return false;
+
+            if (fFilterIndex)
+            {
+                BOOST_FOREACH(const CTxIn& txin, tx.vin)
+                    vSpentScripts.push_back(mapInputs[txin.prevout.hash].second.vout[txin.prevout.n].scriptPubKey);
+            }
         }
 
         mapQueuedChanges[hashTx] = CTxIndex(posThisTx, tx.vout.size());
@@ -2055,22 +2270,12 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
     bool MasternodePayments = false;
     bool fIsInitialDownload = IsInitialBlockDownload();
 
-    if (fTestNet){
-        if (pindex->nHeight > BLOCK_START_MASTERNODE_PAYMENTS_TESTNET){ // Block 75k Testnet
-            MasternodePayments = true;
-            if(fDebug) { printf("CheckBlock() : Masternode payments enabled\n"); }
-        }else{
-            MasternodePayments = false;
-            if(fDebug) { printf("CheckBlock() : Masternode payments disabled\n"); }
-        }
+    if (pindex->nHeight > GetMasternodePaymentsStartBlock()){
+        MasternodePayments = true;
+        if(fDebug) { printf("CheckBlock() : Masternode payments enabled\n"); }
     }else{
-        if (pindex->nHeight > BLOCK_START_MASTERNODE_PAYMENTS){ //Block 645k Mainnet
-            MasternodePayments = true;
-            if(fDebug) { printf("CheckBlock() : Masternode payments enabled\n"); }
-        }else{
-            MasternodePayments = false;
-            if(fDebug) { printf("CheckBlock() : Masternode payments disabled\n"); }
-        }
+        MasternodePayments = false;
+        if(fDebug) { printf("CheckBlock() : Masternode payments disabled\n"); }
     }
 
 
@@ -2113,27 +2318,29 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
                             foundPaymentAmount = true;
                         if(vtx[1].vout[i].scriptPubKey == payee )
                             foundPayee = true;
-                            CScript pubScript;
-                            BOOST_FOREACH(CMasterNode& mn, vecMasternodes)
+
+                        LOCK(cs_masternodes);
+                        std::vector<CMasterNode*> vPaid;
+                        masternodePayees.Find(vtx[1].vout[i].scriptPubKey, vPaid);
+                        BOOST_FOREACH(CMasterNode* pmn, vPaid)
+                        {
+                            CMasterNode& mn = *pmn;
+                            int lastPaid = mn.nBlockLastPaid;
+                            int paidAge = pindex->nHeight+1 - lastPaid;
+                            if (fDebug)
                             {
-                                pubScript = GetScriptForDestination(mn.pubkey.GetID());
                                 CTxDestination address1;
-                                ExtractDestination(pubScript, address1);
+                                ExtractDestination(vtx[1].vout[i].scriptPubKey, address1);
                                 CBitcoinAddress address2(address1);
-
-                                if (vtx[1].vout[i].scriptPubKey == pubScript)
-                                {
-                                    int lastPaid = mn.nBlockLastPaid;
-                                    int paidAge = pindex->nHeight+1 - lastPaid;
-                                    if (fDebug) printf("Masternode PoS payee found at block %d: %s who got paid %s AOP (last payment was %d blocks ago at %d)\n", pindex->nHeight+1, address2.ToString().c_str(), FormatMoney(vtx[1].vout[i].nValue / COIN).c_str(), paidAge, mn.nBlockLastPaid);
-                                    if (paidAge < 150) // TODO: Probably make this check the MN is in the top 50?
-                                    {
-                                        if (fDebug) printf("WARNING: This masternode payment is too aggressive and will not be accepted in v3+\n");
-                                    }
-                                    mn.nBlockLastPaid = pindex->nHeight+1;
-                                    foundPayee = true;
-                                }
+                                printf("Masternode PoS payee found at block %d: %s who got paid %s AOP (last payment was %d blocks ago at %d)\n", pindex->nHeight+1, address2.ToString().c_str(), FormatMoney(vtx[1].vout[i].nValue / COIN).c_str(), paidAge, mn.nBlockLastPaid);
+                            }
+                            if (paidAge < 150) // TODO: Probably make this check the MN is in the top 50?
+                            {
+                                if (fDebug) printf("WARNING: This masternode payment is too aggressive and will not be accepted in v3+\n");
                             }
+                            mn.nBlockLastPaid = pindex->nHeight+1;
+                            foundPayee = true;
+                        }
                     }
 
                     if(!(foundPaymentAmount && foundPayee)) {
@@ -2178,26 +2385,27 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
                         if(vtx[0].vout[i].scriptPubKey == payee )
                             foundPayee = true;
 
-                        CScript pubScript;
-                        BOOST_FOREACH(CMasterNode& mn, vecMasternodes)
+                        LOCK(cs_masternodes);
+                        std::vector<CMasterNode*> vPaid;
+                        masternodePayees.Find(vtx[0].vout[i].scriptPubKey, vPaid);
+                        BOOST_FOREACH(CMasterNode* pmn, vPaid)
                         {
-                            pubScript = GetScriptForDestination(mn.pubkey.GetID());
-                            CTxDestination address1;
-                            ExtractDestination(pubScript, address1);
-                            CBitcoinAddress address2(address1);
-
-                            if (vtx[0].vout[i].scriptPubKey == pubScript)
+                            CMasterNode& mn = *pmn;
+                            int lastPaid = mn.nBlockLastPaid;
+                            int paidAge = pindex->nHeight+1 - lastPaid;
+                            if (fDebug)
                             {
-                                int lastPaid = mn.nBlockLastPaid;
-                                int paidAge = pindex->nHeight+1 - lastPaid;
-                                if (fDebug) printf("Masternode PoW payee found at block %d: %s who got paid %s AOP (last payment was %d blocks ago at %d)\n", pindex->nHeight+1, address2.ToString().c_str(), FormatMoney(vtx[0].vout[i].nValue).c_str(), paidAge, mn.nBlockLastPaid);
-                                if (paidAge < 150) // TODO: Probably make this check the MN is in the top 50?
-                                {
-                                    if (fDebug) printf("WARNING: This masternode payment is too aggressive and will not be accepted in v3+\n");
-                                }
-                                mn.nBlockLastPaid = pindex->nHeight+1;
-                                foundPayee = true;
+                                CTxDestination address1;
+                                ExtractDestination(vtx[0].vout[i].scriptPubKey, address1);
+                                CBitcoinAddress address2(address1);
+                                printf("Masternode PoW payee found at block %d: %s who got paid %s AOP (last payment was %d blocks ago at %d)\n", pindex->nHeight+1, address2.ToString().c_str(), FormatMoney(vtx[0].vout[i].nValue).c_str(), paidAge, mn.nBlockLastPaid);
+                            }
+                            if (paidAge < 150) // TODO: Probably make this check the MN is in the top 50?
+                            {
+                                if (fDebug) printf("WARNING: This masternode payment is too aggressive and will not be accepted in v3+\n");
                             }
+                            mn.nBlockLastPaid = pindex->nHeight+1;
+                            foundPayee = true;
                         }
                     }
                     if(fDebug) {printf("CheckBlock-POW(): foundPaymentAmount= %i ; foundPayee = %i\n", foundPaymentAmount, foundPayee); }
@@ -2240,6 +2448,15 @@ bool CBlock::ConnectBlock(CTxDB& txdb, CBlockIndex* pindex, bool fJustCheck)
         if (!txdb.UpdateTxIndex((*mi).first, (*mi).second))
             return error("ConnectBlock() : UpdateTxIndex failed");
     }
+
+    CBlockStats stats;
+    stats.Set(*this, pindex, nFees, nStakeAmount, vFeeRates);
+    if (!txdb.WriteBlockStats(pindex->GetBlockHash(), stats))
+        return error("ConnectBlock() : WriteBlockStats failed");
+
+    if (fFilterIndex)
+        blockFilterIndex.BlockConnected(*this, pindex, vSpentScripts);
+
     if(GetBoolArg("-addrindex", false))
     {
         // Write Address Index
@@ -2377,6 +2594,11 @@ bool static Reorganize(CTxDB& txdb, CBlockIndex* pindexNew)
     if (!txdb.WriteHashBestChain(pindexNew->GetBlockHash()))
         return error("Reorganize() : WriteHashBestChain failed");
 
+    // The blocks of the new branch have to be on disk before the txdb points at them
+    BOOST_FOREACH(CBlockIndex* pindex, vConnect)
+        if (!blockWriter.WaitForWrite(pindex->nFile, pindex->nBlockPos, true))
+            return error("Reorganize() : block %s was not written", pindex->GetBlockHash().ToString().substr(0,20).c_str());
+
     // Make sure it's successfully written to disk before changing memory structure
     if (!txdb.TxnCommit())
         return error("Reorganize() : TxnCommit failed");
@@ -2390,6 +2612,10 @@ bool static Reorganize(CTxDB& txdb, CBlockIndex* pindexNew)
     BOOST_FOREACH(CBlockIndex* pindex, vConnect)
         if (pindex->pprev)
             pindex->pprev->pnext = pindex;
+    {
+        LOCK(chainActive.cs);
+        chainActive.SetTip(pindexNew);
+    }
 
     // Resurrect memory transactions that were in the disconnected branch
     BOOST_FOREACH(CTransaction& tx, vResurrect)
@@ -2419,11 +2645,22 @@ bool CBlock::SetBestChainInner(CTxDB& txdb, CBlockIndex *pindexNew)
         InvalidChainFound(pindexNew);
         return false;
     }
+
+    // Don't let the txdb point past what's in the block files
+    if (!blockWriter.WaitForWrite(pindexNew->nFile, pindexNew->nBlockPos, true))
+    {
+        txdb.TxnAbort();
+        return error("SetBestChain() : block %s was not written", hash.ToString().substr(0,20).c_str());
+    }
     if (!txdb.TxnCommit())
         return error("SetBestChain() : TxnCommit failed");
 
     // Add to current best branch
     pindexNew->pprev->pnext = pindexNew;
+    {
+        LOCK(chainActive.cs);
+        chainActive.SetTip(pindexNew);
+    }
 
     // Delete redundant memory transactions
     BOOST_FOREACH(CTransaction& tx, vtx)
@@ -2439,7 +2676,7 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
     if (!txdb.TxnBegin())
         return error("SetBestChain() : TxnBegin failed");
 
-    if (pindexGenesisBlock == NULL && hash == (!fTestNet ? hashGenesisBlock : hashGenesisBlockTestNet))
+    if (pindexGenesisBlock == NULL && hash == GetGenesisBlockHash())
     {
         txdb.WriteHashBestChain(hash);
         if (!txdb.TxnCommit())
@@ -2508,7 +2745,10 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
     // New best block
     hashBestChain = hash;
     pindexBest = pindexNew;
-    pblockindexFBBHLast = NULL;
+    {
+        LOCK(chainActive.cs);
+        chainActive.SetTip(pindexNew);
+    }
     nBestHeight = pindexBest->nHeight;
     nBestChainTrust = pindexNew->nChainTrust;
     nTimeBestReceived = GetTime();
@@ -2548,6 +2788,8 @@ bool CBlock::SetBestChain(CTxDB& txdb, CBlockIndex* pindexNew)
         boost::thread t(runCommand, strCmd); // thread runs free
     }
 
+    notificationPublisher.NotifyBlock(*this);
+
     return true;
 }
 
@@ -2627,11 +2869,10 @@ bool CBlock::AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos, const u
         return error("AddToBlockIndex() : %s already exists", hash.ToString().substr(0,20).c_str());
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(nFile, nBlockPos, *this);
-    if (!pindexNew)
-        return error("AddToBlockIndex() : new CBlockIndex failed");
+    CBlockIndex* pindexNew = blockIndexArena.Allocate();
+    *pindexNew = CBlockIndex(nFile, nBlockPos, *this, pindexNew->pcold);
     pindexNew->phashBlock = &hash;
-    map<uint256, CBlockIndex*>::iterator miPrev = mapBlockIndex.find(hashPrevBlock);
+    BlockMap::iterator miPrev = mapBlockIndex.find(hashPrevBlock);
     if (miPrev != mapBlockIndex.end())
     {
         pindexNew->pprev = (*miPrev).second;
@@ -2643,25 +2884,36 @@ bool CBlock::AddToBlockIndex(unsigned int nFile, unsigned int nBlockPos, const u
 
     // ppcoin: compute stake entropy bit for stake modifier
     if (!pindexNew->SetStakeEntropyBit(GetStakeEntropyBit()))
+    {
+        blockIndexArena.Release(pindexNew);
         return error("AddToBlockIndex() : SetStakeEntropyBit() failed");
+    }
 
     // Record proof hash value
     pindexNew->hashProof = hashProof;
 
+    pindexNew->SetChainCache();
+
     // ppcoin: compute stake modifier
     uint64_t nStakeModifier = 0;
     bool fGeneratedStakeModifier = false;
     if (!ComputeNextStakeModifier(pindexNew->pprev, nStakeModifier, fGeneratedStakeModifier))
+    {
+        blockIndexArena.Release(pindexNew);
         return error("AddToBlockIndex() : ComputeNextStakeModifier() failed");
+    }
     pindexNew->SetStakeModifier(nStakeModifier, fGeneratedStakeModifier);
     pindexNew->nStakeModifierChecksum = GetStakeModifierChecksum(pindexNew);
     if (!CheckStakeModifierCheckpoints(pindexNew->nHeight, pindexNew->nStakeModifierChecksum))
+    {
+        blockIndexArena.Release(pindexNew);
         return error("AddToBlockIndex() : Rejected by stake modifier checkpoint height=%d, modifier=0x%016" PRIx64, pindexNew->nHeight, nStakeModifier);
+    }
 
     // Add to mapBlockIndex
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
+    BlockMap::iterator mi = mapBlockIndex.insert(make_pair(hash, pindexNew)).first;
     if (pindexNew->IsProofOfStake())
-        setStakeSeen.insert(make_pair(pindexNew->prevoutStake, pindexNew->nStakeTime));
+        setStakeSeen.insert(make_pair(pindexNew->pcold->prevoutStake, pindexNew->pcold->nStakeTime));
     pindexNew->phashBlock = &((*mi).first);
 
     // Write to disk block index
@@ -2700,7 +2952,7 @@ bool CBlock::CheckBlock(bool fCheckPOW, bool fCheckMerkleRoot, bool fCheckSig) c
     // that can be verified before saving an orphan block.
 
     // Size limits
-    if (vtx.empty() || vtx.size() > MAX_BLOCK_SIZE || ::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION) > MAX_BLOCK_SIZE)
+    if (vtx.empty() || vtx.size() > MAX_BLOCK_SIZE || GetBlockSize() > MAX_BLOCK_SIZE)
         return DoS(100, error("CheckBlock() : size limits failed"));
 
     // Check proof of work matches claimed amount
@@ -2794,7 +3046,7 @@ bool CBlock::AcceptBlock()
         return error("AcceptBlock() : block already in mapBlockIndex");
 
     // Get prev block index
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashPrevBlock);
+    BlockMap::iterator mi = mapBlockIndex.find(hashPrevBlock);
     if (mi == mapBlockIndex.end())
         return DoS(10, error("AcceptBlock() : prev block not found"));
     CBlockIndex* pindexPrev = (*mi).second;
@@ -2855,13 +3107,11 @@ bool CBlock::AcceptBlock()
         !std::equal(expect.begin(), expect.end(), vtx[0].vin[0].scriptSig.begin()))
         return DoS(100, error("AcceptBlock() : block height mismatch in coinbase"));
 
-    // Write block to history file
-    if (!CheckDiskSpace(::GetSerializeSize(*this, SER_DISK, CLIENT_VERSION)))
-        return error("AcceptBlock() : out of disk space");
+    // Queue the block for the history file; it is connected from memory meanwhile
     unsigned int nFile = -1;
     unsigned int nBlockPos = 0;
-    if (!WriteToDisk(nFile, nBlockPos))
-        return error("AcceptBlock() : WriteToDisk failed");
+    if (!blockWriter.Enqueue(*this, !IsInitialBlockDownload() || (nBestHeight+1) % 500 == 0, nFile, nBlockPos))
+        return error("AcceptBlock() : queueing block for write failed");
     if (!AddToBlockIndex(nFile, nBlockPos, hashProof))
         return error("AcceptBlock() : AddToBlockIndex failed");
 
@@ -2883,18 +3133,31 @@ bool CBlock::AcceptBlock()
 
 uint256 CBlockIndex::GetBlockTrust() const
 {
-    CBigNum bnTarget;
-    bnTarget.SetCompact(nBits);
+    bool fNegative, fOverflow;
+    arith_uint256 bnTarget;
+    bnTarget.SetCompact(nBits, &fNegative, &fOverflow);
 
-    if (bnTarget <= 0)
+    if (fNegative || fOverflow || bnTarget == 0)
         return 0;
 
-    return ((CBigNum(1)<<256) / (bnTarget+1)).getuint256();
+    // 2**256 / (bnTarget+1) does not fit in 256 bits, but it is equal to
+    // ~bnTarget / (bnTarget+1) + 1
+    return ArithToUint256((~bnTarget / (bnTarget + 1)) + 1);
 }
 
 bool CBlockIndex::IsSuperMajority(int minVersion, const CBlockIndex* pstart, unsigned int nRequired, unsigned int nToCheck)
 {
     unsigned int nFound = 0;
+    {
+        LOCK(chainActive.cs);
+        if (chainActive.Contains(pstart))
+        {
+            for (int nHeight = pstart->nHeight; nFound < nRequired && nHeight >= 0 && pstart->nHeight - nHeight < (int)nToCheck; nHeight--)
+                if (chainActive.Hot(nHeight).nVersion >= minVersion)
+                    ++nFound;
+            return (nFound >= nRequired);
+        }
+    }
     for (unsigned int i = 0; i < nToCheck && nFound < nRequired && pstart != NULL; i++)
     {
         if (pstart->nVersion >= minVersion)
@@ -2945,16 +3208,18 @@ bool ProcessBlock(CNode* pfrom, CBlock* pblock)
     {
         // Extra checks to prevent "fill up memory by spamming with bogus blocks"
         int64_t deltaTime = pblock->GetBlockTime() - pcheckpoint->nTime;
-        CBigNum bnNewBlock;
-        bnNewBlock.SetCompact(pblock->nBits);
-        CBigNum bnRequired;
+        bool fNegative, fOverflow;
+        arith_uint256 bnNewBlock;
+        bnNewBlock.SetCompact(pblock->nBits, &fNegative, &fOverflow);
+        arith_uint256 bnRequired;
 
         if (pblock->IsProofOfStake())
             bnRequired.SetCompact(ComputeMinStake(GetLastBlockIndex(pcheckpoint, true)->nBits, deltaTime, pblock->nTime));
         else
             bnRequired.SetCompact(ComputeMinWork(GetLastBlockIndex(pcheckpoint, false)->nBits, deltaTime));
 
-        if (bnNewBlock > bnRequired)
+        // as CBigNum compared them: a negative target passes, an oversized one fails
+        if (!fNegative && (fOverflow || bnNewBlock > bnRequired))
         {
             if (pfrom)
                 pfrom->Misbehaving(100);
@@ -3091,6 +3356,7 @@ bool CBlock::SignBlock(CWallet& wallet, int64_t nFees)
 
                 vtx.insert(vtx.begin() + 1, txCoinStake);
                 hashMerkleRoot = BuildMerkleTree();
+                InvalidateSize();
 
                 // append a signature to our block
                 return key.Sign(GetHash(), vchBlockSig);
@@ -3153,6 +3419,9 @@ FILE* OpenBlockFile(unsigned int nFile, unsigned int nBlockPos, const char* pszM
 {
     if ((nFile < 1) || (nFile == (unsigned int) -1))
         return NULL;
+    if (!strchr(pszMode, 'a') && !strchr(pszMode, 'w'))
+        if (!blockWriter.WaitForWrite(nFile, nBlockPos != 0 ? nBlockPos : std::numeric_limits<unsigned int>::max()))
+            return NULL;
     FILE* file = fopen(BlockFilePath(nFile).string().c_str(), pszMode);
     if (!file)
         return NULL;
@@ -3189,11 +3458,58 @@ FILE* AppendBlockFile(unsigned int& nFileRet)
         nCurrentBlockFile++;
     }
 }
+static CBlock CreateGenesisBlock()
+{
+    const char* pszTimestamp = "AveroPay masternode platform 1";
+    CTransaction txNew;
+    txNew.nTime = 1533110271;
+    txNew.vin.resize(1);
+    txNew.vout.resize(1);
+    txNew.vin[0].scriptSig = CScript() << 0 << CBigNum(42) << vector<unsigned char>((const unsigned char*)pszTimestamp, (const unsigned char*)pszTimestamp + strlen(pszTimestamp));
+    txNew.vout[0].SetEmpty();
+
+    CBlock block;
+    block.vtx.push_back(txNew);
+    block.hashPrevBlock = 0;
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    block.nTime    = 1533110271;
+    block.nVersion = 1;
+    block.nBits    = bnProofOfWorkLimit.GetCompact();
+    block.nNonce   = 5320801;
+
+    if (fRegTest)
+    {
+        // about every other nonce meets the regtest limit
+        uint256 hashTarget = CBigNum().SetCompact(block.nBits).getuint256();
+        block.nNonce = 0;
+        while (block.GetHash() > hashTarget)
+            ++block.nNonce;
+    }
+    return block;
+}
+
 bool LoadBlockIndex(bool fAllowNew)
 {
     LOCK(cs_main);
 
-    if (fTestNet)
+    if (fRegTest)
+    {
+        pchMessageStart[0] = 0xfa;
+        pchMessageStart[1] = 0xbf;
+        pchMessageStart[2] = 0xb5;
+        pchMessageStart[3] = 0xda;
+
+        // trivial targets and no waiting for coins to mature or age, so
+        // generate can build long chains at once
+        bnProofOfWorkLimit = bnProofOfWorkLimitRegTest;
+        bnProofOfStakeLimit = bnProofOfWorkLimitRegTest;
+        nStakeMinAge = 0;
+        nModifierInterval = 60;
+        nCoinbaseMaturity = 1;
+
+        hashGenesisBlockRegTest = CreateGenesisBlock().GetHash();
+    }
+    else if (fTestNet)
     {
         pchMessageStart[0] = 0xaf;
         pchMessageStart[1] = 0x3c;
@@ -3220,27 +3536,8 @@ bool LoadBlockIndex(bool fAllowNew)
         if (!fAllowNew)
             return false;
 
-        const char* pszTimestamp = "AveroPay masternode platform 1";
-        CTransaction txNew;
-        txNew.nTime = 1533110271;
-        txNew.vin.resize(1);
-        txNew.vout.resize(1);
-        txNew.vin[0].scriptSig = CScript() << 0 << CBigNum(42) << vector<unsigned char>((const unsigned char*)pszTimestamp, (const unsigned char*)pszTimestamp + strlen(pszTimestamp));
-        txNew.vout[0].SetEmpty();
-
-        CBlock block;
-        block.vtx.push_back(txNew);
-        block.hashPrevBlock = 0;
-        block.hashMerkleRoot = block.BuildMerkleTree();
-        block.nTime    = 1533110271;
-        block.nVersion = 1;
-        block.nBits    = bnProofOfWorkLimit.GetCompact();
-		block.nNonce   = 5320801;
-		if(fTestNet)
-        {
-            block.nNonce   = 5320801;
-        }
-        if (true && (block.GetHash() != hashGenesisBlock)) {
+        CBlock block = CreateGenesisBlock();
+        if (true && (block.GetHash() != GetGenesisBlockHash())) {
 
         // This will figure out a valid hash and Nonce if you're
         // creating a different genesis block:
@@ -3260,7 +3557,7 @@ bool LoadBlockIndex(bool fAllowNew)
         //// debug print
         assert(block.hashMerkleRoot == uint256("0x389e04ce43b5d1fcb7d0e7f2660027ecc830470d7c807984f738995d93318e61"));
         block.print();
-        assert(block.GetHash() == (!fTestNet ? hashGenesisBlock : hashGenesisBlockTestNet));
+        assert(block.GetHash() == GetGenesisBlockHash());
         assert(block.CheckBlock());
 
         // Start new block file
@@ -3272,7 +3569,7 @@ bool LoadBlockIndex(bool fAllowNew)
             return error("LoadBlockIndex() : genesis block not accepted");
 
         // ppcoin: initialize synchronized checkpoint
-        if (!Checkpoints::WriteSyncCheckpoint((!fTestNet ? hashGenesisBlock : hashGenesisBlockTestNet)))
+        if (!Checkpoints::WriteSyncCheckpoint(GetGenesisBlockHash()))
             return error("LoadBlockIndex() : failed to init sync checkpoint");
     }
 
@@ -3301,7 +3598,7 @@ void PrintBlockTree()
     AssertLockHeld(cs_main);
     // pre-compute tree structure
     map<CBlockIndex*, vector<CBlockIndex*> > mapNext;
-    for (map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
+    for (BlockMap::iterator mi = mapBlockIndex.begin(); mi != mapBlockIndex.end(); ++mi)
     {
         CBlockIndex* pindex = (*mi).second;
         mapNext[pindex->pprev].push_back(pindex);
@@ -3371,8 +3668,54 @@ void PrintBlockTree()
     }
 }
 
+// A bootstrap file written by dumpbootstrap with LZ4 framing: every frame
+// holds whole blocks, each with the message start and size in front
+static bool LoadExternalBlockFileLZ4(FILE* fileIn)
+{
+    int64_t nStart = GetTimeMillis();
+
+    int nLoaded = 0;
+    {
+        LOCK(cs_main);
+        try {
+            CAutoFile blkdat(fileIn, SER_DISK, CLIENT_VERSION);
+            vector<unsigned char> vchFrame;
+            while (!fRequestShutdown && ReadBootstrapLZ4Frame(blkdat, vchFrame))
+            {
+                CDataStream ss(vchFrame, SER_DISK, CLIENT_VERSION);
+                while (!ss.empty() && !fRequestShutdown)
+                {
+                    unsigned char pchStart[sizeof(pchMessageStart)];
+                    unsigned int nSize;
+                    ss.read((char*)pchStart, sizeof(pchStart));
+                    ss >> nSize;
+                    if (memcmp(pchStart, pchMessageStart, sizeof(pchStart)) != 0 ||
+                        nSize == 0 || nSize > MAX_BLOCK_SIZE || nSize > ss.size())
+                        throw runtime_error("bad block header in frame");
+
+                    CDataStream ssBlock(ss.begin(), ss.begin() + nSize, SER_DISK, CLIENT_VERSION);
+                    ss.ignore(nSize);
+                    CBlock block;
+                    ssBlock >> block;
+                    if (ProcessBlock(NULL,&block))
+                        nLoaded++;
+                }
+            }
+        }
+        catch (std::exception &e) {
+            printf("%s() : Deserialize or I/O error caught during load: %s\n",
+                   __PRETTY_FUNCTION__, e.what());
+        }
+    }
+    printf("Loaded %i blocks from LZ4 framed file in %" PRId64"ms\n", nLoaded, GetTimeMillis() - nStart);
+    return nLoaded > 0;
+}
+
 bool LoadExternalBlockFile(FILE* fileIn)
 {
+    if (IsBootstrapLZ4(fileIn))
+        return LoadExternalBlockFileLZ4(fileIn);
+
     int64_t nStart = GetTimeMillis();
 
     int nLoaded = 0;
@@ -3436,7 +3779,7 @@ bool LoadExternalBlockFile(FILE* fileIn)
 // CAlert
 //
 
-extern map<uint256, CAlert> mapAlerts;
+extern boost::unordered_map<uint256, CAlert, CSaltedHasher> mapAlerts;
 extern CCriticalSection cs_mapAlerts;
 
 string GetWarnings(string strFor)
@@ -3493,6 +3836,157 @@ string GetWarnings(string strFor)
 
 
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// CMerkleBlock, CPartialMerkleTree
+//
+
+CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter& filter)
+{
+    header.nVersion = block.nVersion;
+    header.hashPrevBlock = block.hashPrevBlock;
+    header.hashMerkleRoot = block.hashMerkleRoot;
+    header.nTime = block.nTime;
+    header.nBits = block.nBits;
+    header.nNonce = block.nNonce;
+    header.vchBlockSig = block.vchBlockSig;
+
+    vector<bool> vMatch;
+    vector<uint256> vHashes;
+
+    vMatch.reserve(block.vtx.size());
+    vHashes.reserve(block.vtx.size());
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+    {
+        uint256 hash = block.vtx[i].GetHash();
+        if (filter.IsRelevantAndUpdate(block.vtx[i], hash))
+        {
+            vMatch.push_back(true);
+            vMatchedTxn.push_back(make_pair(i, hash));
+        }
+        else
+            vMatch.push_back(false);
+        vHashes.push_back(hash);
+    }
+
+    txn = CPartialMerkleTree(vHashes, vMatch);
+}
+
+uint256 CPartialMerkleTree::CalcHash(int height, unsigned int pos, const std::vector<uint256> &vTxid) {
+    if (height == 0) {
+        // hash at height 0 is the txids themself
+        return vTxid[pos];
+    } else {
+        // calculate left hash
+        uint256 left = CalcHash(height-1, pos*2, vTxid), right;
+        // calculate right hash if not beyond the end of the array - copy left hash otherwise
+        if (pos*2+1 < CalcTreeWidth(height-1))
+            right = CalcHash(height-1, pos*2+1, vTxid);
+        else
+            right = left;
+        // combine subhashes
+        return Hash(BEGIN(left), END(left), BEGIN(right), END(right));
+    }
+}
+
+void CPartialMerkleTree::TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch) {
+    // determine whether this node is the parent of at least one matched txid
+    bool fParentOfMatch = false;
+    for (unsigned int p = pos << height; p < (pos+1) << height && p < nTransactions; p++)
+        fParentOfMatch |= vMatch[p];
+    // store as flag bit
+    vBits.push_back(fParentOfMatch);
+    if (height==0 || !fParentOfMatch) {
+        // if at height 0, or nothing interesting below, store hash and stop
+        vHash.push_back(CalcHash(height, pos, vTxid));
+    } else {
+        // otherwise, don't store any hash, but descend into the subtrees
+        TraverseAndBuild(height-1, pos*2, vTxid, vMatch);
+        if (pos*2+1 < CalcTreeWidth(height-1))
+            TraverseAndBuild(height-1, pos*2+1, vTxid, vMatch);
+    }
+}
+
+uint256 CPartialMerkleTree::TraverseAndExtract(int height, unsigned int pos, unsigned int &nBitsUsed, unsigned int &nHashUsed, std::vector<uint256> &vMatch) {
+    if (nBitsUsed >= vBits.size()) {
+        // overflowed the bits array - failure
+        fBad = true;
+        return 0;
+    }
+    bool fParentOfMatch = vBits[nBitsUsed++];
+    if (height==0 || !fParentOfMatch) {
+        // if at height 0, or nothing interesting below, use stored hash and do not descend
+        if (nHashUsed >= vHash.size()) {
+            // overflowed the hash array - failure
+            fBad = true;
+            return 0;
+        }
+        const uint256 &hash = vHash[nHashUsed++];
+        if (height==0 && fParentOfMatch) // in case of height 0, we have a matched txid
+            vMatch.push_back(hash);
+        return hash;
+    } else {
+        // otherwise, descend into the subtrees to extract matched txids and hashes
+        uint256 left = TraverseAndExtract(height-1, pos*2, nBitsUsed, nHashUsed, vMatch), right;
+        if (pos*2+1 < CalcTreeWidth(height-1))
+            right = TraverseAndExtract(height-1, pos*2+1, nBitsUsed, nHashUsed, vMatch);
+        else
+            right = left;
+        // and combine them before returning
+        return Hash(BEGIN(left), END(left), BEGIN(right), END(right));
+    }
+}
+
+CPartialMerkleTree::CPartialMerkleTree(const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch) : nTransactions(vTxid.size()), fBad(false) {
+    // reset state
+    vBits.clear();
+    vHash.clear();
+
+    // calculate height of tree
+    int nHeight = 0;
+    while (CalcTreeWidth(nHeight) > 1)
+        nHeight++;
+
+    // traverse the partial tree
+    TraverseAndBuild(nHeight, 0, vTxid, vMatch);
+}
+
+CPartialMerkleTree::CPartialMerkleTree() : nTransactions(0), fBad(true) {}
+
+uint256 CPartialMerkleTree::ExtractMatches(std::vector<uint256> &vMatch) {
+    vMatch.clear();
+    // An empty set will not work
+    if (nTransactions == 0)
+        return 0;
+    // check for excessively high numbers of transactions
+    if (nTransactions > MAX_BLOCK_SIZE / 60) // 60 is the lower bound for the size of a serialized CTransaction
+        return 0;
+    // there can never be more hashes provided than one for every txid
+    if (vHash.size() > nTransactions)
+        return 0;
+    // there must be at least one bit per node in the partial tree, and at least one node per hash
+    if (vBits.size() < vHash.size())
+        return 0;
+    // calculate height of tree
+    int nHeight = 0;
+    while (CalcTreeWidth(nHeight) > 1)
+        nHeight++;
+    // traverse the partial tree
+    unsigned int nBitsUsed = 0, nHashUsed = 0;
+    uint256 hashMerkleRoot = TraverseAndExtract(nHeight, 0, nBitsUsed, nHashUsed, vMatch);
+    // verify that no problems occurred during the tree traversal
+    if (fBad)
+        return 0;
+    // verify that all bits were consumed (except for the padding caused by serializing it as a byte sequence)
+    if ((nBitsUsed+7)/8 != (vBits.size()+7)/8)
+        return 0;
+    // verify that all hashes were consumed
+    if (nHashUsed != vHash.size())
+        return 0;
+    return hashMerkleRoot;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // Messages
@@ -3543,15 +4037,37 @@ void static ProcessGetData(CNode* pfrom)
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
             {
                 // Send block from disk
-                map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(inv.hash);
+                BlockMap::iterator mi = mapBlockIndex.find(inv.hash);
                 if (mi != mapBlockIndex.end())
                 {
                     CBlock block;
                     block.ReadFromDisk((*mi).second);
-                    pfrom->PushMessage("block", block);
+                    if (inv.type == MSG_BLOCK)
+                        pfrom->PushMessage("block", block);
+                    else // MSG_FILTERED_BLOCK)
+                    {
+                        LOCK(pfrom->cs_filter);
+                        if (pfrom->pfilter)
+                        {
+                            CMerkleBlock merkleBlock(block, *pfrom->pfilter);
+                            pfrom->PushMessage("merkleblock", merkleBlock);
+                            // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
+                            // This avoids hurting performance by pointlessly requiring a round-trip
+                            // Note that there is currently no way for a node to request any single transactions we didnt send here -
+                            // they must either disconnect and retry or request the full block.
+                            // Thus, the protocol spec specified allows for us to provide duplicate txn here,
+                            // however we MUST always provide at least what the remote peer needs
+                            typedef std::pair<unsigned int, uint256> PairType;
+                            BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
+                                if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
+                                    pfrom->PushMessage("tx", block.vtx[pair.first]);
+                        }
+                        // else
+                            // no response
+                    }
 
                     // Trigger them to send a getblocks request for the next batch of inventory
                     if (inv.hash == pfrom->hashContinue)
@@ -3572,7 +4088,7 @@ void static ProcessGetData(CNode* pfrom)
                 bool pushed = false;
                 /*{
                     LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
+                    boost::unordered_map<CInv, CDataStream, CSaltedHasher>::iterator mi = mapRelay.find(inv);
                     if (mi != mapRelay.end()) {
                         pfrom->PushMessage(inv.GetCommand(), (*mi).second);
                         pushed = true;
@@ -3628,7 +4144,7 @@ void static ProcessGetData(CNode* pfrom)
             // Track requests for our stuff.
             g_signals.Inventory(inv.hash);
 
-            if (inv.type == MSG_BLOCK /* || inv.type == MSG_FILTERED_BLOCK */)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
                 break;
         }
     }
@@ -3647,6 +4163,37 @@ void static ProcessGetData(CNode* pfrom)
     }
 }
 
+// Checks a getcfilters/getcfheaders/getcfcheckpt request and finds its stop
+// block in the main chain. Peers asking for something we don't serve are
+// dropped, as BIP 157 says.
+static bool PrepareBlockFilterRequest(CNode* pfrom, unsigned char nFilterType, int nStartHeight, const uint256& hashStop,
+                                      int nMaxBlocks, CBlockIndex*& pindexStop)
+{
+    if (!blockFilterIndex.IsEnabled() || nFilterType != BLOCK_FILTER_BASIC)
+    {
+        printf("peer %s requested unsupported block filter type %d\n", pfrom->addr.ToString().c_str(), nFilterType);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    BlockMap::iterator mi = mapBlockIndex.find(hashStop);
+    if (mi == mapBlockIndex.end() || !chainActive.Contains((*mi).second))
+    {
+        // may have been reorganised away since the peer asked
+        if (fDebugNet)
+            printf("peer %s requested filters up to unknown block %s\n", pfrom->addr.ToString().c_str(), hashStop.ToString().c_str());
+        return false;
+    }
+    pindexStop = (*mi).second;
+
+    if (nStartHeight < 0 || nStartHeight > pindexStop->nHeight || pindexStop->nHeight - nStartHeight >= nMaxBlocks)
+    {
+        pfrom->Misbehaving(20);
+        return false;
+    }
+    return true;
+}
+
 // The message start string is designed to be unlikely to occur in normal data.
 // The characters are rarely used upper ASCII, not valid as UTF-8, and produce
 // a large 4-byte int at any alignment.
@@ -3713,6 +4260,10 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
             vRecv >> pfrom->strSubVer;
         if (!vRecv.empty())
             vRecv >> pfrom->nStartingHeight;
+        if (!vRecv.empty())
+            vRecv >> pfrom->fRelayTxes; // set to true after we get the first filter* message
+        else
+            pfrom->fRelayTxes = true;
 
         if (pfrom->fInbound && addrMe.IsRoutable())
         {
@@ -4036,7 +4587,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         if (locator.IsNull())
         {
             // If locator is null, return the hashStop block
-            map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashStop);
+            BlockMap::iterator mi = mapBlockIndex.find(hashStop);
             if (mi == mapBlockIndex.end())
                 return true;
             pindex = (*mi).second;
@@ -4166,20 +4717,161 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
 
     else if (strCommand == "mempool")
     {
+        LOCK2(cs_main, pfrom->cs_filter);
+
         std::vector<uint256> vtxid;
         mempool.queryHashes(vtxid);
         vector<CInv> vInv;
-        for (unsigned int i = 0; i < vtxid.size(); i++) {
-            CInv inv(MSG_TX, vtxid[i]);
+        BOOST_FOREACH(uint256& hash, vtxid) {
+            CInv inv(MSG_TX, hash);
+            if (pfrom->pfilter)
+            {
+                CTransaction tx;
+                if (!mempool.lookup(hash, tx))
+                    continue; // removed since queryHashes
+                if (!pfrom->pfilter->IsRelevantAndUpdate(tx, hash))
+                    continue;
+            }
             vInv.push_back(inv);
-            if (i == (MAX_INV_SZ - 1))
-                    break;
+            if (vInv.size() == MAX_INV_SZ)
+                break;
         }
         if (vInv.size() > 0)
             pfrom->PushMessage("inv", vInv);
     }
 
 
+    else if (strCommand == "filterload")
+    {
+        CBloomFilter filter;
+        vRecv >> filter;
+
+        if (!filter.IsWithinSizeConstraints())
+            // There is no excuse for sending a too-large filter
+            pfrom->Misbehaving(100);
+        else
+        {
+            LOCK(pfrom->cs_filter);
+            delete pfrom->pfilter;
+            pfrom->pfilter = new CBloomFilter(filter);
+            pfrom->pfilter->UpdateEmptyFull();
+        }
+        pfrom->fRelayTxes = true;
+    }
+
+
+    else if (strCommand == "filteradd")
+    {
+        vector<unsigned char> vData;
+        vRecv >> vData;
+
+        // Nodes must NEVER send a data item > 520 bytes (the max size for a script data object,
+        // and thus, the maximum size any matched object can have) in a filteradd message
+        if (vData.size() > MAX_SCRIPT_ELEMENT_SIZE)
+        {
+            pfrom->Misbehaving(100);
+        } else {
+            LOCK(pfrom->cs_filter);
+            if (pfrom->pfilter)
+                pfrom->pfilter->insert(vData);
+            else
+                pfrom->Misbehaving(100);
+        }
+    }
+
+
+    else if (strCommand == "filterclear")
+    {
+        LOCK(pfrom->cs_filter);
+        delete pfrom->pfilter;
+        pfrom->pfilter = NULL;
+        pfrom->fRelayTxes = true;
+    }
+
+
+    else if (strCommand == "getcfilters")
+    {
+        unsigned char nFilterType;
+        unsigned int nStartHeight;
+        uint256 hashStop;
+        vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+        LOCK(cs_main);
+        CBlockIndex* pindexStop;
+        if (!PrepareBlockFilterRequest(pfrom, nFilterType, nStartHeight, hashStop, MAX_GETCFILTERS_SIZE, pindexStop))
+            return true;
+
+        for (int nHeight = nStartHeight; nHeight <= pindexStop->nHeight; nHeight++)
+        {
+            CBlockIndex* pindex = chainActive[nHeight];
+            CBlockFilterEntry entry;
+            if (!blockFilterIndex.LookupEntry(pindex, entry))
+            {
+                // not indexed yet
+                printf("getcfilters : no filter for block %d\n", nHeight);
+                break;
+            }
+            pfrom->PushMessage("cfilter", nFilterType, pindex->GetBlockHash(), entry.vchFilter);
+        }
+    }
+
+
+    else if (strCommand == "getcfheaders")
+    {
+        unsigned char nFilterType;
+        unsigned int nStartHeight;
+        uint256 hashStop;
+        vRecv >> nFilterType >> nStartHeight >> hashStop;
+
+        LOCK(cs_main);
+        CBlockIndex* pindexStop;
+        if (!PrepareBlockFilterRequest(pfrom, nFilterType, nStartHeight, hashStop, MAX_GETCFHEADERS_SIZE, pindexStop))
+            return true;
+
+        CBlockFilterEntry entry;
+        uint256 hashPrevHeader = 0;
+        if (nStartHeight > 0)
+        {
+            if (!blockFilterIndex.LookupEntry(chainActive[nStartHeight - 1], entry))
+                return true;
+            hashPrevHeader = entry.hashHeader;
+        }
+
+        vector<uint256> vFilterHashes;
+        vFilterHashes.reserve(pindexStop->nHeight - nStartHeight + 1);
+        for (int nHeight = nStartHeight; nHeight <= pindexStop->nHeight; nHeight++)
+        {
+            if (!blockFilterIndex.LookupEntry(chainActive[nHeight], entry))
+                return true;
+            vFilterHashes.push_back(entry.hashFilter);
+        }
+        pfrom->PushMessage("cfheaders", nFilterType, hashStop, hashPrevHeader, vFilterHashes);
+    }
+
+
+    else if (strCommand == "getcfcheckpt")
+    {
+        unsigned char nFilterType;
+        uint256 hashStop;
+        vRecv >> nFilterType >> hashStop;
+
+        LOCK(cs_main);
+        CBlockIndex* pindexStop;
+        if (!PrepareBlockFilterRequest(pfrom, nFilterType, 0, hashStop, std::numeric_limits<int>::max(), pindexStop))
+            return true;
+
+        vector<uint256> vHeaders;
+        for (int nHeight = CFCHECKPT_INTERVAL; nHeight <= pindexStop->nHeight; nHeight += CFCHECKPT_INTERVAL)
+        {
+            CBlockFilterEntry entry;
+            if (!blockFilterIndex.LookupEntry(chainActive[nHeight], entry))
+                return true;
+            vHeaders.push_back(entry.hashHeader);
+        }
+        pfrom->PushMessage("cfcheckpt", nFilterType, hashStop, vHeaders);
+    }
+
+
     else if (strCommand == "checkorder")
     {
         uint256 hashReply;
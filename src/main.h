@@ -14,11 +14,14 @@
 #include "script.h"
 #include "scrypt.h"
 #include "hashblock.h"
+#include "hashmap.h"
+#include "memusage.h"
 
 #include <list>
 
 class CValidationState;
 
+#define BLOCK_START_MASTERNODE_PAYMENTS_REGTEST 10
 #define BLOCK_START_MASTERNODE_PAYMENTS_TESTNET 2222
 #define BLOCK_START_MASTERNODE_PAYMENTS 1000
 
@@ -84,6 +87,22 @@ static const unsigned int MAX_P2SH_SIGOPS = 15;
 
 static const uint256 hashGenesisBlock("0x00000dab85d310f3ec43d3bc03849317049bfa1e9a4fcd19ad5f544712b3b401");
 static const uint256 hashGenesisBlockTestNet("0x0");
+// regtest's genesis is mined when the node starts, see LoadBlockIndex
+extern uint256 hashGenesisBlockRegTest;
+
+static inline const uint256& GetGenesisBlockHash()
+{
+    if (fRegTest)
+        return hashGenesisBlockRegTest;
+    return fTestNet ? hashGenesisBlockTestNet : hashGenesisBlock;
+}
+
+static inline int GetMasternodePaymentsStartBlock()
+{
+    if (fRegTest)
+        return BLOCK_START_MASTERNODE_PAYMENTS_REGTEST;
+    return fTestNet ? BLOCK_START_MASTERNODE_PAYMENTS_TESTNET : BLOCK_START_MASTERNODE_PAYMENTS;
+}
 
 //inline bool IsProtocolV1RetargetingFixed(int nHeight) { return fTestNet || nHeight > 0; }
 //inline bool IsProtocolV2(int nHeight) { return fTestNet || nHeight > 0; }
@@ -98,7 +117,7 @@ inline int64_t GetMNCollateral() { return 5000; }
 
 extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
-extern std::map<uint256, CBlockIndex*> mapBlockIndex;
+extern BlockMap mapBlockIndex;
 extern std::set<std::pair<COutPoint, unsigned int> > setStakeSeen;
 extern CBlockIndex* pindexGenesisBlock;
 extern unsigned int nTargetSpacing;
@@ -176,6 +195,14 @@ const CBlockIndex* GetLastBlockIndex(const CBlockIndex* pindex, bool fProofOfSta
 void StakeMiner(CWallet *pwallet);
 void ResendWalletTransactions(bool fForce = false);
 
+/** Estimated heap memory held by a transaction's or block's own vectors */
+size_t RecursiveDynamicUsage(const CTransaction& tx);
+size_t RecursiveDynamicUsage(const CBlock& block);
+/** Estimated memory of mapBlockIndex, the block index entries and the active chain */
+size_t GetBlockIndexMemoryUsage();
+size_t GetOrphanBlocksMemoryUsage();
+size_t GetOrphanTxMemoryUsage();
+
 
 
 bool FindTransactionsByDestination(const CTxDestination &dest, std::vector<uint256> &vtxhash);
@@ -272,6 +299,9 @@ public:
     std::vector<CTxOut> vout;
     unsigned int nLockTime;
 
+    // memory only
+    mutable unsigned int nCachedSize;
+
     // Denial-of-service detection:
     mutable int nDoS;
     bool DoS(int nDoSIn, bool fIn) const { nDoS += nDoSIn; return fIn; }
@@ -289,6 +319,8 @@ public:
         READWRITE(vin);
         READWRITE(vout);
         READWRITE(nLockTime);
+        if (fRead)
+            nCachedSize = 0;
     )
 
     void SetNull()
@@ -298,9 +330,25 @@ public:
         vin.clear();
         vout.clear();
         nLockTime = 0;
+        nCachedSize = 0;
         nDoS = 0;  // Denial-of-service prevention
     }
 
+    // Serialized size, the same on the network and on disk. It is cached on
+    // first use, so code changing vin or vout of a transaction whose size may
+    // have been asked for already has to call InvalidateSize().
+    unsigned int GetTxSize() const
+    {
+        if (nCachedSize == 0)
+            nCachedSize = ::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION);
+        return nCachedSize;
+    }
+
+    void InvalidateSize() const
+    {
+        nCachedSize = 0;
+    }
+
     bool IsNull() const
     {
         return (vin.empty() && vout.empty());
@@ -685,6 +733,7 @@ public:
 
     // memory only
     mutable std::vector<uint256> vMerkleTree;
+    mutable unsigned int nCachedSize;
 
     // Denial-of-service detection:
     mutable int nDoS;
@@ -716,6 +765,8 @@ public:
             const_cast<CBlock*>(this)->vtx.clear();
             const_cast<CBlock*>(this)->vchBlockSig.clear();
         }
+        if (fRead)
+            nCachedSize = 0;
     )
 
     void SetNull()
@@ -729,9 +780,25 @@ public:
         vtx.clear();
         vchBlockSig.clear();
         vMerkleTree.clear();
+        nCachedSize = 0;
         nDoS = 0;
     }
 
+    // Serialized size of the full block, cached like CTransaction::GetTxSize().
+    // The miner calls InvalidateSize() whenever it changes the transactions
+    // or the signature.
+    unsigned int GetBlockSize() const
+    {
+        if (nCachedSize == 0)
+            nCachedSize = ::GetSerializeSize(*this, SER_NETWORK, PROTOCOL_VERSION);
+        return nCachedSize;
+    }
+
+    void InvalidateSize() const
+    {
+        nCachedSize = 0;
+    }
+
     bool IsNull() const
     {
         return (nBits == 0);
@@ -938,27 +1005,45 @@ private:
 
 
 
+/** Block index fields that no chain walk looks at. They are kept out of
+ * CBlockIndex so the fields the walks do read share fewer cache lines. Set
+ * when the entry is created, from the block or from the block index record.
+ */
+class CBlockIndexCold
+{
+public:
+    uint256 hashMerkleRoot;
+    unsigned int nNonce;
+
+    // proof-of-stake specific fields
+    COutPoint prevoutStake;
+    unsigned int nStakeTime;
+
+    CBlockIndexCold()
+    {
+        hashMerkleRoot = 0;
+        nNonce = 0;
+        prevoutStake.SetNull();
+        nStakeTime = 0;
+    }
+};
+
 /** The block chain is a tree shaped structure starting with the
  * genesis block at the root, with each block potentially having multiple
  * candidates to be the next block.  pprev and pnext link a path through the
  * main/longest chain.  A blockindex may have multiple pprev pointing back
  * to it, but pnext will only point forward to the longest branch, or will
  * be null if the block is not part of the longest chain.
+ *
+ * Fields read by chain walks come first so they share cache lines; the rarely
+ * used header and stake fields live behind pcold (see GetCold()).
  */
 class CBlockIndex
 {
 public:
-    const uint256* phashBlock;
     CBlockIndex* pprev;
     CBlockIndex* pnext;
-    unsigned int nFile;
-    unsigned int nBlockPos;
-    uint256 nChainTrust; // ppcoin: trust score of block chain
     int nHeight;
-
-    int64_t nMint;
-    int64_t nMoneySupply;
-
     unsigned int nFlags;  // ppcoin: block index flags
     enum
     {
@@ -967,21 +1052,30 @@ public:
         BLOCK_STAKE_MODIFIER = (1 << 2), // regenerated stake modifier
     };
 
-    uint64_t nStakeModifier; // hash modifier for proof-of-stake
-    unsigned int nStakeModifierChecksum; // checksum of index; in-memeory only
-
-    // proof-of-stake specific fields
-    COutPoint prevoutStake;
-    unsigned int nStakeTime;
-
-    uint256 hashProof;
-
     // block header
     int nVersion;
-    uint256 hashMerkleRoot;
     unsigned int nTime;
     unsigned int nBits;
-    unsigned int nNonce;
+
+    // in-memory only, derived from the ancestors by SetChainCache()
+    const CBlockIndex* pindexLastPoW; // last proof-of-work block up to and including this one
+    const CBlockIndex* pindexLastPoS; // last proof-of-stake block up to and including this one
+    int64_t nMedianTimePast;
+    unsigned int nNextTargetPoW; // nBits required of a proof-of-work block on top of this one
+    unsigned int nNextTargetPoS; // nBits required of a proof-of-stake block on top of this one
+
+    const uint256* phashBlock;
+    uint64_t nStakeModifier; // hash modifier for proof-of-stake
+    uint256 nChainTrust; // ppcoin: trust score of block chain
+    uint256 hashProof;
+
+    unsigned int nFile;
+    unsigned int nBlockPos;
+    int64_t nMint;
+    int64_t nMoneySupply;
+    unsigned int nStakeModifierChecksum; // checksum of index; in-memeory only
+
+    CBlockIndexCold* pcold;
 
     CBlockIndex()
     {
@@ -998,17 +1092,20 @@ public:
         nStakeModifier = 0;
         nStakeModifierChecksum = 0;
         hashProof = 0;
-        prevoutStake.SetNull();
-        nStakeTime = 0;
+        pcold = NULL;
+        pindexLastPoW = NULL;
+        pindexLastPoS = NULL;
+        nMedianTimePast = 0;
+        nNextTargetPoW = 0;
+        nNextTargetPoS = 0;
 
         nVersion       = 0;
-        hashMerkleRoot = 0;
         nTime          = 0;
         nBits          = 0;
-        nNonce         = 0;
     }
 
-    CBlockIndex(unsigned int nFileIn, unsigned int nBlockPosIn, CBlock& block)
+    /** The cold fields go into pcoldIn, which the entry keeps */
+    CBlockIndex(unsigned int nFileIn, unsigned int nBlockPosIn, CBlock& block, CBlockIndexCold* pcoldIn)
     {
         phashBlock = NULL;
         pprev = NULL;
@@ -1023,35 +1120,45 @@ public:
         nStakeModifier = 0;
         nStakeModifierChecksum = 0;
         hashProof = 0;
+        pindexLastPoW = NULL;
+        pindexLastPoS = NULL;
+        nMedianTimePast = 0;
+        nNextTargetPoW = 0;
+        nNextTargetPoS = 0;
+        pcold = pcoldIn;
         if (block.IsProofOfStake())
         {
             SetProofOfStake();
-            prevoutStake = block.vtx[1].vin[0].prevout;
-            nStakeTime = block.vtx[1].nTime;
-        }
-        else
-        {
-            prevoutStake.SetNull();
-            nStakeTime = 0;
+            pcold->prevoutStake = block.vtx[1].vin[0].prevout;
+            pcold->nStakeTime = block.vtx[1].nTime;
         }
 
-        nVersion       = block.nVersion;
-        hashMerkleRoot = block.hashMerkleRoot;
-        nTime          = block.nTime;
-        nBits          = block.nBits;
-        nNonce         = block.nNonce;
+        nVersion               = block.nVersion;
+        pcold->hashMerkleRoot  = block.hashMerkleRoot;
+        nTime                  = block.nTime;
+        nBits                  = block.nBits;
+        pcold->nNonce          = block.nNonce;
     }
 
+    /** Cold fields; all zero for an entry that only exists as a pprev or
+     * pnext placeholder whose own record was never loaded. */
+    const CBlockIndexCold& GetCold() const;
+
+    /** Fill in the derived in-memory fields. pprev, nHeight and the header
+     * fields must be set, and pprev must already have its own cache. */
+    void SetChainCache();
+
     CBlock GetBlockHeader() const
     {
+        const CBlockIndexCold& cold = GetCold();
         CBlock block;
         block.nVersion       = nVersion;
         if (pprev)
             block.hashPrevBlock = pprev->GetBlockHash();
-        block.hashMerkleRoot = hashMerkleRoot;
+        block.hashMerkleRoot = cold.hashMerkleRoot;
         block.nTime          = nTime;
         block.nBits          = nBits;
-        block.nNonce         = nNonce;
+        block.nNonce         = cold.nNonce;
         return block;
     }
 
@@ -1084,19 +1191,7 @@ public:
 
     enum { nMedianTimeSpan=11 };
 
-    int64_t GetMedianTimePast() const
-    {
-        int64_t pmedian[nMedianTimeSpan];
-        int64_t* pbegin = &pmedian[nMedianTimeSpan];
-        int64_t* pend = &pmedian[nMedianTimeSpan];
-
-        const CBlockIndex* pindex = this;
-        for (int i = 0; i < nMedianTimeSpan && pindex; i++, pindex = pindex->pprev)
-            *(--pbegin) = pindex->GetBlockTime();
-
-        std::sort(pbegin, pend);
-        return pbegin[(pend - pbegin)/2];
-    }
+    int64_t GetMedianTimePast() const;
 
     /**
      * Returns true if there are nRequired or more blocks of minVersion or above
@@ -1154,8 +1249,8 @@ public:
             GeneratedStakeModifier() ? "MOD" : "-", GetStakeEntropyBit(), IsProofOfStake()? "PoS" : "PoW",
             nStakeModifier, nStakeModifierChecksum,
             hashProof.ToString().c_str(),
-            prevoutStake.ToString().c_str(), nStakeTime,
-            hashMerkleRoot.ToString().c_str(),
+            pcold ? pcold->prevoutStake.ToString().c_str() : "-", pcold ? pcold->nStakeTime : 0,
+            pcold ? pcold->hashMerkleRoot.ToString().c_str() : "-",
             GetBlockHash().ToString().c_str());
     }
 
@@ -1177,17 +1272,34 @@ public:
     uint256 hashPrev;
     uint256 hashNext;
 
+    // cold fields are always held by value here, they are part of the record
+    uint256 hashMerkleRoot;
+    unsigned int nNonce;
+    COutPoint prevoutStake;
+    unsigned int nStakeTime;
+
     CDiskBlockIndex()
     {
         hashPrev = 0;
         hashNext = 0;
         blockHash = 0;
+        hashMerkleRoot = 0;
+        nNonce = 0;
+        prevoutStake.SetNull();
+        nStakeTime = 0;
     }
 
     explicit CDiskBlockIndex(CBlockIndex* pindex) : CBlockIndex(*pindex)
     {
         hashPrev = (pprev ? pprev->GetBlockHash() : 0);
         hashNext = (pnext ? pnext->GetBlockHash() : 0);
+
+        const CBlockIndexCold& cold = pindex->GetCold();
+        hashMerkleRoot = cold.hashMerkleRoot;
+        nNonce = cold.nNonce;
+        prevoutStake = cold.prevoutStake;
+        nStakeTime = cold.nStakeTime;
+        pcold = NULL;
     }
 
     IMPLEMENT_SERIALIZE
@@ -1262,8 +1374,107 @@ public:
 
 
 
+/** Hands out CBlockIndex entries, and the CBlockIndexCold record each one
+ * points to, from large contiguous chunks instead of one heap allocation per
+ * block. Entry i of vChunks[n] owns record i of vColdChunks[n]. Entries in
+ * mapBlockIndex are never released, just like mapBlockIndex never shrinks.
+ */
+class CBlockIndexArena
+{
+private:
+    enum { nChunkSize = 4096 };
 
+    mutable CCriticalSection cs;
+    std::vector<CBlockIndex*> vChunks;
+    std::vector<CBlockIndexCold*> vColdChunks;
+    std::vector<CBlockIndex*> vFree;
+    unsigned int nUsedInChunk;
+
+public:
+    CBlockIndexArena() : nUsedInChunk(nChunkSize) {}
+
+    /** Returns a default constructed entry, pcold set to its zeroed cold record */
+    CBlockIndex* Allocate();
+
+    /** Takes back an entry that never made it into mapBlockIndex */
+    void Release(CBlockIndex* pindex);
+
+    /** Bytes reserved for block index entries */
+    size_t GetReservedBytes() const;
+};
+
+extern CBlockIndexArena blockIndexArena;
+
+
+/** Fields of an active chain block that chain walks read */
+struct CBlockIndexHot
+{
+    unsigned int nTime;
+    unsigned int nBits;
+    int nVersion;
+    unsigned int nFlags;
+
+    bool IsProofOfStake() const
+    {
+        return (nFlags & CBlockIndex::BLOCK_PROOF_OF_STAKE);
+    }
+};
+
+/** The active chain laid out by height. Besides the CBlockIndex pointers it
+ * keeps a packed copy of the hot header fields, so walking back over the last
+ * few hundred blocks reads consecutive memory instead of following pprev
+ * through the heap. It is kept in step with the pnext links, so Tip() is
+ * pindexBest outside of SetBestChain().
+ *
+ * Callers hold cs while using any of the accessors.
+ */
+class CChainIndex
+{
+private:
+    std::vector<CBlockIndex*> vChain;
+    std::vector<CBlockIndexHot> vHot;
 
+public:
+    mutable CCriticalSection cs;
+
+    CBlockIndex* Tip() const
+    {
+        return vChain.empty() ? NULL : vChain.back();
+    }
+
+    int Height() const
+    {
+        return (int)vChain.size() - 1;
+    }
+
+    CBlockIndex* operator[](int nHeight) const
+    {
+        if (nHeight < 0 || nHeight >= (int)vChain.size())
+            return NULL;
+        return vChain[nHeight];
+    }
+
+    bool Contains(const CBlockIndex* pindex) const
+    {
+        return pindex && pindex->nHeight >= 0 && pindex->nHeight < (int)vChain.size() && vChain[pindex->nHeight] == pindex;
+    }
+
+    /** Hot fields of the block at nHeight, which must be in range */
+    const CBlockIndexHot& Hot(int nHeight) const
+    {
+        return vHot[nHeight];
+    }
+
+    /** Make pindex the tip, rewriting only the entries above the fork point */
+    void SetTip(CBlockIndex* pindex);
+
+    size_t DynamicMemoryUsage() const
+    {
+        return memusage::DynamicUsage(vChain) + memusage::DynamicUsage(vHot);
+    }
+};
+
+extern CChainIndex chainActive;
 
 
 
@@ -1288,7 +1499,7 @@ public:
 
     explicit CBlockLocator(uint256 hashBlock)
     {
-        std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+        BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
         if (mi != mapBlockIndex.end())
             Set((*mi).second);
     }
@@ -1329,7 +1540,7 @@ public:
             if (vHave.size() > 10)
                 nStep *= 2;
         }
-        vHave.push_back((!fTestNet ? hashGenesisBlock : hashGenesisBlockTestNet));
+        vHave.push_back(GetGenesisBlockHash());
     }
 
     int GetDistanceBack()
@@ -1339,7 +1550,7 @@ public:
         int nStep = 1;
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
             if (mi != mapBlockIndex.end())
             {
                 CBlockIndex* pindex = (*mi).second;
@@ -1358,7 +1569,7 @@ public:
         // Find the first block the caller has in the main chain
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
             if (mi != mapBlockIndex.end())
             {
                 CBlockIndex* pindex = (*mi).second;
@@ -1374,7 +1585,7 @@ public:
         // Find the first block the caller has in the main chain
         BOOST_FOREACH(const uint256& hash, vHave)
         {
-            std::map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hash);
+            BlockMap::iterator mi = mapBlockIndex.find(hash);
             if (mi != mapBlockIndex.end())
             {
                 CBlockIndex* pindex = (*mi).second;
@@ -1382,7 +1593,7 @@ public:
                     return hash;
             }
         }
-        return (!fTestNet ? hashGenesisBlock : hashGenesisBlockTestNet);
+        return GetGenesisBlockHash();
     }
 
     int GetHeight()
@@ -1395,6 +1606,138 @@ public:
 };
 
 
+
+
+/** Data structure that represents a partial merkle tree.
+ *
+ * It represents a subset of the txid's of a known block, in a way that
+ * allows recovery of the list of txid's and the merkle root, in an
+ * authenticated way.
+ *
+ * The encoding works as follows: we traverse the tree in depth-first order,
+ * storing a bit for each traversed node, signifying whether the node is the
+ * parent of at least one matched leaf txid (or a matched txid itself). In
+ * case we are at the leaf level, or this bit is 0, its merkle node hash is
+ * stored, and its children are not explored further. Otherwise, no hash is
+ * stored, but we recurse into both (or the only) child branch. During
+ * decoding, the same depth-first traversal is performed, consuming bits and
+ * hashes as they were written during encoding.
+ *
+ * The serialization is fixed and provides a hard guarantee about the
+ * encoded size:
+ *
+ *   SIZE <= 10 + ceil(32.25*N)
+ *
+ * Where N represents the number of leaf nodes of the partial tree. N itself
+ * is bounded by:
+ *
+ *   N <= total_transactions
+ *   N <= 1 + matched_transactions*tree_height
+ *
+ * The serialization format:
+ *  - uint32     total_transactions (4 bytes)
+ *  - varint     number of hashes   (1-3 bytes)
+ *  - uint256[]  hashes in depth-first order (<= 32*N bytes)
+ *  - varint     number of bytes of flag bits (1-3 bytes)
+ *  - byte[]     flag bits, packed per 8 in a byte, least significant bit first (<= 2*N-1 bits)
+ * The size constraints follow from this.
+ */
+class CPartialMerkleTree
+{
+protected:
+    // the total number of transactions in the block
+    unsigned int nTransactions;
+
+    // node-is-parent-of-matched-txid bits
+    std::vector<bool> vBits;
+
+    // txids and internal hashes
+    std::vector<uint256> vHash;
+
+    // flag set when encountering invalid data
+    bool fBad;
+
+    // helper function to efficiently calculate the number of nodes at given height in the merkle tree
+    unsigned int CalcTreeWidth(int height) const
+    {
+        return (nTransactions+(1 << height)-1) >> height;
+    }
+
+    // calculate the hash of a node in the merkle tree (at leaf level: the txid's themself)
+    uint256 CalcHash(int height, unsigned int pos, const std::vector<uint256> &vTxid);
+
+    // recursive function that traverses tree nodes, storing the data as bits and hashes
+    void TraverseAndBuild(int height, unsigned int pos, const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
+
+    // recursive function that traverses tree nodes, consuming the bits and hashes produced by TraverseAndBuild.
+    // it returns the hash of the respective node.
+    uint256 TraverseAndExtract(int height, unsigned int pos, unsigned int &nBitsUsed, unsigned int &nHashUsed, std::vector<uint256> &vMatch);
+
+public:
+
+    // serialization implementation
+    IMPLEMENT_SERIALIZE(
+        READWRITE(nTransactions);
+        READWRITE(vHash);
+        std::vector<unsigned char> vBytes;
+        if (fRead) {
+            READWRITE(vBytes);
+            CPartialMerkleTree &us = *(const_cast<CPartialMerkleTree*>(this));
+            us.vBits.resize(vBytes.size() * 8);
+            for (unsigned int p = 0; p < us.vBits.size(); p++)
+                us.vBits[p] = (vBytes[p / 8] & (1 << (p % 8))) != 0;
+            us.fBad = false;
+        } else {
+            vBytes.resize((vBits.size()+7)/8);
+            for (unsigned int p = 0; p < vBits.size(); p++)
+                vBytes[p / 8] |= vBits[p] << (p % 8);
+            READWRITE(vBytes);
+        }
+    )
+
+    // Construct a partial merkle tree from a list of transaction id's, and a mask that selects a subset of them
+    CPartialMerkleTree(const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
+
+    CPartialMerkleTree();
+
+    // extract the matching txid's represented by this partial merkle tree.
+    // returns the merkle root, or 0 in case of failure
+    uint256 ExtractMatches(std::vector<uint256> &vMatch);
+};
+
+
+/** Used to relay blocks as header + vector<merkle branch>
+ * to filtered nodes (BIP37 "merkleblock" messages).
+ *
+ * The header is a CBlock without its transactions, serialized the way the
+ * "headers" message sends them. The block signature is kept so that light
+ * clients can check the signature of proof-of-stake blocks.
+ */
+class CMerkleBlock
+{
+public:
+    // Public only for unit testing
+    CBlock header;
+    CPartialMerkleTree txn;
+
+public:
+    // Public only for unit testing and relay testing
+    // (not relayed)
+    std::vector<std::pair<unsigned int, uint256> > vMatchedTxn;
+
+    // Create from a CBlock, filtering transactions according to filter
+    // Note that this will call IsRelevantAndUpdate on the filter for each transaction,
+    // thus the filter will likely be modified.
+    CMerkleBlock(const CBlock& block, CBloomFilter& filter);
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(header);
+        READWRITE(txn);
+    )
+};
+
+
 /** Capture information about block/transaction validation */
 class CValidationState {
 private:
@@ -1463,9 +1806,12 @@ class CTxMemPool
 private:
     unsigned int nTransactionsUpdated;
 public:
+    typedef boost::unordered_map<uint256, CTransaction, CSaltedHasher> TxMap;
+    typedef boost::unordered_map<COutPoint, CInPoint, CSaltedHasher> NextTxMap;
+
     mutable CCriticalSection cs;
-    std::map<uint256, CTransaction> mapTx;
-    std::map<COutPoint, CInPoint> mapNextTx;
+    TxMap mapTx;
+    NextTxMap mapNextTx;
 
     bool accept(CTxDB& txdb, CTransaction &tx,
                 bool* pfMissingInputs);
@@ -1492,11 +1838,14 @@ public:
     bool lookup(uint256 hash, CTransaction& result) const
     {
         LOCK(cs);
-        std::map<uint256, CTransaction>::const_iterator i = mapTx.find(hash);
+        TxMap::const_iterator i = mapTx.find(hash);
         if (i == mapTx.end()) return false;
         result = i->second;
         return true;
     }
+
+    /** Estimated memory of mapTx, the transactions in it and mapNextTx */
+    size_t DynamicMemoryUsage() const;
 };
 
 extern CTxMemPool mempool;
@@ -12,6 +12,9 @@
 #include "addrman.h"
 #include "sync.h"
 #include "core.h"
+#include "ui_interface.h"
+#include "publisher.h"
+#include "memusage.h"
 #include <boost/lexical_cast.hpp>
 
 int CMasterNode::minProtoVersion = MIN_MN_PROTO_VERSION;
@@ -24,8 +27,10 @@ std::vector<pair<int, CMasterNode*> > vecMasternodeScores;
 std::vector<pair<int, CMasterNode> > vecMasternodeRanks;
 /** Object for who's going to get paid on which blocks */
 CMasternodePayments masternodePayments;
+/** vecMasternodes by payee script */
+CMasternodePayeeIndex masternodePayees;
 // keep track of masternode votes I've seen
-map<uint256, CMasternodePaymentWinner> mapSeenMasternodeVotes;
+boost::unordered_map<uint256, CMasternodePaymentWinner, CSaltedHasher> mapSeenMasternodeVotes;
 // keep track of the scanning errors I've seen
 map<uint256, int> mapSeenMasternodeScanningErrors;
 // who's asked for the masternode list and the last time
@@ -123,7 +128,7 @@ void ProcessMessageMasternode(CNode* pfrom, std::string& strCommand, CDataStream
             return;
         }
 
-        if((fTestNet && addr.GetPort() != 19999) || (!fTestNet && addr.GetPort() != 9999)) return;
+        if(!fRegTest && ((fTestNet && addr.GetPort() != 19999) || (!fTestNet && addr.GetPort() != 9999))) return;
 
         //search existing masternode list, this is where we update existing masternodes with new dsee broadcasts
 	      LOCK(cs_masternodes);
@@ -163,7 +168,7 @@ void ProcessMessageMasternode(CNode* pfrom, std::string& strCommand, CDataStream
         if(fDebug) printf("dsee - Got NEW masternode entry %s\n", addr.ToString().c_str());
 
         // make sure it's still unspent
-        //  - this is checked later by .check() in many places and by ThreadCheckDarkSendPool()
+        //  - this is checked later by .check() in many places and by CheckDarkSendPool()
         std::string vinError;
         if(CheckMasternodeVin(vin,vinError)){
             if (fDebugNet) printf("dsee - Accepted input for masternode entry %i %i\n", count, current);
@@ -183,6 +188,7 @@ void ProcessMessageMasternode(CNode* pfrom, std::string& strCommand, CDataStream
             CBlockIndex* pindex = pindexBest;
             mn.UpdateLastPaidBlock(pindex, 1000); // do a search back 1000 blocks when receiving a new masternode to find their last payment
             vecMasternodes.push_back(mn);
+            uiInterface.NotifyMasternodeListChanged();
 
             // if it matches our masternodeprivkey, then we've been remotely activated
             if(pubkey2 == activeMasternode.pubKeyMasternode && protocolVersion == PROTOCOL_VERSION){
@@ -247,6 +253,8 @@ void ProcessMessageMasternode(CNode* pfrom, std::string& strCommand, CDataStream
                             mn.Disable();
                             mn.Check(true);
                         }
+                        // last seen, active time and status all moved, redraw the row
+                        uiInterface.NotifyMasternodeListChanged();
                         RelayDarkSendElectionEntryPing(vin, vchSig, sigTime, stop);
                     }
                 }
@@ -416,6 +424,18 @@ struct CompareValueOnly2
     }
 };
 
+size_t GetMasternodeMemoryUsage()
+{
+    LOCK(cs_masternodes);
+    size_t nUsage = memusage::DynamicUsage(vecMasternodes) + memusage::DynamicUsage(vecMasternodeScores) + memusage::DynamicUsage(vecMasternodeRanks);
+    BOOST_FOREACH(CMasterNode& mn, vecMasternodes)
+        nUsage += memusage::DynamicUsage(mn.sig) + memusage::DynamicUsage(mn.vin.scriptSig);
+    nUsage += memusage::DynamicUsage(mapSeenMasternodeVotes);
+    for (boost::unordered_map<uint256, CMasternodePaymentWinner, CSaltedHasher>::iterator it = mapSeenMasternodeVotes.begin(); it != mapSeenMasternodeVotes.end(); ++it)
+        nUsage += memusage::DynamicUsage(it->second.payee) + memusage::DynamicUsage(it->second.vchSig);
+    return nUsage;
+}
+
 int CountMasternodesAboveProtocol(int protocolVersion)
 {
     int i = 0;
@@ -441,6 +461,51 @@ int GetMasternodeByVin(CTxIn& vin)
     return -1;
 }
 
+void CMasternodePayeeIndex::Invalidate()
+{
+    mapPayees.clear();
+    nIndexed = 0;
+}
+
+void CMasternodePayeeIndex::Update()
+{
+    if (nIndexed > vecMasternodes.size())
+        Invalidate();
+    for (; nIndexed < vecMasternodes.size(); nIndexed++)
+        mapPayees[GetScriptForDestination(vecMasternodes[nIndexed].pubkey.GetID())].push_back(nIndexed);
+}
+
+void CMasternodePayeeIndex::Find(const CScript& scriptPubKey, std::vector<CMasterNode*>& vpmn)
+{
+    AssertLockHeld(cs_masternodes);
+    vpmn.clear();
+    Update();
+
+    std::map<CScript, std::vector<size_t> >::const_iterator it = mapPayees.find(scriptPubKey);
+    if (it == mapPayees.end())
+        return;
+
+    BOOST_FOREACH(size_t i, it->second)
+    {
+        // a list change nobody reported, start over
+        if (i >= vecMasternodes.size() || GetScriptForDestination(vecMasternodes[i].pubkey.GetID()) != scriptPubKey)
+        {
+            if (fDebug) printf("CMasternodePayeeIndex::Find() : stale index, rebuilding\n");
+            Invalidate();
+            Update();
+            vpmn.clear();
+            it = mapPayees.find(scriptPubKey);
+            if (it != mapPayees.end())
+            {
+                BOOST_FOREACH(size_t j, it->second)
+                    vpmn.push_back(&vecMasternodes[j]);
+            }
+            return;
+        }
+        vpmn.push_back(&vecMasternodes[i]);
+    }
+}
+
 int GetCurrentMasterNode(int mod, int64_t nBlockHeight, int minProtocol)
 {
     int i = 0;
@@ -820,6 +885,7 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
                 winner.payee = winnerIn.payee;
                 winner.vchSig = winnerIn.vchSig;
 
+                notificationPublisher.NotifyMasternodeWinner(winner);
                 return true;
             }
         }
@@ -830,6 +896,7 @@ bool CMasternodePayments::AddWinningMasternode(CMasternodePaymentWinner& winnerI
         vWinning.push_back(winnerIn);
         mapSeenMasternodeVotes.insert(make_pair(winnerIn.GetHash(), winnerIn));
 
+        notificationPublisher.NotifyMasternodeWinner(winnerIn);
         return true;
     }
 
@@ -881,8 +948,14 @@ bool CMasternodePayments::ProcessBlock(int nBlockHeight)
         if(++c > (int)vecMasternodes.size()) break;
     }
 
-    std::random_shuffle ( vecMasternodes.begin(), vecMasternodes.end() );
-    BOOST_FOREACH(CMasterNode& mn, vecMasternodes) {
+    // visit the masternodes in random order without moving them, which would
+    // invalidate the payee index
+    std::vector<size_t> vOrder(vecMasternodes.size());
+    for (size_t i = 0; i < vOrder.size(); i++)
+        vOrder[i] = i;
+    std::random_shuffle ( vOrder.begin(), vOrder.end() );
+    BOOST_FOREACH(size_t i, vOrder) {
+        CMasterNode& mn = vecMasternodes[i];
         bool found = false;
         BOOST_FOREACH(CTxIn& vin, vecLastPayments)
             if(mn.vin == vin) found = true;
@@ -906,8 +979,8 @@ bool CMasternodePayments::ProcessBlock(int nBlockHeight)
     if(winner.nBlockHeight == 0 && vecMasternodes.size() > 0) {
         winner.score = 0;
         winner.nBlockHeight = nBlockHeight;
-        winner.vin = vecMasternodes[0].vin;
-        winner.payee =GetScriptForDestination(vecMasternodes[0].pubkey.GetID());
+        winner.vin = vecMasternodes[vOrder[0]].vin;
+        winner.payee =GetScriptForDestination(vecMasternodes[vOrder[0]].pubkey.GetID());
     }
 
 
@@ -18,6 +18,7 @@
 
 class CMasterNode;
 class CMasternodePayments;
+class CMasternodePayeeIndex;
 class uint256;
 
 #define MASTERNODE_NOT_PROCESSED               0 // initial state
@@ -34,6 +35,7 @@ class uint256;
 #define MASTERNODE_MIN_DSEEP_SECONDS           (10*60)
 #define MASTERNODE_MIN_DSEE_SECONDS            (5*60)
 #define MASTERNODE_PING_SECONDS                (1*60)
+#define MASTERNODE_PING_JITTER_SECONDS         15
 #define MASTERNODE_EXPIRATION_SECONDS          (120*60)
 #define MASTERNODE_REMOVAL_SECONDS             (130*60)
 #define MASTERNODE_CHECK_SECONDS               10
@@ -47,8 +49,9 @@ extern std::vector<CMasterNode> vecMasternodes;
 extern std::vector<pair<int, CMasterNode*> > vecMasternodeScores;
 extern std::vector<pair<int, CMasterNode> > vecMasternodeRanks;
 extern CMasternodePayments masternodePayments;
+extern CMasternodePayeeIndex masternodePayees;
 extern std::vector<CTxIn> vecMasternodeAskedFor;
-extern map<uint256, CMasternodePaymentWinner> mapSeenMasternodeVotes;
+extern boost::unordered_map<uint256, CMasternodePaymentWinner, CSaltedHasher> mapSeenMasternodeVotes;
 extern map<int64_t, uint256> mapCacheBlockHashes;
 extern unsigned int mnCount;
 
@@ -57,6 +60,8 @@ extern unsigned int mnCount;
 // manage the masternode connections
 void ProcessMasternodeConnections();
 int CountMasternodesAboveProtocol(int protocolVersion);
+// estimated memory of the masternode list, its rankings and the payment votes seen
+size_t GetMasternodeMemoryUsage();
 
 
 void ProcessMessageMasternode(CNode* pfrom, std::string& strCommand, CDataStream& vRecv);
@@ -177,6 +182,26 @@ int GetMasternodeRank(CMasterNode& tmn, int64_t nBlockHeight=0, int minProtocol=
 int GetMasternodeByRank(int findRank, int64_t nBlockHeight=0, int minProtocol=CMasterNode::minProtoVersion);
 bool GetMasternodeRanks();
 
+// Index of vecMasternodes by the script their payments go to, so block validation
+// finds the masternodes a coinbase or coinstake pays without building the script
+// of every node. Appended entries are indexed on the next lookup; code that erases
+// or reorders vecMasternodes calls Invalidate(). Guarded by cs_masternodes.
+class CMasternodePayeeIndex
+{
+private:
+    std::map<CScript, std::vector<size_t> > mapPayees;
+    size_t nIndexed;
+
+    void Update();
+
+public:
+    CMasternodePayeeIndex() : nIndexed(0) {}
+
+    void Invalidate();
+    // The masternodes paid by scriptPubKey, valid while cs_masternodes is held
+    void Find(const CScript& scriptPubKey, std::vector<CMasterNode*>& vpmn);
+};
+
 // for storing the winning payments
 class CMasternodePaymentWinner
 {
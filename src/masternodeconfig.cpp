@@ -66,7 +66,7 @@ bool CMasternodeConfig::read(std::string& strErr) {
             return false;
         }
 
-        if(CService(ip).GetPort() != 19999 && CService(ip).GetPort() != 9999)  {
+        if(!fRegTest && CService(ip).GetPort() != 19999 && CService(ip).GetPort() != 9999)  {
             strErr = "Invalid port (must be 9999 for mainnet or 19999 for testnet) detected in masternode.conf: " + line;
             streamConfig.close();
             return false;
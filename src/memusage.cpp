@@ -0,0 +1,53 @@
+// Copyright (c) 2018 The AveroPay developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "memusage.h"
+#include "init.h"
+#include "main.h"
+#include "masternode.h"
+#include "net.h"
+#include "script.h"
+#include "smessage.h"
+#include "txdb.h"
+#include "util.h"
+#include "wallet.h"
+
+using namespace std;
+
+void GetMemoryUsage(vector<pair<string, size_t> >& vUsage)
+{
+    vUsage.clear();
+    vUsage.push_back(make_pair("blockindex", GetBlockIndexMemoryUsage()));
+    vUsage.push_back(make_pair("mempool", mempool.DynamicMemoryUsage()));
+    vUsage.push_back(make_pair("orphanblocks", GetOrphanBlocksMemoryUsage()));
+    vUsage.push_back(make_pair("orphantxs", GetOrphanTxMemoryUsage()));
+    vUsage.push_back(make_pair("sigcache", GetSignatureCacheMemoryUsage()));
+    vUsage.push_back(make_pair("smsgbuckets", SecureMsgMemoryUsage()));
+    vUsage.push_back(make_pair("masternodes", GetMasternodeMemoryUsage()));
+    vUsage.push_back(make_pair("addrman", addrman.DynamicMemoryUsage()));
+#ifdef USE_LEVELDB
+    vUsage.push_back(make_pair("txdbcache", GetTxDBCacheSize()));
+#else
+    vUsage.push_back(make_pair("txdbcache", (size_t)GetArg("-dbcache", 25) * 1048576));
+#endif
+    vUsage.push_back(make_pair("smsgdbcache", SecureMsgDBCacheSize()));
+    vUsage.push_back(make_pair("peerbuffers", GetNodeBufferMemoryUsage()));
+    vUsage.push_back(make_pair("relay", GetRelayMemoryUsage()));
+    vUsage.push_back(make_pair("wallet", pwalletMain ? pwalletMain->DynamicMemoryUsage() : 0));
+}
+
+void PrintMemoryUsage()
+{
+    vector<pair<string, size_t> > vUsage;
+    GetMemoryUsage(vUsage);
+
+    string strUsage;
+    size_t nTotal = 0;
+    for (unsigned int i = 0; i < vUsage.size(); i++)
+    {
+        strUsage += strprintf(" %s=%" PRIszu"k", vUsage[i].first.c_str(), vUsage[i].second / 1024);
+        nTotal += vUsage[i].second;
+    }
+    printf("Memory usage: total=%" PRIszu"k%s\n", nTotal / 1024, strUsage.c_str());
+}
@@ -0,0 +1,114 @@
+// Copyright (c) 2018 The AveroPay developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_MEMUSAGE_H
+#define BITCOIN_MEMUSAGE_H
+
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+
+#include <stdint.h>
+
+/** Estimates of the heap memory held by containers.
+ *
+ * Nothing is tracked at allocation time: sizes are worked out from the
+ * container's element count and capacity, the node layouts of libstdc++ and
+ * boost, and a glibc-like malloc that rounds every block up and adds a word
+ * of overhead. DynamicUsage() only counts the container's own allocations, not
+ * memory owned by the elements.
+ */
+namespace memusage
+{
+
+/** Bytes malloc actually uses for an allocation of the given size */
+static inline size_t MallocUsage(size_t alloc)
+{
+    if (alloc == 0)
+        return 0;
+    if (sizeof(void*) == 8)
+        return ((alloc + 31) >> 4) << 4;
+    return ((alloc + 15) >> 3) << 3;
+}
+
+struct stl_tree_node
+{
+    int color;
+    void* parent;
+    void* left;
+    void* right;
+};
+
+struct unordered_node
+{
+    void* next;
+    size_t hash;
+};
+
+template<typename X, typename A>
+static inline size_t DynamicUsage(const std::vector<X, A>& v)
+{
+    return MallocUsage(v.capacity() * sizeof(X));
+}
+
+static inline size_t DynamicUsage(const std::string& s)
+{
+    // short strings live inside the object itself
+    if (s.capacity() < 16)
+        return 0;
+    return MallocUsage(s.capacity() + 1);
+}
+
+template<typename X, typename Y>
+static inline size_t DynamicUsage(const std::set<X, Y>& s)
+{
+    return MallocUsage(sizeof(stl_tree_node) + sizeof(X)) * s.size();
+}
+
+template<typename X, typename Y, typename Z>
+static inline size_t DynamicUsage(const std::map<X, Y, Z>& m)
+{
+    return MallocUsage(sizeof(stl_tree_node) + sizeof(std::pair<const X, Y>)) * m.size();
+}
+
+template<typename X, typename Y, typename Z>
+static inline size_t DynamicUsage(const std::multimap<X, Y, Z>& m)
+{
+    return MallocUsage(sizeof(stl_tree_node) + sizeof(std::pair<const X, Y>)) * m.size();
+}
+
+template<typename X, typename A>
+static inline size_t DynamicUsage(const std::deque<X, A>& d)
+{
+    // libstdc++ allocates 512 byte chunks plus the array pointing to them
+    size_t nChunkSize = sizeof(X) < 512 ? 512 : sizeof(X);
+    size_t nChunks = d.size() / (nChunkSize / sizeof(X)) + 1;
+    return nChunks * MallocUsage(nChunkSize) + MallocUsage((nChunks + 2) * sizeof(void*));
+}
+
+template<typename X, typename Y, typename Z>
+static inline size_t DynamicUsage(const boost::unordered_set<X, Y, Z>& s)
+{
+    return MallocUsage(sizeof(unordered_node) + sizeof(X)) * s.size() + MallocUsage(sizeof(void*) * s.bucket_count());
+}
+
+template<typename X, typename Y, typename Z, typename W>
+static inline size_t DynamicUsage(const boost::unordered_map<X, Y, Z, W>& m)
+{
+    return MallocUsage(sizeof(unordered_node) + sizeof(std::pair<const X, Y>)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
+}
+
+}
+
+/** Estimated memory of the node's major structures, by name */
+void GetMemoryUsage(std::vector<std::pair<std::string, size_t> >& vUsage);
+/** Write the breakdown to debug.log */
+void PrintMemoryUsage();
+
+#endif
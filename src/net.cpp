@@ -10,6 +10,7 @@
 #include "addrman.h"
 #include "ui_interface.h"
 #include "darksend.h"
+#include "scheduler.h"
 
 #ifdef WIN32
 #include <string.h>
@@ -63,7 +64,7 @@ CAddrMan addrman;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
+boost::unordered_map<CInv, CDataStream, CSaltedHasher> mapRelay;
 deque<pair<int64_t, CInv> > vRelayExpiration;
 CCriticalSection cs_mapRelay;
 map<CInv, int64_t> mapAlreadyAskedFor;
@@ -664,6 +665,12 @@ void CNode::copyStats(CNodeStats &stats)
     // Raw ping time is in microseconds, but show it to user as whole seconds (Bitcoin users should be well used to small numbers with many decimal places by now :)
     stats.dPingTime = (((double)nPingUsecTime) / 1e6);
     stats.dPingWait = (((double)nPingUsecWait) / 1e6);
+
+    {
+        LOCK(cs_mapMsgBytes);
+        X(mapSendBytesPerMsgCmd);
+        X(mapRecvBytesPerMsgCmd);
+    }
 }
 #undef X
 
@@ -717,7 +724,12 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
         nBytes -= handled;
 
         if (msg.complete())
+        {
             msg.nTime = GetTimeMicros();
+
+            LOCK(cs_mapMsgBytes);
+            mapRecvBytesPerMsgCmd[msg.hdr.GetCommand()] += CMessageHeader::HEADER_SIZE + msg.hdr.nMessageSize;
+        }
     }
 
     return true;
@@ -1406,32 +1418,11 @@ void DumpAddresses()
            addrman.size(), GetTimeMillis() - nStart);
 }
 
-void ThreadDumpAddress2(void* parg)
+static void PeriodicDumpAddresses()
 {
-    vnThreadsRunning[THREAD_DUMPADDRESS]++;
-    while (!fShutdown)
-    {
-        DumpAddresses();
-        vnThreadsRunning[THREAD_DUMPADDRESS]--;
-        MilliSleep(600000);
-        vnThreadsRunning[THREAD_DUMPADDRESS]++;
-    }
-    vnThreadsRunning[THREAD_DUMPADDRESS]--;
-}
-
-void ThreadDumpAddress(void* parg)
-{
-    // Make this thread recognisable as the address dumping thread
-    RenameThread("AveroPay-adrdump");
-
-    try
-    {
-        ThreadDumpAddress2(parg);
-    }
-    catch (std::exception& e) {
-        PrintException(&e, "ThreadDumpAddress()");
-    }
-    printf("ThreadDumpAddress exited\n");
+    DumpAddresses();
+    if (GetBoolArg("-printmemory"))
+        PrintMemoryUsage();
 }
 
 void ThreadOpenConnections(void* parg)
@@ -2183,9 +2174,8 @@ void StartNode(void* parg)
     if (!NewThread(ThreadMessageHandler, NULL))
         printf("Error: NewThread(ThreadMessageHandler) failed\n");
 
-    // Dump network addresses
-    if (!NewThread(ThreadDumpAddress, NULL))
-        printf("Error; NewThread(ThreadDumpAddress) failed\n");
+    // Dump network addresses every 10 minutes
+    scheduler.ScheduleEvery(PeriodicDumpAddresses, 600000);
 
     // Mine proof-of-stake blocks in the background
     if (!GetBoolArg("-staking", true))
@@ -2195,6 +2185,50 @@ void StartNode(void* parg)
             printf("Error: NewThread(ThreadStakeMiner) failed\n");
 }
 
+size_t GetNodeBufferMemoryUsage()
+{
+    vector<CNode*> vNodesCopy;
+    {
+        LOCK(cs_vNodes);
+        vNodesCopy = vNodes;
+        BOOST_FOREACH(CNode* pnode, vNodesCopy)
+            pnode->AddRef();
+    }
+
+    size_t nUsage = 0;
+    BOOST_FOREACH(CNode* pnode, vNodesCopy)
+    {
+        {
+            LOCK(pnode->cs_vSend);
+            nUsage += memusage::DynamicUsage(pnode->vSendMsg) + memusage::MallocUsage(pnode->ssSend.capacity());
+            BOOST_FOREACH(const CSerializeData& data, pnode->vSendMsg)
+                nUsage += memusage::DynamicUsage(data);
+        }
+        {
+            LOCK(pnode->cs_vRecvMsg);
+            nUsage += memusage::DynamicUsage(pnode->vRecvMsg);
+            BOOST_FOREACH(const CNetMessage& msg, pnode->vRecvMsg)
+                nUsage += memusage::MallocUsage(msg.hdrbuf.capacity()) + memusage::MallocUsage(msg.vRecv.capacity());
+        }
+    }
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodesCopy)
+            pnode->Release();
+    }
+    return nUsage;
+}
+
+size_t GetRelayMemoryUsage()
+{
+    LOCK(cs_mapRelay);
+    size_t nUsage = memusage::DynamicUsage(mapRelay) + memusage::DynamicUsage(vRelayExpiration);
+    for (boost::unordered_map<CInv, CDataStream, CSaltedHasher>::iterator mi = mapRelay.begin(); mi != mapRelay.end(); ++mi)
+        nUsage += memusage::MallocUsage(mi->second.capacity());
+    return nUsage;
+}
+
 bool StopNode()
 {
     printf("StopNode()\n");
@@ -2225,7 +2259,6 @@ bool StopNode()
 #endif
     if (vnThreadsRunning[THREAD_DNSSEED] > 0) printf("ThreadDNSAddressSeed still running\n");
     if (vnThreadsRunning[THREAD_ADDEDCONNECTIONS] > 0) printf("ThreadOpenAddedConnections still running\n");
-    if (vnThreadsRunning[THREAD_DUMPADDRESS] > 0) printf("ThreadDumpAddresses still running\n");
     if (vnThreadsRunning[THREAD_STAKE_MINER] > 0) printf("ThreadStakeMiner still running\n");
     while (vnThreadsRunning[THREAD_MESSAGEHANDLER] > 0 || vnThreadsRunning[THREAD_RPCHANDLER] > 0)
         MilliSleep(20);
@@ -2284,7 +2317,21 @@ void RelayTransaction(const CTransaction& tx, const uint256& hash, const CDataSt
         vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
     }
 
-    RelayInventory(inv);
+    // Only announce to peers whose bloom filter, if they loaded one, matches
+    LOCK(cs_vNodes);
+    BOOST_FOREACH(CNode* pnode, vNodes)
+    {
+        if (!pnode->fRelayTxes)
+            continue;
+        LOCK(pnode->cs_filter);
+        if (pnode->pfilter)
+        {
+            if (pnode->pfilter->IsRelevantAndUpdate(tx, hash))
+                pnode->PushInventory(inv);
+        }
+        else
+            pnode->PushInventory(inv);
+    }
 }
 
 void RelayTransactionLockReq(const CTransaction& tx, const uint256& hash, bool relayToAll)
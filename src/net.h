@@ -19,6 +19,9 @@
 #include "netbase.h"
 #include "protocol.h"
 #include "addrman.h"
+#include "bloom.h"
+#include "hashmap.h"
+#include "memusage.h"
 
 class CRequestTracker;
 class CNode;
@@ -48,6 +51,9 @@ bool BindListenPort(const CService &bindAddr, std::string& strError=REF(std::str
 void StartNode(void* parg);
 bool StopNode();
 void SocketSendData(CNode *pnode);
+// Estimated memory of the peers' send and receive queues, and of the relay cache
+size_t GetNodeBufferMemoryUsage();
+size_t GetRelayMemoryUsage();
 
 // Signals for message handling
 struct CNodeSignals
@@ -129,7 +135,6 @@ enum threadId
     THREAD_UPNP,
     THREAD_DNSSEED,
     THREAD_ADDEDCONNECTIONS,
-    THREAD_DUMPADDRESS,
     THREAD_RPCHANDLER,
     THREAD_STAKE_MINER,
 
@@ -146,7 +151,7 @@ extern CAddrMan addrman;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
+extern boost::unordered_map<CInv, CDataStream, CSaltedHasher> mapRelay;
 extern std::deque<std::pair<int64_t, CInv> > vRelayExpiration;
 extern CCriticalSection cs_mapRelay;
 extern std::map<CInv, int64_t> mapAlreadyAskedFor;
@@ -173,6 +178,8 @@ public:
     int nMisbehavior;
     double dPingTime;
     double dPingWait;
+    std::map<std::string, uint64_t> mapSendBytesPerMsgCmd;
+    std::map<std::string, uint64_t> mapRecvBytesPerMsgCmd;
 };
 
 
@@ -266,6 +273,11 @@ public:
     
     uint64_t nSendBytes;
     uint64_t nRecvBytes;
+
+    // bytes queued and received per message command, headers included
+    CCriticalSection cs_mapMsgBytes;
+    std::map<std::string, uint64_t> mapSendBytesPerMsgCmd;
+    std::map<std::string, uint64_t> mapRecvBytesPerMsgCmd;
     
     int64_t nLastSendEmpty;
     int64_t nTimeConnected;
@@ -286,6 +298,8 @@ public:
     //    until they have initialized their bloom filter.
     bool fRelayTxes;
     bool fDarkSendMaster;
+    CCriticalSection cs_filter;
+    CBloomFilter* pfilter;
     CSemaphoreGrant grantOutbound;
     int nRefCount;
 	NodeId id;
@@ -371,6 +385,8 @@ public:
         nPingUsecTime = 0;
         fPingQueued = false;
         fDarkSendMaster = false;
+        fRelayTxes = false;
+        pfilter = NULL;
 
         // Be shy and don't send version until we hear
         if (hSocket != INVALID_SOCKET && !fInbound)
@@ -384,6 +400,8 @@ public:
             closesocket(hSocket);
             hSocket = INVALID_SOCKET;
         }
+        if (pfilter)
+            delete pfilter;
     }
 
 private:
@@ -539,6 +557,12 @@ public:
             printf("(%d bytes)\n", nSize);
         }
 
+        {
+            LOCK(cs_mapMsgBytes);
+            std::string strCommand(&ssSend[CMessageHeader::MESSAGE_START_SIZE], strnlen(&ssSend[CMessageHeader::MESSAGE_START_SIZE], CMessageHeader::COMMAND_SIZE));
+            mapSendBytesPerMsgCmd[strCommand] += ssSend.size();
+        }
+
         std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
         ssSend.GetAndClear(*it);
         nSendSize += (*it).size();
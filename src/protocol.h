@@ -16,8 +16,11 @@
 #include "uint256.h"
 
 extern bool fTestNet;
+extern bool fRegTest;
 static inline unsigned short GetDefaultPort(const bool testnet = fTestNet)
 {
+    if (testnet && fRegTest)
+        return 33444;
     return testnet ? 33338 : 45360;
 }
 
@@ -69,6 +72,8 @@ class CMessageHeader
 enum
 {
     NODE_NETWORK = (1 << 0),
+    // serves BIP 157 compact block filters (-blockfilterindex)
+    NODE_COMPACT_FILTERS = (1 << 6),
 };
 
 /** A CService with information about it as peer */
@@ -123,6 +128,7 @@ class CInv
         )
 
         friend bool operator<(const CInv& a, const CInv& b);
+        friend bool operator==(const CInv& a, const CInv& b);
 
         bool IsKnownType() const;
         const char* GetCommand() const;
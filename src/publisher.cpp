@@ -0,0 +1,439 @@
+// Copyright (c) 2018 The AveroPay developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "publisher.h"
+#include "main.h"
+#include "masternode.h"
+#include "netbase.h"
+#include "smessage.h"
+#include "util.h"
+#include "wallet.h"
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+using namespace std;
+
+// Events are dropped once this much data waits for the publisher thread, on
+// top of the queue's limit on the number of events
+static const uint64_t MAX_QUEUED_BYTES = 64 * 1024 * 1024;
+
+// A subscriber that has this much unsent data misses events until it catches up
+static const size_t MAX_SUBSCRIBER_SEND = 16 * 1024 * 1024;
+
+static const int MAX_SUBSCRIBERS = 32;
+
+static const char* pszTopicNames[PUB_TOPIC_COUNT] =
+{
+    "hashblock",
+    "hashtx",
+    "rawblock",
+    "rawtx",
+    "hashwallettx",
+    "smsginbox",
+    "masternodewinner",
+};
+
+CNotificationPublisher notificationPublisher;
+
+const char* GetPublishTopicName(int nTopic)
+{
+    if (nTopic < 0 || nTopic >= PUB_TOPIC_COUNT)
+        return "";
+    return pszTopicNames[nTopic];
+}
+
+CNotificationPublisher::CNotificationPublisher()
+{
+    nQueuedBytes = 0;
+    nDropped = 0;
+    for (int i = 0; i < PUB_TOPIC_COUNT; i++)
+    {
+        nSequence[i] = 0;
+        fTopicEnabled[i] = false;
+    }
+    nSubscribers = 0;
+    fActive = false;
+    hListenSocket = INVALID_SOCKET;
+    fRunning = false;
+    fStopping = false;
+}
+
+void CNotificationPublisher::Publish(int nTopic, const CSerializeData& vchBody)
+{
+    // Nobody listening: the event still uses up its sequence number
+    uint32_t nSeq = nSequence[nTopic]++;
+    if (nSubscribers == 0)
+        return;
+
+    CMessage* pmsg = new CMessage();
+    pmsg->nTopic = nTopic;
+    pmsg->nSequence = nSeq;
+    pmsg->vchBody = vchBody;
+    uint64_t nSize = vchBody.size();
+    if (nQueuedBytes.fetch_add(nSize) + nSize > MAX_QUEUED_BYTES || !queue.bounded_push(pmsg))
+    {
+        nQueuedBytes -= nSize;
+        delete pmsg;
+        uint64_t n = ++nDropped;
+        if (n % 1000 == 1)
+            printf("CNotificationPublisher : queue full, dropped %s event (%" PRIu64" dropped so far)\n", pszTopicNames[nTopic], n);
+    }
+}
+
+void CNotificationPublisher::PublishHash(int nTopic, const uint256& hash)
+{
+    CSerializeData vchBody(hash.begin(), hash.end());
+    reverse(vchBody.begin(), vchBody.end());
+    Publish(nTopic, vchBody);
+}
+
+template<typename T>
+void CNotificationPublisher::PublishObject(int nTopic, const T& obj)
+{
+    CSerializeData vchBody;
+    if (nSubscribers > 0)
+    {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << obj;
+        ss.GetAndClear(vchBody);
+    }
+    Publish(nTopic, vchBody);
+}
+
+void CNotificationPublisher::NotifyBlock(const CBlock& block)
+{
+    if (IsTopicActive(PUB_HASHBLOCK))
+        PublishHash(PUB_HASHBLOCK, block.GetHash());
+    if (IsTopicActive(PUB_RAWBLOCK))
+        PublishObject(PUB_RAWBLOCK, block);
+}
+
+void CNotificationPublisher::NotifyTransaction(const CTransaction& tx)
+{
+    if (IsTopicActive(PUB_HASHTX))
+        PublishHash(PUB_HASHTX, tx.GetHash());
+    if (IsTopicActive(PUB_RAWTX))
+        PublishObject(PUB_RAWTX, tx);
+}
+
+void CNotificationPublisher::NotifyWalletTransaction(CWallet* pwallet, const uint256& hashTx, ChangeType status)
+{
+    if (status != CT_DELETED && IsTopicActive(PUB_HASHWALLETTX))
+        PublishHash(PUB_HASHWALLETTX, hashTx);
+}
+
+void CNotificationPublisher::NotifySecMsgInbox(SecMsgStored& smsgStored)
+{
+    if (IsTopicActive(PUB_SMSGINBOX))
+        PublishObject(PUB_SMSGINBOX, smsgStored);
+}
+
+void CNotificationPublisher::NotifyMasternodeWinner(const CMasternodePaymentWinner& winner)
+{
+    if (IsTopicActive(PUB_MASTERNODEWINNER))
+        PublishObject(PUB_MASTERNODEWINNER, winner);
+}
+
+static void AppendLE32(CSerializeData& vch, uint32_t n)
+{
+    for (int i = 0; i < 4; i++)
+        vch.push_back((char)((n >> (8 * i)) & 0xff));
+}
+
+void CNotificationPublisher::Dispatch(const CMessage& msg)
+{
+    const char* pszTopic = pszTopicNames[msg.nTopic];
+    size_t nTopicLen = strlen(pszTopic);
+    size_t nFrameSize = 1 + nTopicLen + 4 + msg.vchBody.size() + 4;
+
+    BOOST_FOREACH(CSubscriber& subscriber, vSubscribers)
+    {
+        if (subscriber.vSend.size() - subscriber.nSendOffset + nFrameSize > MAX_SUBSCRIBER_SEND)
+        {
+            // Slow reader: skip whole frames, the sequence numbers show the gap
+            if (subscriber.nDropped++ % 1000 == 0)
+                printf("CNotificationPublisher : subscriber %s is not keeping up, dropping events\n", subscriber.strAddr.c_str());
+            continue;
+        }
+        CSerializeData& vSend = subscriber.vSend;
+        vSend.reserve(vSend.size() + nFrameSize);
+        vSend.push_back((char)nTopicLen);
+        vSend.insert(vSend.end(), pszTopic, pszTopic + nTopicLen);
+        AppendLE32(vSend, msg.vchBody.size());
+        vSend.insert(vSend.end(), msg.vchBody.begin(), msg.vchBody.end());
+        AppendLE32(vSend, msg.nSequence);
+    }
+}
+
+void CNotificationPublisher::CloseSubscriber(CSubscriber& subscriber, const char* pszReason)
+{
+    printf("CNotificationPublisher : subscriber %s disconnected (%s)\n", subscriber.strAddr.c_str(), pszReason);
+    closesocket(subscriber.hSocket);
+}
+
+void CNotificationPublisher::AcceptSubscribers()
+{
+    while (true)
+    {
+        struct sockaddr_storage sockaddr;
+        socklen_t len = sizeof(sockaddr);
+        SOCKET hSocket = accept(hListenSocket, (struct sockaddr*)&sockaddr, &len);
+        if (hSocket == INVALID_SOCKET)
+            return;
+
+        CService addr;
+        addr.SetSockAddr((const struct sockaddr*)&sockaddr);
+        if ((int)vSubscribers.size() >= MAX_SUBSCRIBERS)
+        {
+            printf("CNotificationPublisher : refusing subscriber %s, already have %d\n", addr.ToString().c_str(), MAX_SUBSCRIBERS);
+            closesocket(hSocket);
+            continue;
+        }
+
+        CSubscriber subscriber;
+        subscriber.hSocket = hSocket;
+        subscriber.strAddr = addr.ToString();
+        subscriber.nSendOffset = 0;
+        subscriber.nDropped = 0;
+        vSubscribers.push_back(subscriber);
+        nSubscribers = vSubscribers.size();
+        printf("CNotificationPublisher : subscriber %s connected\n", subscriber.strAddr.c_str());
+    }
+}
+
+void CNotificationPublisher::SendAndReceive()
+{
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    SOCKET hSocketMax = hListenSocket;
+    FD_SET(hListenSocket, &fdsetRecv);
+    BOOST_FOREACH(const CSubscriber& subscriber, vSubscribers)
+    {
+        FD_SET(subscriber.hSocket, &fdsetRecv);
+        if (subscriber.nSendOffset < subscriber.vSend.size())
+            FD_SET(subscriber.hSocket, &fdsetSend);
+        hSocketMax = max(hSocketMax, subscriber.hSocket);
+    }
+
+    // Producers don't signal the thread, so the queue is polled at this interval
+    struct timeval timeout;
+    timeout.tv_sec  = 0;
+    timeout.tv_usec = 10000;
+    if (select(hSocketMax + 1, &fdsetRecv, &fdsetSend, NULL, &timeout) == SOCKET_ERROR)
+        return;
+
+    BOOST_FOREACH(CSubscriber& subscriber, vSubscribers)
+    {
+        // Subscribers have nothing to say; reading only detects them going away
+        if (FD_ISSET(subscriber.hSocket, &fdsetRecv))
+        {
+            char pchBuf[1024];
+            int nBytes = recv(subscriber.hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+            if (nBytes == 0)
+                CloseSubscriber(subscriber, "closed");
+            else if (nBytes < 0)
+            {
+                int nErr = WSAGetLastError();
+                if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+                    CloseSubscriber(subscriber, "recv error");
+            }
+        }
+
+        if (subscriber.hSocket != INVALID_SOCKET && FD_ISSET(subscriber.hSocket, &fdsetSend))
+        {
+            CSerializeData& vSend = subscriber.vSend;
+            int nBytes = send(subscriber.hSocket, &vSend[subscriber.nSendOffset], vSend.size() - subscriber.nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (nBytes > 0)
+            {
+                subscriber.nSendOffset += nBytes;
+                if (subscriber.nSendOffset == vSend.size())
+                {
+                    subscriber.nSendOffset = 0;
+                    vSend.clear();
+                }
+            }
+            else if (nBytes < 0)
+            {
+                int nErr = WSAGetLastError();
+                if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+                    CloseSubscriber(subscriber, "send error");
+            }
+        }
+    }
+
+    for (vector<CSubscriber>::iterator it = vSubscribers.begin(); it != vSubscribers.end(); )
+    {
+        if (it->hSocket == INVALID_SOCKET)
+            it = vSubscribers.erase(it);
+        else
+            ++it;
+    }
+    nSubscribers = vSubscribers.size();
+
+    if (FD_ISSET(hListenSocket, &fdsetRecv))
+        AcceptSubscribers();
+}
+
+void CNotificationPublisher::ThreadMain()
+{
+    while (true)
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fStopping)
+                break;
+        }
+
+        CMessage* pmsg;
+        while (queue.pop(pmsg))
+        {
+            nQueuedBytes -= pmsg->vchBody.size();
+            Dispatch(*pmsg);
+            delete pmsg;
+        }
+
+        SendAndReceive();
+    }
+
+    BOOST_FOREACH(CSubscriber& subscriber, vSubscribers)
+        closesocket(subscriber.hSocket);
+    vSubscribers.clear();
+    nSubscribers = 0;
+    closesocket(hListenSocket);
+
+    CMessage* pmsg;
+    while (queue.pop(pmsg))
+        delete pmsg;
+    nQueuedBytes = 0;
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fRunning = false;
+    condStopped.notify_all();
+}
+
+static void ThreadNotificationPublisher(void* parg)
+{
+    // Make this thread recognisable as the notification publishing thread
+    RenameThread("AveroPay-publisher");
+
+    try
+    {
+        notificationPublisher.ThreadMain();
+    }
+    catch (std::exception& e) {
+        PrintException(&e, "ThreadNotificationPublisher()");
+    }
+    printf("ThreadNotificationPublisher exited\n");
+}
+
+bool CNotificationPublisher::Start(CWallet* pwallet, std::string& strError)
+{
+    // Topics to publish, all of them unless restricted with -pubnotifytopic
+    bool fAllTopics = !mapMultiArgs.count("-pubnotifytopic");
+    for (int i = 0; i < PUB_TOPIC_COUNT; i++)
+        fTopicEnabled[i] = fAllTopics;
+    if (!fAllTopics)
+    {
+        BOOST_FOREACH(const std::string& strTopic, mapMultiArgs["-pubnotifytopic"])
+        {
+            int i = 0;
+            while (i < PUB_TOPIC_COUNT && strTopic != pszTopicNames[i])
+                i++;
+            if (i == PUB_TOPIC_COUNT)
+            {
+                strError = strprintf(_("Unknown -pubnotifytopic: '%s'"), strTopic.c_str());
+                return false;
+            }
+            fTopicEnabled[i] = true;
+        }
+    }
+
+    // Only loopback unless an address is given explicitly
+    std::string strBind = GetArg("-pubnotify", "");
+    if (strBind.find(':') == std::string::npos)
+        strBind = "127.0.0.1:" + strBind;
+    CService addrBind;
+    if (!Lookup(strBind.c_str(), addrBind, 0, false) || addrBind.GetPort() == 0)
+    {
+        strError = strprintf(_("Invalid -pubnotify address: '%s'"), GetArg("-pubnotify", "").c_str());
+        return false;
+    }
+
+    struct sockaddr_storage sockaddr;
+    socklen_t len = sizeof(sockaddr);
+    if (!addrBind.GetSockAddr((struct sockaddr*)&sockaddr, &len))
+    {
+        strError = strprintf(_("Invalid -pubnotify address: '%s'"), GetArg("-pubnotify", "").c_str());
+        return false;
+    }
+
+    hListenSocket = socket(((struct sockaddr*)&sockaddr)->sa_family, SOCK_STREAM, IPPROTO_TCP);
+    if (hListenSocket == INVALID_SOCKET)
+    {
+        strError = strprintf(_("Couldn't open socket for -pubnotify (socket returned error %d)"), WSAGetLastError());
+        return false;
+    }
+
+    int nOne = 1;
+#ifdef SO_NOSIGPIPE
+    setsockopt(hListenSocket, SOL_SOCKET, SO_NOSIGPIPE, (void*)&nOne, sizeof(int));
+#endif
+#ifndef WIN32
+    setsockopt(hListenSocket, SOL_SOCKET, SO_REUSEADDR, (void*)&nOne, sizeof(int));
+#endif
+
+#ifdef WIN32
+    if (ioctlsocket(hListenSocket, FIONBIO, (u_long*)&nOne) == SOCKET_ERROR ||
+#else
+    if (fcntl(hListenSocket, F_SETFL, O_NONBLOCK) == SOCKET_ERROR ||
+#endif
+        ::bind(hListenSocket, (struct sockaddr*)&sockaddr, len) == SOCKET_ERROR ||
+        listen(hListenSocket, SOMAXCONN) == SOCKET_ERROR)
+    {
+        int nErr = WSAGetLastError();
+        strError = strprintf(_("Unable to publish notifications on %s (error %d, %s)"), addrBind.ToString().c_str(), nErr, strerror(nErr));
+        closesocket(hListenSocket);
+        return false;
+    }
+
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fRunning = true;
+        fStopping = false;
+    }
+    if (!NewThread(ThreadNotificationPublisher, NULL))
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fRunning = false;
+        closesocket(hListenSocket);
+        strError = _("Error: NewThread(ThreadNotificationPublisher) failed");
+        return false;
+    }
+
+    if (pwallet)
+        connWallet = pwallet->NotifyTransactionChanged.connect(boost::bind(&CNotificationPublisher::NotifyWalletTransaction, this, _1, _2, _3));
+    connSecMsgInbox = NotifySecMsgInboxChanged.connect(boost::bind(&CNotificationPublisher::NotifySecMsgInbox, this, _1));
+
+    fActive = true;
+    printf("Publishing notifications on %s\n", addrBind.ToString().c_str());
+    return true;
+}
+
+void CNotificationPublisher::Stop()
+{
+    fActive = false;
+    connWallet.disconnect();
+    connSecMsgInbox.disconnect();
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!fRunning)
+        return;
+    fStopping = true;
+    while (fRunning)
+        condStopped.wait(lock);
+}
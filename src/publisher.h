@@ -0,0 +1,124 @@
+// Copyright (c) 2018 The AveroPay developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_PUBLISHER_H
+#define BITCOIN_PUBLISHER_H
+
+#include "serialize.h"
+#include "compat.h"
+#include "uint256.h"
+#include "ui_interface.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/atomic.hpp>
+#include <boost/lockfree/queue.hpp>
+#include <boost/signals2/connection.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <stdint.h>
+
+class CBlock;
+class CTransaction;
+class CWallet;
+class SecMsgStored;
+class CMasternodePaymentWinner;
+
+enum PublishTopic
+{
+    PUB_HASHBLOCK = 0,
+    PUB_HASHTX,
+    PUB_RAWBLOCK,
+    PUB_RAWTX,
+    PUB_HASHWALLETTX,
+    PUB_SMSGINBOX,
+    PUB_MASTERNODEWINNER,
+
+    PUB_TOPIC_COUNT
+};
+
+const char* GetPublishTopicName(int nTopic);
+
+/** Pushes block, transaction, wallet, secure message and masternode events to
+ * local subscribers over TCP (-pubnotify).
+ *
+ * The code raising an event only serializes it and pushes it onto a fixed size
+ * lock-free queue, it never waits on the publisher or on a subscriber. When the
+ * queue is at its high-water mark the event is dropped. Every event carries a
+ * per-topic sequence number that counts dropped events too, so a subscriber
+ * can tell when it missed something and resync over RPC.
+ *
+ * Each event goes out as one frame:
+ *   uint8 topic length, topic, uint32 body length, body, uint32 sequence
+ * with integers little-endian. Hashes are sent in the byte order they are
+ * displayed in, raw blocks and transactions in their network serialization.
+ */
+class CNotificationPublisher
+{
+private:
+    struct CMessage
+    {
+        int nTopic;
+        uint32_t nSequence;
+        CSerializeData vchBody;
+    };
+
+    struct CSubscriber
+    {
+        SOCKET hSocket;
+        std::string strAddr;
+        CSerializeData vSend;
+        size_t nSendOffset;
+        uint64_t nDropped;
+    };
+
+    boost::lockfree::queue<CMessage*, boost::lockfree::capacity<8192> > queue;
+    boost::atomic<uint64_t> nQueuedBytes;
+    boost::atomic<uint64_t> nDropped;
+    boost::atomic<uint32_t> nSequence[PUB_TOPIC_COUNT];
+    boost::atomic<bool> fTopicEnabled[PUB_TOPIC_COUNT];
+    boost::atomic<int> nSubscribers;
+    boost::atomic<bool> fActive;
+
+    // owned by the publisher thread
+    SOCKET hListenSocket;
+    std::vector<CSubscriber> vSubscribers;
+
+    boost::mutex mutex;
+    boost::condition_variable condStopped;
+    bool fRunning;
+    bool fStopping;
+
+    boost::signals2::connection connWallet;
+    boost::signals2::connection connSecMsgInbox;
+
+    bool IsTopicActive(int nTopic) const { return fActive && fTopicEnabled[nTopic]; }
+    void Publish(int nTopic, const CSerializeData& vchBody);
+    void PublishHash(int nTopic, const uint256& hash);
+    template<typename T> void PublishObject(int nTopic, const T& obj);
+
+    void AcceptSubscribers();
+    void Dispatch(const CMessage& msg);
+    void SendAndReceive();
+    void CloseSubscriber(CSubscriber& subscriber, const char* pszReason);
+
+public:
+    CNotificationPublisher();
+
+    /** Bind the -pubnotify socket and start the publisher thread */
+    bool Start(CWallet* pwallet, std::string& strError);
+    void Stop();
+    void ThreadMain();
+
+    void NotifyBlock(const CBlock& block);
+    void NotifyTransaction(const CTransaction& tx);
+    void NotifyWalletTransaction(CWallet* pwallet, const uint256& hashTx, ChangeType status);
+    void NotifySecMsgInbox(SecMsgStored& smsgStored);
+    void NotifyMasternodeWinner(const CMasternodePaymentWinner& winner);
+};
+
+extern CNotificationPublisher notificationPublisher;
+
+#endif
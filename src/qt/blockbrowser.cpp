@@ -88,7 +88,7 @@ std::string getBlockMerkle(int Height)
 
     CBlock block;
     CBlockIndex* pblockindex = mapBlockIndex[hash];
-    return pblockindex->hashMerkleRoot.ToString().substr(0,10).c_str();
+    return pblockindex->GetCold().hashMerkleRoot.ToString().substr(0,10).c_str();
 }
 
 int getBlocknBits(int Height)
@@ -114,7 +114,7 @@ int getBlockNonce(int Height)
 
     CBlock block;
     CBlockIndex* pblockindex = mapBlockIndex[hash];
-    return pblockindex->nNonce;
+    return pblockindex->GetCold().nNonce;
 }
 
 std::string getBlockDebug(int Height)
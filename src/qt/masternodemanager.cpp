@@ -31,6 +31,7 @@ using namespace std;
 #include <QApplication>
 #include <QClipboard>
 #include <QMessageBox>
+#include <QShowEvent>
 
 MasternodeManager::MasternodeManager(QWidget *parent) :
     QWidget(parent),
@@ -39,6 +40,7 @@ MasternodeManager::MasternodeManager(QWidget *parent) :
     walletModel(0)
 {
     ui->setupUi(this);
+    fPendingUpdate = false;
 
     ui->editButton->setEnabled(false);
     ui->editButton->setVisible(false);
@@ -53,18 +55,20 @@ MasternodeManager::MasternodeManager(QWidget *parent) :
     ui->tableWidget_2->setSortingEnabled(true);
     ui->tableWidget_2->sortByColumn(0, Qt::AscendingOrder);
 
-    subscribeToCoreSignals();
+    // coalesce bursts of list changes (e.g. while syncing the list) into a single refresh
+    listChangedTimer = new QTimer(this);
+    listChangedTimer->setSingleShot(true);
+    connect(listChangedTimer, SIGNAL(timeout()), this, SLOT(updateNodeList()));
 
-    timer = new QTimer(this);
-    connect(timer, SIGNAL(timeout()), this, SLOT(updateNodeList()));
-    if(!GetBoolArg("-reindexaddr", false))
-        timer->start(30000);
+    // the list is refreshed when the core reports a change, there is no polling
+    subscribeToCoreSignals();
 
     updateNodeList();
 }
 
 MasternodeManager::~MasternodeManager()
 {
+    unsubscribeFromCoreSignals();
     delete ui;
 }
 
@@ -91,16 +95,46 @@ static void NotifyAdrenalineNodeUpdated(MasternodeManager *page, CAdrenalineNode
                               );
 }
 
+static void NotifyMasternodeListChanged(MasternodeManager *page)
+{
+    QMetaObject::invokeMethod(page, "masternodeListChanged", Qt::QueuedConnection);
+}
+
+static void NotifyMasternodeStatusChanged(MasternodeManager *page, int status, const std::string& reason)
+{
+    // our own masternode started, stopped or changed state, its row needs redrawing
+    QMetaObject::invokeMethod(page, "masternodeListChanged", Qt::QueuedConnection);
+}
+
 void MasternodeManager::subscribeToCoreSignals()
 {
     // Connect signals to core
     uiInterface.NotifyAdrenalineNodeChanged.connect(boost::bind(&NotifyAdrenalineNodeUpdated, this, _1));
+    uiInterface.NotifyMasternodeListChanged.connect(boost::bind(&NotifyMasternodeListChanged, this));
+    uiInterface.NotifyMasternodeStatusChanged.connect(boost::bind(&NotifyMasternodeStatusChanged, this, _1, _2));
 }
 
 void MasternodeManager::unsubscribeFromCoreSignals()
 {
     // Disconnect signals from core
     uiInterface.NotifyAdrenalineNodeChanged.disconnect(boost::bind(&NotifyAdrenalineNodeUpdated, this, _1));
+    uiInterface.NotifyMasternodeListChanged.disconnect(boost::bind(&NotifyMasternodeListChanged, this));
+    uiInterface.NotifyMasternodeStatusChanged.disconnect(boost::bind(&NotifyMasternodeStatusChanged, this, _1, _2));
+}
+
+void MasternodeManager::masternodeListChanged()
+{
+    if(!listChangedTimer->isActive())
+        listChangedTimer->start(1000);
+}
+
+void MasternodeManager::showEvent(QShowEvent *event)
+{
+    QWidget::showEvent(event);
+
+    // the list is not rebuilt while the page is hidden, catch up now
+    if(fPendingUpdate)
+        updateNodeList();
 }
 
 void MasternodeManager::on_tableWidget_2_itemSelectionChanged()
@@ -239,9 +273,15 @@ static QString seconds_to_DHMS(quint32 duration)
 
 void MasternodeManager::updateNodeList()
 {
+    if(!isVisible()) {
+        fPendingUpdate = true;
+        return;
+    }
+
     TRY_LOCK(cs_masternodes, lockMasternodes);
     if(!lockMasternodes)
         return;
+    fPendingUpdate = false;
 
     ui->countLabel->setText("Updating...");
     if (mnCount == 0) return;
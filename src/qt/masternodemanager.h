@@ -33,11 +33,16 @@ public:
 public slots:
     void updateNodeList();
     void updateAdrenalineNode(QString alias, QString addr, QString privkey);
+    void masternodeListChanged();
+
+protected:
+    void showEvent(QShowEvent *event);
 
 signals:
 
 private:
-    QTimer *timer;
+    QTimer *listChangedTimer;
+    bool fPendingUpdate;
     Ui::MasternodeManager *ui;
     ClientModel *clientModel;
     WalletModel *walletModel;
@@ -71,7 +71,7 @@ public:
         cachedWallet.clear();
         {
             LOCK(wallet->cs_wallet);
-            for(std::map<uint256, CWalletTx>::iterator it = wallet->mapWallet.begin(); it != wallet->mapWallet.end(); ++it)
+            for(CWallet::TxMap::iterator it = wallet->mapWallet.begin(); it != wallet->mapWallet.end(); ++it)
             {
                     std::vector<KernelRecord> txList = KernelRecord::decomposeOutput(wallet, it->second);
                     BOOST_FOREACH(KernelRecord& kr, txList) {
@@ -81,6 +81,8 @@ public:
                     }
             }
         }
+        // mapWallet is a hash table, restore the ordering updateWallet relies on
+        std::stable_sort(cachedWallet.begin(), cachedWallet.end(), TxLessThan());
     }
 
      /* Update our model of the wallet incrementally, to synchronize our model of the wallet
@@ -105,7 +107,7 @@ public:
             {
                 const uint256 &hash = updated_sorted.at(update_idx);
                 // Find transaction in wallet
-                std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(hash);
+                CWallet::TxMap::iterator mi = wallet->mapWallet.find(hash);
                 bool inWallet = mi != wallet->mapWallet.end();
 
                 // Find bounds of this transaction in model
@@ -207,7 +209,7 @@ public:
     {
         {
             LOCK(wallet->cs_wallet);
-            std::map<uint256, CWalletTx>::iterator mi = wallet->mapWallet.find(rec->hash);
+            CWallet::TxMap::iterator mi = wallet->mapWallet.find(rec->hash);
             if(mi != wallet->mapWallet.end())
             {
                 return TransactionDesc::toHTML(wallet, mi->second);
@@ -6,21 +6,128 @@
 #include "base58.h"
 #include "clientmodel.h"
 #include "bitcoinrpc.h"
+#include "blockstats.h"
 #include "marketbrowser.h"
+#include "qcustomplot.h"
+#include "txdb.h"
 #include <sstream>
 #include <string>
 
 using namespace json_spirit;
 
+/* Blocks the network figures and the chart are worked out over */
+static const int STATISTICS_BLOCKS = 144;
+
+/* Collect the chain figures of the page in a separate thread.
+
+   The stats of the last blocks come from the block stats index, which may
+   have to backfill them from disk, so this runs neither on the UI thread nor
+   under cs_main. Only the block index pointers are taken under
+   chainActive.cs; a block disconnected meanwhile only makes the figures
+   stale until the next update.
+*/
+class ChainStatisticsCollector : public QObject
+{
+    Q_OBJECT
+
+public slots:
+    void collect();
+
+signals:
+    void reply(int nHeight, double pHardness, double pHardness2, double pPawrate2, double dNetworkWeight,
+               QVector<double> vHeight, QVector<double> vTxCount, QVector<double> vFeeRate);
+};
+
+#include "statisticspage.moc"
+
+void ChainStatisticsCollector::collect()
+{
+    std::vector<CBlockIndex*> vIndex;
+    {
+        LOCK(chainActive.cs);
+        for (int nHeight = std::max(0, chainActive.Height() - STATISTICS_BLOCKS + 1); nHeight <= chainActive.Height(); nHeight++)
+            vIndex.push_back(chainActive[nHeight]);
+    }
+    if (vIndex.empty())
+    {
+        emit reply(-1, 0, 0, 0, 0, QVector<double>(), QVector<double>(), QVector<double>());
+        return;
+    }
+
+    CTxDB txdb;
+    CBlockStats stats;
+    CBlockStatsWindow window;
+    QVector<double> vHeight, vTxCount, vFeeRate;
+    for (unsigned int i = 0; i < vIndex.size() && !fShutdown; i++)
+    {
+        if (!GetBlockStats(txdb, vIndex[i], stats))
+            break;
+        window.Add(stats);
+        vHeight.append(stats.nHeight);
+        // the coinbase and coinstake are not counted
+        vTxCount.append(stats.nTxCount - (stats.fProofOfStake ? 2 : 1));
+        vFeeRate.append((double)stats.nFeeRatePercentiles[2] / COIN);
+    }
+
+    // without a block of a kind in the window, its difficulty is that of the
+    // last one before it, which the block index caches
+    CBlockIndex* pindexTip = vIndex.back();
+    double pHardness = window.nProofOfWork ? GetDifficultyFromBits(window.nLastWorkBits) :
+                                             GetDifficulty(GetLastBlockIndex(pindexTip, false));
+    double pHardness2 = window.nProofOfStake ? GetDifficultyFromBits(window.nLastStakeBits) :
+                                               GetDifficulty(GetLastBlockIndex(pindexTip, true));
+
+    emit reply(pindexTip->nHeight, pHardness, pHardness2, window.GetNetHashPS() / 1000000, window.GetNetStakeWeight(),
+               vHeight, vTxCount, vFeeRate);
+}
+
 StatisticsPage::StatisticsPage(QWidget *parent) :
     QWidget(parent),
     ui(new Ui::StatisticsPage)
 {
     ui->setupUi(this);
     
-    setFixedSize(400, 420);
+    setFixedSize(400, 640);
+
+    // transactions and median fee rate of the last blocks, from the block stats index
+    chartHeight = -1;
+    fCollecting = false;
+    chartPlot = new QCustomPlot(this);
+    chartPlot->setMinimumHeight(200);
+    chartPlot->setBackground(Qt::transparent);
+    chartPlot->addGraph(chartPlot->xAxis, chartPlot->yAxis);
+    chartPlot->graph(0)->setPen(QPen(QColor(255, 165, 0)));
+    chartPlot->graph(0)->setName(tr("Transactions"));
+    chartPlot->addGraph(chartPlot->xAxis, chartPlot->yAxis2);
+    chartPlot->graph(1)->setPen(QPen(QColor(255, 255, 0)));
+    chartPlot->graph(1)->setName(tr("Median fee (AOP/kB)"));
+    chartPlot->xAxis->setLabel(tr("Block"));
+    chartPlot->yAxis->setLabel(tr("Transactions"));
+    chartPlot->yAxis2->setLabel(tr("Median fee (AOP/kB)"));
+    chartPlot->yAxis2->setVisible(true);
+    chartPlot->legend->setVisible(true);
+    ui->gridLayout->addWidget(chartPlot, 2, 0, 1, 2);
     
     connect(ui->startButton, SIGNAL(pressed()), this, SLOT(updateStatistics()));
+    startThread();
+}
+
+void StatisticsPage::startThread()
+{
+    qRegisterMetaType<QVector<double> >("QVector<double>");
+
+    thread = new QThread(this);
+    ChainStatisticsCollector *executor = new ChainStatisticsCollector();
+    executor->moveToThread(thread);
+
+    connect(executor, SIGNAL(reply(int,double,double,double,double,QVector<double>,QVector<double>,QVector<double>)),
+            this, SLOT(updateChainStatistics(int,double,double,double,double,QVector<double>,QVector<double>,QVector<double>)));
+    connect(this, SIGNAL(requestChainStatistics()), executor, SLOT(collect()));
+    /*  make sure executor object is deleted in its own thread */
+    connect(this, SIGNAL(stopThread()), executor, SLOT(deleteLater()));
+    connect(this, SIGNAL(stopThread()), thread, SLOT(quit()));
+
+    thread->start();
 }
 
 int heightPrevious = -1;
@@ -38,21 +145,14 @@ QString rewardPrevious = "";
 
 void StatisticsPage::updateStatistics()
 {
-    double pHardness = GetDifficulty();
-    double pHardness2 = GetDifficulty(GetLastBlockIndex(pindexBest, true));
-    int pPawrate = GetPoWMHashPS();
-    double pPawrate2 = 0.000;
     int nHeight = pindexBest->nHeight;
     uint64_t nMinWeight = 0, nMaxWeight = 0, nWeight = 0;
     pwalletMain->GetStakeWeight(*pwalletMain, nMinWeight, nMaxWeight, nWeight);
-    uint64_t nNetworkWeight = GetPoSKernelPS();
     int64_t volume = ((pindexBest->nMoneySupply)/100000000);
 	int64_t marketcap = AOPmarket.toDouble();
     int peers = this->model->getNumConnections();
-    pPawrate2 = (double)pPawrate;
     QString height = QString::number(nHeight);
     QString stakemin = QString::number(nMinWeight);
-    QString stakemax = QString::number(nNetworkWeight);
     QString phase = "";
     if (pindexBest->nHeight < 1314001)
     {
@@ -84,9 +184,6 @@ void StatisticsPage::updateStatistics()
     {
         subsidy = "The chain no longer produces proof of work blocks";
     }
-    QString hardness = QString::number(pHardness, 'f', 6);
-    QString hardness2 = QString::number(pHardness2, 'f', 6);
-    QString pawrate = QString::number(pPawrate2, 'f', 3);
     QString Qlpawrate = model->getLastBlockDate().toString();
 
     QString QPeers = QString::number(peers);
@@ -110,12 +207,6 @@ void StatisticsPage::updateStatistics()
     } else {
     ui->minBox->setText("<b><font color=\"orange\">" + stakemin + "</font></b>");
     }
-    if(0 > stakemaxPrevious)
-    {
-        ui->maxBox->setText("<b><font color=\"yellow\">" + stakemax + "</font></b>");
-    } else {
-    ui->maxBox->setText("<b><font color=\"orange\">" + stakemax + "</font></b>");
-    }
 
     if(phase != stakecPrevious)
     {
@@ -131,15 +222,6 @@ void StatisticsPage::updateStatistics()
     ui->rewardBox->setText("<b><font color=\"orange\">" + subsidy + "</font></b>");
     }
     
-    if(pHardness > hardnessPrevious)
-    {
-        ui->diffBox->setText("<b><font color=\"yellow\">" + hardness + "</font></b>");        
-    } else if(pHardness < hardnessPrevious) {
-        ui->diffBox->setText("<b><font color=\"red\">" + hardness + "</font></b>");
-    } else {
-        ui->diffBox->setText("<b><font color=\"orange\">" + hardness + "</font></b>");        
-    }
-	
     if(marketcap > marketcapPrevious)
     {
         ui->marketcap->setText("<b><font color=\"yellow\">$" + QString::number(marketcap) + " USD</font></b>");
@@ -149,24 +231,6 @@ void StatisticsPage::updateStatistics()
         ui->marketcap->setText("<b><font color=\"orange\">$"+QString::number(marketcap)+" USD</font></b>");
     }
 
-    if(pHardness2 > hardnessPrevious2)
-    {
-        ui->diffBox2->setText("<b><font color=\"yellow\">" + hardness2 + "</font></b>");
-    } else if(pHardness2 < hardnessPrevious2) {
-        ui->diffBox2->setText("<b><font color=\"red\">" + hardness2 + "</font></b>");
-    } else {
-        ui->diffBox2->setText("<b><font color=\"orange\">" + hardness2 + "</font></b>");
-    }
-    
-    if(pPawrate2 > netPawratePrevious)
-    {
-        ui->pawrateBox->setText("<b><font color=\"yellow\">" + pawrate + " MH/s</font></b>");
-    } else if(pPawrate2 < netPawratePrevious) {
-        ui->pawrateBox->setText("<b><font color=\"red\">" + pawrate + " MH/s</font></b>");
-    } else {
-        ui->pawrateBox->setText("<b><font color=\"orange\">" + pawrate + " MH/s</font></b>");
-    }
-
     if(Qlpawrate != pawratePrevious)
     {
         ui->localBox->setText("<b><font color=\"yellow\">" + Qlpawrate + "</font></b>");
@@ -192,19 +256,82 @@ void StatisticsPage::updateStatistics()
         ui->volumeBox->setText("<b><font color=\"orange\">" + qVolume + " AOP" + "</font></b>");
     }
 	
-    updatePrevious(nHeight, nMinWeight, nNetworkWeight, phase, subsidy, pHardness, pHardness2, pPawrate2, Qlpawrate, peers, volume, marketcap);
+    updatePrevious(nHeight, nMinWeight, phase, subsidy, Qlpawrate, peers, volume, marketcap);
+
+    // the network figures and the chart are filled in when the collector replies
+    if (!fCollecting)
+    {
+        fCollecting = true;
+        emit requestChainStatistics();
+    }
 }
 
-void StatisticsPage::updatePrevious(int nHeight, int nMinWeight, int nNetworkWeight, QString phase, QString subsidy, double pHardness, double pHardness2, double pPawrate2, QString Qlpawrate, int peers, int volume, int64_t marketcap)
+void StatisticsPage::updateChainStatistics(int nHeight, double pHardness, double pHardness2, double pPawrate2, double dNetworkWeight,
+                                           QVector<double> vHeight, QVector<double> vTxCount, QVector<double> vFeeRate)
 {
-    heightPrevious = nHeight;
-    stakeminPrevious = nMinWeight;
+    fCollecting = false;
+
+    uint64_t nNetworkWeight = dNetworkWeight;
+    QString stakemax = QString::number(nNetworkWeight);
+    QString hardness = QString::number(pHardness, 'f', 6);
+    QString hardness2 = QString::number(pHardness2, 'f', 6);
+    QString pawrate = QString::number(pPawrate2, 'f', 3);
+
+    if(0 > stakemaxPrevious)
+    {
+        ui->maxBox->setText("<b><font color=\"yellow\">" + stakemax + "</font></b>");
+    } else {
+    ui->maxBox->setText("<b><font color=\"orange\">" + stakemax + "</font></b>");
+    }
+
+    if(pHardness > hardnessPrevious)
+    {
+        ui->diffBox->setText("<b><font color=\"yellow\">" + hardness + "</font></b>");        
+    } else if(pHardness < hardnessPrevious) {
+        ui->diffBox->setText("<b><font color=\"red\">" + hardness + "</font></b>");
+    } else {
+        ui->diffBox->setText("<b><font color=\"orange\">" + hardness + "</font></b>");        
+    }
+
+    if(pHardness2 > hardnessPrevious2)
+    {
+        ui->diffBox2->setText("<b><font color=\"yellow\">" + hardness2 + "</font></b>");
+    } else if(pHardness2 < hardnessPrevious2) {
+        ui->diffBox2->setText("<b><font color=\"red\">" + hardness2 + "</font></b>");
+    } else {
+        ui->diffBox2->setText("<b><font color=\"orange\">" + hardness2 + "</font></b>");
+    }
+    
+    if(pPawrate2 > netPawratePrevious)
+    {
+        ui->pawrateBox->setText("<b><font color=\"yellow\">" + pawrate + " MH/s</font></b>");
+    } else if(pPawrate2 < netPawratePrevious) {
+        ui->pawrateBox->setText("<b><font color=\"red\">" + pawrate + " MH/s</font></b>");
+    } else {
+        ui->pawrateBox->setText("<b><font color=\"orange\">" + pawrate + " MH/s</font></b>");
+    }
+
     stakemaxPrevious = nNetworkWeight;
-    stakecPrevious = phase;
-    rewardPrevious = subsidy;
     hardnessPrevious = pHardness;
     hardnessPrevious2 = pHardness2;
     netPawratePrevious = pPawrate2;
+
+    if (nHeight == chartHeight)
+        return;
+    chartHeight = nHeight;
+
+    chartPlot->graph(0)->setData(vHeight, vTxCount);
+    chartPlot->graph(1)->setData(vHeight, vFeeRate);
+    chartPlot->rescaleAxes();
+    chartPlot->replot();
+}
+
+void StatisticsPage::updatePrevious(int nHeight, int nMinWeight, QString phase, QString subsidy, QString Qlpawrate, int peers, int volume, int64_t marketcap)
+{
+    heightPrevious = nHeight;
+    stakeminPrevious = nMinWeight;
+    stakecPrevious = phase;
+    rewardPrevious = subsidy;
     pawratePrevious = Qlpawrate;
     connectionPrevious = peers;
     volumePrevious = volume;
@@ -221,4 +348,7 @@ void StatisticsPage::setModel(ClientModel *model)
 StatisticsPage::~StatisticsPage()
 {
     delete ui;
+    /* Ensure thread is finished before it is deleted */
+    emit stopThread();
+    thread->wait();
 }
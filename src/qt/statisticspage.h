@@ -17,12 +17,15 @@
 #include <QMap>
 #include <QSettings>
 #include <QSlider>
+#include <QThread>
+#include <QVector>
 
 
 namespace Ui {
 class StatisticsPage;
 }
 class ClientModel;
+class QCustomPlot;
 
 class StatisticsPage : public QWidget
 {
@@ -50,13 +53,25 @@ public:
 public slots:
 
     void updateStatistics();
-    void updatePrevious(int, int, int, QString, QString, double, double, double, QString, int, int, int64_t);
+    void updatePrevious(int, int, QString, QString, QString, int, int, int64_t);
 
 private slots:
+    void updateChainStatistics(int nHeight, double pHardness, double pHardness2, double pPawrate2, double dNetworkWeight,
+                               QVector<double> vHeight, QVector<double> vTxCount, QVector<double> vFeeRate);
+
+signals:
+    void requestChainStatistics();
+    void stopThread();
 
 private:
     Ui::StatisticsPage *ui;
     ClientModel *model;
+    QCustomPlot *chartPlot;
+    int chartHeight;
+    QThread *thread;
+    bool fCollecting;
+
+    void startThread();
     
 };
 
@@ -5,7 +5,11 @@
 
 #include "main.h"
 #include "bitcoinrpc.h"
+#include "blockfilter.h"
+#include "blockstats.h"
+#include "bootstrap.h"
 #include "spork.h"
+#include "txdb.h"
 
 using namespace json_spirit;
 using namespace std;
@@ -26,23 +30,7 @@ double GetDifficulty(const CBlockIndex* blockindex)
             blockindex = GetLastBlockIndex(pindexBest, false);
     }
 
-    int nShift = (blockindex->nBits >> 24) & 0xff;
-
-    double dDiff =
-        (double)0x0000ffff / (double)(blockindex->nBits & 0x00ffffff);
-
-    while (nShift < 29)
-    {
-        dDiff *= 256.0;
-        nShift++;
-    }
-    while (nShift > 29)
-    {
-        dDiff /= 256.0;
-        nShift--;
-    }
-
-    return dDiff;
+    return GetDifficultyFromBits(blockindex->nBits);
 }
 
 double GetPoWMHashPS()
@@ -78,20 +66,19 @@ double GetPoSKernelPS()
     double dStakeKernelsTriedAvg = 0;
     int nStakesHandled = 0, nStakesTime = 0;
 
-    CBlockIndex* pindex = pindexBest;;
-    CBlockIndex* pindexPrevStake = NULL;
+    LOCK(chainActive.cs);
+    const CBlockIndexHot* pPrevStake = NULL;
 
-    while (pindex && nStakesHandled < nPoSInterval)
+    for (int nHeight = chainActive.Height(); nHeight >= 0 && nStakesHandled < nPoSInterval; nHeight--)
     {
-        if (pindex->IsProofOfStake())
+        const CBlockIndexHot& hot = chainActive.Hot(nHeight);
+        if (hot.IsProofOfStake())
         {
-            dStakeKernelsTriedAvg += GetDifficulty(pindex) * 4294967296.0;
-            nStakesTime += pindexPrevStake ? (pindexPrevStake->nTime - pindex->nTime) : 0;
-            pindexPrevStake = pindex;
+            dStakeKernelsTriedAvg += GetDifficultyFromBits(hot.nBits) * 4294967296.0;
+            nStakesTime += pPrevStake ? (pPrevStake->nTime - hot.nTime) : 0;
+            pPrevStake = &hot;
             nStakesHandled++;
         }
-
-        pindex = pindex->pprev;
     }
 
     return nStakesTime ? dStakeKernelsTriedAvg / nStakesTime : 0;
@@ -104,7 +91,7 @@ Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool fPri
     CMerkleTx txGen(block.vtx[0]);
     txGen.SetMerkleBranch(&block);
     result.push_back(Pair("confirmations", (int)txGen.GetDepthInMainChain()));
-    result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
+    result.push_back(Pair("size", (int)block.GetBlockSize()));
     result.push_back(Pair("height", blockindex->nHeight));
     result.push_back(Pair("version", block.nVersion));
     result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
@@ -149,15 +136,49 @@ Object blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool fPri
     return result;
 }
 
+static Object bootstrapStatusToJSON(const CBootstrapExport::CStatus& status)
+{
+    Object result;
+    result.push_back(Pair("running", status.fRunning));
+    result.push_back(Pair("complete", status.fComplete));
+    result.push_back(Pair("destination", status.strDest));
+    result.push_back(Pair("startheight", status.nStartHeight));
+    result.push_back(Pair("height", status.nHeight));
+    result.push_back(Pair("endheight", status.nEndHeight));
+    result.push_back(Pair("bytes", (uint64_t)status.nBytes));
+    result.push_back(Pair("lz4", status.fLZ4));
+    int64_t nElapsed = status.nStartTime ? GetTime() - status.nStartTime : 0;
+    result.push_back(Pair("elapsed", nElapsed));
+    if (status.fRunning && nElapsed > 0 && status.nHeight > status.nStartHeight)
+        result.push_back(Pair("blockspersecond", (double)(status.nHeight - status.nStartHeight) / nElapsed));
+    if (!status.strError.empty())
+        result.push_back(Pair("error", status.strError));
+    return result;
+}
+
 Value dumpbootstrap(const Array& params, bool fHelp)
 {
-    if (fHelp || params.size() != 2)
+    if (fHelp || params.size() < 1 || params.size() > 3 || (params.size() == 1 && params[0].get_str() != "stop"))
         throw runtime_error(
-            "dumpbootstrap \"destination\" \"blocks\"\n"
-            "\nCreates a bootstrap format block dump of the blockchain in destination, which can be a directory or a path with filename, up to the given block number.");
+            "dumpbootstrap \"destination\" \"blocks\" [lz4=false]\n"
+            "dumpbootstrap stop\n"
+            "\nStarts writing a bootstrap format block dump of the blockchain up to the given block number\n"
+            "to destination, which can be a directory or a path with filename. The export runs in the\n"
+            "background, getbootstrapinfo reports its progress. A checksummed manifest is written to\n"
+            "<destination>.manifest; running the same command again after an interruption resumes it.\n"
+            "With lz4 the blocks are written in LZ4 compressed frames, which the bootstrap.dat and\n"
+            "-loadblock import reads as well.\n"
+            "\"stop\" interrupts a running export.");
+
+    if (params.size() == 1)
+    {
+        bootstrapExport.Stop();
+        return bootstrapStatusToJSON(bootstrapExport.GetStatus());
+    }
 
     string strDest = params[0].get_str();
     int nBlocks = params[1].get_int();
+    bool fLZ4 = params.size() > 2 && params[2].get_bool();
     if (nBlocks < 0 || nBlocks > nBestHeight)
         throw runtime_error("Block number out of range.");
 
@@ -165,27 +186,21 @@ Value dumpbootstrap(const Array& params, bool fHelp)
     if (boost::filesystem::is_directory(pathDest))
         pathDest /= "bootstrap.dat";
 
-    try {
-        FILE* file = fopen(pathDest.string().c_str(), "wb");
-        if (!file)
-            throw JSONRPCError(RPC_MISC_ERROR, "Error: Could not open bootstrap file for writing.");
+    string strError;
+    if (!bootstrapExport.Start(pathDest.string(), nBlocks, fLZ4, strError))
+        throw JSONRPCError(RPC_MISC_ERROR, "Error: " + strError);
 
-        CAutoFile fileout = CAutoFile(file, SER_DISK, CLIENT_VERSION);
-        if (!fileout)
-            throw JSONRPCError(RPC_MISC_ERROR, "Error: Could not open bootstrap file for writing.");
+    return bootstrapStatusToJSON(bootstrapExport.GetStatus());
+}
 
-        for (int nHeight = 0; nHeight <= nBlocks; nHeight++)
-        {
-            CBlock block;
-            CBlockIndex* pblockindex = FindBlockByHeight(nHeight);
-            block.ReadFromDisk(pblockindex, true);
-            fileout << FLATDATA(pchMessageStart) << fileout.GetSerializeSize(block) << block;
-        }
-    } catch(const boost::filesystem::filesystem_error &e) {
-        throw JSONRPCError(RPC_MISC_ERROR, "Error: Bootstrap dump failed!");
-    }
+Value getbootstrapinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getbootstrapinfo\n"
+            "Returns the progress of the current or last dumpbootstrap export.");
 
-    return Value::null;
+    return bootstrapStatusToJSON(bootstrapExport.GetStatus());
 }
 
 Value getbestblockhash(const Array& params, bool fHelp)
@@ -195,6 +210,7 @@ Value getbestblockhash(const Array& params, bool fHelp)
             "getbestblockhash\n"
             "Returns the hash of the best block in the longest block chain.");
 
+    LOCK(cs_main);
     return hashBestChain.GetHex();
 }
 
@@ -205,6 +221,7 @@ Value getblockcount(const Array& params, bool fHelp)
             "getblockcount\n"
             "Returns the number of blocks in the longest block chain.");
 
+    LOCK(cs_main);
     return nBestHeight;
 }
 
@@ -262,11 +279,12 @@ Value getblockhash(const Array& params, bool fHelp)
             "Returns hash of block in best-block-chain at <index>.");
 
     int nHeight = params[0].get_int();
-    if (nHeight < 0 || nHeight > nBestHeight)
+
+    LOCK(chainActive.cs);
+    if (nHeight < 0 || nHeight > chainActive.Height())
         throw runtime_error("Block number out of range.");
 
-    CBlockIndex* pblockindex = FindBlockByHeight(nHeight);
-    return pblockindex->phashBlock->GetHex();
+    return chainActive[nHeight]->GetBlockHash().GetHex();
 }
 
 //New getblock RPC Command for Denariium Compatibility
@@ -318,8 +336,6 @@ Value getblock(const Array& params, bool fHelp)
             "\nExamples:\n"
         );
 
-    LOCK(cs_main);
-
     std::string strHash = params[0].get_str();
     	uint256 hash(strHash);
     //std::string strHash = params[0].get_str();
@@ -330,12 +346,18 @@ Value getblock(const Array& params, bool fHelp)
             verbosity = params[1].get_bool() ? 1 : 0;
     }
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    CBlockIndex* pblockindex;
+    {
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(hash);
+        if (mi == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        pblockindex = mi->second;
+    }
 
+    // Block index entries are never freed and block files are only appended
+    // to, so the read itself doesn't need cs_main
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-	
 	if(!block.ReadFromDisk(pblockindex, true)){
         // Block not found on disk. This could be because we have the block
         // header in our index but don't have the block (for example if a
@@ -345,8 +367,6 @@ Value getblock(const Array& params, bool fHelp)
 		throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
 	}
 
-	block.ReadFromDisk(pblockindex, true);
-	
     if (verbosity <= 0)
     {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
@@ -356,6 +376,7 @@ Value getblock(const Array& params, bool fHelp)
         return strHex;
     }
 
+    LOCK(cs_main);
     //return blockToJSON(block, pblockindex, verbosity >= 2);
 	return blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false);
 }
@@ -407,6 +428,178 @@ Value getblockbynumber(const Array& params, bool fHelp)
     return blockToJSON(block, pblockindex, params.size() > 1 ? params[1].get_bool() : false);
 }
 
+static CBlockIndex* ParseBlockStatsTarget(const Value& value)
+{
+    if (value.type() == int_type)
+        return chainActive[value.get_int()];
+
+    string strTarget = value.get_str();
+    if (strTarget.size() != 64 || !IsHex(strTarget))
+        return chainActive[atoi(strTarget)];
+
+    BlockMap::iterator mi = mapBlockIndex.find(uint256(strTarget));
+    if (mi == mapBlockIndex.end() || !chainActive.Contains(mi->second))
+        return NULL;
+    return mi->second;
+}
+
+static Object blockStatsToJSON(const CBlockIndex* pindex, const CBlockStats& stats)
+{
+    Object result;
+    result.push_back(Pair("hash", pindex->GetBlockHash().GetHex()));
+    result.push_back(Pair("height", stats.nHeight));
+    result.push_back(Pair("time", stats.nTime));
+    result.push_back(Pair("timedelta", stats.nTimeDelta));
+    result.push_back(Pair("proofofstake", stats.fProofOfStake));
+    result.push_back(Pair("difficulty", GetDifficultyFromBits(stats.nBits)));
+    result.push_back(Pair("txs", (int)stats.nTxCount));
+    result.push_back(Pair("size", (int)stats.nSize));
+    result.push_back(Pair("totalfee", ValueFromAmount(stats.nTotalFees)));
+    Array percentiles;
+    for (int i = 0; i < CBlockStats::NUM_PERCENTILES; i++)
+        percentiles.push_back(ValueFromAmount(stats.nFeeRatePercentiles[i]));
+    result.push_back(Pair("feerate_percentiles", percentiles));
+    result.push_back(Pair("stakeamount", ValueFromAmount(stats.nStakeAmount)));
+    result.push_back(Pair("masternodepayout", ValueFromAmount(stats.nMasternodePayout)));
+    result.push_back(Pair("mint", ValueFromAmount(stats.nMint)));
+    return result;
+}
+
+Value getblockstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "getblockstats <height|hash> [endheight]\n"
+            "Returns the stored statistics of a block in the main chain, or an array of them\n"
+            "for every block from <height|hash> up to and including [endheight].\n"
+            "Fee rates are in AOP per 1000 bytes; feerate_percentiles are the 10th, 25th,\n"
+            "50th, 75th and 90th percentiles weighted by transaction size.");
+
+    CBlockIndex* pindexStart = ParseBlockStatsTarget(params[0]);
+    if (!pindexStart)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found in the main chain");
+
+    CTxDB txdb;
+    CBlockStats stats;
+    if (params.size() < 2)
+    {
+        if (!GetBlockStats(txdb, pindexStart, stats))
+            throw JSONRPCError(RPC_MISC_ERROR, "Could not read block stats");
+        return blockStatsToJSON(pindexStart, stats);
+    }
+
+    int nEndHeight = params[1].get_int();
+    if (nEndHeight < pindexStart->nHeight || nEndHeight > chainActive.Height())
+        throw runtime_error("Block number out of range.");
+    if (nEndHeight - pindexStart->nHeight >= 10000)
+        throw runtime_error("At most 10000 blocks per call.");
+
+    Array result;
+    for (CBlockIndex* pindex = pindexStart; pindex && pindex->nHeight <= nEndHeight; pindex = pindex->pnext)
+    {
+        if (!GetBlockStats(txdb, pindex, stats))
+            throw JSONRPCError(RPC_MISC_ERROR, "Could not read block stats");
+        result.push_back(blockStatsToJSON(pindex, stats));
+    }
+    return result;
+}
+
+static Object blockStatsWindowToJSON(CBlockStatsWindow& window)
+{
+    Object result;
+    result.push_back(Pair("startheight", window.nStartHeight));
+    result.push_back(Pair("endheight", window.nEndHeight));
+    result.push_back(Pair("blocks", window.nBlocks));
+    result.push_back(Pair("posblocks", window.nProofOfStake));
+    result.push_back(Pair("txs", (uint64_t)window.nTxCount));
+    result.push_back(Pair("avgtxs", window.nBlocks ? (double)window.nTxCount / window.nBlocks : 0));
+    result.push_back(Pair("totalsize", (uint64_t)window.nSize));
+    result.push_back(Pair("avgsize", window.nBlocks ? (double)window.nSize / window.nBlocks : 0));
+    result.push_back(Pair("totalfee", ValueFromAmount(window.nTotalFees)));
+    result.push_back(Pair("avgfeerate", ValueFromAmount(window.nFeeTxSize ? window.nTotalFees * 1000 / (int64_t)window.nFeeTxSize : 0)));
+    result.push_back(Pair("medianfeerate", ValueFromAmount(window.GetMedianFeeRate())));
+    result.push_back(Pair("avgblocktime", window.nBlocks ? (double)window.nTimeSpan / window.nBlocks : 0));
+    result.push_back(Pair("avgdifficulty", window.nBlocks ? window.dDifficulty / window.nBlocks : 0));
+    result.push_back(Pair("stakeamount", ValueFromAmount(window.nStakeAmount)));
+    result.push_back(Pair("masternodepayout", ValueFromAmount(window.nMasternodePayout)));
+    result.push_back(Pair("mint", ValueFromAmount(window.nMint)));
+    result.push_back(Pair("netstakeweight", window.GetNetStakeWeight()));
+    return result;
+}
+
+Value getchainstats(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 3)
+        throw runtime_error(
+            "getchainstats [window=144] [count=1] [endheight]\n"
+            "Returns totals and averages of the stored block statistics over [count]\n"
+            "consecutive windows of [window] blocks each, oldest first, the last one ending\n"
+            "at [endheight] (default: the best block). medianfeerate is the median of the\n"
+            "blocks' median fee rates, netstakeweight is worked out like in getmininginfo.");
+
+    int nWindow = params.size() > 0 ? params[0].get_int() : 144;
+    int nCount = params.size() > 1 ? params[1].get_int() : 1;
+    int nEndHeight = params.size() > 2 ? params[2].get_int() : chainActive.Height();
+    if (nWindow < 1 || nCount < 1)
+        throw runtime_error("Window and count must be positive.");
+    if (nEndHeight < 0 || nEndHeight > chainActive.Height())
+        throw runtime_error("Block number out of range.");
+
+    // windows are aligned on nEndHeight, the oldest may be partial
+    int64_t nSpan = (int64_t)nWindow * nCount;
+    int nStartHeight = nSpan > nEndHeight ? 0 : nEndHeight - (int)nSpan + 1;
+    int nWindowEnd = nEndHeight;
+    while (nWindowEnd - nWindow >= nStartHeight)
+        nWindowEnd -= nWindow;
+
+    CTxDB txdb;
+    CBlockStats stats;
+    Array result;
+    CBlockStatsWindow window;
+    for (CBlockIndex* pindex = chainActive[nStartHeight]; pindex && pindex->nHeight <= nEndHeight; pindex = pindex->pnext)
+    {
+        if (!GetBlockStats(txdb, pindex, stats))
+            throw JSONRPCError(RPC_MISC_ERROR, "Could not read block stats");
+        window.Add(stats);
+        if (pindex->nHeight == nWindowEnd)
+        {
+            result.push_back(blockStatsWindowToJSON(window));
+            window = CBlockStatsWindow();
+            nWindowEnd += nWindow;
+        }
+    }
+    return result;
+}
+
+Value getblockfilter(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "getblockfilter <hash> [filtertype=basic]\n"
+            "Returns the BIP 158 compact filter of a block and its filter header.\n"
+            "Needs -blockfilterindex.");
+
+    if (params.size() > 1 && params[1].get_str() != "basic")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Unknown filtertype");
+    if (!blockFilterIndex.IsEnabled())
+        throw JSONRPCError(RPC_MISC_ERROR, "Block filters are not indexed, start with -blockfilterindex");
+
+    uint256 hash(params[0].get_str());
+    BlockMap::iterator mi = mapBlockIndex.find(hash);
+    if (mi == mapBlockIndex.end())
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+    CBlockFilterEntry entry;
+    if (!blockFilterIndex.LookupEntry((*mi).second, entry))
+        throw JSONRPCError(RPC_MISC_ERROR, blockFilterIndex.IsSynced() ? "Filter not found" :
+                           "Filter not found, the block filter index is still being built");
+
+    Object result;
+    result.push_back(Pair("filter", HexStr(entry.vchFilter)));
+    result.push_back(Pair("header", entry.hashHeader.GetHex()));
+    return result;
+}
+
 // ppcoin: get information of sync-checkpoint
 Value getcheckpoint(const Array& params, bool fHelp)
 {
@@ -509,8 +702,6 @@ Value gettxout(const Array& params, bool fHelp)
             "}\n"
         );
 
-    LOCK(cs_main);
-
     Object ret;
 
     uint256 hash;
@@ -520,6 +711,7 @@ Value gettxout(const Array& params, bool fHelp)
     if (params.size() == 3)
         mem = params[2].get_bool();
 
+    // takes cs_main only for the mempool lookup
     CTransaction tx;
     uint256 hashBlock = 0;
     if (!GetTransaction(hash, tx, hashBlock, mem))
@@ -528,51 +720,60 @@ Value gettxout(const Array& params, bool fHelp)
     if (n<0 || (unsigned int)n>=tx.vout.size() || tx.vout[n].IsNull())
       return Value::null;
 
-    ret.push_back(Pair("bestblock", pindexBest->GetBlockHash().GetHex()));
+    int nHeight = -1;
+    int nBestHeight;
+    {
+        LOCK(cs_main);
+        ret.push_back(Pair("bestblock", pindexBest->GetBlockHash().GetHex()));
+        nBestHeight = pindexBest->nHeight;
+        if (hashBlock != 0)
+        {
+            BlockMap::iterator mi = mapBlockIndex.find(hashBlock);
+            if (mi != mapBlockIndex.end() && (*mi).second)
+            {
+                if (!(*mi).second->IsInMainChain())
+                    return Value::null;
+                nHeight = (*mi).second->nHeight;
+            }
+        }
+    }
+
     if (hashBlock == 0)
       ret.push_back(Pair("confirmations", 0));
-    else
+    else if (nHeight >= 0)
     {
-      map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
-      if (mi != mapBlockIndex.end() && (*mi).second)
+      // the blocks after it are read from disk without cs_main, following the
+      // active chain as of the lookup above
+      bool isSpent=false;
+      for (int nNext = nHeight + 1; nNext <= nBestHeight; nNext++)
       {
-        CBlockIndex* pindex = (*mi).second;
-        if (pindex->IsInMainChain())
+        CBlockIndex* pblockindex = FindBlockByHeight(nNext);
+        if (!pblockindex)
+          break;
+        CBlock block;
+        block.ReadFromDisk(pblockindex, true);
+        BOOST_FOREACH(const CTransaction& tx, block.vtx)
         {
-          bool isSpent=false;
-          CBlockIndex* p = pindex;
-          p=p->pnext;
-          for (; p; p = p->pnext)
+          BOOST_FOREACH(const CTxIn& txin, tx.vin)
           {
-            CBlock block;
-            CBlockIndex* pblockindex = mapBlockIndex[p->GetBlockHash()];
-            block.ReadFromDisk(pblockindex, true);
-            BOOST_FOREACH(const CTransaction& tx, block.vtx)
+            if( hash == txin.prevout.hash &&
+               (int64_t)txin.prevout.n )
             {
-              BOOST_FOREACH(const CTxIn& txin, tx.vin)
-              {
-                if( hash == txin.prevout.hash &&
-                   (int64_t)txin.prevout.n )
-                {
-                  printf("spent at block %s\n", block.GetHash().GetHex().c_str());
-                  isSpent=true; break;
-                }
-              }
-
-              if(isSpent) break;
+              printf("spent at block %s\n", block.GetHash().GetHex().c_str());
+              isSpent=true; break;
             }
-
-            if(isSpent) break;
           }
 
-          if(isSpent)
-            return Value::null;
-
-          ret.push_back(Pair("confirmations", pindexBest->nHeight - pindex->nHeight + 1));
+          if(isSpent) break;
         }
-        else
-          return Value::null;
+
+        if(isSpent) break;
       }
+
+      if(isSpent)
+        return Value::null;
+
+      ret.push_back(Pair("confirmations", nBestHeight - nHeight + 1));
     }
 
     ret.push_back(Pair("value", ValueFromAmount(tx.vout[n].nValue)));
@@ -95,8 +95,8 @@ Value masternode(const Array& params, bool fHelp)
         }
         pwalletMain->Lock();
 
-        if(activeMasternode.status == MASTERNODE_STOPPED) return "Successfully Stopped Masternode";
-        if(activeMasternode.status == MASTERNODE_NOT_CAPABLE) return "Not a capable Masternode";
+        if(activeMasternode.GetStatus() == MASTERNODE_STOPPED) return "Successfully Stopped Masternode";
+        if(activeMasternode.GetStatus() == MASTERNODE_NOT_CAPABLE) return "Not a capable Masternode";
 
         return "unknown";
     }
@@ -272,19 +272,18 @@ Value masternode(const Array& params, bool fHelp)
             }
         }
 
-        if(activeMasternode.status != MASTERNODE_REMOTELY_ENABLED && activeMasternode.status != MASTERNODE_IS_CAPABLE){
-            activeMasternode.status = MASTERNODE_NOT_PROCESSED; // TODO: consider better way
-            std::string errorMessage;
+        if(activeMasternode.GetStatus() != MASTERNODE_REMOTELY_ENABLED && activeMasternode.GetStatus() != MASTERNODE_IS_CAPABLE){
+            activeMasternode.ResetStatus();
             activeMasternode.ManageStatus();
             pwalletMain->Lock();
         }
 
-        if(activeMasternode.status == MASTERNODE_REMOTELY_ENABLED) return "masternode started remotely";
-        if(activeMasternode.status == MASTERNODE_INPUT_TOO_NEW) return "masternode input must have at least 15 confirmations";
-        if(activeMasternode.status == MASTERNODE_STOPPED) return "masternode is stopped";
-        if(activeMasternode.status == MASTERNODE_IS_CAPABLE) return "successfully started masternode";
-        if(activeMasternode.status == MASTERNODE_NOT_CAPABLE) return "not capable masternode: " + activeMasternode.notCapableReason;
-        if(activeMasternode.status == MASTERNODE_SYNC_IN_PROCESS) return "sync in process. Must wait until client is synced to start.";
+        if(activeMasternode.GetStatus() == MASTERNODE_REMOTELY_ENABLED) return "masternode started remotely";
+        if(activeMasternode.GetStatus() == MASTERNODE_INPUT_TOO_NEW) return "masternode input must have at least 15 confirmations";
+        if(activeMasternode.GetStatus() == MASTERNODE_STOPPED) return "masternode is stopped";
+        if(activeMasternode.GetStatus() == MASTERNODE_IS_CAPABLE) return "successfully started masternode";
+        if(activeMasternode.GetStatus() == MASTERNODE_NOT_CAPABLE) return "not capable masternode: " + activeMasternode.GetNotCapableReason();
+        if(activeMasternode.GetStatus() == MASTERNODE_SYNC_IN_PROCESS) return "sync in process. Must wait until client is synced to start.";
 
         return "unknown";
     }
@@ -401,12 +400,12 @@ Value masternode(const Array& params, bool fHelp)
 
     if (strCommand == "debug")
     {
-        if(activeMasternode.status == MASTERNODE_REMOTELY_ENABLED) return "masternode started remotely";
-        if(activeMasternode.status == MASTERNODE_INPUT_TOO_NEW) return "masternode input must have at least 15 confirmations";
-        if(activeMasternode.status == MASTERNODE_IS_CAPABLE) return "successfully started masternode";
-        if(activeMasternode.status == MASTERNODE_STOPPED) return "masternode is stopped";
-        if(activeMasternode.status == MASTERNODE_NOT_CAPABLE) return "not capable masternode: " + activeMasternode.notCapableReason;
-        if(activeMasternode.status == MASTERNODE_SYNC_IN_PROCESS) return "sync in process. Must wait until client is synced to start.";
+        if(activeMasternode.GetStatus() == MASTERNODE_REMOTELY_ENABLED) return "masternode started remotely";
+        if(activeMasternode.GetStatus() == MASTERNODE_INPUT_TOO_NEW) return "masternode input must have at least 15 confirmations";
+        if(activeMasternode.GetStatus() == MASTERNODE_IS_CAPABLE) return "successfully started masternode";
+        if(activeMasternode.GetStatus() == MASTERNODE_STOPPED) return "masternode is stopped";
+        if(activeMasternode.GetStatus() == MASTERNODE_NOT_CAPABLE) return "not capable masternode: " + activeMasternode.GetNotCapableReason();
+        if(activeMasternode.GetStatus() == MASTERNODE_SYNC_IN_PROCESS) return "sync in process. Must wait until client is synced to start.";
 
         CTxIn vin = CTxIn();
         CPubKey pubkey = CScript();
@@ -541,9 +540,9 @@ Value masternode(const Array& params, bool fHelp)
                 Object localObj;
                 localObj.push_back(Pair("vin", activeMasternode.vin.ToString().c_str()));
                 localObj.push_back(Pair("service", activeMasternode.service.ToString().c_str()));
-                localObj.push_back(Pair("status", activeMasternode.status));
+                localObj.push_back(Pair("status", activeMasternode.GetStatus()));
                 localObj.push_back(Pair("address", address2.ToString().c_str()));
-                localObj.push_back(Pair("notCapableReason", activeMasternode.notCapableReason.c_str()));
+                localObj.push_back(Pair("notCapableReason", activeMasternode.GetNotCapableReason().c_str()));
                 mnObj.push_back(Pair("local",localObj));
             } else {
                 Object localObj;
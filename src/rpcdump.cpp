@@ -292,6 +292,217 @@ Value importwallet(const Array& params, bool fHelp)
 }
 
 
+// First block a rescan for keys born at nTimeBegin has to read, allowing for block time variability
+static CBlockIndex* RescanStartBlock(int64_t nTimeBegin)
+{
+    CBlockIndex *pindex = pindexBest;
+    while (pindex && pindex->pprev && pindex->nTime > nTimeBegin - 7200)
+        pindex = pindex->pprev;
+    return pindex;
+}
+
+// One importmulti request: {"privkey" or "address", "label", "timestamp"}
+static Object ImportMultiEntry(const Object& request, int64_t& nTimeBegin)
+{
+    Object entry;
+    try
+    {
+        const Value& privkey = find_value(request, "privkey");
+        const Value& address = find_value(request, "address");
+        const Value& label = find_value(request, "label");
+        const Value& timestamp = find_value(request, "timestamp");
+        if ((privkey.type() == null_type) == (address.type() == null_type))
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Exactly one of privkey and address must be given");
+        string strLabel = label.type() == null_type ? "" : label.get_str();
+
+        // the key's birth time, 0 for unknown (scan from the genesis block)
+        int64_t nTime = 0;
+        if (timestamp.type() == str_type && timestamp.get_str() == "now")
+            nTime = pindexBest->nTime;
+        else if (timestamp.type() != null_type)
+            nTime = timestamp.get_int64();
+
+        bool fAdded = false;
+        if (privkey.type() != null_type)
+        {
+            CBitcoinSecret vchSecret;
+            if (!vchSecret.SetString(privkey.get_str()))
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid private key");
+            CKey key = vchSecret.GetKey();
+            CKeyID keyid = key.GetPubKey().GetID();
+            pwalletMain->SetAddressBookName(keyid, strLabel);
+            if (!pwalletMain->HaveKey(keyid))
+            {
+                pwalletMain->mapKeyMetadata[keyid].nCreateTime = std::max(nTime, (int64_t)1);
+                if (!pwalletMain->AddKey(key))
+                    throw JSONRPCError(RPC_WALLET_ERROR, "Error adding key to wallet");
+                fAdded = true;
+            }
+        } else
+        {
+            CScript script;
+            CBitcoinAddress addr(address.get_str());
+            if (addr.IsValid())
+                script.SetDestination(addr.Get());
+            else if (IsHex(address.get_str()))
+            {
+                std::vector<unsigned char> data(ParseHex(address.get_str()));
+                script = CScript(data.begin(), data.end());
+            } else
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid AveroPay address or script");
+
+            if (::IsMine(*pwalletMain, script) == ISMINE_SPENDABLE)
+                throw JSONRPCError(RPC_WALLET_ERROR, "The wallet already contains the private key for this address or script");
+            if (addr.IsValid())
+                pwalletMain->SetAddressBookName(addr.Get(), strLabel);
+            if (!pwalletMain->HaveWatchOnly(script))
+            {
+                if (!pwalletMain->AddWatchOnly(script))
+                    throw JSONRPCError(RPC_WALLET_ERROR, "Error adding address to wallet");
+                fAdded = true;
+            }
+        }
+
+        // keys and scripts the wallet already had were covered by earlier scans
+        if (fAdded)
+            nTimeBegin = std::min(nTimeBegin, nTime);
+        entry.push_back(Pair("success", true));
+    } catch (Object& objError)
+    {
+        entry.push_back(Pair("success", false));
+        entry.push_back(Pair("error", objError));
+    } catch (std::exception& e)
+    {
+        entry.push_back(Pair("success", false));
+        entry.push_back(Pair("error", JSONRPCError(RPC_TYPE_ERROR, e.what())));
+    }
+    return entry;
+}
+
+Value importmulti(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "importmulti <requests> [rescan=true]\n"
+            "Imports private keys and watch-only addresses or scripts with a single rescan.\n"
+            "<requests> is an array of objects:\n"
+            "  {\"privkey\":\"<AveroPayprivkey>\" or \"address\":\"<address or hex script>\",\n"
+            "   \"label\":\"<label>\", \"timestamp\":<unix time> or \"now\"}\n"
+            "The rescan starts at the block of the earliest timestamp among the entries\n"
+            "that were added, a missing timestamp means the whole chain. With rescan=false\n"
+            "the keys are only added, see rescanblockchain.\n"
+            "Returns one {\"success\", \"error\"} result per request and where the rescan started.");
+
+    const Array& requests = params[0].get_array();
+    bool fRescan = true;
+    if (params.size() > 1)
+        fRescan = params[1].get_bool();
+
+    BOOST_FOREACH(const Value& request, requests)
+        if (request.type() == obj_type && find_value(request.get_obj(), "privkey").type() != null_type)
+        {
+            EnsureWalletIsUnlocked();
+            if (fWalletUnlockStakingOnly)
+                throw JSONRPCError(RPC_WALLET_UNLOCK_NEEDED, "Wallet is unlocked for staking only.");
+            break;
+        }
+
+    Object result;
+    Array results;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+
+        int64_t nTimeBegin = std::numeric_limits<int64_t>::max();
+        BOOST_FOREACH(const Value& request, requests)
+        {
+            if (request.type() != obj_type)
+            {
+                Object entry;
+                entry.push_back(Pair("success", false));
+                entry.push_back(Pair("error", JSONRPCError(RPC_TYPE_ERROR, "Request must be an object")));
+                results.push_back(entry);
+                continue;
+            }
+            results.push_back(ImportMultiEntry(request.get_obj(), nTimeBegin));
+        }
+        pwalletMain->MarkDirty();
+
+        if (nTimeBegin != std::numeric_limits<int64_t>::max())
+        {
+            // 0 would be considered 'no value'
+            nTimeBegin = std::max(nTimeBegin, (int64_t)1);
+            if (!pwalletMain->nTimeFirstKey || nTimeBegin < pwalletMain->nTimeFirstKey)
+                pwalletMain->nTimeFirstKey = nTimeBegin;
+
+            CBlockIndex* pindex = RescanStartBlock(nTimeBegin);
+            result.push_back(Pair("rescanfrom", pindex ? pindex->nHeight : 0));
+            if (fRescan && pindex)
+            {
+                printf("importmulti: rescanning last %i blocks\n", pindexBest->nHeight - pindex->nHeight + 1);
+                pwalletMain->ScanForWalletTransactions(pindex, true);
+                pwalletMain->ReacceptWalletTransactions();
+            }
+        }
+        result.push_back(Pair("rescanned", fRescan && nTimeBegin != std::numeric_limits<int64_t>::max()));
+    }
+    result.push_back(Pair("results", results));
+
+    return result;
+}
+
+Value rescanblockchain(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() > 1)
+        throw runtime_error(
+            "rescanblockchain [startheight=0]\n"
+            "Scans the block chain from <startheight> for transactions of the wallet's keys,\n"
+            "e.g. after importmulti with rescan=false.");
+
+    int nStartHeight = 0;
+    if (params.size() > 0)
+        nStartHeight = params[0].get_int();
+
+    LOCK2(cs_main, pwalletMain->cs_wallet);
+    CBlockIndex* pindex = chainActive[std::max(nStartHeight, 0)];
+    if (!pindex)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Start height out of range");
+
+    int nFound = pwalletMain->ScanForWalletTransactions(pindex, true);
+    pwalletMain->ReacceptWalletTransactions();
+    pwalletMain->MarkDirty();
+
+    Object result;
+    result.push_back(Pair("startheight", pindex->nHeight));
+    result.push_back(Pair("stopheight", nBestHeight));
+    result.push_back(Pair("found", nFound));
+    return result;
+}
+
+Value getrescaninfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getrescaninfo\n"
+            "Returns the progress of a running wallet rescan.");
+
+    int nStart = pwalletMain->nRescanStart;
+    int nHeight = pwalletMain->nRescanHeight;
+    int nTip = nBestHeight;
+
+    Object result;
+    result.push_back(Pair("running", nStart >= 0));
+    if (nStart >= 0)
+    {
+        result.push_back(Pair("startheight", nStart));
+        result.push_back(Pair("height", nHeight));
+        result.push_back(Pair("tipheight", nTip));
+        double dProgress = nTip > nStart ? (double)(nHeight - nStart) / (nTip - nStart) : 1.0;
+        result.push_back(Pair("progress", std::min(std::max(dProgress, 0.0), 1.0)));
+    }
+    return result;
+}
+
+
 Value dumpprivkey(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
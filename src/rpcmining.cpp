@@ -112,6 +112,74 @@ Value getstakinginfo(const Array& params, bool fHelp)
     return obj;
 }
 
+Value generate(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "generate <nblocks> [proofofstake=false]\n"
+            "Create <nblocks> blocks on top of the best chain right away and return their hashes.\n"
+            "Proof-of-stake blocks need wallet coins older than the stake modifier selection\n"
+            "interval, use setmocktime to move the clock forward.\n"
+            "Only available with -regtest.");
+
+    if (!fRegTest)
+        throw JSONRPCError(RPC_METHOD_NOT_FOUND, "generate is only available with -regtest");
+
+    int nGenerate = params[0].get_int();
+    bool fProofOfStake = params.size() > 1 && params[1].get_bool();
+    if (nGenerate <= 0)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid number of blocks");
+    if (pwalletMain->IsLocked())
+        throw JSONRPCError(RPC_WALLET_UNLOCK_NEEDED, "Error: Please enter the wallet passphrase with walletpassphrase first.");
+
+    Array blockHashes;
+    int64_t nSearchStart = GetTimeMillis();
+    while ((int)blockHashes.size() < nGenerate)
+    {
+        if (fShutdown)
+            throw JSONRPCError(RPC_MISC_ERROR, "Shutting down");
+
+        int64_t nFees = 0;
+        auto_ptr<CBlock> pblock(CreateNewBlock(pwalletMain, fProofOfStake, &nFees));
+        if (!pblock.get())
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Couldn't create new block");
+
+        if (fProofOfStake)
+        {
+            // SignBlock searches the seconds since its last call, so a kernel
+            // may only turn up once the clock has moved on
+            if (!pblock->SignBlock(*pwalletMain, nFees))
+            {
+                if (GetTimeMillis() - nSearchStart > 10000)
+                    throw JSONRPCError(RPC_WALLET_ERROR, strprintf("No stake kernel found after %d blocks", (int)blockHashes.size()));
+                MilliSleep(250);
+                continue;
+            }
+            if (!CheckStake(pblock.get(), *pwalletMain))
+                throw JSONRPCError(RPC_MISC_ERROR, "Generated proof-of-stake block was not accepted");
+        }
+        else
+        {
+            CReserveKey reservekey(pwalletMain);
+            unsigned int nExtraNonce = 0;
+            {
+                LOCK(cs_main);
+                IncrementExtraNonce(pblock.get(), pindexBest, nExtraNonce);
+            }
+            uint256 hashTarget = CBigNum().SetCompact(pblock->nBits).getuint256();
+            while (pblock->GetHash() > hashTarget)
+                ++pblock->nNonce;
+            if (!CheckWork(pblock.get(), *pwalletMain, reservekey))
+                throw JSONRPCError(RPC_MISC_ERROR, "Generated proof-of-work block was not accepted");
+        }
+
+        blockHashes.push_back(pblock->GetHash().GetHex());
+        nSearchStart = GetTimeMillis();
+    }
+
+    return blockHashes;
+}
+
 Value getworkex(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() > 2)
@@ -236,6 +304,8 @@ Value getworkex(const Array& params, bool fHelp)
             CDataStream(coinbase, SER_NETWORK, PROTOCOL_VERSION) >> pblock->vtx[0]; // FIXME - HACK!
 
         pblock->hashMerkleRoot = pblock->BuildMerkleTree();
+        pblock->vtx[0].InvalidateSize();
+        pblock->InvalidateSize();
 
         return CheckWork(pblock, *pwalletMain, reservekey);
     }
@@ -352,6 +422,8 @@ Value getwork(const Array& params, bool fHelp)
         pblock->nNonce = pdata->nNonce;
         pblock->vtx[0].vin[0].scriptSig = mapNewBlock[pdata->hashMerkleRoot].second;
         pblock->hashMerkleRoot = pblock->BuildMerkleTree();
+        pblock->vtx[0].InvalidateSize();
+        pblock->InvalidateSize();
 
         return CheckWork(pblock, *pwalletMain, reservekey);
     }
@@ -526,11 +598,7 @@ Value getblocktemplate(const Array& params, bool fHelp)
 
     bool bMasternodePayments = false;
 
-    if(fTestNet){
-        if(pindexPrev->nHeight+1 >= BLOCK_START_MASTERNODE_PAYMENTS_TESTNET) bMasternodePayments = true;
-    } else {
-        if(pindexPrev->nHeight+1 >= BLOCK_START_MASTERNODE_PAYMENTS) bMasternodePayments = true;
-    }
+    if(pindexPrev->nHeight+1 >= GetMasternodePaymentsStartBlock()) bMasternodePayments = true;
 	if(fDebug) { printf("GetBlockTemplate(): Masternode Payments : %i\n", bMasternodePayments); }
 	
     if(!masternodePayments.GetBlockPayee(pindexPrev->nHeight+1, payee)){
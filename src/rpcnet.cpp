@@ -8,6 +8,7 @@
 #include "wallet.h"
 #include "db.h"
 #include "walletdb.h"
+#include "memusage.h"
 
 using namespace json_spirit;
 using namespace std;
@@ -61,6 +62,18 @@ Value getpeerinfo(const Array& params, bool fHelp)
         obj.push_back(Pair("inbound", stats.fInbound));
         obj.push_back(Pair("startingheight", stats.nStartingHeight));
         obj.push_back(Pair("banscore", stats.nMisbehavior));
+        obj.push_back(Pair("bytessent", stats.nSendBytes));
+        obj.push_back(Pair("bytesrecv", stats.nRecvBytes));
+
+        Object sendPerMsgCmd;
+        for (map<string, uint64_t>::const_iterator it = stats.mapSendBytesPerMsgCmd.begin(); it != stats.mapSendBytesPerMsgCmd.end(); ++it)
+            sendPerMsgCmd.push_back(Pair(it->first, it->second));
+        obj.push_back(Pair("bytessent_per_msg", sendPerMsgCmd));
+
+        Object recvPerMsgCmd;
+        for (map<string, uint64_t>::const_iterator it = stats.mapRecvBytesPerMsgCmd.begin(); it != stats.mapRecvBytesPerMsgCmd.end(); ++it)
+            recvPerMsgCmd.push_back(Pair(it->first, it->second));
+        obj.push_back(Pair("bytesrecv_per_msg", recvPerMsgCmd));
 
         ret.push_back(obj);
     }
@@ -172,3 +185,40 @@ Value sendalert(const Array& params, bool fHelp)
         result.push_back(Pair("nCancel", alert.nCancel));
     return result;
 }
+
+Value getmemoryinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getmemoryinfo\n"
+            "Returns an estimate of the bytes held by the node's major in-memory structures.\n"
+            "The database caches are reported at their configured size.");
+
+    vector<pair<string, size_t> > vUsage;
+    GetMemoryUsage(vUsage);
+
+    Object obj;
+    uint64_t nTotal = 0;
+    for (unsigned int i = 0; i < vUsage.size(); i++)
+    {
+        obj.push_back(Pair(vUsage[i].first, (uint64_t)vUsage[i].second));
+        nTotal += vUsage[i].second;
+    }
+    obj.push_back(Pair("total", nTotal));
+    return obj;
+}
+
+Value setmocktime(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "setmocktime <timestamp>\n"
+            "Set the node's clock to <timestamp> (seconds since epoch), 0 to go back to the system clock.\n"
+            "Only available on the test network.");
+
+    if (!fTestNet)
+        throw runtime_error("setmocktime is for testing only");
+
+    SetMockTime(params[0].get_int64());
+    return Value::null;
+}
@@ -346,25 +346,66 @@ Value smsglocalkeys(const Array& params, bool fHelp)
 
 Value smsgscanchain(const Array& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 1)
         throw runtime_error(
-            "smsgscanchain \n"
-            "Look for public keys in the block chain.");
+            "smsgscanchain [restart=false]\n"
+            "Look for public keys in the block chain.\n"
+            "The scan runs in the background and resumes where it stopped, from the genesis block if restart is true.\n"
+            "See smsgscanstatus for its progress.");
     
     if (!fSecMsgEnabled)
         throw runtime_error("Secure messaging is disabled.");
     
+    bool fRestart = params.size() > 0 && params[0].get_bool();
+    
     Object result;
-    if (!SecureMsgScanBlockChain())
+    if (!SecureMsgScanBlockChain(fRestart))
     {
         result.push_back(Pair("result", "Scan Chain Failed."));
     } else
     {
-        result.push_back(Pair("result", "Scan Chain Completed."));
+        result.push_back(Pair("result", "Scan Chain Started."));
     }
     return result;
 }
 
+Value smsgscanstatus(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "smsgscanstatus \n"
+            "Show the progress of the public key scan of the block chain.");
+    
+    if (!fSecMsgEnabled)
+        throw runtime_error("Secure messaging is disabled.");
+    
+    SecMsgScanStatus status;
+    SecureMsgGetScanStatus(status);
+    
+    Object result;
+    result.push_back(Pair("enabled", status.fEnabled));
+    result.push_back(Pair("running", status.fRunning));
+    result.push_back(Pair("height", status.nHeight));
+    result.push_back(Pair("chainheight", nBestHeight));
+    if (status.fEnabled && nBestHeight > 0)
+        result.push_back(Pair("progress", std::min(1.0, (double)(status.nHeight + 1) / (nBestHeight + 1))));
+    if (status.nStarted)
+    {
+        result.push_back(Pair("startheight", status.nStartHeight));
+        result.push_back(Pair("blocks", (uint64_t)status.nBlocks));
+        result.push_back(Pair("transactions", (uint64_t)status.nTransactions));
+        result.push_back(Pair("inputs", (uint64_t)status.nInputs));
+        result.push_back(Pair("pubkeys", (uint64_t)status.nPubkeys));
+        result.push_back(Pair("duplicates", (uint64_t)status.nDuplicates));
+        if (status.fRunning)
+            result.push_back(Pair("elapsed", (int64_t)(GetTimeMillis() - status.nStarted)));
+    };
+    if (!status.sError.empty())
+        result.push_back(Pair("error", status.sError));
+    
+    return result;
+}
+
 Value smsgscanbuckets(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -562,6 +603,60 @@ Value smsgsendanon(const Array& params, bool fHelp)
     return result;
 }
 
+Value smsgsendbatch(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 2)
+        throw runtime_error(
+            "smsgsendbatch <addrFrom> [{\"address\":addrTo,\"message\":message},...]\n"
+            "Send encrypted messages from addrFrom to many addresses at once.\n"
+            "addrFrom can be anon to send them anonymously.\n"
+            "Messages are encrypted in parallel and queued together, failures are listed by position.");
+    
+    if (!fSecMsgEnabled)
+        throw runtime_error("Secure messaging is disabled.");
+    
+    std::string addrFrom  = params[0].get_str();
+    Array messages        = params[1].get_array();
+    
+    std::vector<SecMsgBatchEntry> vEntries;
+    vEntries.reserve(messages.size());
+    BOOST_FOREACH(const Value& value, messages)
+    {
+        const Object& o = value.get_obj();
+        vEntries.push_back(SecMsgBatchEntry(find_value(o, "address").get_str(), find_value(o, "message").get_str()));
+    };
+    
+    Object result;
+    std::string sError;
+    if (SecureMsgSendBatch(addrFrom, vEntries, sError) != 0)
+    {
+        result.push_back(Pair("result", "Send failed."));
+        result.push_back(Pair("error", sError));
+        return result;
+    };
+    
+    int nSent = 0;
+    Array failed;
+    for (unsigned int i = 0; i < vEntries.size(); ++i)
+    {
+        if (vEntries[i].nResult == 0)
+        {
+            nSent++;
+            continue;
+        };
+        Object entry;
+        entry.push_back(Pair("index", (int)i));
+        entry.push_back(Pair("address", vEntries[i].sAddrTo));
+        entry.push_back(Pair("error", vEntries[i].sError));
+        failed.push_back(entry);
+    };
+    
+    result.push_back(Pair("result", nSent == (int)vEntries.size() ? "Sent." : "Partially sent."));
+    result.push_back(Pair("sent", nSent));
+    result.push_back(Pair("failed", failed));
+    return result;
+}
+
 Value smsginbox(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() > 1) // defaults to read
@@ -0,0 +1,137 @@
+// Copyright (c) 2018 The AveroPay developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "scheduler.h"
+#include "util.h"
+
+#include <boost/bind.hpp>
+
+using namespace std;
+
+CScheduler scheduler;
+
+CScheduler::CScheduler()
+{
+    nNextId = 1;
+    fStopping = false;
+}
+
+CScheduler::~CScheduler()
+{
+    Stop();
+}
+
+void CScheduler::Start(int nThreads)
+{
+    for (int i = 0; i < std::max(nThreads, 1); i++)
+        threads.create_thread(boost::bind(&CScheduler::ThreadMain, this));
+}
+
+void CScheduler::Stop()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fStopping = true;
+        queue.clear();
+        mapPending.clear();
+        setRunningPeriodic.clear();
+    }
+    condWake.notify_all();
+    threads.join_all();
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    fStopping = false;
+}
+
+CScheduler::TaskId CScheduler::Add(const Function& f, int64_t nTimeMillis, int64_t nInterval)
+{
+    TaskId id;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        id = nNextId++;
+        Task task = {id, f, nInterval};
+        mapPending[id] = queue.insert(make_pair(nTimeMillis, task));
+    }
+    condWake.notify_one();
+    return id;
+}
+
+CScheduler::TaskId CScheduler::Schedule(Function f, int64_t nTimeMillis)
+{
+    return Add(f, nTimeMillis, 0);
+}
+
+CScheduler::TaskId CScheduler::ScheduleFromNow(Function f, int64_t nDeltaMillis)
+{
+    return Add(f, GetTimeMillis() + nDeltaMillis, 0);
+}
+
+CScheduler::TaskId CScheduler::ScheduleEvery(Function f, int64_t nIntervalMillis)
+{
+    nIntervalMillis = std::max(nIntervalMillis, (int64_t)1);
+    return Add(f, GetTimeMillis() + nIntervalMillis, nIntervalMillis);
+}
+
+bool CScheduler::Cancel(TaskId id)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (setRunningPeriodic.erase(id))
+        return true;
+    map<TaskId, TaskQueue::iterator>::iterator mi = mapPending.find(id);
+    if (mi == mapPending.end())
+        return false;
+    queue.erase(mi->second);
+    mapPending.erase(mi);
+    return true;
+}
+
+size_t CScheduler::GetQueueSize()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    return queue.size();
+}
+
+void CScheduler::ThreadMain()
+{
+    RenameThread("AveroPay-sched");
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (!fStopping)
+    {
+        if (queue.empty())
+        {
+            condWake.wait(lock);
+            continue;
+        }
+        int64_t nWait = queue.begin()->first - GetTimeMillis();
+        if (nWait > 0)
+        {
+            condWake.timed_wait(lock, boost::posix_time::milliseconds(nWait));
+            continue;
+        }
+
+        Task task = queue.begin()->second;
+        mapPending.erase(task.id);
+        queue.erase(queue.begin());
+        if (task.nInterval)
+            setRunningPeriodic.insert(task.id);
+
+        lock.unlock();
+        try
+        {
+            task.f();
+        }
+        catch (std::exception& e) {
+            PrintExceptionContinue(&e, "CScheduler");
+        }
+        catch (...) {
+            PrintExceptionContinue(NULL, "CScheduler");
+        }
+        lock.lock();
+
+        // unless it was cancelled while it ran
+        if (task.nInterval && setRunningPeriodic.erase(task.id) && !fStopping)
+            mapPending[task.id] = queue.insert(make_pair(GetTimeMillis() + task.nInterval, task));
+    }
+}
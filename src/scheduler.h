@@ -0,0 +1,77 @@
+// Copyright (c) 2018 The AveroPay developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_SCHEDULER_H
+#define BITCOIN_SCHEDULER_H
+
+#include <map>
+#include <set>
+
+#include <boost/function.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <stdint.h>
+
+/** Runs tasks at a given time on a small pool of worker threads.
+ *
+ * The node's housekeeping jobs (flushing the wallet and peers.dat, masternode
+ * checks, smsg bucket expiry, relocking the wallet) used to have a thread
+ * each that slept in a loop and polled fShutdown. Here they share one queue
+ * ordered by due time: the workers sleep on a condition variable until the
+ * earliest task is due or a task is added, and Stop() wakes them at once.
+ *
+ * Times are GetTimeMillis() values. A periodic task runs again an interval
+ * after its previous run finished, like the loops it replaces. Tasks should
+ * not block for long, as they hold up the tasks behind them.
+ */
+class CScheduler
+{
+public:
+    typedef boost::function<void()> Function;
+    /** Identifies a scheduled task for Cancel(), 0 is none */
+    typedef uint64_t TaskId;
+
+    CScheduler();
+    ~CScheduler();
+
+    void Start(int nThreads);
+    /** Drop the pending tasks and stop the workers, once running tasks return */
+    void Stop();
+
+    TaskId Schedule(Function f, int64_t nTimeMillis);
+    TaskId ScheduleFromNow(Function f, int64_t nDeltaMillis);
+    /** Run f every nIntervalMillis, the first time one interval from now */
+    TaskId ScheduleEvery(Function f, int64_t nIntervalMillis);
+    /** Remove a task; a periodic task that is running is not run again.
+        Returns false if the task already ran or was cancelled. */
+    bool Cancel(TaskId id);
+
+    size_t GetQueueSize();
+
+private:
+    struct Task
+    {
+        TaskId id;
+        Function f;
+        int64_t nInterval; // 0 for one-shot tasks
+    };
+    typedef std::multimap<int64_t, Task> TaskQueue;
+
+    boost::mutex mutex;
+    boost::condition_variable condWake;
+    TaskQueue queue;
+    std::map<TaskId, TaskQueue::iterator> mapPending;
+    std::set<TaskId> setRunningPeriodic;
+    TaskId nNextId;
+    bool fStopping;
+    boost::thread_group threads;
+
+    TaskId Add(const Function& f, int64_t nTimeMillis, int64_t nInterval);
+    void ThreadMain();
+};
+
+extern CScheduler scheduler;
+
+#endif
@@ -17,6 +17,7 @@ using namespace boost;
 #include "main.h"
 #include "sync.h"
 #include "util.h"
+#include "memusage.h"
 #include "eccryptoverify.h"
 
 namespace {
@@ -2270,13 +2271,28 @@ public:
         sigdata_type k(hash, vchSig, pubKey);
         setValid.insert(k);
     }
+
+    size_t DynamicMemoryUsage()
+    {
+        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+
+        size_t nUsage = memusage::DynamicUsage(setValid);
+        BOOST_FOREACH(const sigdata_type& k, setValid)
+            nUsage += memusage::DynamicUsage(k.get<1>());
+        return nUsage;
+    }
 };
 
+static CSignatureCache signatureCache;
+
+size_t GetSignatureCacheMemoryUsage()
+{
+    return signatureCache.DynamicMemoryUsage();
+}
+
 bool CheckSig(vector<unsigned char> vchSig, const vector<unsigned char> &vchPubKey, const CScript &scriptCode,
               const CTransaction& txTo, unsigned int nIn, int nHashType, int flags)
 {
-    static CSignatureCache signatureCache;
-
     CPubKey pubkey(vchPubKey);
     if (!pubkey.IsValid())
         return false;
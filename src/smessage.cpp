@@ -10,7 +10,8 @@ Notes:
     parameters:
         -nosmsg             Disable secure messaging (fNoSmsg)
         -debugsmsg          Show extra debug messages (fDebugSmsg)
-        -smsgscanchain      Scan the block chain for public key addresses on startup
+        -smsgscanchain      Scan the block chain for public key addresses on startup, in the background
+        -smsgpowthreads     Threads doing proof of work for outgoing messages
     
     
     Wallet Locked
@@ -46,6 +47,8 @@ Notes:
 
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string/predicate.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
 
 
 #include "base58.h"
@@ -53,6 +56,8 @@ Notes:
 #include "main.h"
 #include "init.h" // pwalletMain
 #include "txdb.h"
+#include "memusage.h"
+#include "scheduler.h"
 
 
 #include "lz4/lz4.c"
@@ -231,66 +236,22 @@ bool SecMsgDB::Open(const char* pszMode)
 };
 
 
-class SecMsgBatchScanner : public leveldb::WriteBatch::Handler
-{
-public:
-    std::string needle;
-    bool* deleted;
-    std::string* foundValue;
-    bool foundEntry;
-    
-    SecMsgBatchScanner() : foundEntry(false) {}
-    
-    virtual void Put(const leveldb::Slice& key, const leveldb::Slice& value)
-    {
-        if (key.ToString() == needle)
-        {
-            foundEntry = true;
-            *deleted = false;
-            *foundValue = value.ToString();
-        };
-    };
-    
-    virtual void Delete(const leveldb::Slice& key)
-    {
-        if (key.ToString() == needle)
-        {
-            foundEntry = true;
-            *deleted = true;
-        };
-    };
-};
-
 // When performing a read, if we have an active batch we need to check it first
 // before reading from the database, as the rest of the code assumes that once
-// a database transaction begins reads are consistent with it. It would be good
-// to change that assumption in future and avoid the performance hit, though in
-// practice it does not appear to be large.
+// a database transaction begins reads are consistent with it.
 bool SecMsgDB::ScanBatch(const CDataStream& key, std::string* value, bool* deleted) const
 {
     if (!activeBatch)
         return false;
     
-    *deleted = false;
-    SecMsgBatchScanner scanner;
-    scanner.needle = key.str();
-    scanner.deleted = deleted;
-    scanner.foundValue = value;
-    leveldb::Status s = activeBatch->Iterate(&scanner);
-    if (!s.ok())
-    {
-        printf("SecMsgDB ScanBatch error: %s\n", s.ToString().c_str());
-        return false;
-    };
-    
-    return scanner.foundEntry;
+    return activeBatch->Lookup(key.str(), value, deleted);
 }
 
 bool SecMsgDB::TxnBegin()
 {
     if (activeBatch)
         return true;
-    activeBatch = new leveldb::WriteBatch();
+    activeBatch = new CIndexedWriteBatch();
     return true;
 };
 
@@ -301,7 +262,7 @@ bool SecMsgDB::TxnCommit()
     
     leveldb::WriteOptions writeOptions;
     writeOptions.sync = true;
-    leveldb::Status status = pdb->Write(writeOptions, activeBatch);
+    leveldb::Status status = pdb->Write(writeOptions, activeBatch->GetBatch());
     delete activeBatch;
     activeBatch = NULL;
     
@@ -423,6 +384,77 @@ bool SecMsgDB::ExistsPK(CKeyID& addr)
     return s.IsNotFound() == false;
 };
 
+bool SecMsgDB::ReadScanHeight(int& nHeight)
+{
+    // -- progress of the public key scan, see SecureMsgScanBlockChain()
+    if (!pdb)
+        return false;
+    
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey << 's';
+    ssKey << 'h';
+    std::string strValue;
+    
+    bool readFromDb = true;
+    if (activeBatch)
+    {
+        bool deleted = false;
+        readFromDb = ScanBatch(ssKey, &strValue, &deleted) == false;
+        if (deleted)
+            return false;
+    };
+    
+    if (readFromDb)
+    {
+        leveldb::Status s = pdb->Get(leveldb::ReadOptions(), ssKey.str(), &strValue);
+        if (!s.ok())
+        {
+            if (!s.IsNotFound())
+                printf("LevelDB read failure: %s\n", s.ToString().c_str());
+            return false;
+        };
+    };
+    
+    try {
+        CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+        ssValue >> nHeight;
+    } catch (std::exception& e) {
+        printf("SecMsgDB::ReadScanHeight() unserialize threw: %s.\n", e.what());
+        return false;
+    }
+    
+    return true;
+};
+
+bool SecMsgDB::WriteScanHeight(int nHeight)
+{
+    if (!pdb)
+        return false;
+    
+    CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+    ssKey << 's';
+    ssKey << 'h';
+    CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+    ssValue << nHeight;
+    
+    if (activeBatch)
+    {
+        activeBatch->Put(ssKey.str(), ssValue.str());
+        return true;
+    };
+    
+    leveldb::WriteOptions writeOptions;
+    writeOptions.sync = true;
+    leveldb::Status s = pdb->Put(writeOptions, ssKey.str(), ssValue.str());
+    if (!s.ok())
+    {
+        printf("SecMsgDB write failure: %s\n", s.ToString().c_str());
+        return false;
+    };
+    
+    return true;
+};
+
 
 bool SecMsgDB::NextSmesg(leveldb::Iterator* it, std::string& prefix, unsigned char* chKey, SecMsgStored& smsgStored)
 {
@@ -586,124 +618,194 @@ bool SecMsgDB::EraseSmesg(unsigned char* chKey)
     return false;
 };
 
-void ThreadSecureMsg(void* parg)
+static CScheduler::TaskId nBucketTask = 0;
+
+static void SecureMsgManageBuckets()
 {
-    // -- bucket management thread
-    RenameThread("AveroPay-smsg"); // Make this thread recognisable
+    // -- bucket management, run every SMSG_THREAD_DELAY seconds by the scheduler
+    if (!fSecMsgEnabled)
+        return;
     
-    uint32_t delay = 0;
+    int64_t now = GetTime();
+    
+    if (fDebugSmsg)
+        printf("SecureMsgThread %" PRId64" \n", now);
+    
+    int64_t cutoffTime = now - SMSG_RETENTION;
     
-    while (fSecMsgEnabled)
     {
-        // shutdown thread waits 5 seconds, this should be less
-        MilliSleep(1000); // milliseconds
-        
-        if (!fSecMsgEnabled) // check again after sleep
-            break;
-        
-        delay++;
-        if (delay < SMSG_THREAD_DELAY) // check every SMSG_THREAD_DELAY seconds
-            continue;
-        delay = 0;
-        
-        int64_t now = GetTime();
-        
-        if (fDebugSmsg)
-            printf("SecureMsgThread %" PRId64" \n", now);
-        
-        int64_t cutoffTime = now - SMSG_RETENTION;
+        LOCK(cs_smsg);
+        std::map<int64_t, SecMsgBucket>::iterator it;
+        it = smsgBuckets.begin();
         
+        while (it != smsgBuckets.end())
         {
-            LOCK(cs_smsg);
-            std::map<int64_t, SecMsgBucket>::iterator it;
-            it = smsgBuckets.begin();
-            
-            while (it != smsgBuckets.end())
+            //if (fDebugSmsg)
+            //    printf("Checking bucket %"PRId64", size %"PRIszu" \n", it->first, it->second.setTokens.size());
+            if (it->first < cutoffTime)
             {
-                //if (fDebugSmsg)
-                //    printf("Checking bucket %"PRId64", size %"PRIszu" \n", it->first, it->second.setTokens.size());
-                if (it->first < cutoffTime)
+                if (fDebugSmsg)
+                    printf("Removing bucket %" PRId64" \n", it->first);
+                std::string fileName = boost::lexical_cast<std::string>(it->first) + "_01.dat";
+                fs::path fullPath = GetDataDir() / "smsgStore" / fileName;
+                if (fs::exists(fullPath))
                 {
-                    if (fDebugSmsg)
-                        printf("Removing bucket %" PRId64" \n", it->first);
-                    std::string fileName = boost::lexical_cast<std::string>(it->first) + "_01.dat";
-                    fs::path fullPath = GetDataDir() / "smsgStore" / fileName;
-                    if (fs::exists(fullPath))
-                    {
-                        try {
-                            fs::remove(fullPath);
-                        } catch (const fs::filesystem_error& ex)
-                        {
-                            printf("Error removing bucket file %s.\n", ex.what());
-                        };
-                    } else
-                        printf("Path %s does not exist \n", fullPath.string().c_str());
-                    
-                    // -- look for a wl file, it stores incoming messages when wallet is locked
-                    fileName = boost::lexical_cast<std::string>(it->first) + "_01_wl.dat";
-                    fullPath = GetDataDir() / "smsgStore" / fileName;
-                    if (fs::exists(fullPath))
+                    try {
+                        fs::remove(fullPath);
+                    } catch (const fs::filesystem_error& ex)
                     {
-                        try {
-                            fs::remove(fullPath);
-                        } catch (const fs::filesystem_error& ex)
-                        {
-                            printf("Error removing wallet locked file %s.\n", ex.what());
-                        };
+                        printf("Error removing bucket file %s.\n", ex.what());
                     };
-                    
-                    smsgBuckets.erase(it++);
                 } else
+                    printf("Path %s does not exist \n", fullPath.string().c_str());
+                
+                // -- look for a wl file, it stores incoming messages when wallet is locked
+                fileName = boost::lexical_cast<std::string>(it->first) + "_01_wl.dat";
+                fullPath = GetDataDir() / "smsgStore" / fileName;
+                if (fs::exists(fullPath))
                 {
-                    // -- tick down nLockCount, so will eventually expire if peer never sends data
-                    if (it->second.nLockCount > 0)
+                    try {
+                        fs::remove(fullPath);
+                    } catch (const fs::filesystem_error& ex)
                     {
-                        it->second.nLockCount--;
+                        printf("Error removing wallet locked file %s.\n", ex.what());
+                    };
+                };
+                
+                smsgBuckets.erase(it++);
+            } else
+            {
+                // -- tick down nLockCount, so will eventually expire if peer never sends data
+                if (it->second.nLockCount > 0)
+                {
+                    it->second.nLockCount--;
+                    
+                    if (it->second.nLockCount == 0)     // lock timed out
+                    {
+                        uint32_t    nPeerId     = it->second.nLockPeerId;
+                        int64_t     ignoreUntil = GetTime() + SMSG_TIME_IGNORE;
                         
-                        if (it->second.nLockCount == 0)     // lock timed out
+                        if (fDebugSmsg)
+                            printf("Lock on bucket %" PRId64" for peer %u timed out.\n", it->first, nPeerId);
+                        // -- look through the nodes for the peer that locked this bucket
+                        LOCK(cs_vNodes);
+                        BOOST_FOREACH(CNode* pnode, vNodes)
                         {
-                            uint32_t    nPeerId     = it->second.nLockPeerId;
-                            int64_t     ignoreUntil = GetTime() + SMSG_TIME_IGNORE;
+                            if (pnode->smsgData.nPeerId != nPeerId)
+                                continue;
+                            pnode->smsgData.ignoreUntil = ignoreUntil;
+                            
+                            // -- alert peer that they are being ignored
+                            std::vector<unsigned char> vchData;
+                            vchData.resize(8);
+                            memcpy(&vchData[0], &ignoreUntil, 8);
+                            pnode->PushMessage("smsgIgnore", vchData);
                             
                             if (fDebugSmsg)
-                                printf("Lock on bucket %" PRId64" for peer %u timed out.\n", it->first, nPeerId);
-                            // -- look through the nodes for the peer that locked this bucket
-                            LOCK(cs_vNodes);
-                            BOOST_FOREACH(CNode* pnode, vNodes)
-                            {
-                                if (pnode->smsgData.nPeerId != nPeerId)
-                                    continue;
-                                pnode->smsgData.ignoreUntil = ignoreUntil;
-                                
-                                // -- alert peer that they are being ignored
-                                std::vector<unsigned char> vchData;
-                                vchData.resize(8);
-                                memcpy(&vchData[0], &ignoreUntil, 8);
-                                pnode->PushMessage("smsgIgnore", vchData);
-                                
-                                if (fDebugSmsg)
-                                    printf("This node will ignore peer %u until %" PRId64".\n", nPeerId, ignoreUntil);
-                                break;
-                            };
-                            it->second.nLockPeerId = 0;
-                        }; // if (it->second.nLockCount == 0)
-                    };
-                    ++it;
-                }; // ! if (it->first < cutoffTime)
-            };
-        }; // LOCK(cs_smsg);
+                                printf("This node will ignore peer %u until %" PRId64".\n", nPeerId, ignoreUntil);
+                            break;
+                        };
+                        it->second.nLockPeerId = 0;
+                    }; // if (it->second.nLockCount == 0)
+                };
+                ++it;
+            }; // ! if (it->first < cutoffTime)
+        };
+    }; // LOCK(cs_smsg);
+};
+
+// -- messages written to the send queue by SecureMsgSendBatch, handed to the
+//    proof of work threads without a trip through the db. setPowQueued holds
+//    their keys until the message has left the db, so the db scan skips them.
+static boost::mutex mutexPowQueue;
+static boost::condition_variable condPowQueue;
+static std::deque<std::pair<std::vector<unsigned char>, SecMsgStored> > queuePow;
+static std::set<std::vector<unsigned char> > setPowQueued;
+
+static int SecureMsgPowAndStore(unsigned char* chKey, SecMsgStored& smsgStored)
+{
+    /* Do the proof of work for a message from the send queue and move it to the message store
+        returns
+            0       success
+            1       failed, message removed
+            2       shutting down, message left in the send queue
+    */
+    
+    unsigned char* pHeader = &smsgStored.vchMessage[0];
+    unsigned char* pPayload = &smsgStored.vchMessage[SMSG_HDR_LEN];
+    SecureMessage* psmsg = (SecureMessage*) pHeader;
+    
+    // -- do proof of work
+    int rv = SecureMsgSetHash(pHeader, pPayload, psmsg->nPayload);
+    if (rv == 2) 
+        return 2; // /eave message in db, if terminated due to shutdown
+    
+    // -- message is removed here, no matter what
+    {
+        LOCK(cs_smsgDB);
+        SecMsgDB dbOutbox;
+        if (dbOutbox.Open("cr+"))
+            dbOutbox.EraseSmesg(chKey);
+    }
+    if (rv != 0)
+    {
+        printf("SecMsgPow: Could not get proof of work hash, message removed.\n");
+        return 1;
+    };
+    
+    // -- add to message store
+    {
+        LOCK(cs_smsg);
+        if (SecureMsgStore(pHeader, pPayload, psmsg->nPayload, true) != 0)
+        {
+            printf("SecMsgPow: Could not place message in buckets, message removed.\n");
+            return 1;
+        };
+    }
+    
+    // -- test if message was sent to self
+    if (SecureMsgScanMessage(pHeader, pPayload, psmsg->nPayload, true) != 0)
+    {
+        // message recipient is not this node (or failed)
     };
     
-    printf("ThreadSecureMsg exited.\n");
+    return 0;
+};
+
+static bool SecureMsgPowDequeue(int64_t nWaitMs)
+{
+    // -- take one message from the in-memory queue, waiting up to nWaitMs for one
+    std::pair<std::vector<unsigned char>, SecMsgStored> item;
+    {
+        boost::unique_lock<boost::mutex> lock(mutexPowQueue);
+        if (queuePow.empty() && nWaitMs > 0)
+            condPowQueue.timed_wait(lock, boost::posix_time::milliseconds(nWaitMs));
+        if (queuePow.empty())
+            return false;
+        item = queuePow.front();
+        queuePow.pop_front();
+    }
+    
+    int rv = SecureMsgPowAndStore(&item.first[0], item.second);
+    
+    {
+        boost::unique_lock<boost::mutex> lock(mutexPowQueue);
+        setPowQueued.erase(item.first);
+    }
+    return rv != 2;
+};
+
+static bool SecureMsgPowIsQueued(unsigned char* chKey)
+{
+    boost::unique_lock<boost::mutex> lock(mutexPowQueue);
+    return setPowQueued.count(std::vector<unsigned char>(chKey, chKey + 18)) > 0;
 };
 
 void ThreadSecureMsgPow(void* parg)
 {
-    // -- proof of work thread
+    // -- proof of work thread, also picks up messages left in the send queue db
     RenameThread("AveroPay-smsg-pow"); // Make this thread recognisable
     
-    int rv;
-    std::vector<unsigned char> vchKey;
     SecMsgStored smsgStored;
     
     std::string sPrefix("qm");
@@ -714,6 +816,8 @@ void ThreadSecureMsgPow(void* parg)
     {
         // -- sleep at end, then fSecMsgEnabled is tested on wake
         
+        while (fSecMsgEnabled && SecureMsgPowDequeue(0));
+        
         SecMsgDB dbOutbox;
         leveldb::Iterator* it;
         {
@@ -735,41 +839,12 @@ void ThreadSecureMsgPow(void* parg)
                     break;
             }
             
-            unsigned char* pHeader = &smsgStored.vchMessage[0];
-            unsigned char* pPayload = &smsgStored.vchMessage[SMSG_HDR_LEN];
-            SecureMessage* psmsg = (SecureMessage*) pHeader;
-            
-            // -- do proof of work
-            rv = SecureMsgSetHash(pHeader, pPayload, psmsg->nPayload);
-            if (rv == 2) 
-                break; // /eave message in db, if terminated due to shutdown
-            
-            // -- message is removed here, no matter what
-            {
-                LOCK(cs_smsgDB);
-                dbOutbox.EraseSmesg(chKey);
-            }
-            if (rv != 0)
-            {
-                printf("SecMsgPow: Could not get proof of work hash, message removed.\n");
+            // -- queued in memory, another proof of work thread has it
+            if (SecureMsgPowIsQueued(chKey))
                 continue;
-            };
             
-            // -- add to message store
-            {
-                LOCK(cs_smsg);
-                if (SecureMsgStore(pHeader, pPayload, psmsg->nPayload, true) != 0)
-                {
-                    printf("SecMsgPow: Could not place message in buckets, message removed.\n");
-                    continue;
-                };
-            }
-            
-            // -- test if message was sent to self
-            if (SecureMsgScanMessage(pHeader, pPayload, psmsg->nPayload, true) != 0)
-            {
-                // message recipient is not this node (or failed)
-            };
+            if (SecureMsgPowAndStore(chKey, smsgStored) == 2)
+                break;
         };
         
         {
@@ -778,12 +853,39 @@ void ThreadSecureMsgPow(void* parg)
         }
         
         // -- shutdown thread waits 5 seconds, this should be less
-        MilliSleep(1000); // milliseconds
+        SecureMsgPowDequeue(1000); // milliseconds
     };
     
     printf("ThreadSecureMsgPow exited.\n");
 };
 
+void ThreadSecureMsgPowWorker(void* parg)
+{
+    // -- extra proof of work threads (-smsgpowthreads), work the in-memory queue only
+    RenameThread("AveroPay-smsg-pow");
+    
+    while (fSecMsgEnabled)
+        SecureMsgPowDequeue(1000); // milliseconds
+};
+
+static bool SecureMsgStartThreads()
+{
+    if (!NewThread(ThreadSecureMsgPow, NULL))
+        return false;
+    
+    scheduler.Cancel(nBucketTask);
+    nBucketTask = scheduler.ScheduleEvery(SecureMsgManageBuckets, SMSG_THREAD_DELAY * 1000);
+    
+    int nPowThreads = GetArg("-smsgpowthreads", 1);
+    for (int i = 1; i < nPowThreads; ++i)
+    {
+        if (!NewThread(ThreadSecureMsgPowWorker, NULL))
+            return false;
+    };
+    
+    return true;
+};
+
 
 std::string getTimeString(int64_t timestamp, char *buffer, size_t nBuffer)
 {
@@ -1134,6 +1236,8 @@ int SecureMsgWriteIni()
 };
 
 
+static void SecureMsgResumeScan();
+
 /** called from AppInit2() in init.cpp */
 bool SecureMsgStart(bool fDontStart, bool fScanChain)
 {
@@ -1160,6 +1264,9 @@ bool SecureMsgStart(bool fDontStart, bool fScanChain)
     if (fScanChain)
     {
         SecureMsgScanBlockChain();
+    } else
+    {
+        SecureMsgResumeScan();
     };
     
     if (SecureMsgBuildBucketSet() != 0)
@@ -1170,8 +1277,7 @@ bool SecureMsgStart(bool fDontStart, bool fScanChain)
     };
     
     // -- start threads
-    if (!NewThread(ThreadSecureMsg, NULL)
-        || !NewThread(ThreadSecureMsgPow, NULL))
+    if (!SecureMsgStartThreads())
     {
         printf("SecureMsg could not start threads, secure messaging disabled.\n");
         fSecMsgEnabled = false;
@@ -1181,6 +1287,28 @@ bool SecureMsgStart(bool fDontStart, bool fScanChain)
     return true;
 };
 
+/** Memory held by the buckets' token sets, for getmemoryinfo */
+size_t SecureMsgMemoryUsage()
+{
+    LOCK(cs_smsg);
+    size_t nUsage = memusage::DynamicUsage(smsgBuckets);
+    std::map<int64_t, SecMsgBucket>::iterator it;
+    for (it = smsgBuckets.begin(); it != smsgBuckets.end(); ++it)
+        nUsage += memusage::DynamicUsage(it->second.setTokens);
+    return nUsage;
+};
+
+size_t SecureMsgDBCacheSize()
+{
+    LOCK(cs_smsgDB);
+    if (!smsgDB)
+        return 0;
+
+    // SecMsgDB::Open() uses the defaults: an 8MB block cache and two write buffers
+    leveldb::Options options;
+    return 8 * 1048576 + 2 * options.write_buffer_size;
+};
+
 /** called from Shutdown() in init.cpp */
 bool SecureMsgShutdown()
 {
@@ -1194,6 +1322,8 @@ bool SecureMsgShutdown()
         printf("Failed to save smsg.ini\n");
     
     fSecMsgEnabled = false;
+    scheduler.Cancel(nBucketTask);
+    nBucketTask = 0;
     
     if (smsgDB)
     {
@@ -1243,14 +1373,15 @@ bool SecureMsgEnable()
     }; // LOCK(cs_smsg);
     
     // -- start threads
-    if (!NewThread(ThreadSecureMsg, NULL)
-        || !NewThread(ThreadSecureMsgPow, NULL))
+    if (!SecureMsgStartThreads())
     {
         printf("SecureMsgEnable could not start threads, secure messaging disabled.\n");
         fSecMsgEnabled = false;
         return false;
     };
     
+    SecureMsgResumeScan();
+    
     // -- ping each peer, don't know which have messaging enabled
     {
         LOCK(cs_vNodes);
@@ -1277,6 +1408,8 @@ bool SecureMsgDisable()
     {
         LOCK(cs_smsg);
         fSecMsgEnabled = false;
+        scheduler.Cancel(nBucketTask);
+        nBucketTask = 0;
         
         // -- clear smsgBuckets
         std::map<int64_t, SecMsgBucket>::iterator it;
@@ -1942,19 +2075,20 @@ int SecureMsgInsertAddress(CKeyID& hashKey, CPubKey& pubKey)
 };
 
 
-static bool ScanBlock(CBlock& block, CTxDB& txdb, SecMsgDB& addrpkdb,
-    uint32_t& nTransactions, uint32_t& nInputs, uint32_t& nPubkeys, uint32_t& nDuplicates)
+static void GetBlockPublicKeys(const CBlock& block, std::vector<CPubKey>& vPubKeys,
+    uint32_t& nTransactions, uint32_t& nInputs)
 {
-   AssertLockHeld(cs_smsgDB);
+    // -- public keys are in txin.scriptSig, or the coinstake's scriptPubKey
+    //    reads only the block, so several threads can run this at once
     
     valtype vch;
     opcodetype opcode;
     
     // -- only scan inputs of standard txns and coinstakes
     
-    BOOST_FOREACH(CTransaction& tx, block.vtx)
+    BOOST_FOREACH(const CTransaction& tx, block.vtx)
     {
-	std::string sReason;
+        std::string sReason;
         // - harvest public keys from coinstake txns
         if (tx.IsCoinStake())
         {
@@ -1976,12 +2110,7 @@ static bool ScanBlock(CBlock& block, CTxDB& txdb, SecMsgDB& addrpkdb,
                         continue;
                     };
                     
-                    CKeyID addrKey = pubKey.GetID();
-                    switch (SecureMsgInsertAddress(addrKey, pubKey, addrpkdb))
-                    {
-                        case 0: nPubkeys++; break;      // added key
-                        case 4: nDuplicates++; break;   // duplicate key
-                    }
+                    vPubKeys.push_back(pubKey);
                     break;
                 };
             };
@@ -1990,14 +2119,11 @@ static bool ScanBlock(CBlock& block, CTxDB& txdb, SecMsgDB& addrpkdb,
         if (IsStandardTx(tx, sReason))
         {
             for (uint32_t i = 0; i < tx.vin.size(); i++)
-            {                
-                CScript *script = &tx.vin[i].scriptSig;
+            {
+                const CScript *script = &tx.vin[i].scriptSig;
                 CScript::const_iterator pc = script->begin();
                 CScript::const_iterator pend = script->end();
-
-                uint256 prevoutHash;
-                CKey key;
-
+                
                 while (pc < pend)
                 {
                     if (!script->GetOp(pc, opcode, vch))
@@ -2014,144 +2140,358 @@ static bool ScanBlock(CBlock& block, CTxDB& txdb, SecMsgDB& addrpkdb,
                             continue;
                         };
                         
-                        CKeyID addrKey = pubKey.GetID();
-                        switch (SecureMsgInsertAddress(addrKey, pubKey, addrpkdb))
-                        {
-                            case 0: nPubkeys++; break;      // added key
-                            case 4: nDuplicates++; break;   // duplicate key
-                        }
+                        vPubKeys.push_back(pubKey);
                         break;
                     };
-
+                    
                 };
                 nInputs++;
             };
         };
         nTransactions++;
+    };
+};
 
-        if (nTransactions % 10000 == 0) // for ScanChainForPublicKeys
+static void InsertPublicKeys(std::vector<CPubKey>& vPubKeys, SecMsgDB& addrpkdb,
+    uint32_t& nPubkeys, uint32_t& nDuplicates)
+{
+    AssertLockHeld(cs_smsgDB);
+    
+    BOOST_FOREACH(CPubKey& pubKey, vPubKeys)
+    {
+        CKeyID addrKey = pubKey.GetID();
+        switch (SecureMsgInsertAddress(addrKey, pubKey, addrpkdb))
         {
-            printf("Scanning transaction no. %u.\n", nTransactions);
-        };
+            case 0: nPubkeys++; break;      // added key
+            case 4: nDuplicates++; break;   // duplicate key
+        }
     };
-    return true;
 };
 
 
-bool SecureMsgScanBlock(CBlock& block)
+// -- the scan of the block chain for public keys. Its progress is kept in the
+//    db ("sh"), blocks are harvested in height order from the genesis block up
+//    and the scan resumes from there when interrupted. Once the scan thread has
+//    caught up, SecureMsgScanBlock() moves the height on block by block and
+//    restarts the thread when it sees a gap. Guarded by cs_smsgDB.
+static SecMsgScanStatus smsgScan;
+
+static const int SMSG_SCAN_CHUNK = 1000;   // blocks read between two commits of the scan
+
+class SecMsgScanEntry
 {
-    /*
-    scan block for public key addresses
-    called from ProcessMessage() in main where strCommand == "block"
-    */
-    
-    if (fDebugSmsg)
-        printf("SecureMsgScanBlock().\n");
+// -- one block of a chunk of the scan
+public:
+    SecMsgScanEntry() : nFile(0), nBlockPos(0), fRead(false), nTransactions(0), nInputs(0) {};
+    
+    unsigned int            nFile;
+    unsigned int            nBlockPos;
+    uint256                 hash;
+    bool                    fRead;
+    uint32_t                nTransactions;
+    uint32_t                nInputs;
+    std::vector<CPubKey>    vPubKeys;
+};
+
+class CSecMsgChainScanner
+{
+// -- shared state of the threads reading a chunk of the scan
+public:
+    std::vector<SecMsgScanEntry> vEntries;
     
-    uint32_t nTransactions  = 0;
-    uint32_t nInputs        = 0;
-    uint32_t nPubkeys       = 0;
-    uint32_t nDuplicates    = 0;
+    boost::atomic<size_t> nNext;
     
+    void Run()
     {
-        LOCK(cs_smsgDB);
-        CTxDB txdb("r");
-        
-        SecMsgDB addrpkdb;
-        if (!addrpkdb.Open("cw")
-            || !addrpkdb.TxnBegin())
-            return false;
-        
-        ScanBlock(block, txdb, addrpkdb,
-            nTransactions, nInputs, nPubkeys, nDuplicates);
-        
-        addrpkdb.TxnCommit();
+        size_t n;
+        while ((n = nNext++) < vEntries.size())
+        {
+            if (!fSecMsgEnabled || fShutdown)
+                return;
+            
+            SecMsgScanEntry& entry = vEntries[n];
+            CBlock block;
+            if (!block.ReadFromDisk(entry.nFile, entry.nBlockPos)
+                || block.GetHash() != entry.hash)
+                continue;
+            
+            GetBlockPublicKeys(block, entry.vPubKeys, entry.nTransactions, entry.nInputs);
+            entry.fRead = true;
+        };
+    };
+};
+
+static bool SecureMsgScanChunk(bool& fCaughtUp)
+{
+    // -- harvest the next SMSG_SCAN_CHUNK blocks of the chain on all cores,
+    //    then store the keys and the new height in one db transaction
+    fCaughtUp = false;
+    
+    int nStart;
+    {
+        LOCK(cs_smsgDB);
+        nStart = smsgScan.nHeight + 1;
     }
     
+    CSecMsgChainScanner scanner;
+    scanner.nNext = 0;
+    {
+        LOCK(cs_main);
+        for (int nHeight = nStart; nHeight < nStart + SMSG_SCAN_CHUNK; ++nHeight)
+        {
+            const CBlockIndex* pindex = chainActive[nHeight];
+            if (!pindex)
+                break;
+            SecMsgScanEntry entry;
+            entry.nFile = pindex->nFile;
+            entry.nBlockPos = pindex->nBlockPos;
+            entry.hash = pindex->GetBlockHash();
+            scanner.vEntries.push_back(entry);
+        };
+    }
+    
+    if (scanner.vEntries.empty())
+    {
+        fCaughtUp = true;
+        return true;
+    };
+    
+    size_t nThreads = std::max(1u, boost::thread::hardware_concurrency());
+    nThreads = std::min(nThreads, scanner.vEntries.size());
+    if (nThreads <= 1)
+    {
+        scanner.Run();
+    } else
+    {
+        boost::thread_group threads;
+        for (size_t i = 0; i < nThreads; ++i)
+            threads.create_thread(boost::bind(&CSecMsgChainScanner::Run, &scanner));
+        threads.join_all();
+    };
+    
+    if (!fSecMsgEnabled || fShutdown)
+        return false;
+    
+    LOCK(cs_smsgDB);
+    if (!fSecMsgEnabled) // SecureMsgShutdown() deletes smsgDB under cs_smsgDB
+        return false;
+    
+    SecMsgDB addrpkdb;
+    if (!addrpkdb.Open("cw")
+        || !addrpkdb.TxnBegin())
+    {
+        smsgScan.sError = "Could not open the secure messaging db.";
+        return false;
+    };
+    
+    // -- keep the blocks before a failed read
+    int nHeight = nStart - 1;
+    SecMsgScanStatus counts;
+    BOOST_FOREACH(SecMsgScanEntry& entry, scanner.vEntries)
+    {
+        if (!entry.fRead)
+        {
+            smsgScan.sError = strprintf("Could not read block %s at height %d.", entry.hash.ToString().c_str(), nHeight + 1);
+            break;
+        };
+        InsertPublicKeys(entry.vPubKeys, addrpkdb, counts.nPubkeys, counts.nDuplicates);
+        counts.nBlocks++;
+        counts.nTransactions += entry.nTransactions;
+        counts.nInputs += entry.nInputs;
+        nHeight++;
+    };
+    
+    if (!addrpkdb.WriteScanHeight(nHeight)
+        || !addrpkdb.TxnCommit())
+    {
+        smsgScan.sError = "Could not write to the secure messaging db.";
+        return false;
+    };
+    
+    smsgScan.nHeight = nHeight;
+    smsgScan.nBlocks += counts.nBlocks;
+    smsgScan.nTransactions += counts.nTransactions;
+    smsgScan.nInputs += counts.nInputs;
+    smsgScan.nPubkeys += counts.nPubkeys;
+    smsgScan.nDuplicates += counts.nDuplicates;
+    
     if (fDebugSmsg)
-        printf("Found %u transactions, %u inputs, %u new public keys, %u duplicates.\n", nTransactions, nInputs, nPubkeys, nDuplicates);
+        printf("Scanned for public keys to height %d.\n", nHeight);
     
-    return true;
+    return smsgScan.sError.empty();
 };
 
-bool ScanChainForPublicKeys(CBlockIndex* pindexStart)
+void ThreadSecureMsgScanChain(void* parg)
 {
+    // -- catches the public key scan up with the chain, then exits
+    RenameThread("AveroPay-smsg-scan"); // Make this thread recognisable
+    
     printf("Scanning block chain for public keys.\n");
-    int64_t nStart = GetTimeMillis();
     
-    if (fDebugSmsg)
-        printf("From height %u.\n", pindexStart->nHeight);
+    bool fCaughtUp = false;
+    try {
+        while (fSecMsgEnabled && !fShutdown)
+        {
+            if (!SecureMsgScanChunk(fCaughtUp)
+                || fCaughtUp)
+                break;
+        };
+    } catch (std::exception& e)
+    {
+        PrintException(&e, "ThreadSecureMsgScanChain()");
+    };
+    
+    LOCK(cs_smsgDB);
+    smsgScan.fRunning = false;
+    
+    printf("Scanned %u blocks, %u transactions, %u inputs\n", smsgScan.nBlocks, smsgScan.nTransactions, smsgScan.nInputs);
+    printf("Found %u public keys, %u duplicates.\n", smsgScan.nPubkeys, smsgScan.nDuplicates);
+    printf("Took %" PRId64" ms\n", GetTimeMillis() - smsgScan.nStarted);
+    if (!smsgScan.sError.empty())
+        printf("Public key scan stopped at height %d: %s\n", smsgScan.nHeight, smsgScan.sError.c_str());
+    else
+    if (fCaughtUp)
+        printf("Public key scan caught up at height %d.\n", smsgScan.nHeight);
     
-    // -- public keys are in txin.scriptSig
-    //    matching addresses are in scriptPubKey of txin's referenced output
+    printf("ThreadSecureMsgScanChain exited.\n");
+};
+
+static bool SecureMsgStartScanThread()
+{
+    AssertLockHeld(cs_smsgDB);
+    
+    if (smsgScan.fRunning)
+        return true;
+    
+    smsgScan.fRunning = true;
+    smsgScan.nStartHeight = smsgScan.nHeight;
+    smsgScan.nStarted = GetTimeMillis();
+    smsgScan.nBlocks = smsgScan.nTransactions = smsgScan.nInputs = 0;
+    smsgScan.nPubkeys = smsgScan.nDuplicates = 0;
+    smsgScan.sError.clear();
+    
+    if (!NewThread(ThreadSecureMsgScanChain, NULL))
+    {
+        printf("Error: NewThread(ThreadSecureMsgScanChain) failed\n");
+        smsgScan.fRunning = false;
+        return false;
+    };
+    return true;
+};
+
+static void SecureMsgResumeScan()
+{
+    // -- resume a scan started in an earlier session
+    LOCK(cs_smsgDB);
+    
+    SecMsgDB addrpkdb;
+    int nHeight;
+    if (smsgScan.fRunning
+        || !addrpkdb.Open("cr+")
+        || !addrpkdb.ReadScanHeight(nHeight))
+        return;
+    
+    smsgScan.fEnabled = true;
+    smsgScan.nHeight = nHeight;
+    SecureMsgStartScanThread();
+};
+
+
+bool SecureMsgScanBlock(CBlock& block)
+{
+    /*
+    scan block for public key addresses
+    called from ProcessMessage() in main where strCommand == "block"
+    */
+    
+    if (fDebugSmsg)
+        printf("SecureMsgScanBlock().\n");
     
-    uint32_t nBlocks        = 0;
     uint32_t nTransactions  = 0;
     uint32_t nInputs        = 0;
     uint32_t nPubkeys       = 0;
     uint32_t nDuplicates    = 0;
     
+    std::vector<CPubKey> vPubKeys;
+    GetBlockPublicKeys(block, vPubKeys, nTransactions, nInputs);
+    
+    // -- height of the block if it joined the main chain
+    int nHeightBlock = -1;
     {
-        LOCK(cs_smsgDB);
+        LOCK(cs_main);
+        BlockMap::iterator mi = mapBlockIndex.find(block.GetHash());
+        if (mi != mapBlockIndex.end()
+            && chainActive.Contains(mi->second))
+            nHeightBlock = mi->second->nHeight;
+    }
     
-        CTxDB txdb("r");
+    {
+        LOCK(cs_smsgDB);
         
         SecMsgDB addrpkdb;
         if (!addrpkdb.Open("cw")
             || !addrpkdb.TxnBegin())
             return false;
         
-        CBlockIndex* pindex = pindexStart;
-        while (pindex)
-        {
-            nBlocks++;
-            CBlock block;
-            block.ReadFromDisk(pindex, true);
-            
-            ScanBlock(block, txdb, addrpkdb,
-                nTransactions, nInputs, nPubkeys, nDuplicates);
-            
-            pindex = pindex->pnext;
-        };
+        InsertPublicKeys(vPubKeys, addrpkdb, nPubkeys, nDuplicates);
         
-        addrpkdb.TxnCommit();
-    };
+        // -- keep the scan current, a block it cannot follow on from means
+        //    some were missed, the scan thread fills them in
+        bool fNext = smsgScan.fEnabled && !smsgScan.fRunning
+            && nHeightBlock == smsgScan.nHeight + 1;
+        if (fNext)
+            addrpkdb.WriteScanHeight(nHeightBlock);
+        
+        if (addrpkdb.TxnCommit() && fNext)
+            smsgScan.nHeight = nHeightBlock;
+        
+        if (smsgScan.fEnabled && !smsgScan.fRunning
+            && nHeightBlock > smsgScan.nHeight + 1)
+            SecureMsgStartScanThread();
+    }
     
-    printf("Scanned %u blocks, %u transactions, %u inputs\n", nBlocks, nTransactions, nInputs);
-    printf("Found %u public keys, %u duplicates.\n", nPubkeys, nDuplicates);
-    printf("Took %" PRId64" ms\n", GetTimeMillis() - nStart);
+    if (fDebugSmsg)
+        printf("Found %u transactions, %u inputs, %u new public keys, %u duplicates.\n", nTransactions, nInputs, nPubkeys, nDuplicates);
     
     return true;
 };
 
-bool SecureMsgScanBlockChain()
+bool SecureMsgScanBlockChain(bool fRestart)
 {
-    TRY_LOCK(cs_main, lockMain);
-    if (lockMain)
-    {
-        CBlockIndex *pindexScan = pindexGenesisBlock;
-        if (pindexScan == NULL)
-        {
-            printf("Error: pindexGenesisBlock not set.\n");
-            return false;
-        };
-        
-        
-        try { // -- in try to catch errors opening db, 
-            if (!ScanChainForPublicKeys(pindexScan))
-                return false;
-        } catch (std::exception& e)
-        {
-            printf("ScanChainForPublicKeys() threw: %s.\n", e.what());
-            return false;
-        };
-    } else
+    // -- start, or resume, the scan of the block chain in the background,
+    //    from the genesis block if fRestart
+    LOCK(cs_smsgDB);
+    
+    if (smsgScan.fRunning)
     {
-        printf("ScanChainForPublicKeys() Could not lock main.\n");
+        if (fRestart)
+            printf("SecureMsgScanBlockChain() scan is already running.\n");
+        return !fRestart;
+    };
+    
+    SecMsgDB addrpkdb;
+    if (!addrpkdb.Open("cr+"))
         return false;
+    
+    int nHeight;
+    if (fRestart
+        || !addrpkdb.ReadScanHeight(nHeight))
+    {
+        // -- record the scan before the first chunk, so it resumes even from there
+        nHeight = -1;
+        if (!addrpkdb.WriteScanHeight(nHeight))
+            return false;
     };
     
-    return true;
+    smsgScan.fEnabled = true;
+    smsgScan.nHeight = nHeight;
+    return SecureMsgStartScanThread();
+};
+
+void SecureMsgGetScanStatus(SecMsgScanStatus& status)
+{
+    LOCK(cs_smsgDB);
+    status = smsgScan;
 };
 
 bool SecureMsgScanBuckets()
@@ -3286,7 +3626,41 @@ int SecureMsgSetHash(unsigned char *pHeader, unsigned char *pPayload, uint32_t n
     return 0;
 };
 
+static int SecureMsgEncrypt(SecureMessage& smsg, std::string& addressFrom, CPubKey& cpkDestK, std::string& message);
+
 int SecureMsgEncrypt(SecureMessage& smsg, std::string& addressFrom, std::string& addressTo, std::string& message)
+{
+    if (fDebugSmsg)
+        printf("SecureMsgEncrypt(%s, %s, ...)\n", addressFrom.c_str(), addressTo.c_str());
+    
+    CBitcoinAddress coinAddrDest;
+    CKeyID ckidDest;
+    
+    if (!coinAddrDest.SetString(addressTo))
+    {
+        printf("addressTo is not valid.\n");
+        return 4;
+    };
+    
+    if (!coinAddrDest.GetKeyID(ckidDest))
+    {
+        printf("coinAddrDest.GetKeyID failed: %s.\n", coinAddrDest.ToString().c_str());
+        return 4;
+    };
+    
+    // -- public key K is the destination address
+    CPubKey cpkDestK;
+    if (SecureMsgGetStoredKey(ckidDest, cpkDestK) != 0
+        && SecureMsgGetLocalKey(ckidDest, cpkDestK) != 0) // maybe it's a local key (outbox?)
+    {
+        printf("Could not get public key for destination address.\n");
+        return 5;
+    };
+    
+    return SecureMsgEncrypt(smsg, addressFrom, cpkDestK, message);
+};
+
+static int SecureMsgEncrypt(SecureMessage& smsg, std::string& addressFrom, CPubKey& cpkDestK, std::string& message)
 {
     /* Create a secure message
         
@@ -3311,10 +3685,6 @@ int SecureMsgEncrypt(SecureMessage& smsg, std::string& addressFrom, std::string&
             11      Encrypt failed.
     */
     
-    if (fDebugSmsg)
-        printf("SecureMsgEncrypt(%s, %s, ...)\n", addressFrom.c_str(), addressTo.c_str());
-    
-    
     if (message.size() > SMSG_MAX_MSG_BYTES)
     {
         printf("Message is too long, %" PRIszu".\n", message.size());
@@ -3353,31 +3723,6 @@ int SecureMsgEncrypt(SecureMessage& smsg, std::string& addressFrom, std::string&
     };
     
     
-    CBitcoinAddress coinAddrDest;
-    CKeyID ckidDest;
-    
-    if (!coinAddrDest.SetString(addressTo))
-    {
-        printf("addressTo is not valid.\n");
-        return 4;
-    };
-    
-    if (!coinAddrDest.GetKeyID(ckidDest))
-    {
-        printf("coinAddrDest.GetKeyID failed: %s.\n", coinAddrDest.ToString().c_str());
-        return 4;
-    };
-    
-    // -- public key K is the destination address
-    CPubKey cpkDestK;
-    if (SecureMsgGetStoredKey(ckidDest, cpkDestK) != 0
-        && SecureMsgGetLocalKey(ckidDest, cpkDestK) != 0) // maybe it's a local key (outbox?)
-    {
-        printf("Could not get public key for destination address.\n");
-        return 5;
-    };
-    
-    
     // -- Generate 16 random bytes as IV.
     RandAddSeedPerfmon();
     RAND_bytes(&smsg.iv[0], 16);
@@ -3564,6 +3909,24 @@ int SecureMsgEncrypt(SecureMessage& smsg, std::string& addressFrom, std::string&
     return 0;
 };
 
+static std::string SecureMsgEncryptError(int rv)
+{
+    switch(rv)
+    {
+        case 2:  return "Message is too long.";
+        case 3:  return "Invalid addressFrom.";
+        case 4:  return "Invalid addressTo.";
+        case 5:  return "Could not get public key for addressTo.";
+        case 6:  return "ECDH_compute_key failed.";
+        case 7:  return "Could not get private key for addressFrom.";
+        case 8:  return "Could not allocate memory.";
+        case 9:  return "Could not compress message data.";
+        case 10: return "Could not generate MAC.";
+        case 11: return "Encrypt failed.";
+        default: return "Unspecified Error.";
+    };
+};
+
 int SecureMsgSend(std::string& addressFrom, std::string& addressTo, std::string& message, std::string& sError)
 {
     /* Encrypt secure message, and place it on the network
@@ -3598,22 +3961,7 @@ int SecureMsgSend(std::string& addressFrom, std::string& addressTo, std::string&
     if ((rv = SecureMsgEncrypt(smsg, addressFrom, addressTo, message)) != 0)
     {
         printf("SecureMsgSend(), encrypt for recipient failed.\n");
-        
-        switch(rv)
-        {
-            case 2:  sError = "Message is too long.";                       break;
-            case 3:  sError = "Invalid addressFrom.";                       break;
-            case 4:  sError = "Invalid addressTo.";                         break;
-            case 5:  sError = "Could not get public key for addressTo.";    break;
-            case 6:  sError = "ECDH_compute_key failed.";                   break;
-            case 7:  sError = "Could not get private key for addressFrom."; break;
-            case 8:  sError = "Could not allocate memory.";                 break;
-            case 9:  sError = "Could not compress message data.";           break;
-            case 10: sError = "Could not generate MAC.";                    break;
-            case 11: sError = "Encrypt failed.";                            break;
-            default: sError = "Unspecified Error.";                         break;
-        };
-        
+        sError = SecureMsgEncryptError(rv);
         return rv;
     };
     
@@ -3734,6 +4082,267 @@ int SecureMsgSend(std::string& addressFrom, std::string& addressTo, std::string&
 };
 
 
+static void SecureMsgStoreForSend(SecureMessage& smsg, const char* pszPrefix, std::vector<unsigned char>& vchKey, SecMsgStored& smsgStored)
+{
+    // -- key is prefix, timestamp and a sample of the payload, so it sorts fifo
+    vchKey.resize(18);
+    memcpy(&vchKey[0],  pszPrefix,       2);
+    memcpy(&vchKey[2],  &smsg.timestamp, 8);
+    memcpy(&vchKey[10], smsg.pPayload,   8);
+    
+    smsgStored.timeReceived = GetTime();
+    smsgStored.vchMessage.resize(SMSG_HDR_LEN + smsg.nPayload);
+    memcpy(&smsgStored.vchMessage[0], &smsg.hash[0], SMSG_HDR_LEN);
+    memcpy(&smsgStored.vchMessage[SMSG_HDR_LEN], smsg.pPayload, smsg.nPayload);
+};
+
+class CSecMsgBatchEncrypter
+{
+// -- shared state of the threads encrypting a batch
+public:
+    std::string sAddrFrom;
+    std::string sAddrOutbox;
+    CPubKey cpkOutbox;
+    std::vector<SecMsgBatchEntry>* pvEntries;
+    std::vector<CPubKey> vDestKeys;
+    
+    std::vector<std::vector<unsigned char> > vQueueKeys;
+    std::vector<SecMsgStored> vQueued;
+    std::vector<std::vector<unsigned char> > vOutboxKeys;
+    std::vector<SecMsgStored> vOutbox;
+    
+    boost::atomic<size_t> nNext;
+    
+    void Run()
+    {
+        size_t n;
+        while ((n = nNext++) < pvEntries->size())
+        {
+            SecMsgBatchEntry& entry = (*pvEntries)[n];
+            if (entry.nResult != 0)
+                continue;
+            
+            try {
+                SecureMessage smsg;
+                if ((entry.nResult = SecureMsgEncrypt(smsg, sAddrFrom, vDestKeys[n], entry.sMessage)) != 0)
+                {
+                    entry.sError = SecureMsgEncryptError(entry.nResult);
+                    continue;
+                };
+                SecureMsgStoreForSend(smsg, "qm", vQueueKeys[n], vQueued[n]);
+                vQueued[n].sAddrTo = entry.sAddrTo;
+                
+                if (!cpkOutbox.IsValid())
+                    continue;
+                
+                SecureMessage smsgForOutbox;
+                int rv;
+                if ((rv = SecureMsgEncrypt(smsgForOutbox, sAddrFrom, cpkOutbox, entry.sMessage)) != 0)
+                {
+                    printf("SecureMsgSendBatch(), encrypt for outbox failed, %d.\n", rv);
+                    continue;
+                };
+                SecureMsgStoreForSend(smsgForOutbox, "nm", vOutboxKeys[n], vOutbox[n]);
+                vOutbox[n].sAddrTo = entry.sAddrTo;
+                vOutbox[n].sAddrOutbox = sAddrOutbox;
+            } catch (std::exception& e) {
+                printf("SecureMsgSendBatch(), encrypt threw: %s.\n", e.what());
+                entry.nResult = 8;
+                entry.sError = SecureMsgEncryptError(entry.nResult);
+            };
+        };
+    };
+};
+
+int SecureMsgSendBatch(std::string& addressFrom, std::vector<SecMsgBatchEntry>& vEntries, std::string& sError)
+{
+    /* Encrypt many messages from one address and place them on the network
+        Recipient public keys are read in one pass over the key db, the messages are encrypted
+        on several threads and written to the send queue and outbox in one db batch, then
+        handed to the proof of work threads directly.
+        
+        returns 0 when the batch was processed, the result of each message is in its entry
+    */
+    
+    if (fDebugSmsg)
+        printf("SecureMsgSendBatch(%s, %" PRIszu" messages)\n", addressFrom.c_str(), vEntries.size());
+    
+    if (pwalletMain->IsLocked())
+    {
+        sError = "Wallet is locked, wallet must be unlocked to send and recieve messages.";
+        return 1;
+    };
+    
+    CSecMsgBatchEncrypter batch;
+    batch.sAddrFrom = addressFrom;
+    batch.pvEntries = &vEntries;
+    batch.vDestKeys.resize(vEntries.size());
+    batch.vQueueKeys.resize(vEntries.size());
+    batch.vQueued.resize(vEntries.size());
+    batch.vOutboxKeys.resize(vEntries.size());
+    batch.vOutbox.resize(vEntries.size());
+    batch.nNext = 0;
+    
+    // -- destination key ids, looked up once each in key order
+    std::vector<CKeyID> vDestIds(vEntries.size());
+    std::map<CKeyID, CPubKey> mapDestKeys;
+    for (size_t i = 0; i < vEntries.size(); ++i)
+    {
+        SecMsgBatchEntry& entry = vEntries[i];
+        entry.nResult = 0;
+        entry.sError.clear();
+        
+        CBitcoinAddress coinAddrDest;
+        if (entry.sMessage.size() > SMSG_MAX_MSG_BYTES)
+            entry.nResult = 2;
+        else
+        if (!coinAddrDest.SetString(entry.sAddrTo)
+            || !coinAddrDest.GetKeyID(vDestIds[i]))
+            entry.nResult = 4;
+        else
+            mapDestKeys[vDestIds[i]] = CPubKey();
+        
+        if (entry.nResult != 0)
+            entry.sError = SecureMsgEncryptError(entry.nResult);
+    };
+    
+    {
+        LOCK(cs_smsgDB);
+        SecMsgDB addrpkdb;
+        if (!addrpkdb.Open("r"))
+        {
+            sError = "Could not open the public key db.";
+            return 1;
+        };
+        
+        std::map<CKeyID, CPubKey>::iterator it;
+        for (it = mapDestKeys.begin(); it != mapDestKeys.end(); ++it)
+        {
+            CKeyID ckid = it->first;
+            if (!addrpkdb.ReadPK(ckid, it->second))
+                it->second = CPubKey();
+        };
+    }
+    
+    for (size_t i = 0; i < vEntries.size(); ++i)
+    {
+        if (vEntries[i].nResult != 0)
+            continue;
+        
+        CPubKey& cpkDest = mapDestKeys[vDestIds[i]];
+        if (!cpkDest.IsValid()
+            && SecureMsgGetLocalKey(vDestIds[i], cpkDest) != 0) // maybe it's a local key
+        {
+            vEntries[i].nResult = 5;
+            vEntries[i].sError = SecureMsgEncryptError(5);
+            continue;
+        };
+        batch.vDestKeys[i] = cpkDest;
+    };
+    
+    // -- copies for the outbox are encrypted for the first owned address
+    {
+        LOCK(pwalletMain->cs_wallet);
+        BOOST_FOREACH(const PAIRTYPE(CTxDestination, std::string)& entry, pwalletMain->mapAddressBook)
+        {
+            if (!IsMine(*pwalletMain, entry.first))
+                continue;
+            
+            CBitcoinAddress address(entry.first);
+            CKeyID ckidOutbox;
+            if (!address.GetKeyID(ckidOutbox)
+                || SecureMsgGetLocalKey(ckidOutbox, batch.cpkOutbox) != 0)
+                continue;
+            batch.sAddrOutbox = address.ToString();
+            break;
+        };
+    }
+    if (batch.sAddrOutbox.empty())
+        printf("Warning: SecureMsgSendBatch() could not find an address to encrypt outbox messages with.\n");
+    
+    // -- encrypt
+    size_t nThreads = std::max(1u, boost::thread::hardware_concurrency());
+    nThreads = std::min(nThreads, vEntries.size());
+    if (nThreads <= 1)
+    {
+        batch.Run();
+    } else
+    {
+        boost::thread_group threads;
+        for (size_t i = 0; i < nThreads; ++i)
+            threads.create_thread(boost::bind(&CSecMsgBatchEncrypter::Run, &batch));
+        threads.join_all();
+    };
+    
+    // -- write the send queue and outbox entries in one batch, reserving the
+    //    send queue keys first so the db scan of the pow thread leaves them alone
+    std::vector<size_t> vSent;
+    for (size_t i = 0; i < vEntries.size(); ++i)
+        if (vEntries[i].nResult == 0)
+            vSent.push_back(i);
+    
+    if (vSent.empty())
+        return 0;
+    
+    {
+        boost::unique_lock<boost::mutex> lock(mutexPowQueue);
+        BOOST_FOREACH(size_t i, vSent)
+            setPowQueued.insert(batch.vQueueKeys[i]);
+    }
+    
+    bool fWritten = false;
+    {
+        LOCK(cs_smsgDB);
+        SecMsgDB db;
+        if (db.Open("cw") && db.TxnBegin())
+        {
+            BOOST_FOREACH(size_t i, vSent)
+            {
+                db.WriteSmesg(&batch.vQueueKeys[i][0], batch.vQueued[i]);
+                if (!batch.vOutboxKeys[i].empty())
+                    db.WriteSmesg(&batch.vOutboxKeys[i][0], batch.vOutbox[i]);
+            };
+            fWritten = db.TxnCommit();
+        };
+        
+        if (fWritten)
+        {
+            BOOST_FOREACH(size_t i, vSent)
+                if (!batch.vOutboxKeys[i].empty())
+                    NotifySecMsgOutboxChanged(batch.vOutbox[i]);
+        };
+    }
+    
+    {
+        boost::unique_lock<boost::mutex> lock(mutexPowQueue);
+        BOOST_FOREACH(size_t i, vSent)
+        {
+            if (fWritten)
+                queuePow.push_back(std::make_pair(batch.vQueueKeys[i], batch.vQueued[i]));
+            else
+                setPowQueued.erase(batch.vQueueKeys[i]);
+        };
+    }
+    condPowQueue.notify_all();
+    
+    if (!fWritten)
+    {
+        BOOST_FOREACH(size_t i, vSent)
+        {
+            vEntries[i].nResult = 1;
+            vEntries[i].sError = "Could not write to the send queue.";
+        };
+        sError = "Could not write to the send queue.";
+        return 1;
+    };
+    
+    if (fDebugSmsg)
+        printf("SecureMsgSendBatch(), %" PRIszu" messages queued for sending.\n", vSent.size());
+    
+    return 0;
+};
+
+
 int SecureMsgDecrypt(bool fTestOnly, std::string& address, unsigned char *pHeader, unsigned char *pPayload, uint32_t nPayload, MessageData& msg)
 {
     /* Decrypt secure message
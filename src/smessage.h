@@ -9,6 +9,7 @@
 
 #include "net.h"
 #include "db.h"
+#include "indexedbatch.h"
 #include "wallet.h"
 #include "lz4/lz4.h"
 
@@ -155,7 +156,7 @@ public:
     
     int64_t                     timeChanged;
     uint32_t                    hash;           // token set should get ordered the same on each node
-    uint32_t                    nLockCount;     // set when smsgWant first sent, unset at end of smsgMsg, ticks down in ThreadSecureMsg()
+    uint32_t                    nLockCount;     // set when smsgWant first sent, unset at end of smsgMsg, ticks down in SecureMsgManageBuckets()
     uint32_t                    nLockPeerId;    // id of peer that bucket is locked for
     std::set<SecMsgToken>       setTokens;
     
@@ -277,6 +278,40 @@ public:
     );
 };
 
+class SecMsgBatchEntry
+{
+// -- one message of SecureMsgSendBatch
+public:
+    SecMsgBatchEntry() : nResult(0) {};
+    SecMsgBatchEntry(const std::string& sAddrToIn, const std::string& sMessageIn)
+        : sAddrTo(sAddrToIn), sMessage(sMessageIn), nResult(0) {};
+    
+    std::string     sAddrTo;
+    std::string     sMessage;
+    int             nResult;        // 0 queued, else a SecureMsgEncrypt error code
+    std::string     sError;
+};
+
+class SecMsgScanStatus
+{
+// -- progress of the public key scan of the block chain
+public:
+    SecMsgScanStatus() : fEnabled(false), fRunning(false), nHeight(-1), nStartHeight(-1),
+        nStarted(0), nBlocks(0), nTransactions(0), nInputs(0), nPubkeys(0), nDuplicates(0) {};
+    
+    bool            fEnabled;       // a scan was started, blocks received are harvested in order
+    bool            fRunning;       // the scan thread is catching up
+    int             nHeight;        // last height harvested, -1 before the first block
+    int             nStartHeight;   // height the current pass resumed from
+    int64_t         nStarted;       // GetTimeMillis() when the current pass started
+    uint32_t        nBlocks;
+    uint32_t        nTransactions;
+    uint32_t        nInputs;
+    uint32_t        nPubkeys;
+    uint32_t        nDuplicates;
+    std::string     sError;
+};
+
 class SecMsgDB
 {
 public:
@@ -305,6 +340,9 @@ public:
     bool WritePK(CKeyID& addr, CPubKey& pubkey);
     bool ExistsPK(CKeyID& addr);
     
+    bool ReadScanHeight(int& nHeight);
+    bool WriteScanHeight(int nHeight);
+    
     bool NextSmesg(leveldb::Iterator* it, std::string& prefix, unsigned char* vchKey, SecMsgStored& smsgStored);
     bool NextSmesgKey(leveldb::Iterator* it, std::string& prefix, unsigned char* vchKey);
     bool ReadSmesg(unsigned char* chKey, SecMsgStored& smsgStored);
@@ -313,7 +351,7 @@ public:
     bool EraseSmesg(unsigned char* chKey);
     
     leveldb::DB *pdb;       // points to the global instance
-    leveldb::WriteBatch *activeBatch;
+    CIndexedWriteBatch *activeBatch;
     
 };
 
@@ -330,6 +368,10 @@ int SecureMsgWriteIni();
 bool SecureMsgStart(bool fDontStart, bool fScanChain);
 bool SecureMsgShutdown();
 
+// Estimated memory of the bucket token sets, and the most the message db's caches use
+size_t SecureMsgMemoryUsage();
+size_t SecureMsgDBCacheSize();
+
 bool SecureMsgEnable();
 bool SecureMsgDisable();
 
@@ -338,8 +380,8 @@ bool SecureMsgSendData(CNode* pto, bool fSendTrickle);
 
 
 bool SecureMsgScanBlock(CBlock& block);
-bool ScanChainForPublicKeys(CBlockIndex* pindexStart);
-bool SecureMsgScanBlockChain();
+bool SecureMsgScanBlockChain(bool fRestart=false);
+void SecureMsgGetScanStatus(SecMsgScanStatus& status);
 bool SecureMsgScanBuckets();
 
 
@@ -365,6 +407,7 @@ int SecureMsgStore(SecureMessage& smsg, bool fUpdateBucket);
 
 
 int SecureMsgSend(std::string& addressFrom, std::string& addressTo, std::string& message, std::string& sError);
+int SecureMsgSendBatch(std::string& addressFrom, std::vector<SecMsgBatchEntry>& vEntries, std::string& sError);
 
 int SecureMsgValidate(unsigned char *pHeader, unsigned char *pPayload, uint32_t nPayload);
 int SecureMsgSetHash(unsigned char *pHeader, unsigned char *pPayload, uint32_t nPayload);
@@ -20,7 +20,7 @@ using namespace boost;
 class CSporkMessage;
 class CSporkManager;
 
-std::map<uint256, CSporkMessage> mapSporks;
+boost::unordered_map<uint256, CSporkMessage, CSaltedHasher> mapSporks;
 std::map<int, CSporkMessage> mapSporksActive;
 CSporkManager sporkManager;
 
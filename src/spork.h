@@ -44,7 +44,7 @@ class CSporkManager;
 using namespace std;
 using namespace boost;
 
-extern std::map<uint256, CSporkMessage> mapSporks;
+extern boost::unordered_map<uint256, CSporkMessage, CSaltedHasher> mapSporks;
 extern std::map<int, CSporkMessage> mapSporksActive;
 extern CSporkManager sporkManager;
 
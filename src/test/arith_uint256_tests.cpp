@@ -0,0 +1,211 @@
+#include <boost/test/unit_test.hpp>
+
+#include "arith_uint256.h"
+#include "bignum.h"
+#include "main.h"
+#include "util.h"
+
+using namespace std;
+
+// nBits of the chain limits (main and proof-of-stake, testnet, regtest) and a
+// sample of Bitcoin's difficulty history down to today's targets
+static const uint32_t nHistoricalBits[] = {
+    0x1e0fffff, 0x1f00ffff, 0x207fffff,
+    0x1d00ffff, 0x1c3fffc0, 0x1b0404cb, 0x1a05db8b, 0x1903a30c, 0x1806b99f,
+    0x1715a35c, 0x17034219, 0x1d00d86a, 0x1c05a3f4, 0x1b00dc31, 0x1a0ffff0,
+};
+
+static uint256 RandomTarget(unsigned int nBits)
+{
+    uint256 n = GetRandHash();
+    return nBits ? n >> (256 - nBits) : 0;
+}
+
+// The CBigNum code the consensus paths ran before
+static unsigned int ComputeMaxBitsBigNum(const CBigNum& bnTargetLimit, unsigned int nBase, int64_t nTime)
+{
+    CBigNum bnResult;
+    bnResult.SetCompact(nBase);
+    bnResult *= 2;
+    while (nTime > 0 && bnResult < bnTargetLimit)
+    {
+        bnResult *= 2;
+        nTime -= 24 * 60 * 60;
+    }
+    if (bnResult > bnTargetLimit)
+        bnResult = bnTargetLimit;
+    return bnResult.GetCompact();
+}
+
+static unsigned int RetargetBigNum(const CBigNum& bnTargetLimit, unsigned int nBits, int64_t nActualSpacing)
+{
+    if (nActualSpacing < 0)
+        nActualSpacing = nTargetSpacing;
+    CBigNum bnNew;
+    bnNew.SetCompact(nBits);
+    int64_t nInterval = 120 / nTargetSpacing;
+    bnNew *= ((nInterval - 1) * nTargetSpacing + nActualSpacing + nActualSpacing);
+    bnNew /= ((nInterval + 1) * nTargetSpacing);
+    if (bnNew <= 0 || bnNew > bnTargetLimit)
+        bnNew = bnTargetLimit;
+    return bnNew.GetCompact();
+}
+
+static uint256 BlockTrustBigNum(unsigned int nBits)
+{
+    CBigNum bnTarget;
+    bnTarget.SetCompact(nBits);
+    if (bnTarget <= 0)
+        return 0;
+    return ((CBigNum(1)<<256) / (bnTarget+1)).getuint256();
+}
+
+static bool CheckProofOfWorkBigNum(const CBigNum& bnLimit, const uint256& hash, unsigned int nBits)
+{
+    CBigNum bnTarget;
+    bnTarget.SetCompact(nBits);
+    if (bnTarget <= 0 || bnTarget > bnLimit)
+        return false;
+    return hash <= bnTarget.getuint256();
+}
+
+// Every exponent with the mantissa edges and random mantissas, plus the history
+static void GetTestBits(vector<uint32_t>& vBits)
+{
+    static const uint32_t nMantissas[] = {0, 1, 0x7f, 0x80, 0xff, 0x100, 0x7fff, 0x8000, 0xffff,
+                                          0x10000, 0x7fffff, 0x800000, 0x800001, 0x80ffff, 0xffffff};
+    for (uint32_t nSize = 0; nSize <= 0x24; nSize++)
+    {
+        for (unsigned int i = 0; i < sizeof(nMantissas) / sizeof(nMantissas[0]); i++)
+            vBits.push_back(nSize << 24 | nMantissas[i]);
+        for (int i = 0; i < 200; i++)
+            vBits.push_back(nSize << 24 | (GetRandInt(0x1000000) & 0xffffff));
+    }
+    vBits.push_back(0xff123456);
+    vBits.insert(vBits.end(), nHistoricalBits, nHistoricalBits + sizeof(nHistoricalBits) / sizeof(nHistoricalBits[0]));
+}
+
+BOOST_AUTO_TEST_SUITE(arith_uint256_tests)
+
+BOOST_AUTO_TEST_CASE(arith_uint256_operators)
+{
+    for (int i = 0; i < 1000; i++)
+    {
+        uint256 a = RandomTarget(GetRandInt(257)), b = RandomTarget(GetRandInt(257));
+        unsigned int nShift = GetRandInt(300);
+        arith_uint256 x = UintToArith256(a), y = UintToArith256(b);
+        CBigNum bnA(a), bnB(b);
+
+        BOOST_CHECK(ArithToUint256(x) == a);
+        BOOST_CHECK(ArithToUint256(x + y) == (bnA + bnB).getuint256());
+        BOOST_CHECK(ArithToUint256(x * y) == (bnA * bnB).getuint256());
+        BOOST_CHECK(ArithToUint256(x * (uint32_t)nShift) == (bnA * CBigNum(nShift)).getuint256());
+        BOOST_CHECK(ArithToUint256(x << nShift) == (bnA << nShift).getuint256());
+        BOOST_CHECK(ArithToUint256(x >> nShift) == (bnA >> nShift).getuint256());
+        BOOST_CHECK_EQUAL(x < y, bnA < bnB);
+        if (b != 0)
+            BOOST_CHECK(ArithToUint256(x / y) == (bnA / bnB).getuint256());
+        if (bnA >= bnB)
+            BOOST_CHECK(ArithToUint256(x - y) == (bnA - bnB).getuint256());
+    }
+
+    BOOST_CHECK_THROW(arith_uint256(1) / arith_uint256(0), arith_uint256_error);
+    BOOST_CHECK(ArithToUint256(~arith_uint256(0) >> 20) == ~uint256(0) >> 20);
+    BOOST_CHECK_EQUAL((~arith_uint256(0)).bits(), 256U);
+    BOOST_CHECK_EQUAL(arith_uint256(0x100).bits(), 9U);
+}
+
+BOOST_AUTO_TEST_CASE(arith_uint256_compact)
+{
+    vector<uint32_t> vBits;
+    GetTestBits(vBits);
+    CBigNum bnMax(~uint256(0));
+    BOOST_FOREACH(uint32_t nBits, vBits)
+    {
+        CBigNum bn;
+        bn.SetCompact(nBits);
+        bool fNegative, fOverflow;
+        arith_uint256 x;
+        x.SetCompact(nBits, &fNegative, &fOverflow);
+
+        BOOST_CHECK_EQUAL(fNegative, bn < 0);
+        CBigNum bnAbs = fNegative ? CBigNum(0) - bn : bn;
+        BOOST_CHECK_EQUAL(fOverflow, bnAbs > bnMax);
+        if (fOverflow)
+            continue;
+        BOOST_CHECK(ArithToUint256(x) == bnAbs.getuint256());
+        BOOST_CHECK_EQUAL(x.GetCompact(fNegative), bn.GetCompact());
+    }
+
+    // the encoding of the limits
+    BOOST_CHECK_EQUAL((~arith_uint256(0) >> 20).GetCompact(), 0x1e0fffffU);
+    BOOST_CHECK_EQUAL((~arith_uint256(0) >> 16).GetCompact(), 0x1f00ffffU);
+    BOOST_CHECK_EQUAL((~arith_uint256(0) >> 1).GetCompact(), 0x207fffffU);
+}
+
+BOOST_AUTO_TEST_CASE(arith_uint256_consensus_paths)
+{
+    unsigned int nLimitBits = GetNextTargetRequired(NULL, false);
+    CBigNum bnLimit;
+    bnLimit.SetCompact(nLimitBits);
+
+    vector<uint32_t> vBits;
+    GetTestBits(vBits);
+    static const int64_t nSpacings[] = {-5, 0, 1, 30, 60, 61, 600, 86400, 1 << 30};
+    static const int64_t nTimes[] = {0, 1, 24 * 60 * 60, 3 * 24 * 60 * 60, 40 * 24 * 60 * 60};
+    BOOST_FOREACH(uint32_t nBits, vBits)
+    {
+        CBlockIndex index;
+        index.nBits = nBits;
+        BOOST_CHECK(index.GetBlockTrust() == BlockTrustBigNum(nBits));
+
+        CBigNum bnTarget;
+        bnTarget.SetCompact(nBits);
+        uint256 target = bnTarget.getuint256();
+        BOOST_CHECK_EQUAL(CheckProofOfWork(0, nBits), CheckProofOfWorkBigNum(bnLimit, 0, nBits));
+        BOOST_CHECK_EQUAL(CheckProofOfWork(target, nBits), CheckProofOfWorkBigNum(bnLimit, target, nBits));
+        BOOST_CHECK_EQUAL(CheckProofOfWork(target + 1, nBits), CheckProofOfWorkBigNum(bnLimit, target + 1, nBits));
+
+        // ComputeMinWork and the retarget take the nBits of accepted blocks
+        if (bnTarget <= 0 || bnTarget > bnLimit)
+            continue;
+        for (unsigned int i = 0; i < sizeof(nTimes) / sizeof(nTimes[0]); i++)
+            BOOST_CHECK_EQUAL(ComputeMinWork(nBits, nTimes[i]), ComputeMaxBitsBigNum(bnLimit, nBits, nTimes[i]));
+
+        CBlockIndex index0, index1, index2;
+        index1.pprev = &index0;
+        index2.pprev = &index1;
+        index1.nTime = 1500000000;
+        index2.nBits = nBits;
+        for (unsigned int i = 0; i < sizeof(nSpacings) / sizeof(nSpacings[0]); i++)
+        {
+            index2.nTime = index1.nTime + nSpacings[i];
+            BOOST_CHECK_EQUAL(GetNextTargetRequired(&index2, false), RetargetBigNum(bnLimit, nBits, nSpacings[i]));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(arith_uint256_trust_benchmark)
+{
+    static const int nRounds = 100000;
+    uint256 trust, trustBigNum;
+    int64_t nStart = GetTimeMicros();
+    for (int i = 0; i < nRounds; i++)
+    {
+        CBlockIndex index;
+        index.nBits = nHistoricalBits[i % (sizeof(nHistoricalBits) / sizeof(nHistoricalBits[0]))];
+        trust += index.GetBlockTrust();
+    }
+    int64_t nArith = GetTimeMicros() - nStart;
+
+    nStart = GetTimeMicros();
+    for (int i = 0; i < nRounds; i++)
+        trustBigNum += BlockTrustBigNum(nHistoricalBits[i % (sizeof(nHistoricalBits) / sizeof(nHistoricalBits[0]))]);
+    int64_t nBigNum = GetTimeMicros() - nStart;
+
+    BOOST_CHECK(trust == trustBigNum);
+    BOOST_TEST_MESSAGE(strprintf("block trust of %d headers: arith_uint256 %" PRId64" us, CBigNum %" PRId64" us",
+                                 nRounds, nArith, nBigNum));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
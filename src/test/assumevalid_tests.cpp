@@ -0,0 +1,141 @@
+//
+// Unit tests for -assumevalid script skipping
+//
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+
+#include "../checkpoints.h"
+#include "../main.h"
+#include "../script.h"
+#include "../txdb.h"
+#include "../wallet.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(assumevalid_tests)
+
+// Adds a block index entry on top of pprev, with a made up hash
+static CBlockIndex* AddBlockIndex(CBlockIndex* pprev, unsigned int nSalt)
+{
+    CBlockIndex* pindex = new CBlockIndex();
+    pindex->pprev = pprev;
+    pindex->nHeight = pprev ? pprev->nHeight + 1 : 0;
+    uint256 hash = uint256(nSalt) << 32;
+    hash |= (uint64_t)pindex->nHeight;
+    BlockMap::iterator mi = mapBlockIndex.insert(make_pair(hash, pindex)).first;
+    pindex->phashBlock = &((*mi).first);
+    return pindex;
+}
+
+static void RemoveBlockIndex(vector<CBlockIndex*>& vBlocks)
+{
+    BOOST_FOREACH(CBlockIndex* pindex, vBlocks)
+    {
+        mapBlockIndex.erase(pindex->GetBlockHash());
+        delete pindex;
+    }
+    vBlocks.clear();
+}
+
+BOOST_AUTO_TEST_CASE(assumevalid_ancestors)
+{
+    LOCK(cs_main);
+    uint256 hashSave = Checkpoints::hashAssumeValid;
+
+    // main chain of 10 blocks and a fork off it at height 4
+    vector<CBlockIndex*> vMain, vFork;
+    vMain.push_back(AddBlockIndex(NULL, 1));
+    for (int i = 1; i < 10; i++)
+        vMain.push_back(AddBlockIndex(vMain.back(), 1));
+    vFork.push_back(AddBlockIndex(vMain[4], 2));
+    for (int i = 1; i < 4; i++)
+        vFork.push_back(AddBlockIndex(vFork.back(), 2));
+
+    Checkpoints::hashAssumeValid = vMain[7]->GetBlockHash();
+    for (int i = 0; i <= 7; i++)
+        BOOST_CHECK(Checkpoints::IsAssumedValid(vMain[i]));
+    // blocks above the assumed one are fully checked
+    BOOST_CHECK(!Checkpoints::IsAssumedValid(vMain[8]));
+    BOOST_CHECK(!Checkpoints::IsAssumedValid(vMain[9]));
+    // so are blocks that are not its ancestors, even at lower heights
+    BOOST_FOREACH(CBlockIndex* pindex, vFork)
+        BOOST_CHECK(!Checkpoints::IsAssumedValid(pindex));
+
+    // switching to a block on the fork
+    Checkpoints::hashAssumeValid = vFork[1]->GetBlockHash();
+    BOOST_CHECK(Checkpoints::IsAssumedValid(vMain[4]));
+    BOOST_CHECK(Checkpoints::IsAssumedValid(vFork[1]));
+    BOOST_CHECK(!Checkpoints::IsAssumedValid(vMain[5]));
+    BOOST_CHECK(!Checkpoints::IsAssumedValid(vFork[2]));
+
+    // an unknown block that is not a checkpoint covers nothing, 0 turns it off
+    Checkpoints::hashAssumeValid = uint256(12345);
+    BOOST_CHECK(!Checkpoints::IsAssumedValid(vMain[1]));
+    Checkpoints::hashAssumeValid = 0;
+    BOOST_CHECK(!Checkpoints::IsAssumedValid(vMain[1]));
+
+    RemoveBlockIndex(vFork);
+    RemoveBlockIndex(vMain);
+    Checkpoints::hashAssumeValid = hashSave;
+}
+
+BOOST_AUTO_TEST_CASE(assumevalid_rejects_bad_signature_above)
+{
+    LOCK(cs_main);
+    uint256 hashSave = Checkpoints::hashAssumeValid;
+
+    vector<CBlockIndex*> vMain;
+    vMain.push_back(AddBlockIndex(NULL, 3));
+    for (int i = 1; i < 6; i++)
+        vMain.push_back(AddBlockIndex(vMain.back(), 3));
+    Checkpoints::hashAssumeValid = vMain[3]->GetBlockHash();
+
+    CBasicKeyStore keystore;
+    CKey key;
+    key.MakeNewKey(true);
+    keystore.AddKey(key);
+
+    CTransaction txFrom;
+    txFrom.vout.resize(1);
+    txFrom.vout[0].scriptPubKey << key.GetPubKey() << OP_CHECKSIG;
+    txFrom.vout[0].nValue = COIN;
+
+    CTransaction txTo;
+    txTo.nTime = txFrom.nTime;
+    txTo.vin.resize(1);
+    txTo.vout.resize(1);
+    txTo.vin[0].prevout.n = 0;
+    txTo.vin[0].prevout.hash = txFrom.GetHash();
+    txTo.vout[0].nValue = COIN / 2;
+    BOOST_CHECK(SignSignature(keystore, txFrom, txTo, 0));
+
+    CTxDB txdb("r");
+    MapPrevTx mapInputs;
+    mapInputs[txFrom.GetHash()] = make_pair(CTxIndex(CDiskTxPos(1,1,1), txFrom.vout.size()), txFrom);
+    map<uint256, CTxIndex> mapQueuedChanges;
+
+    // well signed, it connects above the assumed block too
+    BOOST_CHECK(txTo.ConnectInputs(txdb, mapInputs, mapQueuedChanges, CDiskTxPos(1,1,2), vMain[4], true, false,
+                                   STANDARD_SCRIPT_VERIFY_FLAGS, !Checkpoints::IsAssumedValid(vMain[4])));
+
+    // Corrupt the signature
+    CScript scriptSigBad = txTo.vin[0].scriptSig;
+    scriptSigBad[10] ^= 0x01;
+    txTo.vin[0].scriptSig = scriptSigBad;
+
+    // ConnectBlock only skips the check at or below the assumed block; above
+    // it the signature is verified, and fails
+    for (int i = 0; i < 6; i++)
+    {
+        bool fScriptChecks = !Checkpoints::IsAssumedValid(vMain[i]);
+        mapQueuedChanges.clear();
+        bool fConnected = txTo.ConnectInputs(txdb, mapInputs, mapQueuedChanges, CDiskTxPos(1,1,2), vMain[i], true, false,
+                                             STANDARD_SCRIPT_VERIFY_FLAGS, fScriptChecks);
+        BOOST_CHECK_EQUAL(fConnected, i <= 3);
+    }
+
+    RemoveBlockIndex(vMain);
+    Checkpoints::hashAssumeValid = hashSave;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
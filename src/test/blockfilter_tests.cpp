@@ -0,0 +1,94 @@
+#include <boost/test/unit_test.hpp>
+
+#include "blockfilter.h"
+#include "main.h"
+#include "util.h"
+
+using namespace std;
+
+BOOST_AUTO_TEST_SUITE(blockfilter_tests)
+
+// Block 0 of the BIP 158 test vectors (Bitcoin testnet genesis)
+BOOST_AUTO_TEST_CASE(blockfilter_bip158_vector)
+{
+    uint256 hashBlock("000000000933ea01ad0ee984209779baaec3ced90fa3f408719526f8d77f4943");
+    CBlockFilter::ElementSet setElements;
+    setElements.insert(ParseHex("4104678afdb0fe5548271967f1a67130b7105cd6a828e03909a67962e0ea1f61deb649f6bc3f4cef38c4f35504e51ec112de5c384df7ba0b8d578a4c702b6bf11d5fac"));
+
+    CBlockFilter filter(hashBlock, setElements);
+    BOOST_CHECK_EQUAL(HexStr(filter.GetEncoded()), "019dfca8");
+    BOOST_CHECK_EQUAL(filter.ComputeHeader(0).GetHex(), "21584579b7eb08997773e5aeff3a7f932700042d0ed2a6129012b7d7ae81b750");
+
+    // decoding what was encoded
+    CBlockFilter filter2(hashBlock, filter.GetEncoded());
+    BOOST_CHECK_EQUAL(filter2.GetElementCount(), 1U);
+    BOOST_CHECK(filter2.GetHash() == filter.GetHash());
+    BOOST_CHECK(filter2.MatchAny(setElements));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_match)
+{
+    uint256 hashBlock("6f1ba7b2c6c8d2b8d3a1ea1e0d0f4c5a3e2b7a9a0c3d1e8f5b4a6c7d8e9f0a1b");
+    CBlockFilter::ElementSet setIncluded, setExcluded;
+    for (int i = 0; i < 100; i++)
+    {
+        CBlockFilter::Element element(32, (unsigned char)i);
+        element[0] = 1;
+        setIncluded.insert(element);
+        element[0] = 2;
+        setExcluded.insert(element);
+    }
+
+    CBlockFilter filter(hashBlock, setIncluded);
+    BOOST_CHECK_EQUAL(filter.GetElementCount(), 100U);
+    BOOST_FOREACH(const CBlockFilter::Element& element, setIncluded)
+        BOOST_CHECK(filter.Match(element));
+
+    // false positives happen about once in M
+    int nFalsePositives = 0;
+    BOOST_FOREACH(const CBlockFilter::Element& element, setExcluded)
+        if (filter.Match(element))
+            nFalsePositives++;
+    BOOST_CHECK(nFalsePositives <= 1);
+
+    CBlockFilter::ElementSet setQuery;
+    setQuery.insert(*setExcluded.begin());
+    setQuery.insert(*setIncluded.rbegin());
+    BOOST_CHECK(filter.MatchAny(setQuery));
+
+    // an empty filter matches nothing
+    CBlockFilter filterEmpty(hashBlock, CBlockFilter::ElementSet());
+    BOOST_CHECK_EQUAL(HexStr(filterEmpty.GetEncoded()), "00");
+    BOOST_CHECK(!filterEmpty.MatchAny(setIncluded));
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_basic_elements)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CScript scriptPay = GetScriptForDestination(key.GetPubKey().GetID());
+    CScript scriptSpent;
+    scriptSpent << key.GetPubKey() << OP_CHECKSIG;
+    CScript scriptData;
+    scriptData << OP_RETURN << vector<unsigned char>(8, 0x42);
+
+    CBlock block;
+    CTransaction tx;
+    tx.vout.resize(3);
+    tx.vout[0].scriptPubKey = scriptPay;
+    tx.vout[1].scriptPubKey = scriptData;
+    // vout[2] stays empty, like the first output of a coinstake
+    block.vtx.push_back(tx);
+
+    vector<CScript> vSpent;
+    vSpent.push_back(scriptSpent);
+    vSpent.push_back(CScript());
+
+    CBlockFilter::ElementSet setElements;
+    CBlockFilter::GetBasicElements(block, vSpent, setElements);
+    BOOST_CHECK_EQUAL(setElements.size(), 2U);
+    BOOST_CHECK(setElements.count(CBlockFilter::Element(scriptPay.begin(), scriptPay.end())));
+    BOOST_CHECK(setElements.count(CBlockFilter::Element(scriptSpent.begin(), scriptSpent.end())));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,237 @@
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+#include "bloom.h"
+#include "util.h"
+#include "key.h"
+#include "main.h"
+#include "serialize.h"
+
+using namespace std;
+
+// A transaction spending prevout, paying to a pubkey and to the hash of another
+static CTransaction MakeTx(const COutPoint& prevout, const CKey& keySpend, const CKey& keyPubKey, const CKey& keyHash)
+{
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    // not a valid signature, only the pushed data matters here
+    tx.vin[0].scriptSig << vector<unsigned char>(72, 0x30) << keySpend.GetPubKey();
+    tx.vout.resize(2);
+    tx.vout[0].nValue = 10 * COIN;
+    tx.vout[0].scriptPubKey << keyPubKey.GetPubKey() << OP_CHECKSIG;
+    tx.vout[1].nValue = 5 * COIN;
+    tx.vout[1].scriptPubKey.SetDestination(keyHash.GetPubKey().GetID());
+    return tx;
+}
+
+static vector<unsigned char> ToVector(const CPubKey& pubkey)
+{
+    return vector<unsigned char>(pubkey.begin(), pubkey.end());
+}
+
+static vector<unsigned char> ToVector(const CKeyID& keyID)
+{
+    return vector<unsigned char>(keyID.begin(), keyID.end());
+}
+
+BOOST_AUTO_TEST_SUITE(bloom_tests)
+
+BOOST_AUTO_TEST_CASE(bloom_create_insert_serialize)
+{
+    CBloomFilter filter(3, 0.01, 0, BLOOM_UPDATE_ALL);
+
+    filter.insert(ParseHex("99108ad8ed9bb6274d3980bab5a85c048f0950c8"));
+    BOOST_CHECK_MESSAGE( filter.contains(ParseHex("99108ad8ed9bb6274d3980bab5a85c048f0950c8")), "BloomFilter doesn't contain just-inserted object!");
+    // One bit different in first byte
+    BOOST_CHECK_MESSAGE(!filter.contains(ParseHex("19108ad8ed9bb6274d3980bab5a85c048f0950c8")), "BloomFilter contains something it shouldn't!");
+
+    filter.insert(ParseHex("b5a2c786d9ef4658287ced5914b37a1b4aa32eee"));
+    BOOST_CHECK_MESSAGE(filter.contains(ParseHex("b5a2c786d9ef4658287ced5914b37a1b4aa32eee")), "BloomFilter doesn't contain just-inserted object (2)!");
+
+    filter.insert(ParseHex("b9300670b4c5366e95b2699e8b18bc75e5f729c5"));
+    BOOST_CHECK_MESSAGE(filter.contains(ParseHex("b9300670b4c5366e95b2699e8b18bc75e5f729c5")), "BloomFilter doesn't contain just-inserted object (3)!");
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << filter;
+
+    vector<unsigned char> vch = ParseHex("03614e9b050000000000000001");
+    vector<char> expected(vch.size());
+
+    for (unsigned int i = 0; i < vch.size(); i++)
+        expected[i] = (char)vch[i];
+
+    BOOST_CHECK_EQUAL_COLLECTIONS(stream.begin(), stream.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(bloom_create_insert_serialize_with_tweak)
+{
+    // Same test as bloom_create_insert_serialize, but with a non-zero nTweak
+    CBloomFilter filter(3, 0.01, 2147483649UL, BLOOM_UPDATE_ALL);
+
+    filter.insert(ParseHex("99108ad8ed9bb6274d3980bab5a85c048f0950c8"));
+    BOOST_CHECK_MESSAGE( filter.contains(ParseHex("99108ad8ed9bb6274d3980bab5a85c048f0950c8")), "BloomFilter doesn't contain just-inserted object!");
+    // One bit different in first byte
+    BOOST_CHECK_MESSAGE(!filter.contains(ParseHex("19108ad8ed9bb6274d3980bab5a85c048f0950c8")), "BloomFilter contains something it shouldn't!");
+
+    filter.insert(ParseHex("b5a2c786d9ef4658287ced5914b37a1b4aa32eee"));
+    BOOST_CHECK_MESSAGE(filter.contains(ParseHex("b5a2c786d9ef4658287ced5914b37a1b4aa32eee")), "BloomFilter doesn't contain just-inserted object (2)!");
+
+    filter.insert(ParseHex("b9300670b4c5366e95b2699e8b18bc75e5f729c5"));
+    BOOST_CHECK_MESSAGE(filter.contains(ParseHex("b9300670b4c5366e95b2699e8b18bc75e5f729c5")), "BloomFilter doesn't contain just-inserted object (3)!");
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << filter;
+
+    vector<unsigned char> vch = ParseHex("03ce4299050000000100008001");
+    vector<char> expected(vch.size());
+
+    for (unsigned int i = 0; i < vch.size(); i++)
+        expected[i] = (char)vch[i];
+
+    BOOST_CHECK_EQUAL_COLLECTIONS(stream.begin(), stream.end(), expected.begin(), expected.end());
+}
+
+BOOST_AUTO_TEST_CASE(bloom_match)
+{
+    CKey keySpend, keyPubKey, keyHash, keyOther;
+    keySpend.MakeNewKey(true);
+    keyPubKey.MakeNewKey(true);
+    keyHash.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+
+    COutPoint prevout(uint256(0x1234), 3);
+    CTransaction tx = MakeTx(prevout, keySpend, keyPubKey, keyHash);
+    uint256 hash = tx.GetHash();
+
+    CBloomFilter filter(10, 0.000001, 0, BLOOM_UPDATE_ALL);
+    filter.insert(hash);
+    BOOST_CHECK_MESSAGE(filter.IsRelevantAndUpdate(tx, hash), "Simple Bloom filter didn't match tx hash");
+
+    filter = CBloomFilter(10, 0.000001, 0, BLOOM_UPDATE_ALL);
+    filter.insert(ToVector(keySpend.GetPubKey()));
+    BOOST_CHECK_MESSAGE(filter.IsRelevantAndUpdate(tx, hash), "Bloom filter didn't match input pubkey");
+
+    filter = CBloomFilter(10, 0.000001, 0, BLOOM_UPDATE_ALL);
+    filter.insert(ToVector(keyPubKey.GetPubKey()));
+    BOOST_CHECK_MESSAGE(filter.IsRelevantAndUpdate(tx, hash), "Bloom filter didn't match output pubkey");
+
+    filter = CBloomFilter(10, 0.000001, 0, BLOOM_UPDATE_ALL);
+    filter.insert(ToVector(keyHash.GetPubKey().GetID()));
+    BOOST_CHECK_MESSAGE(filter.IsRelevantAndUpdate(tx, hash), "Bloom filter didn't match output address");
+
+    filter = CBloomFilter(10, 0.000001, 0, BLOOM_UPDATE_ALL);
+    filter.insert(prevout);
+    BOOST_CHECK_MESSAGE(filter.IsRelevantAndUpdate(tx, hash), "Bloom filter didn't match COutPoint");
+
+    filter = CBloomFilter(10, 0.000001, 0, BLOOM_UPDATE_ALL);
+    filter.insert(uint256(0x4321));
+    BOOST_CHECK_MESSAGE(!filter.IsRelevantAndUpdate(tx, hash), "Bloom filter matched random tx hash");
+
+    filter = CBloomFilter(10, 0.000001, 0, BLOOM_UPDATE_ALL);
+    filter.insert(ToVector(keyOther.GetPubKey()));
+    filter.insert(COutPoint(prevout.hash, 2));
+    BOOST_CHECK_MESSAGE(!filter.IsRelevantAndUpdate(tx, hash), "Bloom filter matched unrelated key or COutPoint");
+}
+
+BOOST_AUTO_TEST_CASE(bloom_match_update)
+{
+    CKey keySpend, keyPubKey, keyHash, keyOther;
+    keySpend.MakeNewKey(true);
+    keyPubKey.MakeNewKey(true);
+    keyHash.MakeNewKey(true);
+    keyOther.MakeNewKey(true);
+
+    CTransaction tx = MakeTx(COutPoint(uint256(0x1234), 0), keySpend, keyPubKey, keyHash);
+    uint256 hash = tx.GetHash();
+    // spends the pay-to-pubkey-hash output of tx
+    CTransaction txSpend = MakeTx(COutPoint(hash, 1), keyOther, keyOther, keyOther);
+
+    // BLOOM_UPDATE_ALL adds every matched output, so the spend matches too
+    CBloomFilter filter(10, 0.000001, 0, BLOOM_UPDATE_ALL);
+    filter.insert(ToVector(keyHash.GetPubKey().GetID()));
+    BOOST_CHECK(filter.IsRelevantAndUpdate(tx, hash));
+    BOOST_CHECK(filter.contains(COutPoint(hash, 1)));
+    BOOST_CHECK(filter.IsRelevantAndUpdate(txSpend, txSpend.GetHash()));
+
+    // BLOOM_UPDATE_P2PUBKEY_ONLY only adds pay-to-pubkey and multisig outputs
+    filter = CBloomFilter(10, 0.000001, 0, BLOOM_UPDATE_P2PUBKEY_ONLY);
+    filter.insert(ToVector(keyHash.GetPubKey().GetID()));
+    filter.insert(ToVector(keyPubKey.GetPubKey()));
+    BOOST_CHECK(filter.IsRelevantAndUpdate(tx, hash));
+    BOOST_CHECK(filter.contains(COutPoint(hash, 0)));
+    BOOST_CHECK(!filter.contains(COutPoint(hash, 1)));
+    BOOST_CHECK(!filter.IsRelevantAndUpdate(txSpend, txSpend.GetHash()));
+
+    // BLOOM_UPDATE_NONE never changes the filter
+    filter = CBloomFilter(10, 0.000001, 0, BLOOM_UPDATE_NONE);
+    filter.insert(ToVector(keyHash.GetPubKey().GetID()));
+    BOOST_CHECK(filter.IsRelevantAndUpdate(tx, hash));
+    BOOST_CHECK(!filter.contains(COutPoint(hash, 1)));
+    BOOST_CHECK(!filter.IsRelevantAndUpdate(txSpend, txSpend.GetHash()));
+}
+
+BOOST_AUTO_TEST_CASE(merkle_block)
+{
+    CKey keyWallet;
+    keyWallet.MakeNewKey(true);
+
+    // a block of 9 transactions, the 3rd and 8th pay to the wallet
+    CBlock block;
+    block.nTime = 1500000000;
+    block.nBits = 0x1e0fffff;
+    for (unsigned int i = 0; i < 9; i++)
+    {
+        CKey keyPay;
+        keyPay.MakeNewKey(true);
+        CTransaction tx = MakeTx(COutPoint(uint256(i + 1), 0), keyPay, keyPay, (i == 2 || i == 7) ? keyWallet : keyPay);
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    block.vchBlockSig = ParseHex("3045");
+
+    CBloomFilter filter(10, 0.000001, 0, BLOOM_UPDATE_ALL);
+    filter.insert(ToVector(keyWallet.GetPubKey().GetID()));
+
+    CMerkleBlock merkleBlock(block, filter);
+    BOOST_CHECK(merkleBlock.header.GetHash() == block.GetHash());
+    BOOST_CHECK(merkleBlock.header.vtx.empty());
+    BOOST_CHECK(merkleBlock.header.vchBlockSig == block.vchBlockSig);
+
+    BOOST_CHECK(merkleBlock.vMatchedTxn.size() == 2);
+    BOOST_CHECK(merkleBlock.vMatchedTxn[0] == make_pair(2U, block.vtx[2].GetHash()));
+    BOOST_CHECK(merkleBlock.vMatchedTxn[1] == make_pair(7U, block.vtx[7].GetHash()));
+
+    // what a light client does with the message
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << merkleBlock;
+    CBlock header;
+    CPartialMerkleTree txn;
+    ss >> header >> txn;
+    BOOST_CHECK(ss.empty());
+    BOOST_CHECK(header.GetHash() == block.GetHash());
+
+    vector<uint256> vMatched;
+    BOOST_CHECK(txn.ExtractMatches(vMatched) == block.hashMerkleRoot);
+    BOOST_CHECK(vMatched.size() == 2);
+    BOOST_CHECK(vMatched[0] == block.vtx[2].GetHash());
+    BOOST_CHECK(vMatched[1] == block.vtx[7].GetHash());
+
+    // the filter picked up the wallet's new outputs, so a block spending one
+    // of them matches without the client sending filteradd
+    CBlock blockSpend;
+    blockSpend.vtx.push_back(MakeTx(COutPoint(block.vtx[7].GetHash(), 1), keyWallet, keyWallet, keyWallet));
+    blockSpend.hashMerkleRoot = blockSpend.BuildMerkleTree();
+    CMerkleBlock merkleSpend(blockSpend, filter);
+    BOOST_CHECK(merkleSpend.vMatchedTxn.size() == 1);
+
+    // nothing matches an empty filter, and the tree still proves the root
+    CBloomFilter filterEmpty(10, 0.000001, 0, BLOOM_UPDATE_ALL);
+    CMerkleBlock merkleNone(block, filterEmpty);
+    BOOST_CHECK(merkleNone.vMatchedTxn.empty());
+    BOOST_CHECK(merkleNone.txn.ExtractMatches(vMatched) == block.hashMerkleRoot);
+    BOOST_CHECK(vMatched.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,33 @@
+#include <boost/test/unit_test.hpp>
+
+#include "hash.h"
+#include "hashmap.h"
+#include "uint256.h"
+
+BOOST_AUTO_TEST_SUITE(hash_tests)
+
+BOOST_AUTO_TEST_CASE(siphash_uint256)
+{
+    // Reference vector from the SipHash-2-4 paper, key 00..0f, message 00..1f
+    uint256 x("1f1e1d1c1b1a191817161514131211100f0e0d0c0b0a09080706050403020100");
+    BOOST_CHECK_EQUAL(SipHashUint256(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, x), 0x7127512f72f27cceULL);
+    BOOST_CHECK(SipHashUint256Extra(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, x, 1) !=
+                SipHashUint256Extra(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, x, 2));
+}
+
+BOOST_AUTO_TEST_CASE(salted_hasher)
+{
+    CSaltedHasher hasher;
+    uint256 a = 1, b = 2;
+    BOOST_CHECK_EQUAL(hasher(a), hasher(a));
+    BOOST_CHECK(hasher(a) != hasher(b));
+    BOOST_CHECK(hasher(COutPoint(a, 0)) != hasher(COutPoint(a, 1)));
+
+    boost::unordered_map<uint256, int, CSaltedHasher> map;
+    for (int i = 0; i < 1000; i++)
+        map[uint256(i)] = i;
+    BOOST_CHECK_EQUAL(map.size(), 1000U);
+    BOOST_CHECK_EQUAL(map[uint256(500)], 500);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
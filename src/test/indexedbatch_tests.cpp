@@ -0,0 +1,95 @@
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+#include <string>
+
+#include "indexedbatch.h"
+
+using namespace std;
+
+// What a committed batch does to each key: the value written, or "" if deleted
+class CBatchContents : public leveldb::WriteBatch::Handler
+{
+public:
+    map<string, string> mapValues;
+    map<string, bool> mapDeleted;
+
+    void Put(const leveldb::Slice& key, const leveldb::Slice& value)
+    {
+        mapValues[key.ToString()] = value.ToString();
+        mapDeleted[key.ToString()] = false;
+    }
+
+    void Delete(const leveldb::Slice& key)
+    {
+        mapValues.erase(key.ToString());
+        mapDeleted[key.ToString()] = true;
+    }
+};
+
+static string LookupValue(const CIndexedWriteBatch& batch, const string& key)
+{
+    string value = "unset";
+    bool fDeleted;
+    if (!batch.Lookup(key, &value, &fDeleted))
+        return "missing";
+    return fDeleted ? "deleted" : value;
+}
+
+BOOST_AUTO_TEST_SUITE(indexedbatch_tests)
+
+BOOST_AUTO_TEST_CASE(indexedbatch_read_your_writes)
+{
+    CIndexedWriteBatch batch;
+    BOOST_CHECK_EQUAL(LookupValue(batch, "a"), "missing");
+
+    batch.Put("a", "first");
+    batch.Put("b", "");
+    BOOST_CHECK_EQUAL(LookupValue(batch, "a"), "first");
+    BOOST_CHECK_EQUAL(LookupValue(batch, "b"), "");
+    BOOST_CHECK_EQUAL(LookupValue(batch, "c"), "missing");
+
+    // shorter rewrites reuse the value's space, longer ones move it
+    batch.Put("a", "1st");
+    BOOST_CHECK_EQUAL(LookupValue(batch, "a"), "1st");
+    batch.Put("a", "a much longer value");
+    BOOST_CHECK_EQUAL(LookupValue(batch, "a"), "a much longer value");
+    BOOST_CHECK_EQUAL(LookupValue(batch, "b"), "");
+    BOOST_CHECK_EQUAL(batch.size(), 2U);
+}
+
+BOOST_AUTO_TEST_CASE(indexedbatch_overwrite_erase_order)
+{
+    CIndexedWriteBatch batch;
+    batch.Put("put-delete", "x");
+    batch.Delete("put-delete");
+    batch.Delete("delete-put");
+    batch.Put("delete-put", "y");
+    batch.Put("put-delete-put", "long value");
+    batch.Delete("put-delete-put");
+    batch.Put("put-delete-put", "z");
+    batch.Delete("delete-only");
+
+    BOOST_CHECK_EQUAL(LookupValue(batch, "put-delete"), "deleted");
+    BOOST_CHECK_EQUAL(LookupValue(batch, "delete-put"), "y");
+    BOOST_CHECK_EQUAL(LookupValue(batch, "put-delete-put"), "z");
+    BOOST_CHECK_EQUAL(LookupValue(batch, "delete-only"), "deleted");
+
+    // the committed batch holds the latest operation of every key
+    CBatchContents contents;
+    BOOST_CHECK(batch.GetBatch()->Iterate(&contents).ok());
+    BOOST_CHECK_EQUAL(contents.mapDeleted.size(), 4U);
+    BOOST_CHECK(contents.mapDeleted["put-delete"]);
+    BOOST_CHECK(contents.mapDeleted["delete-only"]);
+    BOOST_CHECK_EQUAL(contents.mapValues["delete-put"], "y");
+    BOOST_CHECK_EQUAL(contents.mapValues["put-delete-put"], "z");
+    BOOST_CHECK_EQUAL(contents.mapValues.size(), 2U);
+
+    // building the batch twice does not add anything
+    CBatchContents contents2;
+    BOOST_CHECK(batch.GetBatch()->Iterate(&contents2).ok());
+    BOOST_CHECK(contents2.mapValues == contents.mapValues);
+    BOOST_CHECK(contents2.mapDeleted == contents.mapDeleted);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
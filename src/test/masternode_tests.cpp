@@ -0,0 +1,148 @@
+#include <boost/test/unit_test.hpp>
+
+#include "masternode.h"
+#include "util.h"
+
+using namespace std;
+
+static CMasterNode MakeMasternode(const CPubKey& pubkey, unsigned int n)
+{
+    CTxIn vin(COutPoint(uint256(n + 1), 0));
+    return CMasterNode(CService("10.0.0.1", 9999), vin, pubkey, vector<unsigned char>(), 0, pubkey, PROTOCOL_VERSION);
+}
+
+static void FillMasternodes(unsigned int nCount)
+{
+    LOCK(cs_masternodes);
+    vecMasternodes.clear();
+    masternodePayees.Invalidate();
+    for (unsigned int i = 0; i < nCount; i++)
+    {
+        CKey key;
+        key.MakeNewKey(true);
+        vecMasternodes.push_back(MakeMasternode(key.GetPubKey(), i));
+    }
+}
+
+static CScript PayeeScript(unsigned int i)
+{
+    return GetScriptForDestination(vecMasternodes[i].pubkey.GetID());
+}
+
+// What ConnectBlock did before the index: build every node's script per output
+static void FindPaidByScan(const CTransaction& tx, vector<CMasterNode*>& vpmn)
+{
+    vpmn.clear();
+    BOOST_FOREACH(const CTxOut& txout, tx.vout)
+        BOOST_FOREACH(CMasterNode& mn, vecMasternodes)
+        {
+            CScript pubScript = GetScriptForDestination(mn.pubkey.GetID());
+            CTxDestination address1;
+            ExtractDestination(pubScript, address1);
+            CBitcoinAddress address2(address1);
+            if (txout.scriptPubKey == pubScript)
+                vpmn.push_back(&mn);
+        }
+}
+
+static void FindPaidByIndex(const CTransaction& tx, vector<CMasterNode*>& vpmn)
+{
+    vpmn.clear();
+    BOOST_FOREACH(const CTxOut& txout, tx.vout)
+    {
+        vector<CMasterNode*> vPaid;
+        masternodePayees.Find(txout.scriptPubKey, vPaid);
+        vpmn.insert(vpmn.end(), vPaid.begin(), vPaid.end());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE(masternode_tests)
+
+BOOST_AUTO_TEST_CASE(masternode_payee_index)
+{
+    FillMasternodes(20);
+    LOCK(cs_masternodes);
+
+    vector<CMasterNode*> vPaid;
+    masternodePayees.Find(PayeeScript(7), vPaid);
+    BOOST_CHECK(vPaid.size() == 1 && vPaid[0] == &vecMasternodes[7]);
+
+    CKey keyOther;
+    keyOther.MakeNewKey(true);
+    CScript scriptOther = GetScriptForDestination(keyOther.GetPubKey().GetID());
+    masternodePayees.Find(scriptOther, vPaid);
+    BOOST_CHECK(vPaid.empty());
+
+    // appended nodes are picked up without an Invalidate(), a second node with
+    // the same collateral key is paid by the same script
+    vecMasternodes.push_back(MakeMasternode(keyOther.GetPubKey(), 100));
+    vecMasternodes.push_back(MakeMasternode(vecMasternodes[3].pubkey, 101));
+    masternodePayees.Find(scriptOther, vPaid);
+    BOOST_CHECK(vPaid.size() == 1 && vPaid[0] == &vecMasternodes[20]);
+    masternodePayees.Find(PayeeScript(3), vPaid);
+    BOOST_CHECK_EQUAL(vPaid.size(), 2U);
+
+    // erasing reports the change
+    CScript scriptErased = PayeeScript(5);
+    CScript scriptMoved = PayeeScript(6);
+    vecMasternodes.erase(vecMasternodes.begin() + 5);
+    masternodePayees.Invalidate();
+    masternodePayees.Find(scriptErased, vPaid);
+    BOOST_CHECK(vPaid.empty());
+    masternodePayees.Find(scriptMoved, vPaid);
+    BOOST_CHECK(vPaid.size() == 1 && vPaid[0] == &vecMasternodes[5]);
+
+    // a change nobody reported is caught by the lookup
+    swap(vecMasternodes[0], vecMasternodes[1]);
+    CScript scriptFirst = PayeeScript(1);
+    masternodePayees.Find(scriptFirst, vPaid);
+    BOOST_CHECK(vPaid.size() == 1 && vPaid[0] == &vecMasternodes[1]);
+
+    vecMasternodes.clear();
+    masternodePayees.Invalidate();
+}
+
+BOOST_AUTO_TEST_CASE(masternode_payee_benchmark)
+{
+    static const unsigned int nCounts[] = {1000, 2500, 5000, 10000};
+    for (unsigned int n = 0; n < sizeof(nCounts) / sizeof(nCounts[0]); n++)
+    {
+        FillMasternodes(nCounts[n]);
+        LOCK(cs_masternodes);
+
+        // a coinstake paying the staker twice and one masternode
+        CKey keyStaker;
+        keyStaker.MakeNewKey(true);
+        CTransaction tx;
+        tx.vout.resize(4);
+        tx.vout[1].scriptPubKey = GetScriptForDestination(keyStaker.GetPubKey().GetID());
+        tx.vout[2].scriptPubKey = tx.vout[1].scriptPubKey;
+        tx.vout[3].scriptPubKey = PayeeScript(nCounts[n] / 2);
+
+        static const int nBlocks = 20;
+        vector<CMasterNode*> vScan, vIndex;
+        int64_t nStart = GetTimeMicros();
+        for (int i = 0; i < nBlocks; i++)
+            FindPaidByScan(tx, vScan);
+        int64_t nScan = GetTimeMicros() - nStart;
+
+        nStart = GetTimeMicros();
+        masternodePayees.Find(CScript(), vIndex);
+        int64_t nBuild = GetTimeMicros() - nStart;
+        nStart = GetTimeMicros();
+        for (int i = 0; i < nBlocks; i++)
+            FindPaidByIndex(tx, vIndex);
+        int64_t nLookup = GetTimeMicros() - nStart;
+
+        BOOST_CHECK(vScan == vIndex);
+        BOOST_CHECK(vIndex.size() == 1 && vIndex[0] == &vecMasternodes[nCounts[n] / 2]);
+        BOOST_TEST_MESSAGE(strprintf("%u masternodes: scan %.1f us/block, index build %" PRId64" us, lookup %.1f us/block",
+                                     nCounts[n], (double)nScan / nBlocks, nBuild, (double)nLookup / nBlocks));
+    }
+
+    LOCK(cs_masternodes);
+    vecMasternodes.clear();
+    masternodePayees.Invalidate();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,117 @@
+#include <boost/test/unit_test.hpp>
+
+#include <boost/atomic.hpp>
+#include <boost/bind.hpp>
+
+#include "scheduler.h"
+#include "util.h"
+
+using namespace std;
+
+static boost::mutex mutexOrder;
+
+static void RecordRun(vector<int>* pvOrder, int n)
+{
+    boost::unique_lock<boost::mutex> lock(mutexOrder);
+    pvOrder->push_back(n);
+}
+
+static void Count(boost::atomic<int>* pnCount)
+{
+    (*pnCount)++;
+}
+
+static void CountSlowly(boost::atomic<int>* pnCount)
+{
+    (*pnCount)++;
+    MilliSleep(50);
+}
+
+// Wait up to a few seconds for the count, so a loaded machine does not fail the test
+static bool WaitForCount(boost::atomic<int>& nCount, int nTarget)
+{
+    for (int i = 0; i < 500 && nCount < nTarget; i++)
+        MilliSleep(10);
+    return nCount >= nTarget;
+}
+
+BOOST_AUTO_TEST_SUITE(scheduler_tests)
+
+BOOST_AUTO_TEST_CASE(scheduler_order)
+{
+    CScheduler s;
+    vector<int> vOrder;
+    int64_t nNow = GetTimeMillis();
+    s.Schedule(boost::bind(RecordRun, &vOrder, 3), nNow + 60);
+    s.Schedule(boost::bind(RecordRun, &vOrder, 1), nNow + 20);
+    s.Schedule(boost::bind(RecordRun, &vOrder, 2), nNow + 40);
+    s.Schedule(boost::bind(RecordRun, &vOrder, 0), nNow - 1000);
+    BOOST_CHECK_EQUAL(s.GetQueueSize(), 4U);
+
+    s.Start(1);
+    for (int i = 0; i < 500 && s.GetQueueSize() > 0; i++)
+        MilliSleep(10);
+    MilliSleep(20);
+    s.Stop();
+
+    BOOST_REQUIRE_EQUAL(vOrder.size(), 4U);
+    for (int i = 0; i < 4; i++)
+        BOOST_CHECK_EQUAL(vOrder[i], i);
+}
+
+BOOST_AUTO_TEST_CASE(scheduler_periodic_cancel)
+{
+    CScheduler s;
+    s.Start(2);
+
+    // a cancelled one-shot task never runs
+    boost::atomic<int> nOnce(0);
+    CScheduler::TaskId idOnce = s.ScheduleFromNow(boost::bind(Count, &nOnce), 100);
+    BOOST_CHECK(s.Cancel(idOnce));
+    BOOST_CHECK(!s.Cancel(idOnce));
+
+    boost::atomic<int> nRuns(0);
+    CScheduler::TaskId id = s.ScheduleEvery(boost::bind(Count, &nRuns), 5);
+    BOOST_CHECK(WaitForCount(nRuns, 3));
+    BOOST_CHECK(s.Cancel(id));
+    MilliSleep(20);
+    int nAfterCancel = nRuns;
+    MilliSleep(100);
+    BOOST_CHECK_EQUAL(nRuns, nAfterCancel);
+
+    // cancelling a periodic task while it runs stops it being queued again
+    boost::atomic<int> nSlowRuns(0);
+    id = s.ScheduleEvery(boost::bind(CountSlowly, &nSlowRuns), 1);
+    BOOST_CHECK(WaitForCount(nSlowRuns, 1));
+    BOOST_CHECK(s.Cancel(id));
+    MilliSleep(100);
+    BOOST_CHECK_EQUAL(nSlowRuns, 1);
+    BOOST_CHECK_EQUAL(s.GetQueueSize(), 0U);
+    BOOST_CHECK_EQUAL(nOnce, 0);
+
+    s.Stop();
+}
+
+BOOST_AUTO_TEST_CASE(scheduler_stop_wakes_workers)
+{
+    CScheduler s;
+    boost::atomic<int> nRuns(0);
+    s.ScheduleFromNow(boost::bind(Count, &nRuns), 60 * 60 * 1000);
+    s.ScheduleEvery(boost::bind(Count, &nRuns), 60 * 60 * 1000);
+    s.Start(2);
+    MilliSleep(20);
+
+    int64_t nStart = GetTimeMillis();
+    s.Stop();
+    BOOST_CHECK(GetTimeMillis() - nStart < 1000);
+    BOOST_CHECK_EQUAL(nRuns, 0);
+    BOOST_CHECK_EQUAL(s.GetQueueSize(), 0U);
+
+    // and it can be started again
+    s.ScheduleFromNow(boost::bind(Count, &nRuns), 0);
+    s.Start(1);
+    BOOST_CHECK(WaitForCount(nRuns, 1));
+    s.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -292,4 +292,225 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
     }
 }
 
+static CMerkleTxRef make_prev(int n)
+{
+    boost::shared_ptr<CMerkleTx> ptx(new CMerkleTx);
+    ptx->nLockTime = n;
+    ptx->vin.resize(1);
+    ptx->vin[0].scriptSig = CScript() << vector<unsigned char>(72, n);
+    ptx->vout.resize(2);
+    return ptx;
+}
+
+BOOST_AUTO_TEST_CASE(supporting_tx_records)
+{
+    CWalletTx wtx;
+    wtx.nLockTime = 1000;
+    wtx.vtxPrev.push_back(make_prev(1));
+    wtx.vtxPrev.push_back(make_prev(2));
+
+    // new records list the hashes
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << wtx;
+    BOOST_CHECK(wtx.mapValue.empty());
+    CWalletTx wtxRead;
+    ss >> wtxRead;
+    BOOST_CHECK(wtxRead.vtxPrev.empty());
+    BOOST_CHECK(wtxRead.mapValue.empty());
+    BOOST_CHECK(wtxRead.vPrevPending.size() == 2 &&
+                wtxRead.vPrevPending[0] == wtx.vtxPrev[0]->GetHash() &&
+                wtxRead.vPrevPending[1] == wtx.vtxPrev[1]->GetHash());
+
+    // records of older versions carry the transactions inline
+    CDataStream ssOld(SER_DISK, CLIENT_VERSION);
+    vector<CMerkleTx> vtxPrevInline;
+    vtxPrevInline.push_back(*wtx.vtxPrev[0]);
+    vtxPrevInline.push_back(*wtx.vtxPrev[1]);
+    ssOld << *(CMerkleTx*)&wtx << vtxPrevInline << mapValue_t() << vector<pair<string, string> >();
+    ssOld << wtx.fTimeReceivedIsTxTime << wtx.nTimeReceived << wtx.fFromMe << (char)false;
+    BOOST_TEST_MESSAGE(strprintf("wallet tx record with two supporting transactions: %" PRIszu" bytes inline, %" PRIszu" bytes shared",
+                                 ssOld.size(), ::GetSerializeSize(wtx, SER_DISK, CLIENT_VERSION)));
+    CWalletTx wtxOld;
+    ssOld >> wtxOld;
+    BOOST_CHECK(wtxOld.vPrevPending.empty());
+    BOOST_CHECK(wtxOld.vtxPrev.size() == 2 && wtxOld.vtxPrev[1]->GetHash() == wtx.vtxPrev[1]->GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(supporting_tx_sharing)
+{
+    CWallet walletShared;
+    CMerkleTxRef ptxParent = make_prev(1);
+
+    CWalletTx wtx1, wtx2;
+    wtx1.nLockTime = 1;
+    wtx1.vtxPrev.push_back(ptxParent);
+    wtx2.nLockTime = 2;
+    wtx2.vtxPrev.push_back(CMerkleTxRef(new CMerkleTx(*ptxParent)));
+    wtx2.vtxPrev.push_back(make_prev(2));
+
+    walletShared.ShareSupportingTransactions(wtx1);
+    walletShared.ShareSupportingTransactions(wtx2);
+    BOOST_CHECK_EQUAL(walletShared.mapSupportingTx.size(), 2U);
+    BOOST_CHECK(wtx1.vtxPrev[0] == wtx2.vtxPrev[0]);
+
+    // a record read by hash resolves to the shared copy
+    CWalletTx wtx3;
+    wtx3.vPrevPending.push_back(ptxParent->GetHash());
+    walletShared.ShareSupportingTransactions(wtx3);
+    BOOST_CHECK(wtx3.vPrevPending.empty());
+    BOOST_CHECK(wtx3.vtxPrev.size() == 1 && wtx3.vtxPrev[0] == wtx1.vtxPrev[0]);
+
+    // a newer merkle branch replaces the shared copy only on update, and the
+    // old copy is left as it was
+    boost::shared_ptr<CMerkleTx> ptxConfirmed(new CMerkleTx(*ptxParent));
+    ptxConfirmed->hashBlock = 1;
+    ptxConfirmed->nIndex = 1;
+    CWalletTx wtx4;
+    wtx4.vtxPrev.push_back(ptxConfirmed);
+    walletShared.ShareSupportingTransactions(wtx4);
+    BOOST_CHECK(wtx4.vtxPrev[0] == wtx1.vtxPrev[0]);
+    wtx4.vtxPrev[0] = ptxConfirmed;
+    walletShared.ShareSupportingTransactions(wtx4, NULL, true);
+    BOOST_CHECK(wtx4.vtxPrev[0] == ptxConfirmed);
+    BOOST_CHECK(walletShared.mapSupportingTx[ptxParent->GetHash()] == wtx4.vtxPrev[0]);
+    BOOST_CHECK(wtx1.vtxPrev[0]->hashBlock == 0);
+
+    // unreferenced ones go
+    wtx2.vtxPrev.clear();
+    walletShared.PruneSupportingTransactions();
+    BOOST_CHECK_EQUAL(walletShared.mapSupportingTx.size(), 1U);
+    BOOST_CHECK(walletShared.mapSupportingTx.count(ptxParent->GetHash()));
+}
+
+// GetAccountBalance as it was before the ledger: every wallet transaction and accounting entry
+static int64_t AccountBalanceByScan(CWallet& w, const string& strAccount, int nMinDepth, const isminefilter& filter)
+{
+    int64_t nBalance = 0;
+    for (CWallet::TxMap::iterator it = w.mapWallet.begin(); it != w.mapWallet.end(); ++it)
+    {
+        const CWalletTx& wtx = (*it).second;
+        if (!wtx.IsFinal() || wtx.GetDepthInMainChain() < 0)
+            continue;
+
+        int64_t nReceived, nSent, nFee;
+        wtx.GetAccountAmounts(strAccount, nReceived, nSent, nFee, filter);
+
+        if (nReceived != 0 && wtx.GetDepthInMainChain() >= nMinDepth && wtx.GetBlocksToMaturity() == 0)
+            nBalance += nReceived;
+        nBalance -= nSent + nFee;
+    }
+    nBalance += CWalletDB(w.strWalletFile).GetAccountCreditDebit(strAccount);
+    return nBalance;
+}
+
+static void check_ledger(CWallet& w)
+{
+    static const char* pszAccounts[] = {"", "alice", "bob", "carol"};
+    for (unsigned int i = 0; i < sizeof(pszAccounts) / sizeof(pszAccounts[0]); i++)
+        for (int nMinDepth = 0; nMinDepth <= 1; nMinDepth++)
+        {
+            BOOST_CHECK_EQUAL(w.GetAccountBalance(pszAccounts[i], nMinDepth, ISMINE_SPENDABLE),
+                              AccountBalanceByScan(w, pszAccounts[i], nMinDepth, ISMINE_SPENDABLE));
+            BOOST_CHECK_EQUAL(w.GetAccountBalance(pszAccounts[i], nMinDepth, ISMINE_ALL),
+                              AccountBalanceByScan(w, pszAccounts[i], nMinDepth, ISMINE_ALL));
+        }
+}
+
+static CKeyID add_ledger_key(CWallet& w)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    w.AddKey(key);
+    return key.GetPubKey().GetID();
+}
+
+// Add a transaction to the wallet and the mempool, so it counts at depth 0
+static uint256 add_ledger_tx(CWallet& w, CTransaction& tx, const string& strFromAccount = "")
+{
+    CWalletTx wtx(&w, tx);
+    wtx.strFromAccount = strFromAccount;
+    w.AddToWallet(wtx);
+    mempool.addUnchecked(tx.GetHash(), tx);
+    return tx.GetHash();
+}
+
+BOOST_AUTO_TEST_CASE(account_ledger)
+{
+    bool fFirstRun;
+    CWallet w("wallet_ledger.dat");
+    w.LoadWallet(fFirstRun);
+    LOCK2(cs_main, w.cs_wallet);
+
+    CKeyID keyA = add_ledger_key(w), keyB = add_ledger_key(w), keyC = add_ledger_key(w), keyChange = add_ledger_key(w);
+    w.SetAddressBookName(keyA, "alice");
+    w.SetAddressBookName(keyB, "bob");
+    CKey keyOther;
+    keyOther.MakeNewKey(true);
+
+    // built on first use
+    CTransaction tx1;
+    tx1.nLockTime = 1;
+    tx1.vout.resize(1);
+    tx1.vout[0].nValue = 10 * COIN;
+    tx1.vout[0].scriptPubKey.SetDestination(keyA);
+    uint256 hash1 = add_ledger_tx(w, tx1);
+    check_ledger(w);
+    BOOST_CHECK_EQUAL(w.GetAccountBalance("alice", 0, ISMINE_SPENDABLE), 10 * COIN);
+    BOOST_CHECK_EQUAL(w.GetAccountBalance("alice", 1, ISMINE_SPENDABLE), 0);
+
+    // then kept up by AddToWallet
+    CTransaction tx2;
+    tx2.nLockTime = 2;
+    tx2.vout.resize(2);
+    tx2.vout[0].nValue = 2 * COIN;
+    tx2.vout[0].scriptPubKey.SetDestination(keyB);
+    tx2.vout[1].nValue = 1 * COIN;
+    tx2.vout[1].scriptPubKey.SetDestination(keyC);
+    add_ledger_tx(w, tx2);
+    check_ledger(w);
+
+    // a label moves an address's outputs to its account
+    w.SetAddressBookName(keyC, "alice");
+    check_ledger(w);
+    BOOST_CHECK_EQUAL(w.GetAccountBalance("alice", 0, ISMINE_SPENDABLE), 11 * COIN);
+
+    BOOST_CHECK(w.AccountMove("alice", "bob", 3 * COIN, "ledger test"));
+    check_ledger(w);
+    BOOST_CHECK_EQUAL(w.GetAccountBalance("alice", 0, ISMINE_SPENDABLE), 8 * COIN);
+
+    // bob spends alice's coins: sent amount and fee, change unlabelled
+    CTransaction tx3;
+    tx3.nLockTime = 3;
+    tx3.vin.resize(1);
+    tx3.vin[0].prevout = COutPoint(hash1, 0);
+    tx3.vout.resize(2);
+    tx3.vout[0].nValue = 4 * COIN;
+    tx3.vout[0].scriptPubKey.SetDestination(keyOther.GetPubKey().GetID());
+    tx3.vout[1].nValue = 5 * COIN + COIN / 2;
+    tx3.vout[1].scriptPubKey.SetDestination(keyChange);
+    add_ledger_tx(w, tx3, "bob");
+    check_ledger(w);
+    BOOST_CHECK_EQUAL(w.GetAccountBalance("bob", 0, ISMINE_SPENDABLE), COIN / 2);
+
+    // labelling the change address makes it a receive
+    w.SetAddressBookName(keyChange, "carol");
+    check_ledger(w);
+    w.DelAddressBookName(keyC);
+    check_ledger(w);
+
+    // a transaction leaving the mempool stops counting
+    mempool.remove(tx2);
+    check_ledger(w);
+
+    // new watch-only scripts make old transactions ours
+    CScript scriptOther;
+    scriptOther.SetDestination(keyOther.GetPubKey().GetID());
+    w.AddWatchOnly(scriptOther);
+    check_ledger(w);
+    w.MarkDirty();
+    check_ledger(w);
+
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
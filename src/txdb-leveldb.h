@@ -7,6 +7,8 @@
 #define BITCOIN_LEVELDB_H
 
 #include "main.h"
+#include "blockstats.h"
+#include "indexedbatch.h"
 
 #include <map>
 #include <string>
@@ -45,7 +47,7 @@ private:
 
     // A batch stores up writes and deletes for atomic application. When this
     // field is non-NULL, writes/deletes go there instead of directly to disk.
-    leveldb::WriteBatch *activeBatch;
+    CIndexedWriteBatch *activeBatch;
     leveldb::Options options;
     bool fReadOnly;
     int nVersion;
@@ -195,6 +197,8 @@ public:
     bool ReadDiskTx(COutPoint outpoint, CTransaction& tx, CTxIndex& txindex);
     bool ReadDiskTx(COutPoint outpoint, CTransaction& tx);
     bool WriteBlockIndex(const CDiskBlockIndex& blockindex);
+    bool ReadBlockStats(uint256 hash, CBlockStats& stats);
+    bool WriteBlockStats(uint256 hash, const CBlockStats& stats);
     bool ReadHashBestChain(uint256& hashBestChain);
     bool WriteHashBestChain(uint256 hashBestChain);
     bool ReadBestInvalidTrust(CBigNum& bnBestInvalidTrust);
@@ -208,5 +212,7 @@ private:
     bool LoadBlockIndexGuts();
 };
 
+// Most memory the LevelDB caches of the transaction index use
+size_t GetTxDBCacheSize();
 
 #endif // BITCOIN_DB_H
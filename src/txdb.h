@@ -10,6 +10,7 @@
 #include "txdb-leveldb.h"
 #else
 #include "db.h"
+#include "blockstats.h"
 #include "txdb-bdb.h"
 #endif
 
@@ -89,6 +89,12 @@ public:
 	
 	boost::signals2::signal<void (CAdrenalineNodeConfig nodeConfig)> NotifyAdrenalineNodeChanged;
 
+    /** Status of the local masternode changed. */
+    boost::signals2::signal<void (int status, const std::string& reason)> NotifyMasternodeStatusChanged;
+
+    /** Masternode added to or removed from the masternode list. */
+    boost::signals2::signal<void ()> NotifyMasternodeListChanged;
+
     /**
      * New, updated or cancelled alert.
      * @note called with lock cs_mapAlerts held.
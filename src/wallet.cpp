@@ -15,6 +15,7 @@
 #include "darksend.h"
 #include "masternode.h"
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/range/algorithm.hpp>
 #include <boost/numeric/ublas/matrix.hpp>
 
@@ -193,6 +194,10 @@ bool CWallet::AddWatchOnly(const CScript &dest)
     if (!CCryptoKeyStore::AddWatchOnly(dest))
         return false;
     nTimeFirstKey = 1; // No birthday information for watch-only keys.
+    {
+        LOCK(cs_wallet);
+        fAccountTxsIndexed = false;
+    }
     NotifyWatchonlyChanged(true);
     if (!fFileBacked)
         return true;
@@ -506,7 +511,7 @@ CWallet::TxItems CWallet::OrderedTxItems(std::list<CAccountingEntry>& acentries,
 
     // Note: maintaining indices in the database of (account,time) --> txid and (account, time) --> acentry
     // would make this much faster for applications that do this a lot.
-    for (map<uint256, CWalletTx>::iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+    for (CWallet::TxMap::iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
     {
         CWalletTx* wtx = &((*it).second);
         txOrdered.insert(make_pair(wtx->nOrderPos, TxPair(wtx, (CAccountingEntry*)0)));
@@ -521,6 +526,120 @@ CWallet::TxItems CWallet::OrderedTxItems(std::list<CAccountingEntry>& acentries,
     return txOrdered;
 }
 
+void CWallet::IndexAccountTx(const CWalletTx& wtx)
+{
+    AssertLockHeld(cs_wallet);
+    uint256 hash = wtx.GetHash();
+
+    // as GetAccountAmounts() attributes amounts, for the widest filter
+    int64_t nFee;
+    string strSentAccount;
+    list<COutputEntry> listReceived;
+    list<COutputEntry> listSent;
+    wtx.GetAmounts(listReceived, listSent, nFee, strSentAccount, ISMINE_ALL);
+    if (wtx.GetDebit(ISMINE_ALL) > 0)
+        mapAccountTxs[strSentAccount].insert(hash);
+    BOOST_FOREACH(const COutputEntry& r, listReceived)
+    {
+        map<CTxDestination, string>::const_iterator mi = mapAddressBook.find(r.destination);
+        mapAccountTxs[mi != mapAddressBook.end() ? (*mi).second : ""].insert(hash);
+    }
+
+    // change outputs are left out of listReceived until their address gets a label
+    BOOST_FOREACH(const CTxOut& txout, wtx.vout)
+    {
+        CTxDestination address;
+        if (IsMine(txout) != ISMINE_NO && ExtractDestination(txout.scriptPubKey, address))
+            mapDestinationTxs[address].insert(hash);
+    }
+}
+
+void CWallet::LoadAccountingEntry(const CAccountingEntry& acentry)
+{
+    LOCK(cs_wallet);
+    mapAccountCreditDebit[acentry.strAccount] += acentry.nCreditDebit;
+}
+
+bool CWallet::AccountMove(const string& strFrom, const string& strTo, int64_t nAmount, const string& strComment)
+{
+    CWalletDB walletdb(strWalletFile);
+    if (!walletdb.TxnBegin())
+        return false;
+
+    int64_t nNow = GetAdjustedTime();
+
+    // Debit
+    CAccountingEntry debit;
+    debit.nOrderPos = IncOrderPosNext(&walletdb);
+    debit.strAccount = strFrom;
+    debit.nCreditDebit = -nAmount;
+    debit.nTime = nNow;
+    debit.strOtherAccount = strTo;
+    debit.strComment = strComment;
+    walletdb.WriteAccountingEntry(debit);
+
+    // Credit
+    CAccountingEntry credit;
+    credit.nOrderPos = IncOrderPosNext(&walletdb);
+    credit.strAccount = strTo;
+    credit.nCreditDebit = nAmount;
+    credit.nTime = nNow;
+    credit.strOtherAccount = strFrom;
+    credit.strComment = strComment;
+    walletdb.WriteAccountingEntry(credit);
+
+    if (!walletdb.TxnCommit())
+        return false;
+
+    LoadAccountingEntry(debit);
+    LoadAccountingEntry(credit);
+    return true;
+}
+
+int64_t CWallet::GetAccountBalance(const string& strAccount, int nMinDepth, const isminefilter& filter)
+{
+    LOCK(cs_wallet);
+    if (!fAccountTxsIndexed)
+    {
+        mapAccountTxs.clear();
+        mapDestinationTxs.clear();
+        for (TxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+            IndexAccountTx((*it).second);
+        fAccountTxsIndexed = true;
+    }
+
+    int64_t nBalance = 0;
+
+    // Tally wallet transactions
+    map<string, set<uint256> >::const_iterator mi = mapAccountTxs.find(strAccount);
+    if (mi != mapAccountTxs.end())
+    {
+        BOOST_FOREACH(const uint256& hash, (*mi).second)
+        {
+            TxMap::const_iterator it = mapWallet.find(hash);
+            if (it == mapWallet.end())
+                continue;
+            const CWalletTx& wtx = (*it).second;
+            if (!wtx.IsFinal() || wtx.GetDepthInMainChain() < 0)
+                continue;
+
+            int64_t nReceived, nSent, nFee;
+            wtx.GetAccountAmounts(strAccount, nReceived, nSent, nFee, filter);
+
+            if (nReceived != 0 && wtx.GetDepthInMainChain() >= nMinDepth && wtx.GetBlocksToMaturity() == 0)
+                nBalance += nReceived;
+            nBalance -= nSent + nFee;
+        }
+    }
+
+    // Tally internal accounting entries
+    map<string, int64_t>::const_iterator ci = mapAccountCreditDebit.find(strAccount);
+    if (ci != mapAccountCreditDebit.end())
+        nBalance += (*ci).second;
+
+    return nBalance;
+}
+
 void CWallet::WalletUpdateSpent(const CTransaction &tx, bool fBlock)
 {
     // Anytime a signature is successfully verified, it's proof the outpoint is spent.
@@ -530,7 +649,7 @@ void CWallet::WalletUpdateSpent(const CTransaction &tx, bool fBlock)
         LOCK(cs_wallet);
         BOOST_FOREACH(const CTxIn& txin, tx.vin)
         {
-            map<uint256, CWalletTx>::iterator mi = mapWallet.find(txin.prevout.hash);
+            CWallet::TxMap::iterator mi = mapWallet.find(txin.prevout.hash);
             if (mi != mapWallet.end())
             {
                 CWalletTx& wtx = (*mi).second;
@@ -550,7 +669,7 @@ void CWallet::WalletUpdateSpent(const CTransaction &tx, bool fBlock)
         if (fBlock)
         {
             uint256 hash = tx.GetHash();
-            map<uint256, CWalletTx>::iterator mi = mapWallet.find(hash);
+            CWallet::TxMap::iterator mi = mapWallet.find(hash);
             CWalletTx& wtx = (*mi).second;
 
             BOOST_FOREACH(const CTxOut& txout, tx.vout)
@@ -574,6 +693,7 @@ void CWallet::MarkDirty()
         LOCK(cs_wallet);
         BOOST_FOREACH(PAIRTYPE(const uint256, CWalletTx)& item, mapWallet)
             item.second.MarkDirty();
+        fAccountTxsIndexed = false;
     }
 }
 
@@ -583,12 +703,13 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn)
     {
         LOCK(cs_wallet);
         // Inserts only if not already there, returns tx inserted or tx found
-        pair<map<uint256, CWalletTx>::iterator, bool> ret = mapWallet.insert(make_pair(hash, wtxIn));
+        pair<CWallet::TxMap::iterator, bool> ret = mapWallet.insert(make_pair(hash, wtxIn));
         CWalletTx& wtx = (*ret.first).second;
         wtx.BindWallet(this);
         bool fInsertedNew = ret.second;
         if (fInsertedNew)
         {
+            ShareSupportingTransactions(wtx);
             wtx.nTimeReceived = GetAdjustedTime();
             wtx.nOrderPos = IncOrderPosNext();
 
@@ -662,6 +783,9 @@ bool CWallet::AddToWallet(const CWalletTx& wtxIn)
             fUpdated |= wtx.UpdateSpent(wtxIn.vfSpent);
         }
 
+        if (fAccountTxsIndexed)
+            IndexAccountTx(wtx);
+
         //// debug print
         printf("AddToWallet %s  %s%s\n", wtxIn.GetHash().ToString().substr(0,10).c_str(), (fInsertedNew ? "new" : ""), (fUpdated ? "update" : ""));
 
@@ -748,17 +872,99 @@ bool CWallet::EraseFromWallet(uint256 hash)
     {
         LOCK(cs_wallet);
         if (mapWallet.erase(hash))
-            CWalletDB(strWalletFile).EraseTx(hash);
+        {
+            CWalletDB walletdb(strWalletFile);
+            walletdb.EraseTx(hash);
+            PruneSupportingTransactions(&walletdb);
+        }
     }
     return true;
 }
 
+void CWallet::LoadSupportingTx(const CMerkleTx& tx)
+{
+    LOCK(cs_wallet);
+    mapSupportingTx[tx.GetHash()] = CMerkleTxRef(new CMerkleTx(tx));
+}
+
+static bool IsSameMerkleBranch(const CMerkleTx& a, const CMerkleTx& b)
+{
+    return a.hashBlock == b.hashBlock && a.nIndex == b.nIndex && a.vMerkleBranch == b.vMerkleBranch;
+}
+
+// Point the supporting transactions of wtx at the shared copies, adding and
+// writing the ones the wallet has not seen yet. Transactions loaded from
+// records that only list the hashes are resolved here. With fUpdate, the
+// merkle branches of wtx are newer: a shared copy with a different one is
+// replaced and its record rewritten. Wallet transactions that still point at
+// the old copy keep it until they are reloaded.
+void CWallet::ShareSupportingTransactions(CWalletTx& wtx, CWalletDB* pwalletdb, bool fUpdate)
+{
+    LOCK(cs_wallet);
+    boost::scoped_ptr<CWalletDB> pwalletdbOwned;
+
+    BOOST_FOREACH(CMerkleTxRef& ptx, wtx.vtxPrev)
+    {
+        uint256 hash = ptx->GetHash();
+        pair<SupportingTxMap::iterator, bool> ret = mapSupportingTx.insert(make_pair(hash, ptx));
+        if (!ret.second)
+        {
+            if (!fUpdate || ret.first->second == ptx || IsSameMerkleBranch(*ret.first->second, *ptx))
+            {
+                ptx = ret.first->second;
+                continue;
+            }
+            ret.first->second = ptx;
+        }
+        if (!fFileBacked)
+            continue;
+        if (!pwalletdb)
+        {
+            pwalletdbOwned.reset(new CWalletDB(strWalletFile));
+            pwalletdb = pwalletdbOwned.get();
+        }
+        if (!pwalletdb->WritePrevTx(hash, *ptx))
+            printf("ShareSupportingTransactions() : writing %s failed\n", hash.ToString().c_str());
+    }
+
+    BOOST_FOREACH(const uint256& hash, wtx.vPrevPending)
+    {
+        SupportingTxMap::const_iterator mi = mapSupportingTx.find(hash);
+        if (mi == mapSupportingTx.end())
+        {
+            printf("ShareSupportingTransactions() : supporting transaction %s of %s is missing\n",
+                   hash.ToString().c_str(), wtx.GetHash().ToString().c_str());
+            continue;
+        }
+        wtx.vtxPrev.push_back(mi->second);
+    }
+    wtx.vPrevPending.clear();
+}
+
+// Drop the supporting transactions no wallet transaction refers to any more
+void CWallet::PruneSupportingTransactions(CWalletDB* pwalletdb)
+{
+    LOCK(cs_wallet);
+    SupportingTxMap::iterator it = mapSupportingTx.begin();
+    while (it != mapSupportingTx.end())
+    {
+        if (!it->second.unique())
+        {
+            ++it;
+            continue;
+        }
+        if (pwalletdb)
+            pwalletdb->ErasePrevTx(it->first);
+        mapSupportingTx.erase(it++);
+    }
+}
+
 
 isminetype CWallet::IsMine(const CTxIn &txin) const
 {
     {
         LOCK(cs_wallet);
-        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
+        CWallet::TxMap::const_iterator mi = mapWallet.find(txin.prevout.hash);
         if (mi != mapWallet.end())
         {
             const CWalletTx& prev = (*mi).second;
@@ -773,7 +979,7 @@ int64_t CWallet::GetDebit(const CTxIn &txin, const isminefilter& filter) const
 {
     {
         LOCK(cs_wallet);
-        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
+        CWallet::TxMap::const_iterator mi = mapWallet.find(txin.prevout.hash);
         if (mi != mapWallet.end())
         {
             const CWalletTx& prev = (*mi).second;
@@ -789,7 +995,7 @@ bool CWallet::IsDenominated(const CTxIn &txin) const
 {
     {
         LOCK(cs_wallet);
-        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
+        CWallet::TxMap::const_iterator mi = mapWallet.find(txin.prevout.hash);
         if (mi != mapWallet.end())
         {
             const CWalletTx& prev = (*mi).second;
@@ -1010,7 +1216,6 @@ void CWalletTx::AddSupportingTransactions(CTxDB& txdb)
         // This critsect is OK because txdb is already open
         {
             LOCK(pwallet->cs_wallet);
-            map<uint256, const CMerkleTx*> mapWalletPrev;
             set<uint256> setAlreadyDone;
             for (unsigned int i = 0; i < vWorkQueue.size(); i++)
             {
@@ -1019,34 +1224,36 @@ void CWalletTx::AddSupportingTransactions(CTxDB& txdb)
                     continue;
                 setAlreadyDone.insert(hash);
 
-                CMerkleTx tx;
-                map<uint256, CWalletTx>::const_iterator mi = pwallet->mapWallet.find(hash);
-                if (mi != pwallet->mapWallet.end())
+                // The shared copies are not changed in place: this works on
+                // its own copy, which CommitTransaction shares again
+                boost::shared_ptr<CMerkleTx> ptx;
+                CWallet::TxMap::const_iterator mi = pwallet->mapWallet.find(hash);
+                CWallet::SupportingTxMap::const_iterator mp = pwallet->mapSupportingTx.find(hash);
+                if (mp != pwallet->mapSupportingTx.end())
                 {
-                    tx = (*mi).second;
-                    BOOST_FOREACH(const CMerkleTx& txWalletPrev, (*mi).second.vtxPrev)
-                        mapWalletPrev[txWalletPrev.GetHash()] = &txWalletPrev;
+                    ptx.reset(new CMerkleTx(*(*mp).second));
                 }
-                else if (mapWalletPrev.count(hash))
+                else if (mi != pwallet->mapWallet.end())
                 {
-                    tx = *mapWalletPrev[hash];
-                }
-                else if (txdb.ReadDiskTx(hash, tx))
-                {
-                    ;
+                    ptx.reset(new CMerkleTx((*mi).second));
                 }
                 else
                 {
-                    printf("ERROR: AddSupportingTransactions() : unsupported transaction\n");
-                    continue;
+                    CMerkleTx tx;
+                    if (!txdb.ReadDiskTx(hash, tx))
+                    {
+                        printf("ERROR: AddSupportingTransactions() : unsupported transaction\n");
+                        continue;
+                    }
+                    ptx.reset(new CMerkleTx(tx));
                 }
 
-                int nDepth = tx.SetMerkleBranch();
-                vtxPrev.push_back(tx);
+                int nDepth = ptx->SetMerkleBranch();
+                vtxPrev.push_back(ptx);
 
                 if (nDepth < COPY_DEPTH)
                 {
-                    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+                    BOOST_FOREACH(const CTxIn& txin, ptx->vin)
                         vWorkQueue.push_back(txin.prevout.hash);
                 }
             }
@@ -1071,8 +1278,18 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
     CBlockIndex* pindex = pindexStart;
     {
         LOCK2(cs_main, cs_wallet);
+        if (pindex)
+            nRescanStart = pindex->nHeight;
+        int64_t nNextLog = GetTime() + 60;
         while (pindex)
         {
+            nRescanHeight = pindex->nHeight;
+            if (GetTime() >= nNextLog)
+            {
+                printf("Rescanning... at height %d of %d, %d transactions found\n", pindex->nHeight, nBestHeight, ret);
+                nNextLog = GetTime() + 60;
+            }
+
             // no need to read and scan block, if block was created before
             // our wallet birthday (as adjusted for block time variability)
             if (nTimeFirstKey && (pindex->nTime < (nTimeFirstKey - 7200))) {
@@ -1089,6 +1306,8 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
             }
             pindex = pindex->pnext;
         }
+        nRescanStart = -1;
+        nRescanHeight = -1;
     }
     return ret;
 }
@@ -1176,13 +1395,13 @@ void CWallet::ReacceptWalletTransactions()
 
 void CWalletTx::RelayWalletTransaction(CTxDB& txdb)
 {
-    BOOST_FOREACH(const CMerkleTx& tx, vtxPrev)
+    BOOST_FOREACH(const CMerkleTxRef& ptx, vtxPrev)
     {
-        if (!(tx.IsCoinBase() || tx.IsCoinStake()))
+        if (!(ptx->IsCoinBase() || ptx->IsCoinStake()))
         {
-            uint256 hash = tx.GetHash();
+            uint256 hash = ptx->GetHash();
             if (!txdb.ContainsTx(hash))
-                RelayTransaction((CTransaction)tx, hash);
+                RelayTransaction((CTransaction)*ptx, hash);
         }
     }
     if (!(IsCoinBase() || IsCoinStake()))
@@ -1265,7 +1484,7 @@ int64_t CWallet::GetBalance() const
     int64_t nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (CWallet::TxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx* pcoin = &(*it).second;
             if (pcoin->IsTrusted())
@@ -1281,7 +1500,7 @@ int64_t CWallet::GetUnlockedBalance() const
     int64_t nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+        for (CWallet::TxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
             const CWalletTx* pcoin = &(*it).second;
 
             if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
@@ -1297,7 +1516,7 @@ int64_t CWallet::GetLockedBalance() const
     int64_t nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
+        for (CWallet::TxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it) {
             const CWalletTx* pcoin = &(*it).second;
 
             if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0)
@@ -1312,7 +1531,7 @@ int64_t CWallet::GetUnconfirmedBalance() const
     int64_t nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (CWallet::TxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx* pcoin = &(*it).second;
             if (!pcoin->IsFinal() || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
@@ -1327,7 +1546,7 @@ int64_t CWallet::GetImmatureBalance() const
     int64_t nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (CWallet::TxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx* pcoin = &(*it).second;
             if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0 && pcoin->IsInMainChain())
@@ -1342,7 +1561,7 @@ int64_t CWallet::GetWatchOnlyBalance() const
     int64_t nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (CWallet::TxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx* pcoin = &(*it).second;
             if (pcoin->IsTrusted())
@@ -1358,7 +1577,7 @@ int64_t CWallet::GetUnconfirmedWatchOnlyBalance() const
     int64_t nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (CWallet::TxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx* pcoin = &(*it).second;
             if (!IsFinalTx(*pcoin) || (!pcoin->IsTrusted() && pcoin->GetDepthInMainChain() == 0))
@@ -1373,7 +1592,7 @@ int64_t CWallet::GetImmatureWatchOnlyBalance() const
     int64_t nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (CWallet::TxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx* pcoin = &(*it).second;
             if ((pcoin->IsCoinBase() || pcoin->IsCoinStake()) && pcoin->GetBlocksToMaturity() > 0 && pcoin->IsInMainChain())
@@ -1389,7 +1608,7 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (CWallet::TxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx* pcoin = &(*it).second;
 
@@ -1439,7 +1658,7 @@ void CWallet::AvailableCoinsMN(vector<COutput>& vCoins, bool fOnlyConfirmed, boo
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (CWallet::TxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx* pcoin = &(*it).second;
 
@@ -1498,7 +1717,7 @@ void CWallet::AvailableCoinsForStaking(vector<COutput>& vCoins, unsigned int nSp
 
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (CWallet::TxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx* pcoin = &(*it).second;
 
@@ -1567,7 +1786,7 @@ int64_t CWallet::GetStakeAmount() const
     int64_t nTotal = 0;
     {
         LOCK2(cs_main, cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (CWallet::TxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx* pcoin = &(*it).second;
             if (pcoin->IsTrusted() && pcoin->GetDepthInMainChain() > 0) //Just pulls GetBalance() currently
@@ -1582,7 +1801,7 @@ int64_t CWallet::GetStake() const
 {
     int64_t nTotal = 0;
     LOCK2(cs_main, cs_wallet);
-    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+    for (CWallet::TxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
     {
         const CWalletTx* pcoin = &(*it).second;
         if (pcoin->IsCoinStake() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
@@ -1595,7 +1814,7 @@ int64_t CWallet::GetNewMint() const
 {
     int64_t nTotal = 0;
     LOCK2(cs_main, cs_wallet);
-    for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+    for (CWallet::TxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
     {
         const CWalletTx* pcoin = &(*it).second;
         if (pcoin->IsCoinBase() && pcoin->GetBlocksToMaturity() > 0 && pcoin->GetDepthInMainChain() > 0)
@@ -2090,7 +2309,7 @@ int CWallet::CountInputsWithAmount(int64_t nInputAmount)
     int64_t nTotal = 0;
     {
         LOCK(cs_wallet);
-        for (map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        for (CWallet::TxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         {
             const CWalletTx* pcoin = &(*it).second;
             if (pcoin->IsTrusted()){
@@ -3373,14 +3592,8 @@ bool CWallet::CreateCoinStake(const CKeyStore& keystore, unsigned int nBits, int
     // start masternode payments
     bool bMasterNodePayment = false;
 
-    if (fTestNet){
-        if (pindexPrev->nHeight+1 > BLOCK_START_MASTERNODE_PAYMENTS_TESTNET ){
-            bMasterNodePayment = true;
-        }
-    }else{
-        if (pindexPrev->nHeight+1 > BLOCK_START_MASTERNODE_PAYMENTS){
-            bMasterNodePayment = true;
-        }
+    if (pindexPrev->nHeight+1 > GetMasternodePaymentsStartBlock()){
+        bMasterNodePayment = true;
     }
     if(fDebug) { printf("CreateCoinStake() : Masternode Payments = %i!\n", bMasterNodePayment); }
 
@@ -3493,6 +3706,10 @@ bool CWallet::CommitTransaction(CWalletTx& wtxNew, CReserveKey& reservekey)
             // Take key pair from key pool so it won't be used again
             reservekey.KeepKey();
 
+            // CreateTransaction gave the supporting transactions fresh merkle
+            // branches; keep them in the shared copies and their records
+            ShareSupportingTransactions(wtxNew, NULL, true);
+
             // Add tx to wallet, because if it has change it's also ours,
             // otherwise just for transaction history.
             AddToWallet(wtxNew);
@@ -3623,7 +3840,7 @@ DBErrors CWallet::LoadWallet(bool& fFirstRunRet)
         return nLoadWalletRet;
     fFirstRunRet = !vchDefaultKey.IsValid();
 
-    NewThread(ThreadFlushWalletDB, &strWalletFile);
+    StartFlushWalletDB(strWalletFile);
     return DB_LOAD_OK;
 }
 
@@ -3639,6 +3856,11 @@ bool CWallet::SetAddressBookName(const CTxDestination& address, const string& st
         fOwned = ::IsMine(*this, address);
 
         mapAddressBook[address] = strName;
+
+        // the address's transactions now count towards strName
+        map<CTxDestination, set<uint256> >::const_iterator it = mapDestinationTxs.find(address);
+        if (fAccountTxsIndexed && it != mapDestinationTxs.end())
+            mapAccountTxs[strName].insert((*it).second.begin(), (*it).second.end());
     }
 
     if (fOwned)
@@ -3659,6 +3881,10 @@ bool CWallet::DelAddressBookName(const CTxDestination& address)
         LOCK(cs_wallet); // mapAddressBook
 
         mapAddressBook.erase(address);
+
+        map<CTxDestination, set<uint256> >::const_iterator it = mapDestinationTxs.find(address);
+        if (fAccountTxsIndexed && it != mapDestinationTxs.end())
+            mapAccountTxs[""].insert((*it).second.begin(), (*it).second.end());
     }
 
     bool fOwned = ::IsMine(*this, address);
@@ -3700,7 +3926,7 @@ bool CWallet::GetTransaction(const uint256 &hashTx, CWalletTx& wtx)
 {
     {
         LOCK(cs_wallet);
-        map<uint256, CWalletTx>::iterator mi = mapWallet.find(hashTx);
+        CWallet::TxMap::iterator mi = mapWallet.find(hashTx);
         if (mi != mapWallet.end())
         {
             wtx = (*mi).second;
@@ -3888,6 +4114,31 @@ bool CWallet::GetKeyFromPool(CPubKey& result, bool fAllowReuse)
     return true;
 }
 
+static size_t MerkleTxDynamicUsage(const CMerkleTx& tx)
+{
+    return RecursiveDynamicUsage(tx) + memusage::DynamicUsage(tx.vMerkleBranch);
+}
+
+size_t CWallet::DynamicMemoryUsage() const
+{
+    LOCK(cs_wallet);
+    size_t nUsage = memusage::DynamicUsage(mapWallet);
+    for (TxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+    {
+        const CWalletTx& wtx = it->second;
+        nUsage += MerkleTxDynamicUsage(wtx) + memusage::DynamicUsage(wtx.vtxPrev) + memusage::DynamicUsage(wtx.mapValue) +
+                  memusage::DynamicUsage(wtx.vOrderForm) + memusage::DynamicUsage(wtx.strFromAccount) + memusage::DynamicUsage(wtx.vfSpent);
+        for (mapValue_t::const_iterator mi = wtx.mapValue.begin(); mi != wtx.mapValue.end(); ++mi)
+            nUsage += memusage::DynamicUsage(mi->first) + memusage::DynamicUsage(mi->second);
+    }
+    // each supporting transaction once, with its shared_ptr control block
+    nUsage += memusage::DynamicUsage(mapSupportingTx);
+    for (SupportingTxMap::const_iterator it = mapSupportingTx.begin(); it != mapSupportingTx.end(); ++it)
+        nUsage += memusage::MallocUsage(sizeof(CMerkleTx)) + memusage::MallocUsage(2 * sizeof(void*) + 2 * sizeof(int)) +
+                  MerkleTxDynamicUsage(*it->second);
+    return nUsage;
+}
+
 int64_t CWallet::GetOldestKeyPoolTime()
 {
     int64_t nIndex = 0;
@@ -4040,7 +4291,7 @@ void CWallet::FixSpentCoins(int& nMismatchFound, int64_t& nBalanceInQuestion, bo
     LOCK(cs_wallet);
     vector<CWalletTx*> vCoins;
     vCoins.reserve(mapWallet.size());
-    for (map<uint256, CWalletTx>::iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+    for (CWallet::TxMap::iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
         vCoins.push_back(&(*it).second);
 
     CTxDB txdb("r");
@@ -4089,7 +4340,7 @@ void CWallet::DisableTransaction(const CTransaction &tx)
     LOCK(cs_wallet);
     BOOST_FOREACH(const CTxIn& txin, tx.vin)
     {
-        map<uint256, CWalletTx>::iterator mi = mapWallet.find(txin.prevout.hash);
+        CWallet::TxMap::iterator mi = mapWallet.find(txin.prevout.hash);
         if (mi != mapWallet.end())
         {
             CWalletTx& prev = (*mi).second;
@@ -4164,7 +4415,7 @@ void CWallet::UpdatedTransaction(const uint256 &hashTx)
     {
         LOCK(cs_wallet);
         // Only notify UI if this transaction is in this wallet
-        map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(hashTx);
+        CWallet::TxMap::const_iterator mi = mapWallet.find(hashTx);
         if (mi != mapWallet.end())
             NotifyTransactionChanged(this, hashTx, CT_UPDATED);
 			vMintingWalletUpdated.push_back(hashTx);
@@ -4197,10 +4448,10 @@ void CWallet::GetKeyBirthTimes(std::map<CKeyID, int64_t> &mapKeyBirth) const {
 
     // find first block that affects those keys, if there are any left
     std::vector<CKeyID> vAffected;
-    for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); it++) {
+    for (CWallet::TxMap::const_iterator it = mapWallet.begin(); it != mapWallet.end(); it++) {
         // iterate over all wallet transactions...
         const CWalletTx &wtx = (*it).second;
-        std::map<uint256, CBlockIndex*>::const_iterator blit = mapBlockIndex.find(wtx.hashBlock);
+        BlockMap::const_iterator blit = mapBlockIndex.find(wtx.hashBlock);
         if (blit != mapBlockIndex.end() && blit->second->IsInMainChain()) {
             // ... which are already in a block
             int nHeight = blit->second->nHeight;
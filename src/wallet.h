@@ -10,6 +10,8 @@
 
 #include <stdlib.h>
 
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include "main.h"
 #include "key.h"
@@ -32,6 +34,9 @@ class CScript;
 
 typedef std::map<CKeyID, CStealthKeyMetadata> StealthKeyMetaMap;
 typedef std::map<std::string, std::string> mapValue_t;
+// Supporting transactions are shared between wallet transactions, so they are
+// never changed in place; an update replaces the pointer
+typedef boost::shared_ptr<const CMerkleTx> CMerkleTxRef;
 
 /** (client) version numbers for particular wallet features */
 enum WalletFeature
@@ -122,6 +127,21 @@ private:
     int64_t nNextResend;
     int64_t nLastResend;
 
+    // Per-account ledger behind GetAccountBalance(), guarded by cs_wallet.
+    // mapAccountTxs holds, for each account, the wallet transactions that may
+    // have amounts in it (a superset: extra entries only cost a lookup);
+    // mapDestinationTxs the transactions paying each of our destinations, so a
+    // relabelled address can be added to its new account. The transaction sets
+    // are built on first use and after MarkDirty(), as new keys and scripts can
+    // make old transactions ours. Depth is evaluated per query, so confirmations
+    // need no update. mapAccountCreditDebit sums each account's move entries.
+    std::map<std::string, std::set<uint256> > mapAccountTxs;
+    std::map<CTxDestination, std::set<uint256> > mapDestinationTxs;
+    std::map<std::string, int64_t> mapAccountCreditDebit;
+    bool fAccountTxsIndexed;
+
+    void IndexAccountTx(const CWalletTx& wtx);
+
 public:
     /// Main wallet lock.
     /// This lock protects all the fields added by CWallet
@@ -153,6 +173,10 @@ public:
     StealthKeyMetaMap mapStealthKeyMeta;
     uint32_t nStealth, nFoundStealth; // for reporting, zero before use
 
+    // progress of ScanForWalletTransactions(), -1 when no rescan runs; read without locks by getrescaninfo
+    boost::atomic<int> nRescanStart;
+    boost::atomic<int> nRescanHeight;
+
 
     typedef std::map<unsigned int, CMasterKey> MasterKeyMap;
     MasterKeyMap mapMasterKeys;
@@ -181,9 +205,19 @@ public:
         pwalletdbEncryption = NULL;
         nOrderPosNext = 0;
         nTimeFirstKey = 0;
+        nRescanStart = -1;
+        nRescanHeight = -1;
+        fAccountTxsIndexed = false;
     }
 
-    std::map<uint256, CWalletTx> mapWallet;
+    typedef boost::unordered_map<uint256, CWalletTx, CSaltedHasher> TxMap;
+
+    TxMap mapWallet;
+    // The supporting transactions of mapWallet (CWalletTx::vtxPrev), one copy per
+    // hash however many wallet transactions link back through them. Each is kept
+    // in its own "prevtx" record and dropped once only this map refers to it.
+    typedef boost::unordered_map<uint256, CMerkleTxRef, CSaltedHasher> SupportingTxMap;
+    SupportingTxMap mapSupportingTx;
 	  std::vector<uint256> vMintingWalletUpdated;
     int64_t nOrderPosNext;
     std::map<uint256, int> mapRequestCount;
@@ -272,10 +306,21 @@ public:
      */
     TxItems OrderedTxItems(std::list<CAccountingEntry>& acentries, std::string strAccount = "");
 
+    /** Add an accounting entry to the account ledger (LoadWallet and committed moves) */
+    void LoadAccountingEntry(const CAccountingEntry& acentry);
+    /** Move an amount between accounts, writing both entries in one db transaction */
+    bool AccountMove(const std::string& strFrom, const std::string& strTo, int64_t nAmount, const std::string& strComment);
+    /** Balance of an account: its received, sent and fee amounts in transactions of
+        at least nMinDepth confirmations, plus its moves. The caller holds cs_main. */
+    int64_t GetAccountBalance(const std::string& strAccount, int nMinDepth, const isminefilter& filter);
+
     void MarkDirty();
     bool AddToWallet(const CWalletTx& wtxIn);
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlock* pblock, bool fUpdate = false, bool fFindBlock = false);
     bool EraseFromWallet(uint256 hash);
+    void LoadSupportingTx(const CMerkleTx& tx);
+    void ShareSupportingTransactions(CWalletTx& wtx, CWalletDB* pwalletdb=NULL, bool fUpdate=false);
+    void PruneSupportingTransactions(CWalletDB* pwalletdb=NULL);
     void WalletUpdateSpent(const CTransaction& prevout, bool fBlock = false);
     int ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
     void ReacceptWalletTransactions();
@@ -329,6 +374,9 @@ public:
     std::set< std::set<CTxDestination> > GetAddressGroupings();
     std::map<CTxDestination, int64_t> GetAddressBalances();
 
+    // Estimated memory of mapWallet and the transactions in it
+    size_t DynamicMemoryUsage() const;
+
 	  bool IsDenominated(const CTxIn &txin) const;
 
     bool IsDenominated(const CTransaction& tx) const
@@ -529,7 +577,7 @@ private:
     const CWallet* pwallet;
 
 public:
-    std::vector<CMerkleTx> vtxPrev;
+    std::vector<CMerkleTxRef> vtxPrev;  // shared through CWallet::mapSupportingTx
     mapValue_t mapValue;
     std::vector<std::pair<std::string, std::string> > vOrderForm;
     unsigned int fTimeReceivedIsTxTime;
@@ -541,6 +589,7 @@ public:
     int64_t nOrderPos;  // position in ordered transaction list
 
     // memory only
+    std::vector<uint256> vPrevPending;  // supporting transactions read by hash, see CWallet::ShareSupportingTransactions()
     mutable bool fDebitCached;
     mutable bool fCreditCached;
     mutable bool fImmatureCreditCached;
@@ -584,6 +633,7 @@ public:
     {
         pwallet = pwalletIn;
         vtxPrev.clear();
+        vPrevPending.clear();
         mapValue.clear();
         vOrderForm.clear();
         fTimeReceivedIsTxTime = false;
@@ -637,10 +687,21 @@ public:
 
             if (nTimeSmart)
                 pthis->mapValue["timesmart"] = strprintf("%u", nTimeSmart);
+
+            // supporting transactions have their own records, list their hashes
+            std::string strPrev;
+            BOOST_FOREACH(const CMerkleTxRef& ptx, vtxPrev)
+                strPrev += (strPrev.empty() ? "" : ",") + ptx->GetHash().GetHex();
+            BOOST_FOREACH(const uint256& hash, vPrevPending)
+                strPrev += (strPrev.empty() ? "" : ",") + hash.GetHex();
+            if (!strPrev.empty())
+                pthis->mapValue["prevtxs"] = strPrev;
         }
 
         nSerSize += SerReadWrite(s, *(CMerkleTx*)this, nType, nVersion,ser_action);
-        READWRITE(vtxPrev);
+        // records written before the shared supporting transactions carry them inline
+        std::vector<CMerkleTx> vtxPrevInline;
+        READWRITE(vtxPrevInline);
         READWRITE(mapValue);
         READWRITE(vOrderForm);
         READWRITE(fTimeReceivedIsTxTime);
@@ -661,6 +722,12 @@ public:
             ReadOrderPos(pthis->nOrderPos, pthis->mapValue);
 
             pthis->nTimeSmart = mapValue.count("timesmart") ? (unsigned int)atoi64(pthis->mapValue["timesmart"]) : 0;
+
+            BOOST_FOREACH(const CMerkleTx& tx, vtxPrevInline)
+                pthis->vtxPrev.push_back(CMerkleTxRef(new CMerkleTx(tx)));
+            const std::string& strPrev = pthis->mapValue["prevtxs"];
+            for (size_t i = 0; i + 64 <= strPrev.size(); i += 65)
+                pthis->vPrevPending.push_back(uint256(strPrev.substr(i, 64)));
         }
 
         pthis->mapValue.erase("fromaccount");
@@ -668,6 +735,7 @@ public:
         pthis->mapValue.erase("spent");
         pthis->mapValue.erase("n");
         pthis->mapValue.erase("timesmart");
+        pthis->mapValue.erase("prevtxs");
     )
 
     // marks certain txout's as spent
@@ -1019,8 +1087,8 @@ public:
 
             if (mapPrev.empty())
             {
-                BOOST_FOREACH(const CMerkleTx& tx, vtxPrev)
-                    mapPrev[tx.GetHash()] = &tx;
+                BOOST_FOREACH(const CMerkleTxRef& ptxPrev, vtxPrev)
+                    mapPrev[ptxPrev->GetHash()] = ptxPrev.get();
             }
 
             BOOST_FOREACH(const CTxIn& txin, ptx->vin)
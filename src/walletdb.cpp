@@ -6,7 +6,9 @@
 #include "walletdb.h"
 #include "wallet.h"
 #include "key.h"
+#include "scheduler.h"
 #include <boost/version.hpp>
+#include <boost/bind.hpp>
 #include <boost/filesystem.hpp>
 
 using namespace std;
@@ -164,7 +166,7 @@ CWalletDB::ReorderTransactions(CWallet* pwallet)
     typedef multimap<int64_t, TxPair > TxItems;
     TxItems txByTime;
 
-    for (map<uint256, CWalletTx>::iterator it = pwallet->mapWallet.begin(); it != pwallet->mapWallet.end(); ++it)
+    for (CWallet::TxMap::iterator it = pwallet->mapWallet.begin(); it != pwallet->mapWallet.end(); ++it)
     {
         CWalletTx* wtx = &((*it).second);
         txByTime.insert(make_pair(wtx->nTimeReceived, TxPair(wtx, (CAccountingEntry*)0)));
@@ -294,6 +296,10 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
             if (wtx.nOrderPos == -1)
                 wss.fAnyUnordered = true;
 
+            // Move supporting transactions stored inline to their own records
+            if (!wtx.vtxPrev.empty())
+                wss.vWalletUpgrade.push_back(hash);
+
             //// debug print
             //printf("LoadWallet  %s\n", wtx.GetHash().ToString().c_str());
             //printf(" %12"PRId64"  %s  %s  %s\n",
@@ -301,6 +307,19 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
             //    DateTimeStrFormat("%x %H:%M:%S", wtx.GetBlockTime()).c_str(),
             //    wtx.hashBlock.ToString().substr(0,20).c_str(),
             //    wtx.mapValue["message"].c_str());
+        }
+        else if (strType == "prevtx")
+        {
+            uint256 hash;
+            ssKey >> hash;
+            CMerkleTx tx;
+            ssValue >> tx;
+            if (tx.GetHash() != hash)
+            {
+                strErr = "Error reading wallet database: supporting transaction corrupt";
+                return false;
+            }
+            pwallet->LoadSupportingTx(tx);
         } else
         if (strType == "sxAddr")
         {
@@ -320,13 +339,12 @@ ReadKeyValue(CWallet* pwallet, CDataStream& ssKey, CDataStream& ssValue,
             if (nNumber > nAccountingEntryNumber)
                 nAccountingEntryNumber = nNumber;
 
-            if (!wss.fAnyUnordered)
-            {
-                CAccountingEntry acentry;
-                ssValue >> acentry;
-                if (acentry.nOrderPos == -1)
-                    wss.fAnyUnordered = true;
-            }
+            CAccountingEntry acentry;
+            ssValue >> acentry;
+            acentry.strAccount = strAccount;
+            pwallet->LoadAccountingEntry(acentry);
+            if (acentry.nOrderPos == -1)
+                wss.fAnyUnordered = true;
         }
         else if (strType == "watchs")
         {
@@ -608,9 +626,24 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
         pwallet->nTimeFirstKey = 1; // 0 would be considered 'no value'
 
 
+    // Share the supporting transactions; records that still carried them are
+    // rewritten with hashes only
+    size_t nPrevRefs = 0;
+    {
+        LOCK(pwallet->cs_wallet);
+        for (CWallet::TxMap::iterator it = pwallet->mapWallet.begin(); it != pwallet->mapWallet.end(); ++it)
+        {
+            pwallet->ShareSupportingTransactions(it->second, this);
+            nPrevRefs += it->second.vtxPrev.size();
+        }
+    }
+
     BOOST_FOREACH(uint256 hash, wss.vWalletUpgrade)
         WriteTx(hash, pwallet->mapWallet[hash]);
 
+    pwallet->PruneSupportingTransactions(this);
+    printf("Supporting transactions: %" PRIszu" stored for %" PRIszu" references\n", pwallet->mapSupportingTx.size(), nPrevRefs);
+
     // Rewrite encrypted wallets of versions 0.4.0 and 0.5.0rc:
     if (wss.fIsEncrypted && (wss.nFileVersion == 40000 || wss.nFileVersion == 50000))
         return DB_NEED_REWRITE;
@@ -624,68 +657,69 @@ DBErrors CWalletDB::LoadWallet(CWallet* pwallet)
     return result;
 }
 
-void ThreadFlushWalletDB(void* parg)
-{
-    // Make this thread recognisable as the wallet flushing thread
-    RenameThread("AveroPay-wallet");
-
-    const string& strFile = ((const string*)parg)[0];
-    static bool fOneThread;
-    if (fOneThread)
-        return;
-    fOneThread = true;
-    if (!GetBoolArg("-flushwallet", true))
-        return;
+static unsigned int nFlushLastSeen;
+static unsigned int nFlushLastFlushed;
+static int64_t nFlushLastWalletUpdate;
 
-    unsigned int nLastSeen = nWalletDBUpdated;
-    unsigned int nLastFlushed = nWalletDBUpdated;
-    int64_t nLastWalletUpdate = GetTime();
-    while (!fShutdown)
+static void PeriodicFlushWalletDB(const string& strFile)
+{
+    if (nFlushLastSeen != nWalletDBUpdated)
     {
-        MilliSleep(500);
+        nFlushLastSeen = nWalletDBUpdated;
+        nFlushLastWalletUpdate = GetTime();
+    }
 
-        if (nLastSeen != nWalletDBUpdated)
+    if (nFlushLastFlushed != nWalletDBUpdated && GetTime() - nFlushLastWalletUpdate >= 2)
+    {
+        TRY_LOCK(bitdb.cs_db,lockDb);
+        if (lockDb)
         {
-            nLastSeen = nWalletDBUpdated;
-            nLastWalletUpdate = GetTime();
-        }
+            // Don't do this if any databases are in use
+            int nRefCount = 0;
+            map<string, int>::iterator mi = bitdb.mapFileUseCount.begin();
+            while (mi != bitdb.mapFileUseCount.end())
+            {
+                nRefCount += (*mi).second;
+                mi++;
+            }
 
-        if (nLastFlushed != nWalletDBUpdated && GetTime() - nLastWalletUpdate >= 2)
-        {
-            TRY_LOCK(bitdb.cs_db,lockDb);
-            if (lockDb)
+            if (nRefCount == 0 && !fShutdown)
             {
-                // Don't do this if any databases are in use
-                int nRefCount = 0;
-                map<string, int>::iterator mi = bitdb.mapFileUseCount.begin();
-                while (mi != bitdb.mapFileUseCount.end())
+                map<string, int>::iterator mi = bitdb.mapFileUseCount.find(strFile);
+                if (mi != bitdb.mapFileUseCount.end())
                 {
-                    nRefCount += (*mi).second;
-                    mi++;
-                }
+                    printf("Flushing wallet.dat\n");
+                    nFlushLastFlushed = nWalletDBUpdated;
+                    int64_t nStart = GetTimeMillis();
 
-                if (nRefCount == 0 && !fShutdown)
-                {
-                    map<string, int>::iterator mi = bitdb.mapFileUseCount.find(strFile);
-                    if (mi != bitdb.mapFileUseCount.end())
-                    {
-                        printf("Flushing wallet.dat\n");
-                        nLastFlushed = nWalletDBUpdated;
-                        int64_t nStart = GetTimeMillis();
-
-                        // Flush wallet.dat so it's self contained
-                        bitdb.CloseDb(strFile);
-                        bitdb.CheckpointLSN(strFile);
-
-                        bitdb.mapFileUseCount.erase(mi++);
-                        printf("Flushed wallet.dat %" PRId64"ms\n", GetTimeMillis() - nStart);
-                    }
+                    // Flush wallet.dat so it's self contained
+                    bitdb.CloseDb(strFile);
+                    bitdb.CheckpointLSN(strFile);
+
+                    bitdb.mapFileUseCount.erase(mi++);
+                    printf("Flushed wallet.dat %" PRId64"ms\n", GetTimeMillis() - nStart);
                 }
             }
         }
     }
 }
 
+void StartFlushWalletDB(const string& strFile)
+{
+    // only the first wallet loaded is flushed
+    static bool fStarted;
+    if (fStarted)
+        return;
+    fStarted = true;
+    if (!GetBoolArg("-flushwallet", true))
+        return;
+
+    nFlushLastSeen = nWalletDBUpdated;
+    nFlushLastFlushed = nWalletDBUpdated;
+    nFlushLastWalletUpdate = GetTime();
+    scheduler.ScheduleEvery(boost::bind(PeriodicFlushWalletDB, strFile), 500);
+}
+
 bool BackupWallet(const CWallet& wallet, const string& strDest)
 {
     if (!wallet.fFileBacked)
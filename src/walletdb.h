@@ -166,6 +166,18 @@ public:
         return Erase(std::make_pair(std::string("tx"), hash));
     }
 
+    bool WritePrevTx(uint256 hash, const CMerkleTx& tx)
+    {
+        nWalletDBUpdated++;
+        return Write(std::make_pair(std::string("prevtx"), hash), tx);
+    }
+
+    bool ErasePrevTx(uint256 hash)
+    {
+        nWalletDBUpdated++;
+        return Erase(std::make_pair(std::string("prevtx"), hash));
+    }
+
     bool WriteStealthKeyMeta(const CKeyID& keyId, const CStealthKeyMetadata& sxKeyMeta)
     {
         nWalletDBUpdated++;